@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+# Decoder for the binary log of a LOG_BINARY build (see src/BinaryLog.h). The device only
+# stores the address of each format string and the raw arguments, this script looks the
+# format strings up in the firmware ELF and does the formatting. The ELF has to be the one
+# the device is running, the marker in the /logs.bin header is checked against it.
+#
+#   scripts/decode_binlog.py .pio/build/esp32-c3-devkitm-1/firmware.elf bluefigate.local
+#   scripts/decode_binlog.py firmware.elf logs.bin --after 1234
+#
+# Prints the same "<seq> <ms> <LEVEL> <message>" lines as /logs.
+import argparse
+import os
+import re
+import struct
+import sys
+import urllib.request
+
+MAGIC = b"BLG1"
+MARKER = b"BlueFiGate binary log v1"
+HEADER = struct.Struct("<4sIHHII")
+RECORD = struct.Struct("<IIIBB22s")
+FLAG_TRUNCATED = 0x80
+LEVELS = ["DEBUG", "INFO", "WARNING", "ERROR", "CRITICAL"]
+# LogModule in the upper four bits of the level byte, GENERAL messages have no tag
+MODULES = ["", "BLE", "TDT", "WIFI", "WEB", "TIME", "BATTERY", "ENERGY"]
+# Same conversions BinaryLog::packArgs walks: flags, width and precision, length, conversion
+CONVERSION = re.compile(r"%([-+ #0-9.*]*)([hlzjt]*)(.)", re.S)
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class Elf:
+    """The allocated sections of a 32 bit little endian ELF, enough to read strings by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("%s is not a 32 bit little endian ELF" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, flags, addr, offset, size = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            if flags & SHF_ALLOC and sh_type != SHT_NOBITS and size > 0:
+                self.sections.append((addr, size, offset))
+
+    def string(self, address):
+        for addr, size, offset in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.find(b"\0", start, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.data[start:end].decode("utf-8", "replace")
+        return None
+
+
+def take(payload, pos, fmt):
+    size = struct.calcsize(fmt)
+    if pos + size > len(payload):
+        return None, pos
+    return struct.unpack_from(fmt, payload, pos)[0], pos + size
+
+
+def format_record(format_string, payload):
+    out = []
+    pos = 0
+    last = 0
+    for match in CONVERSION.finditer(format_string):
+        out.append(format_string[last:match.start()])
+        last = match.end()
+        spec, length, conv = match.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+
+        # '*' width or precision, one int each
+        stars = []
+        for _ in range(spec.count("*")):
+            value, pos = take(payload, pos, "<i")
+            if value is None:
+                break
+            stars.append(value)
+        if len(stars) != spec.count("*"):
+            break
+        for value in stars:
+            spec = spec.replace("*", str(value), 1)
+
+        if conv in "diuxXoc":
+            wide = length.count("l") >= 2
+            value, pos = take(payload, pos, ("<q" if wide else "<i") if conv in "di" else ("<Q" if wide else "<I"))
+            if value is None:
+                break
+            out.append(("%" + spec + conv) % value)
+        elif conv == "p":
+            value, pos = take(payload, pos, "<I")
+            if value is None:
+                break
+            out.append("0x%08x" % value)
+        elif conv in "fFeEgG":
+            value, pos = take(payload, pos, "<d")
+            if value is None:
+                break
+            out.append(("%" + spec + conv) % value)
+        elif conv == "s":
+            end = payload.find(b"\0", pos)
+            if end < 0:
+                break
+            out.append(("%" + spec + "s") % payload[pos:end].decode("utf-8", "replace"))
+            pos = end + 1
+        else:
+            break
+    else:
+        out.append(format_string[last:])
+        return "".join(out)
+    # Arguments missing from here on, packArgs ran out of room or met a conversion it does not know
+    return "".join(out) + " [truncated]"
+
+
+def read_source(source, after):
+    if os.path.exists(source):
+        with open(source, "rb") as f:
+            return f.read()
+    url = source if source.startswith("http") else "http://%s/logs.bin" % source
+    if after is not None:
+        url += "?after=%d" % after
+    with urllib.request.urlopen(url, timeout=10) as response:
+        return response.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the gateway's binary log")
+    parser.add_argument("elf", help="firmware.elf of the running build")
+    parser.add_argument("source", help="file saved from /logs.bin, or the gateway host name")
+    parser.add_argument("--after", type=int, help="only records after this sequence number (host only)")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    data = read_source(args.source, args.after)
+    if len(data) < HEADER.size:
+        sys.exit("Short response, is the firmware built with LOG_BINARY?")
+    magic, marker, record_size, _, dropped, uptime = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        sys.exit("Not a binary log")
+    if record_size != RECORD.size:
+        sys.exit("Record size %d, this decoder expects %d" % (record_size, RECORD.size))
+    if elf.string(marker) != MARKER.decode():
+        sys.exit("%s does not belong to the firmware that wrote this log" % args.elf)
+
+    for offset in range(HEADER.size, len(data) - record_size + 1, record_size):
+        seq, format_address, timestamp, level, length, payload = RECORD.unpack_from(data, offset)
+        format_string = elf.string(format_address)
+        if format_string is None:
+            message = "<unknown format 0x%08x>" % format_address
+        else:
+            message = format_record(format_string, payload[:length & ~FLAG_TRUNCATED])
+        module = level >> 4
+        level &= 0x0F
+        if module >= len(MODULES):
+            message = "[%d] %s" % (module, message)
+        elif MODULES[module]:
+            message = "[%s] %s" % (MODULES[module], message)
+        level_name = LEVELS[level] if level < len(LEVELS) else "UNKNOWN"
+        print("%u %u %s %s" % (seq, timestamp, level_name, message))
+    print("# uptime %u ms, %u records dropped" % (uptime, dropped), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+# PlatformIO pre-build script: gzips the static web assets and embeds them in flash
+# as byte arrays, so the firmware serves them precompressed without any filesystem.
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT = os.path.join(PROJECT_DIR, "src", "generated", "WebAssets.h")
+
+# file name -> C identifier prefix
+ASSETS = {
+    "dashboard.html": "DASHBOARD_HTML",
+}
+
+
+def render_asset(name, prefix):
+    with open(os.path.join(WEB_DIR, name), "rb") as f:
+        raw = f.read()
+    # mtime=0 keeps the output (and the ETag) stable between builds
+    data = gzip.compress(raw, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(data).hexdigest()[:16]
+    lines = ["// %s: %d bytes, %d gzipped" % (name, len(raw), len(data)),
+             "const uint8_t %s_GZ[] PROGMEM = {" % prefix]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines.append("};")
+    lines.append("constexpr size_t %s_GZ_LEN = %d;" % (prefix, len(data)))
+    lines.append("constexpr const char *%s_ETAG = \"\\\"%s\\\"\";" % (prefix, etag))
+    return "\n".join(lines)
+
+
+def main():
+    content = "// Generated by scripts/embed_web_assets.py from web/, do not edit\n#pragma once\n\n#include <Arduino.h>\n\n"
+    content += "\n\n".join(render_asset(name, prefix) for name, prefix in ASSETS.items()) + "\n"
+
+    os.makedirs(os.path.dirname(OUTPUT), exist_ok=True)
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, "r") as f:
+            if f.read() == content:
+                return
+    with open(OUTPUT, "w") as f:
+        f.write(content)
+    print("Embedded web assets into %s" % os.path.relpath(OUTPUT, PROJECT_DIR))
+
+
+main()
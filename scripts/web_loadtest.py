@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+# Load generator for the gateway's web server. Runs a number of concurrent clients
+# against the given endpoints for a while and reports requests per second, latency
+# percentiles, bytes per response and status codes per endpoint. Before and after the
+# run it reads /webstats.json, so the device side latency and the heap each request held
+# show up next to the client numbers.
+#
+#   scripts/web_loadtest.py bluefigate.local --clients 4 --duration 30 / /battery.json /metrics
+#
+# Note that the gateway rate limits each client IP (bursts of 10, then 4 requests per
+# second), so from a single host anything beyond that is answered with 429. That is
+# intended, the 429/503 counts show how the server sheds load.
+import argparse
+import http.client
+import json
+import threading
+import time
+from collections import defaultdict
+
+DEFAULT_ENDPOINTS = ["/", "/battery.json", "/battery.cbor", "/battery", "/energy.json", "/stats.json", "/metrics"]
+
+
+class Result:
+    def __init__(self):
+        self.latencies = []
+        self.bytes = 0
+        self.statuses = defaultdict(int)
+        self.errors = 0
+
+
+def percentile(values, percent):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    rank = max(0, min(len(values) - 1, int(round(percent / 100.0 * len(values) + 0.5)) - 1))
+    return values[rank]
+
+
+def client_loop(host, port, endpoints, deadline, results, lock, offset):
+    index = offset
+    while time.monotonic() < deadline:
+        path = endpoints[index % len(endpoints)]
+        index += 1
+        start = time.monotonic()
+        try:
+            # One connection per request, the server closes after every response anyway
+            conn = http.client.HTTPConnection(host, port, timeout=10)
+            conn.request("GET", path, headers={"Accept-Encoding": "gzip"})
+            response = conn.getresponse()
+            body = response.read()
+            conn.close()
+            elapsed = time.monotonic() - start
+            with lock:
+                result = results[path]
+                result.latencies.append(elapsed * 1000.0)
+                result.bytes += len(body)
+                result.statuses[response.status] += 1
+        except (OSError, http.client.HTTPException):
+            with lock:
+                results[path].errors += 1
+            time.sleep(0.1)
+
+
+def fetch_webstats(host, port):
+    try:
+        conn = http.client.HTTPConnection(host, port, timeout=10)
+        conn.request("GET", "/webstats.json")
+        response = conn.getresponse()
+        data = response.read()
+        conn.close()
+        if response.status != 200:
+            return None
+        return json.loads(data)
+    except (OSError, http.client.HTTPException, ValueError):
+        return None
+
+
+def device_delta(before, after):
+    """Per endpoint device numbers for the requests made during the run."""
+    if not before or not after:
+        return {}
+    previous = {e["uri"]: e for e in before["endpoints"]}
+    delta = {}
+    for endpoint in after["endpoints"]:
+        old = previous.get(endpoint["uri"], {"requests": 0, "latencySum": 0})
+        requests = endpoint["requests"] - old["requests"]
+        if requests > 0:
+            delta[endpoint["uri"]] = {
+                "latencyAvg": (endpoint["latencySum"] - old["latencySum"]) / requests,
+                "heapAvg": endpoint["heapAvg"],
+                "heapMax": endpoint["heapMax"],
+            }
+    return delta
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load test the gateway web server")
+    parser.add_argument("host")
+    parser.add_argument("endpoints", nargs="*", default=DEFAULT_ENDPOINTS)
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--clients", type=int, default=2)
+    parser.add_argument("--duration", type=float, default=20.0, help="seconds")
+    args = parser.parse_intermixed_args()
+
+    before = fetch_webstats(args.host, args.port)
+    results = defaultdict(Result)
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.duration
+    threads = [threading.Thread(target=client_loop, args=(args.host, args.port, args.endpoints, deadline, results, lock, i))
+               for i in range(args.clients)]
+    started = time.monotonic()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - started
+    # Give the last connections time to close, the device records them on disconnect
+    time.sleep(1.0)
+    device = device_delta(before, fetch_webstats(args.host, args.port))
+
+    total = sum(len(r.latencies) for r in results.values())
+    print("%d requests in %.1f s with %d clients: %.1f req/s" % (total, elapsed, args.clients, total / elapsed))
+    print()
+    print("%-16s %7s %8s %8s %8s %8s %9s  %-20s %9s %9s %9s" % (
+        "endpoint", "req/s", "p50 ms", "p90 ms", "p99 ms", "max ms", "bytes", "status", "dev avg", "heap avg", "heap max"))
+    for path in args.endpoints:
+        result = results[path]
+        count = len(result.latencies)
+        statuses = " ".join("%d:%d" % item for item in sorted(result.statuses.items()))
+        if result.errors:
+            statuses += " err:%d" % result.errors
+        dev = device.get(path)
+        print("%-16s %7.1f %8.1f %8.1f %8.1f %8.1f %9.0f  %-20s %9s %9s %9s" % (
+            path, count / elapsed,
+            percentile(result.latencies, 50), percentile(result.latencies, 90), percentile(result.latencies, 99),
+            max(result.latencies, default=0.0), result.bytes / count if count else 0, statuses,
+            "%.1f" % dev["latencyAvg"] if dev else "-",
+            dev["heapAvg"] if dev else "-", dev["heapMax"] if dev else "-"))
+    if not device:
+        print()
+        print("No device statistics, /webstats.json was not reachable")
+
+
+if __name__ == "__main__":
+    main()
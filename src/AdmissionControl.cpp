@@ -0,0 +1,126 @@
+// AdmissionControl.cpp
+#include "AdmissionControl.h"
+#include "Log.h"
+
+Admission AdmissionControl::admit(uint32_t clientIp)
+{
+    Admission result = Admission::ADMITTED;
+    // release() and unpark() of a parked request may come in either order
+    const uint8_t working = m_inFlight > m_parked ? m_inFlight - m_parked : 0;
+    if (working >= MAX_IN_FLIGHT)
+    {
+        result = Admission::TOO_MANY_IN_FLIGHT;
+    }
+    else if (ESP.getFreeHeap() < MIN_FREE_HEAP || ESP.getMaxAllocHeap() < MIN_LARGEST_BLOCK)
+    {
+        result = Admission::LOW_MEMORY;
+    }
+    else if (!takeToken(clientIp, millis()))
+    {
+        result = Admission::RATE_LIMITED;
+    }
+
+    m_counts[(int)result]++;
+    if (result == Admission::ADMITTED)
+    {
+        m_inFlight++;
+    }
+    else
+    {
+        LOG_DEBUG(WEB, "Request shed: %s (%u in flight, %u free heap)", getName(result), m_inFlight, ESP.getFreeHeap());
+    }
+    return result;
+}
+
+void AdmissionControl::release()
+{
+    if (m_inFlight > 0)
+    {
+        m_inFlight--;
+    }
+}
+
+bool AdmissionControl::park()
+{
+    if (m_parked >= MAX_PARKED)
+    {
+        return false;
+    }
+    m_parked++;
+    return true;
+}
+
+void AdmissionControl::unpark()
+{
+    if (m_parked > 0)
+    {
+        m_parked--;
+    }
+}
+
+bool AdmissionControl::takeToken(uint32_t clientIp, uint32_t nowMs)
+{
+    // Find the client, or take over the slot that was idle the longest
+    Client *client = &m_clients[0];
+    for (Client &candidate : m_clients)
+    {
+        if (candidate.ip == clientIp)
+        {
+            client = &candidate;
+            break;
+        }
+        if (nowMs - candidate.lastMs > nowMs - client->lastMs)
+        {
+            client = &candidate;
+        }
+    }
+
+    if (client->ip != clientIp)
+    {
+        client->ip = clientIp;
+        client->tokens = BUCKET_CAPACITY * TOKEN;
+    }
+    else
+    {
+        // In thousandths, REFILL_PER_SECOND tokens per second are REFILL_PER_SECOND per ms. The
+        // bucket is full again within seconds, the cap only keeps the product from overflowing
+        const uint32_t elapsedMs = std::min(nowMs - client->lastMs, (uint32_t)60000);
+        client->tokens = std::min(BUCKET_CAPACITY * TOKEN, client->tokens + elapsedMs * REFILL_PER_SECOND);
+    }
+    client->lastMs = nowMs;
+
+    if (client->tokens < TOKEN)
+    {
+        return false;
+    }
+    client->tokens -= TOKEN;
+    return true;
+}
+
+uint32_t AdmissionControl::getRetryAfter(Admission admission) const
+{
+    switch (admission)
+    {
+    case Admission::LOW_MEMORY:
+        return 5;
+    default:
+        return 1;
+    }
+}
+
+const char *AdmissionControl::getName(Admission admission)
+{
+    switch (admission)
+    {
+    case Admission::ADMITTED:
+        return "admitted";
+    case Admission::TOO_MANY_IN_FLIGHT:
+        return "in_flight";
+    case Admission::LOW_MEMORY:
+        return "low_memory";
+    case Admission::RATE_LIMITED:
+        return "rate_limited";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,69 @@
+// AdmissionControl.h
+#pragma once
+
+#include <Arduino.h>
+
+enum class Admission : uint8_t
+{
+    ADMITTED,
+    TOO_MANY_IN_FLIGHT, // 503
+    LOW_MEMORY,         // 503
+    RATE_LIMITED,       // 429
+    COUNT
+};
+
+// Decides whether the web server takes on another request. Every admitted request costs
+// an AsyncTCP connection, its request object and whatever the handler allocates, so we
+// cap the number in flight, limit each client with a token bucket and shed everything
+// while the heap (or its largest free block) is low, instead of running into a crash.
+// Long polls waiting for a sample have their own budget of MAX_PARKED on top of
+// MAX_IN_FLIGHT, so they can never take the slots of the dashboard or /metrics.
+// Only used from the AsyncTCP task, so no locking.
+class AdmissionControl
+{
+public:
+    static constexpr uint8_t MAX_IN_FLIGHT = 8;
+    // Each parked request holds an AsyncTCP connection and its buffers
+    static constexpr uint8_t MAX_PARKED = 4;
+    static constexpr uint32_t MIN_FREE_HEAP = 24 * 1024;
+    static constexpr uint32_t MIN_LARGEST_BLOCK = 8 * 1024;
+    // Per client: bursts of up to 10 requests, refilled at 4 per second
+    static constexpr uint32_t BUCKET_CAPACITY = 10;
+    static constexpr uint32_t REFILL_PER_SECOND = 4;
+    static constexpr int TRACKED_CLIENTS = 8;
+
+    // On ADMITTED the caller must call release() once the request is gone
+    Admission admit(uint32_t clientIp);
+    void release();
+    // An admitted request that waits for a sample (long poll) does no work meanwhile, so
+    // from park() to unpark() it counts against MAX_PARKED instead of MAX_IN_FLIGHT.
+    // False if MAX_PARKED are waiting already, the request must not park then.
+    bool park();
+    void unpark();
+
+    // Seconds a shed client should wait before trying again
+    uint32_t getRetryAfter(Admission admission) const;
+    static const char *getName(Admission admission);
+
+    uint8_t getInFlight() const { return m_inFlight; }
+    uint8_t getParked() const { return m_parked; }
+    uint32_t getCount(Admission admission) const { return m_counts[(int)admission]; }
+
+private:
+    // Tokens are kept in thousandths, so refilling needs no floats
+    static constexpr uint32_t TOKEN = 1000;
+
+    struct Client
+    {
+        uint32_t ip = 0;
+        uint32_t tokens = 0;
+        uint32_t lastMs = 0;
+    };
+
+    Client m_clients[TRACKED_CLIENTS];
+    uint8_t m_inFlight = 0;
+    uint8_t m_parked = 0;
+    uint32_t m_counts[(int)Admission::COUNT] = {};
+
+    bool takeToken(uint32_t clientIp, uint32_t nowMs);
+};
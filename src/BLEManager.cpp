@@ -42,16 +42,16 @@ void BLEManager::init(bool bIsReset)
 {
     if (!initialized)
     {
-        Log.debug("[BLE] Init");
+        LOG_DEBUG(BLE, "Init");
         NimBLEDevice::init("Vancontrol");
         if (!m_prefs.begin(BLE_NVS_NAMESPACE))
         {
-            Log.error("[BLE] Opening preferences failed");
+            LOG_ERROR(BLE, "Opening preferences failed");
         }
         if (bIsReset)
         {
             m_prefs.clear();
-            Log.info("[BLE] Deleting known devices list");
+            LOG_INFO(BLE, "Deleting known devices list");
         }
         initialized = true;
     }
@@ -92,12 +92,18 @@ void BLEManager::process()
         busy = true;
     }
 
+    if (m_refreshRequested.exchange(false) && currentTask)
+    {
+        currentTask->requestRefresh();
+    }
+
     if (currentTask)
     {
         if (currentTask->process())
         {
             if (currentTask->isSticky())
             {
+                m_reconnectCount++;
                 currentTask->restart();
             }
             else
@@ -107,7 +113,7 @@ void BLEManager::process()
                 {
                     m_knownDeviceMap[currentTask->getServiceUuid()] = currentTask->getDeviceAddress();
                     m_prefs.putULong64(uuidToShortKey(currentTask->getServiceUuid()).c_str(), (uint64_t)currentTask->getDeviceAddress());
-                    Log.debug("BLE Manager. Put device to known list: %s for service %s", currentTask->getDeviceAddress().toString().c_str(), currentTask->getServiceUuid().toString().c_str());
+                    LOG_DEBUG(BLE, "Put device to known list: %s for service %s", currentTask->getDeviceAddress().toString().c_str(), currentTask->getServiceUuid().toString().c_str());
                 }
 
                 currentTask = NULL;
@@ -124,6 +130,7 @@ void BLEManager::process()
             if (currentTask->isSticky())
             {
                 delay(200);
+                m_reconnectCount++;
                 currentTask->restart();
             }
             else
@@ -5,6 +5,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <atomic>
 #include <NimBLEDevice.h>
 #include <Preferences.h>
 
@@ -43,6 +44,8 @@ struct TaskResult
     size_t dataLength = 0;
     std::string deviceName;
     NimBLEAddress deviceAddress;
+    uint32_t durationMs = 0; // from (re)starting the task until the result was available
+    uint64_t scheduledMs = 0; // Clock::nowMs() the poll was due, 0 = not on the poll schedule
 };
 
 class BLETask
@@ -68,6 +71,8 @@ public:
     virtual bool process() = 0;
     virtual void stop() = 0;
     virtual void restart() {};
+    // Poll again as soon as possible instead of waiting for the next interval
+    virtual void requestRefresh() {};
 
 protected:
     TaskType type;
@@ -115,6 +120,11 @@ public:
     void process();
     void init(bool bIsReset);
     bool isBusy() const;
+    // Thread safe, the current task is asked in the next process() call. Requests that
+    // come in before that are coalesced into one.
+    void requestRefresh() { m_refreshRequested = true; }
+    // Sticky tasks that had to start over after an error or timeout, i.e. BLE reconnects
+    uint32_t getReconnectCount() const { return m_reconnectCount; }
     std::string uuidToShortKey(const NimBLEUUID &uuid);
 
 protected:
@@ -130,4 +140,6 @@ private:
     bool busy;
     bool initialized;
     Preferences m_prefs;
+    uint32_t m_reconnectCount = 0;
+    std::atomic<bool> m_refreshRequested{false};
 };
\ No newline at end of file
@@ -4,6 +4,11 @@
 #include "OtherFunctions.h"
 #include "TDTPollCharacteristicTask.h"
 #include "config.h"
+#include "LiFePO4Soc.h"
+#include "FixedPoint.h"
+#include "CrashStore.h"
+#include "Clock.h"
+#include "BootPhases.h"
 
 BatteryManager::BatteryManager(BLEManager &bleManager)
     : m_bleManager(bleManager)
@@ -12,8 +17,13 @@ BatteryManager::BatteryManager(BLEManager &bleManager)
 
 void BatteryManager::init()
 {
-    Log.debug("[BATTERY] Init");
-    // No preferences to load
+    LOG_DEBUG(BATTERY, "Init");
+    m_energy.init();
+}
+
+void BatteryManager::flush()
+{
+    m_energy.flush();
 }
 
 void BatteryManager::doPolling()
@@ -32,6 +42,12 @@ void BatteryManager::finishedPolling()
     m_hasPolled = true;
 }
 
+uint64_t BatteryManager::getSampleEpochMs() const
+{
+    const uint64_t sampleMs = m_lastSampleClockMs;
+    return sampleMs != 0 ? Clock::toEpochMs(sampleMs) : 0;
+}
+
 void BatteryManager::processBleTDTResult(const TaskResult &result)
 {
     if (result.status == TaskStatus::SUCCESS)
@@ -45,15 +61,121 @@ void BatteryManager::processBleTDTResult(const TaskResult &result)
                 minVoltage = bms.cellVoltages[i];
             }
         }
-        lastTdtUpdateMs = millis();
+        const TDTBMSData previous = tdtBmsData;
+        const int previousSoc = m_soc;
+        const bool previousAtRest = m_atRest;
+        m_lastSampleClockMs = Clock::nowMs();
+        lastTdtUpdateMs = (uint32_t)m_lastSampleClockMs;
+        m_pollDurationMs = result.durationMs;
         tdtBmsData = bms;
-        Log.info("[Battery]: BLE: TDT Poll succeeded, min voltage: %f, Status: %s", minVoltage / 1000.0f, result.errorMessage.c_str());
+        m_voltage = bms.voltage;
+        m_powerFlow = (int32_t)bms.voltage * bms.current; // 0.01V * 0.1A = 1 mW
+        m_energy.addSample(bms.voltage, bms.current, lastTdtUpdateMs);
+        m_stats.addSample(bms, lastTdtUpdateMs);
+        m_history.add(bms, lastTdtUpdateMs);
+        CrashStore::addSample(bms, lastTdtUpdateMs);
+        updateVoltageSOC(bms, lastTdtUpdateMs);
+        updatePollSchedule(result.scheduledMs);
+        BootPhases::mark(BootPhase::FIRST_SAMPLE);
+        updateFieldVersions(previous, previousSoc, previousAtRest, m_sampleVersion + 1);
+        m_sampleVersion++;
+        LOG_INFO(BATTERY, "TDT Poll succeeded, min voltage: %s, Status: %s", FixedText(Fixed(minVoltage, 3)).c_str(), result.errorMessage.c_str());
     }
     else
     {
-        Log.info("[Battery]: BLE: Trying to poll TDT battery status failed, reason: %s",
+        m_pollFailures++;
+        LOG_INFO(BATTERY, "Trying to poll TDT battery status failed, reason: %s",
                  BLETask::getResultLabel(result.status));
     }
 
     finishedPolling();
-}
\ No newline at end of file
+}
+
+void BatteryManager::updateFieldVersions(const TDTBMSData &previous, int previousSoc, bool previousAtRest, uint32_t version)
+{
+    const TDTBMSData &current = tdtBmsData;
+    const bool changed[] = {
+        current.cellCount != previous.cellCount,
+        current.tempSensorCount != previous.tempSensorCount,
+        current.voltage != previous.voltage,
+        current.current != previous.current,
+        current.batteryLevel != previous.batteryLevel,
+        current.cycleCharge != previous.cycleCharge,
+        current.cycles != previous.cycles,
+        current.problemCode != previous.problemCode,
+        current.cellCount != previous.cellCount || memcmp(current.cellVoltages, previous.cellVoltages, sizeof(current.cellVoltages)) != 0,
+        current.tempSensorCount != previous.tempSensorCount || memcmp(current.temperatures, previous.temperatures, sizeof(current.temperatures)) != 0,
+        m_soc != previousSoc,
+        m_atRest != previousAtRest,
+    };
+    static_assert(sizeof(changed) / sizeof(changed[0]) == (size_t)BatteryField::COUNT, "one entry per field");
+
+    for (int i = 0; i < (int)BatteryField::COUNT; ++i)
+    {
+        // The first sample counts as a change of everything, even of fields that are still zero
+        if (changed[i] || version == 1)
+        {
+            m_fieldVersions[i] = version;
+        }
+    }
+}
+
+void BatteryManager::updatePollSchedule(uint64_t scheduledMs)
+{
+    // The first poll after connecting is not on the schedule
+    if (scheduledMs == 0)
+    {
+        return;
+    }
+    m_pollLateness.add((int32_t)(m_lastSampleClockMs - scheduledMs), lastTdtUpdateMs);
+    if (m_lastScheduledMs != 0)
+    {
+        const uint64_t slots = (scheduledMs - m_lastScheduledMs + TDTPollCharacteristicTask::POLL_INTERVAL / 2) / TDTPollCharacteristicTask::POLL_INTERVAL;
+        if (slots > 1)
+        {
+            m_missedPollSlots += slots - 1;
+        }
+    }
+    m_lastScheduledMs = scheduledMs;
+    m_scheduledPolls++;
+}
+
+void BatteryManager::updateVoltageSOC(const TDTBMSData &bms, uint32_t sampleMs)
+{
+    if (bms.cellCount == 0 || abs(bms.current) > REST_CURRENT_THRESHOLD)
+    {
+        m_restSinceMs = 0;
+        m_atRest = false;
+        return;
+    }
+
+    if (m_restSinceMs == 0)
+    {
+        m_restSinceMs = sampleMs;
+    }
+    m_atRest = sampleMs - m_restSinceMs >= REST_TIME_MS;
+    if (!m_atRest)
+    {
+        return;
+    }
+
+    uint32_t cellSum = 0;
+    const int cells = min((int)bms.cellCount, 4);
+    for (int i = 0; i < cells; ++i)
+    {
+        cellSum += bms.cellVoltages[i];
+    }
+    // The coldest sensor is closest to the cell that drags the OCV down
+    int16_t temperature = LiFePO4Soc::REFERENCE_TEMP_DECI_C;
+    for (int i = 0; i < bms.tempSensorCount && i < 4; ++i)
+    {
+        temperature = i == 0 ? bms.temperatures[i] : min(temperature, bms.temperatures[i]);
+    }
+
+    m_soc = calculateLiFePO4SOC(cellSum / cells, temperature);
+}
+
+int BatteryManager::calculateLiFePO4SOC(uint16_t cellMillivolts, int16_t temperature)
+{
+    return (LiFePO4Soc::socPermille(cellMillivolts, temperature) + 5) / 10;
+}
@@ -3,7 +3,31 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <atomic>
 #include "BLEManager.h"
+#include "EnergyCounter.h"
+#include "BatteryStats.h"
+#include "SampleHistory.h"
+#include "SlidingWindowStats.h"
+#include "FixedPoint.h"
+
+// Fields of a battery sample as exposed by the API, for projections and deltas
+enum class BatteryField : uint8_t
+{
+    CELL_COUNT,
+    TEMP_SENSOR_COUNT,
+    VOLTAGE,
+    CURRENT,
+    BATTERY_LEVEL,
+    CYCLE_CHARGE,
+    CYCLES,
+    PROBLEM_CODE,
+    CELL_VOLTAGES,
+    TEMPERATURES,
+    VOLTAGE_SOC,
+    AT_REST,
+    COUNT
+};
 
 class BatteryManager
 {
@@ -13,29 +37,69 @@ public:
     void doPolling();
     void finishedPolling();
     void init();
+    void flush();
+    // Poll the BMS now instead of at the next interval, may be called from any task
+    void requestFreshSample() { m_bleManager.requestRefresh(); }
+
+    // Rest detection for the voltage based SOC: OCV is only meaningful after the
+    // pack has been (almost) idle for a while
+    static constexpr int16_t REST_CURRENT_THRESHOLD = 5; // in 0.1A
+    static constexpr uint32_t REST_TIME_MS = 30 * 60 * 1000;
 
     // Inline getters
-    int getSOC() const { return m_soc; }
-    float getVoltage() const { return m_voltage; }
-    float getPowerFlow() const { return m_powerFlow; }
+    int getSOC() const { return m_soc; } // voltage based SOC from the last rest period, -1 if unknown
+    bool isAtRest() const { return m_atRest; }
+    Fixed getVoltage() const { return Fixed(m_voltage, 2); }     // in V
+    Fixed getPowerFlow() const { return Fixed(m_powerFlow, 3); } // in W
     TDTBMSData getTdtBms() const { return tdtBmsData; }
     uint32_t getLastTdtUpdateMs() const { return lastTdtUpdateMs; }
+    uint64_t getLastSampleClockMs() const { return m_lastSampleClockMs; } // Clock::nowMs(), 0 = none yet
+    uint64_t getSampleEpochMs() const; // when the last sample was taken, 0 if none or the time is not synced
+    uint32_t getSampleVersion() const { return m_sampleVersion; } // increases with every new sample, 0 = none yet
     bool hasPolled() const { return m_hasPolled; }
     bool isPolling() const { return m_isPolling; }
+    const EnergyCounter &getEnergy() const { return m_energy; }
+    const BatteryStats &getStats() const { return m_stats; }
+    const SampleHistory &getHistory() const { return m_history; }
+    // Sample version in which the field last changed its value
+    uint32_t getFieldVersion(BatteryField field) const { return m_fieldVersions[(int)field]; }
+    uint32_t getPollDurationMs() const { return m_pollDurationMs; } // of the last successful poll
+    uint32_t getPollFailures() const { return m_pollFailures; }
+    // ms from the slot a poll was scheduled for until its sample arrived, over the last hour
+    WindowStats getPollLateness() const { return m_pollLateness.get(); }
+    uint32_t getScheduledPolls() const { return m_scheduledPolls; }
+    uint32_t getMissedPollSlots() const { return m_missedPollSlots; }
+    uint32_t getBleReconnects() const { return m_bleManager.getReconnectCount(); }
 
 private:
     BLEManager &m_bleManager;
     bool m_isPolling = false;
     bool m_hasPolled = false;
     int m_soc = -1;          // State of Charge (%)
-    float m_voltage = 0.0f;  // Battery voltage
-    float m_powerFlow = 0.0f; // Current power flow (positive = charging, negative = discharging)
+    bool m_atRest = false;
+    uint32_t m_restSinceMs = 0; // 0 = under load
+    uint16_t m_voltage = 0;  // Battery voltage in 0.01V
+    int32_t m_powerFlow = 0; // Current power flow in mW (positive = charging, negative = discharging)
 
     TDTBMSData tdtBmsData;
     uint32_t lastTdtUpdateMs = 0;
-
+    std::atomic<uint64_t> m_lastSampleClockMs{0};
+    uint32_t m_pollDurationMs = 0;
+    uint32_t m_pollFailures = 0;
+    SlidingWindow<12> m_pollLateness{60UL * 60 * 1000}; // 5 min slices
+    uint64_t m_lastScheduledMs = 0;
+    uint32_t m_scheduledPolls = 0;
+    uint32_t m_missedPollSlots = 0;
+    std::atomic<uint32_t> m_sampleVersion{0};
+    uint32_t m_fieldVersions[(int)BatteryField::COUNT] = {};
+    EnergyCounter m_energy;
+    BatteryStats m_stats;
+    SampleHistory m_history;
 
     void processBleResult(const TaskResult &result);
     void processBleTDTResult(const TaskResult &result);
-    int calculateLiFePO4SOC(float voltage);
+    void updatePollSchedule(uint64_t scheduledMs);
+    void updateVoltageSOC(const TDTBMSData &bms, uint32_t sampleMs);
+    void updateFieldVersions(const TDTBMSData &previous, int previousSoc, bool previousAtRest, uint32_t version);
+    int calculateLiFePO4SOC(uint16_t cellMillivolts, int16_t temperature);
 };
\ No newline at end of file
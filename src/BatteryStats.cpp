@@ -0,0 +1,87 @@
+// BatteryStats.cpp
+#include "BatteryStats.h"
+
+void BatteryStats::addSample(const TDTBMSData &bms, uint32_t sampleMs)
+{
+    m_metrics[(int)StatsMetric::VOLTAGE].add(bms.voltage, sampleMs);
+    m_metrics[(int)StatsMetric::CURRENT].add(bms.current, sampleMs);
+
+    if (bms.cellCount > 0)
+    {
+        uint16_t minCell = UINT16_MAX;
+        uint16_t maxCell = 0;
+        for (int i = 0; i < bms.cellCount && i < 4; ++i)
+        {
+            minCell = std::min(minCell, bms.cellVoltages[i]);
+            maxCell = std::max(maxCell, bms.cellVoltages[i]);
+        }
+        m_metrics[(int)StatsMetric::CELL_SPREAD].add(maxCell - minCell, sampleMs);
+    }
+
+    if (bms.tempSensorCount > 0)
+    {
+        int16_t minTemp = INT16_MAX;
+        int16_t maxTemp = INT16_MIN;
+        for (int i = 0; i < bms.tempSensorCount && i < 4; ++i)
+        {
+            minTemp = std::min(minTemp, bms.temperatures[i]);
+            maxTemp = std::max(maxTemp, bms.temperatures[i]);
+        }
+        m_metrics[(int)StatsMetric::TEMP_MAX].add(maxTemp, sampleMs);
+        m_metrics[(int)StatsMetric::TEMP_MIN].add(minTemp, sampleMs);
+    }
+}
+
+WindowStats BatteryStats::get(StatsMetric metric, StatsWindow window) const
+{
+    const MetricWindows &windows = m_metrics[(int)metric];
+    switch (window)
+    {
+    case StatsWindow::MIN_1:
+        return windows.min1.get();
+    case StatsWindow::MIN_15:
+        return windows.min15.get();
+    case StatsWindow::HOUR_1:
+        return windows.hour1.get();
+    case StatsWindow::HOUR_24:
+        return windows.hour24.get();
+    default:
+        return WindowStats();
+    }
+}
+
+const char *BatteryStats::getMetricName(StatsMetric metric)
+{
+    switch (metric)
+    {
+    case StatsMetric::VOLTAGE:
+        return "voltage";
+    case StatsMetric::CURRENT:
+        return "current";
+    case StatsMetric::CELL_SPREAD:
+        return "cellSpread";
+    case StatsMetric::TEMP_MAX:
+        return "tempMax";
+    case StatsMetric::TEMP_MIN:
+        return "tempMin";
+    default:
+        return "unknown";
+    }
+}
+
+const char *BatteryStats::getWindowName(StatsWindow window)
+{
+    switch (window)
+    {
+    case StatsWindow::MIN_1:
+        return "1m";
+    case StatsWindow::MIN_15:
+        return "15m";
+    case StatsWindow::HOUR_1:
+        return "1h";
+    case StatsWindow::HOUR_24:
+        return "24h";
+    default:
+        return "unknown";
+    }
+}
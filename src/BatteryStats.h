@@ -0,0 +1,54 @@
+// BatteryStats.h
+#pragma once
+
+#include <Arduino.h>
+#include "BLEManager.h"
+#include "SlidingWindowStats.h"
+
+enum class StatsMetric
+{
+    VOLTAGE,     // pack voltage in 0.01V
+    CURRENT,     // in 0.1A
+    CELL_SPREAD, // max - min cell voltage in mV
+    TEMP_MAX,    // hottest sensor in 0.1°C
+    TEMP_MIN,    // coldest sensor in 0.1°C
+    COUNT
+};
+
+enum class StatsWindow
+{
+    MIN_1,
+    MIN_15,
+    HOUR_1,
+    HOUR_24,
+    COUNT
+};
+
+class BatteryStats
+{
+public:
+    void addSample(const TDTBMSData &bms, uint32_t sampleMs);
+    WindowStats get(StatsMetric metric, StatsWindow window) const;
+
+    static const char *getMetricName(StatsMetric metric);
+    static const char *getWindowName(StatsWindow window);
+
+private:
+    struct MetricWindows
+    {
+        SlidingWindow<12> min1{60UL * 1000};            // 5 s slices
+        SlidingWindow<15> min15{15UL * 60 * 1000};      // 1 min slices
+        SlidingWindow<12> hour1{60UL * 60 * 1000};      // 5 min slices
+        SlidingWindow<24> hour24{24UL * 60 * 60 * 1000}; // 1 h slices
+
+        void add(int32_t value, uint32_t nowMs)
+        {
+            min1.add(value, nowMs);
+            min15.add(value, nowMs);
+            hour1.add(value, nowMs);
+            hour24.add(value, nowMs);
+        }
+    };
+
+    MetricWindows m_metrics[(int)StatsMetric::COUNT];
+};
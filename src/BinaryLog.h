@@ -0,0 +1,148 @@
+// BinaryLog.h
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <cstdarg>
+
+// Deferred log record for LOG_BINARY builds: instead of formatting, the logger stores the
+// address of the format string (it lives in flash, so the address identifies it in the
+// firmware ELF), the timestamp and the raw arguments. scripts/decode_binlog.py does the
+// formatting on the host with the ELF of the running firmware.
+struct BinaryLogRecord
+{
+    static constexpr size_t PAYLOAD_SIZE = 22;
+    static constexpr uint8_t FLAG_TRUNCATED = 0x80; // in payloadLength, arguments did not fit
+
+    uint32_t seq;
+    uint32_t format;    // address of the format string
+    uint32_t timestamp; // millis()
+    uint8_t level;      // LogLevel, LogModule in the upper four bits
+    uint8_t payloadLength;
+    uint8_t payload[PAYLOAD_SIZE]; // arguments in format order, little endian, strings inline with NUL
+};
+
+// Marker whose address goes into the /logs.bin header, the decoder looks it up in the
+// ELF to make sure both belong to the same build
+inline constexpr char BINARY_LOG_MARKER[] = "BlueFiGate binary log v1";
+
+namespace BinaryLog
+{
+    // Walks the conversions of a printf format and copies the matching arguments into
+    // payload: integers, pointers and chars as 4 bytes (8 with ll), floating point as 8
+    // bytes, strings as their bytes plus NUL. Returns the payload length, with
+    // FLAG_TRUNCATED set when an argument did not fit; the decoder stops there.
+    inline uint8_t packArgs(const char *format, va_list args, uint8_t *payload, size_t size)
+    {
+        size_t len = 0;
+        auto put = [&](const void *data, size_t bytes) -> bool
+        {
+            if (len + bytes > size)
+                return false;
+            memcpy(payload + len, data, bytes);
+            len += bytes;
+            return true;
+        };
+
+        for (const char *p = format; *p != '\0'; ++p)
+        {
+            if (*p != '%')
+                continue;
+            ++p;
+            if (*p == '%')
+                continue;
+
+            // Flags, width and precision; '*' takes an int argument
+            while (*p != '\0' && strchr("-+ #0123456789.*", *p) != nullptr)
+            {
+                if (*p == '*')
+                {
+                    const int32_t value = va_arg(args, int);
+                    if (!put(&value, sizeof(value)))
+                        return len | BinaryLogRecord::FLAG_TRUNCATED;
+                }
+                ++p;
+            }
+            // The argument is read with the type printf would read, an int sized one without
+            // a modifier (long is wider than int on the host); only ll is packed as 8 bytes
+            int longs = 0;
+            char modifier = '\0';
+            while (*p == 'l' || *p == 'h' || *p == 'z' || *p == 'j' || *p == 't')
+            {
+                longs += *p == 'l' ? 1 : 0;
+                if (*p != 'h')
+                    modifier = *p;
+                ++p;
+            }
+
+            bool fits = true;
+            switch (*p)
+            {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                if (longs >= 2)
+                {
+                    const uint64_t value = va_arg(args, unsigned long long);
+                    fits = put(&value, sizeof(value));
+                }
+                else
+                {
+                    uint32_t value;
+                    if (modifier == 'l')
+                        value = (uint32_t)va_arg(args, unsigned long);
+                    else if (modifier == 'z' || modifier == 't')
+                        value = (uint32_t)va_arg(args, size_t);
+                    else if (modifier == 'j')
+                        value = (uint32_t)va_arg(args, uintmax_t);
+                    else
+                        value = va_arg(args, unsigned int);
+                    fits = put(&value, sizeof(value));
+                }
+                break;
+            case 'p':
+            {
+                const uint32_t value = (uint32_t)(uintptr_t)va_arg(args, void *);
+                fits = put(&value, sizeof(value));
+                break;
+            }
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            {
+                const double value = va_arg(args, double);
+                fits = put(&value, sizeof(value));
+                break;
+            }
+            case 's':
+            {
+                const char *text = va_arg(args, const char *);
+                if (text == nullptr)
+                    text = "(null)";
+                // As much of the string as fits, always terminated
+                const size_t room = size - len;
+                const size_t textLen = strlen(text);
+                if (room == 0)
+                    return len | BinaryLogRecord::FLAG_TRUNCATED;
+                const size_t copy = textLen < room - 1 ? textLen : room - 1;
+                put(text, copy);
+                payload[len++] = '\0';
+                fits = copy == textLen;
+                break;
+            }
+            default:
+                return len | BinaryLogRecord::FLAG_TRUNCATED; // unknown conversion, nothing after it can be decoded
+            }
+            if (!fits)
+                return len | BinaryLogRecord::FLAG_TRUNCATED;
+        }
+        return (uint8_t)len;
+    }
+}
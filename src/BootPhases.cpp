@@ -0,0 +1,45 @@
+// BootPhases.cpp
+#include "BootPhases.h"
+#include <atomic>
+#include "Clock.h"
+#include "Log.h"
+
+namespace
+{
+    // Marked from the loop task and the WiFi event task
+    std::atomic<uint32_t> s_marks[(int)BootPhase::COUNT];
+}
+
+void BootPhases::mark(BootPhase phase)
+{
+    const uint32_t nowMs = std::max<uint32_t>(1, (uint32_t)Clock::nowMs());
+    uint32_t expected = 0;
+    if (s_marks[(int)phase].compare_exchange_strong(expected, nowMs))
+    {
+        LOG_INFO(GENERAL, "Boot phase %s reached after %u ms", getName(phase), nowMs);
+    }
+}
+
+uint32_t BootPhases::getMs(BootPhase phase)
+{
+    return s_marks[(int)phase];
+}
+
+const char *BootPhases::getName(BootPhase phase)
+{
+    switch (phase)
+    {
+    case BootPhase::WIFI_START:
+        return "wifi_start";
+    case BootPhase::WIFI_CONNECTED:
+        return "wifi_connected";
+    case BootPhase::WIFI_GOT_IP:
+        return "wifi_got_ip";
+    case BootPhase::WEB_SERVER:
+        return "web_server";
+    case BootPhase::FIRST_SAMPLE:
+        return "first_sample";
+    default:
+        return "unknown";
+    }
+}
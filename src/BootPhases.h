@@ -0,0 +1,25 @@
+// BootPhases.h
+#pragma once
+
+#include <Arduino.h>
+
+enum class BootPhase : uint8_t
+{
+    WIFI_START,     // first connect attempt
+    WIFI_CONNECTED, // associated with the AP
+    WIFI_GOT_IP,
+    WEB_SERVER,     // web server listening
+    FIRST_SAMPLE,   // first battery sample
+    COUNT
+};
+
+// Milliseconds from boot until each phase of the startup was first reached, to see where
+// the time goes until the gateway answers. Only the first time counts, a reconnect later
+// on does not move the marks.
+class BootPhases
+{
+public:
+    static void mark(BootPhase phase);
+    static uint32_t getMs(BootPhase phase); // 0 = not reached yet
+    static const char *getName(BootPhase phase);
+};
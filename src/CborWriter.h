@@ -0,0 +1,91 @@
+// CborWriter.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Minimal CBOR (RFC 8949) encoder into a caller provided buffer, only the definite length
+// types we need: unsigned/negative integers, booleans, arrays and maps.
+// Writing past the end sets an overflow flag instead of failing per call, check ok() once
+// at the end.
+class CborWriter
+{
+public:
+    CborWriter(uint8_t *buffer, size_t size) : m_buffer(buffer), m_size(size) {}
+
+    void writeUInt(uint64_t value) { writeHead(MAJOR_UNSIGNED, value); }
+    void writeInt(int64_t value)
+    {
+        if (value >= 0)
+            writeHead(MAJOR_UNSIGNED, (uint64_t)value);
+        else
+            writeHead(MAJOR_NEGATIVE, (uint64_t)(-1 - value));
+    }
+    void writeBool(bool value) { writeByte(value ? SIMPLE_TRUE : SIMPLE_FALSE); }
+    void beginArray(size_t count) { writeHead(MAJOR_ARRAY, count); }
+    void beginMap(size_t pairs) { writeHead(MAJOR_MAP, pairs); }
+
+    size_t length() const { return m_len; }
+    bool ok() const { return !m_overflow; }
+
+private:
+    static constexpr uint8_t MAJOR_UNSIGNED = 0;
+    static constexpr uint8_t MAJOR_NEGATIVE = 1;
+    static constexpr uint8_t MAJOR_ARRAY = 4;
+    static constexpr uint8_t MAJOR_MAP = 5;
+    static constexpr uint8_t SIMPLE_FALSE = 0xF4;
+    static constexpr uint8_t SIMPLE_TRUE = 0xF5;
+
+    uint8_t *m_buffer;
+    size_t m_size;
+    size_t m_len = 0;
+    bool m_overflow = false;
+
+    // Initial byte plus the shortest big endian argument that holds the value
+    void writeHead(uint8_t major, uint64_t value)
+    {
+        const uint8_t type = major << 5;
+        if (value < 24)
+        {
+            writeByte(type | (uint8_t)value);
+        }
+        else if (value <= 0xFF)
+        {
+            writeByte(type | 24);
+            writeByte((uint8_t)value);
+        }
+        else if (value <= 0xFFFF)
+        {
+            writeByte(type | 25);
+            writeBigEndian(value, 2);
+        }
+        else if (value <= 0xFFFFFFFFULL)
+        {
+            writeByte(type | 26);
+            writeBigEndian(value, 4);
+        }
+        else
+        {
+            writeByte(type | 27);
+            writeBigEndian(value, 8);
+        }
+    }
+
+    void writeBigEndian(uint64_t value, int bytes)
+    {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8)
+        {
+            writeByte((uint8_t)(value >> shift));
+        }
+    }
+
+    void writeByte(uint8_t byte)
+    {
+        if (m_len >= m_size)
+        {
+            m_overflow = true;
+            return;
+        }
+        m_buffer[m_len++] = byte;
+    }
+};
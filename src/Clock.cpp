@@ -0,0 +1,131 @@
+// Clock.cpp
+#include "Clock.h"
+#include <esp_timer.h>
+#include <sys/time.h>
+
+namespace
+{
+    // Written from the SNTP callback in the lwIP task, read from any task
+    portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+    bool s_set = false;
+    int64_t s_anchorUs = 0;       // monotonic time of the last sync
+    int64_t s_anchorOffsetUs = 0; // epoch minus monotonic time at the last sync
+    int32_t s_driftPpb = 0;
+
+    // Sync the drift is measured from
+    bool s_hasBase = false;
+    int64_t s_baseUs = 0;
+    int64_t s_baseOffsetUs = 0;
+
+    int64_t s_lastStepUs = 0;
+    uint32_t s_syncCount = 0;
+
+    // Caller holds s_lock
+    int64_t mapToEpochUs(int64_t monotonicUs)
+    {
+        const int64_t sinceAnchorMs = (monotonicUs - s_anchorUs) / 1000;
+        return monotonicUs + s_anchorOffsetUs + sinceAnchorMs * s_driftPpb / 1000000;
+    }
+}
+
+uint64_t Clock::nowUs()
+{
+    return (uint64_t)esp_timer_get_time();
+}
+
+uint64_t Clock::nowMs()
+{
+    return nowUs() / 1000;
+}
+
+uint64_t Clock::fromMillis(uint32_t ms)
+{
+    const uint64_t now = nowMs();
+    return now - (uint32_t)((uint32_t)now - ms);
+}
+
+bool Clock::isWallClockSet()
+{
+    portENTER_CRITICAL(&s_lock);
+    const bool set = s_set;
+    portEXIT_CRITICAL(&s_lock);
+    return set;
+}
+
+uint64_t Clock::epochMs()
+{
+    return toEpochMs(nowMs());
+}
+
+uint64_t Clock::toEpochMs(uint64_t monotonicMs)
+{
+    portENTER_CRITICAL(&s_lock);
+    const bool set = s_set;
+    const int64_t epochUs = set ? mapToEpochUs((int64_t)monotonicMs * 1000) : 0;
+    portEXIT_CRITICAL(&s_lock);
+    return set && epochUs > 0 ? (uint64_t)epochUs / 1000 : 0;
+}
+
+void Clock::updateWallClock(bool fromNtp)
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    const int64_t monotonicUs = (int64_t)nowUs();
+    const int64_t epochUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    const int64_t offsetUs = epochUs - monotonicUs;
+
+    portENTER_CRITICAL(&s_lock);
+    s_lastStepUs = s_set ? epochUs - mapToEpochUs(monotonicUs) : 0;
+    if (!fromNtp)
+    {
+        // Only a starting point until NTP answers
+        s_hasBase = false;
+    }
+    else if (!s_hasBase)
+    {
+        s_hasBase = true;
+        s_baseUs = monotonicUs;
+        s_baseOffsetUs = offsetUs;
+    }
+    else if (monotonicUs - s_baseUs >= (int64_t)MIN_DRIFT_INTERVAL_MS * 1000)
+    {
+        const int64_t driftPpb = (offsetUs - s_baseOffsetUs) * 1000 / ((monotonicUs - s_baseUs) / 1000000);
+        // A jump that large is a new time, not drift, start measuring again from here
+        s_driftPpb = driftPpb >= -MAX_DRIFT_PPB && driftPpb <= MAX_DRIFT_PPB ? (int32_t)driftPpb : 0;
+        s_baseUs = monotonicUs;
+        s_baseOffsetUs = offsetUs;
+    }
+    s_anchorUs = monotonicUs;
+    s_anchorOffsetUs = offsetUs;
+    s_set = true;
+    if (fromNtp)
+    {
+        s_syncCount++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int32_t Clock::getDriftPpb()
+{
+    portENTER_CRITICAL(&s_lock);
+    const int32_t drift = s_driftPpb;
+    portEXIT_CRITICAL(&s_lock);
+    return drift;
+}
+
+int64_t Clock::getLastStepUs()
+{
+    portENTER_CRITICAL(&s_lock);
+    const int64_t step = s_lastStepUs;
+    portEXIT_CRITICAL(&s_lock);
+    return step;
+}
+
+uint32_t Clock::getSyncCount()
+{
+    portENTER_CRITICAL(&s_lock);
+    const uint32_t count = s_syncCount;
+    portEXIT_CRITICAL(&s_lock);
+    return count;
+}
@@ -0,0 +1,47 @@
+// Clock.h
+#pragma once
+
+#include <Arduino.h>
+
+// One time base for the whole firmware: a 64 bit millisecond clock since boot from
+// esp_timer, which never wraps (unlike millis() after 49.7 days) and never jumps, plus the
+// mapping to wall clock time, updated whenever NTP syncs. Timestamps are taken on the
+// monotonic clock and only turned into epoch time when they are shown, so samples taken
+// before the first sync get their time once it is there, and every resync corrects old
+// and new samples alike.
+//
+// The mapping is a line through the last NTP sync: epoch = monotonic + offset + drift *
+// (monotonic - last sync), with the drift of the crystal against NTP time measured between
+// syncs, so the time stays right across the 24 h between resyncs.
+class Clock
+{
+public:
+    // Syncs closer together than this give too noisy a drift
+    static constexpr uint32_t MIN_DRIFT_INTERVAL_MS = 10 * 60 * 1000;
+    // Far beyond any crystal, a larger drift means the time was set by hand or was wrong
+    static constexpr int32_t MAX_DRIFT_PPB = 500000;
+
+    // Monotonic time since boot
+    static uint64_t nowMs();
+    static uint64_t nowUs();
+
+    // Widens a millis() timestamp from the last 49.7 days to the monotonic clock; millis()
+    // is the same clock cut to 32 bits
+    static uint64_t fromMillis(uint32_t ms);
+
+    // Epoch time in ms, 0 as long as the wall clock is not set
+    static bool isWallClockSet();
+    static uint64_t epochMs();
+    static uint64_t toEpochMs(uint64_t monotonicMs);
+
+    // Maps the monotonic clock to the system time, call whenever the system time was set.
+    // fromNtp = false for a time that is only kept from before a reset, which is good
+    // enough to show but not to estimate the drift from.
+    static void updateWallClock(bool fromNtp = true);
+
+    // Drift of the monotonic clock against NTP time in parts per billion (positive = the
+    // crystal is slow), and how far the mapping was off at the last sync
+    static int32_t getDriftPpb();
+    static int64_t getLastStepUs();
+    static uint32_t getSyncCount();
+};
@@ -0,0 +1,155 @@
+// CrashStore.cpp
+#include "CrashStore.h"
+#include <algorithm>
+#include <atomic>
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+#include "BLEManager.h"
+#include "Clock.h"
+#include "Log.h"
+#include "OtherFunctions.h"
+
+namespace
+{
+    constexpr uint32_t MAGIC = 0x43525331; // "CRS1", change when the layout changes
+
+    struct Region
+    {
+        uint32_t magic;
+        uint32_t bootCount;
+        char note[CrashStore::NOTE_SIZE];
+        uint32_t headerCrc; // over everything above
+        CrashStore::LogEntry logs[CrashStore::LOG_ENTRIES];
+        CrashStore::SampleEntry samples[CrashStore::SAMPLE_ENTRIES];
+    };
+
+    RTC_NOINIT_ATTR Region s_region;
+
+    std::atomic<uint32_t> s_logSeq{0};
+    uint32_t s_sampleSeq = 0; // samples only come from the loop task
+
+    // Over the entry up to its crc member
+    template <typename Entry>
+    uint32_t entryCrc(const Entry &entry)
+    {
+        return esp_rom_crc32_le(0, (const uint8_t *)&entry, offsetof(Entry, crc));
+    }
+
+    uint32_t headerCrc()
+    {
+        return esp_rom_crc32_le(0, (const uint8_t *)&s_region, offsetof(Region, headerCrc));
+    }
+
+    // Intact, non-empty entries sorted by sequence number
+    template <typename Entry, size_t N>
+    void collect(const Entry (&entries)[N], std::vector<Entry> &out, uint32_t &rejected)
+    {
+        for (const Entry &entry : entries)
+        {
+            if (entry.crc != entryCrc(entry))
+            {
+                rejected++;
+            }
+            else if (entry.seq != 0)
+            {
+                out.push_back(entry);
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const Entry &a, const Entry &b)
+                  { return a.seq < b.seq; });
+    }
+}
+
+esp_reset_reason_t CrashStore::s_resetReason = ESP_RST_UNKNOWN;
+uint32_t CrashStore::s_bootCount = 1;
+std::vector<CrashStore::LogEntry> CrashStore::s_recoveredLogs;
+std::vector<CrashStore::SampleEntry> CrashStore::s_recoveredSamples;
+char CrashStore::s_recoveredNote[NOTE_SIZE] = "";
+uint32_t CrashStore::s_rejected = 0;
+
+void CrashStore::recover(esp_reset_reason_t reason)
+{
+    s_resetReason = reason;
+    s_bootCount = 1;
+    s_recoveredLogs.clear();
+    s_recoveredSamples.clear();
+    s_recoveredNote[0] = '\0';
+    s_rejected = 0;
+
+    // After a power cycle the RTC memory holds noise that could pass a CRC by chance
+    if (reason != ESP_RST_POWERON && s_region.magic == MAGIC && s_region.headerCrc == headerCrc())
+    {
+        s_bootCount = s_region.bootCount + 1;
+        memcpy(s_recoveredNote, s_region.note, NOTE_SIZE);
+        s_recoveredNote[NOTE_SIZE - 1] = '\0';
+        collect(s_region.logs, s_recoveredLogs, s_rejected);
+        collect(s_region.samples, s_recoveredSamples, s_rejected);
+    }
+
+    // Empty entries get a valid CRC too, so rejected only counts real damage
+    memset(&s_region, 0, sizeof(s_region));
+    for (LogEntry &entry : s_region.logs)
+    {
+        entry.crc = entryCrc(entry);
+    }
+    for (SampleEntry &entry : s_region.samples)
+    {
+        entry.crc = entryCrc(entry);
+    }
+    s_region.magic = MAGIC;
+    s_region.bootCount = s_bootCount;
+    s_region.headerCrc = headerCrc();
+
+    if (!s_recoveredLogs.empty() || !s_recoveredSamples.empty() || s_recoveredNote[0] != '\0')
+    {
+        Log.warn("Recovered %u log records and %u samples from the previous boot (%s%s%s), %u entries damaged",
+                 (unsigned)s_recoveredLogs.size(), (unsigned)s_recoveredSamples.size(), getResetReasonString(reason),
+                 s_recoveredNote[0] != '\0' ? ": " : "", s_recoveredNote, s_rejected);
+    }
+}
+
+void CrashStore::addLog(uint8_t level, uint32_t timestamp, const char *message)
+{
+    // Built on the stack and copied in one go, so the slot is only inconsistent for a moment
+    LogEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.seq = s_logSeq.fetch_add(1, std::memory_order_relaxed) + 1;
+    entry.timestamp = timestamp;
+    entry.level = level;
+    strncpy(entry.message, message, LOG_MESSAGE_SIZE - 1);
+    entry.crc = entryCrc(entry);
+    memcpy(&s_region.logs[entry.seq % LOG_ENTRIES], &entry, sizeof(entry));
+}
+
+void CrashStore::addSample(const TDTBMSData &data, uint32_t timestamp)
+{
+    SampleEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.seq = ++s_sampleSeq;
+    entry.timestamp = timestamp;
+    entry.epoch = (uint32_t)(Clock::epochMs() / 1000);
+    entry.voltage = data.voltage;
+    entry.current = data.current;
+    entry.batteryLevel = data.batteryLevel;
+    entry.problemCode = data.problemCode;
+    entry.minCellVoltage = UINT16_MAX;
+    for (int i = 0; i < data.cellCount; ++i)
+    {
+        entry.minCellVoltage = std::min(entry.minCellVoltage, data.cellVoltages[i]);
+        entry.maxCellVoltage = std::max(entry.maxCellVoltage, data.cellVoltages[i]);
+    }
+    entry.maxTemperature = INT16_MIN;
+    for (int i = 0; i < data.tempSensorCount; ++i)
+    {
+        entry.maxTemperature = std::max(entry.maxTemperature, data.temperatures[i]);
+    }
+    entry.crc = entryCrc(entry);
+    memcpy(&s_region.samples[entry.seq % SAMPLE_ENTRIES], &entry, sizeof(entry));
+}
+
+void CrashStore::setRestartNote(const char *note)
+{
+    strncpy(s_region.note, note, NOTE_SIZE - 1);
+    s_region.note[NOTE_SIZE - 1] = '\0';
+    s_region.headerCrc = headerCrc();
+}
@@ -0,0 +1,72 @@
+// CrashStore.h
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+struct TDTBMSData;
+
+// The last log records (INFO and above) and battery samples, kept in RTC memory that is
+// not initialized on boot. They survive a panic, a watchdog reset and esp_restart(), but
+// not a power cycle. Every entry carries its own CRC, so an entry that was half written
+// when the firmware crashed is dropped on recovery while the others are kept.
+// Writers do not lock: a log entry takes its slot by sequence number like LogRing does.
+class CrashStore
+{
+public:
+    static constexpr size_t LOG_ENTRIES = 24;
+    static constexpr size_t LOG_MESSAGE_SIZE = 76;
+    static constexpr size_t SAMPLE_ENTRIES = 4;
+    static constexpr size_t NOTE_SIZE = 48;
+
+    struct LogEntry
+    {
+        uint32_t seq; // from 1, 0 = empty
+        uint32_t timestamp;
+        uint8_t level;
+        char message[LOG_MESSAGE_SIZE];
+        uint32_t crc;
+    };
+
+    // The values that matter when looking back at a crash, in raw BMS units
+    struct SampleEntry
+    {
+        uint32_t seq; // from 1, 0 = empty
+        uint32_t timestamp; // millis()
+        uint32_t epoch;     // 0 while the time was not synced
+        uint16_t voltage;
+        int16_t current;
+        uint16_t minCellVoltage;
+        uint16_t maxCellVoltage;
+        int16_t maxTemperature;
+        uint16_t problemCode;
+        uint8_t batteryLevel;
+        uint32_t crc;
+    };
+
+    // Takes over what the previous boot left behind and clears the store for this one.
+    // Call first thing in setup(); a later call starts over, as after a reset.
+    static void recover(esp_reset_reason_t reason);
+
+    static void addLog(uint8_t level, uint32_t timestamp, const char *message);
+    static void addSample(const TDTBMSData &data, uint32_t timestamp);
+
+    // Why the firmware is about to restart on purpose, shown after the reboot
+    static void setRestartNote(const char *note);
+
+    // What recover() found, oldest first
+    static esp_reset_reason_t getResetReason() { return s_resetReason; }
+    static uint32_t getBootCount() { return s_bootCount; }
+    static const std::vector<LogEntry> &getRecoveredLogs() { return s_recoveredLogs; }
+    static const std::vector<SampleEntry> &getRecoveredSamples() { return s_recoveredSamples; }
+    static const char *getRecoveredNote() { return s_recoveredNote; }
+    static uint32_t getRejected() { return s_rejected; }
+
+private:
+    static esp_reset_reason_t s_resetReason;
+    static uint32_t s_bootCount;
+    static std::vector<LogEntry> s_recoveredLogs;
+    static std::vector<SampleEntry> s_recoveredSamples;
+    static char s_recoveredNote[NOTE_SIZE];
+    static uint32_t s_rejected;
+};
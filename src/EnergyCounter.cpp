@@ -0,0 +1,348 @@
+// EnergyCounter.cpp
+#include "EnergyCounter.h"
+#include <algorithm>
+#include <time.h>
+#include "Log.h"
+#include "Clock.h"
+
+const char *ENERGY_NVS_NAMESPACE = "energy";
+const char *ENERGY_NVS_KEY = "state";
+
+void EnergyCounter::init()
+{
+    if (!m_prefs.begin(ENERGY_NVS_NAMESPACE))
+    {
+        LOG_ERROR(ENERGY, "Opening preferences failed");
+        return;
+    }
+    m_prefsOpen = true;
+    loadCheckpoint();
+}
+
+void EnergyCounter::loadCheckpoint()
+{
+    PersistedState state;
+    if (m_prefs.getBytesLength(ENERGY_NVS_KEY) != sizeof(state) || m_prefs.getBytes(ENERGY_NVS_KEY, &state, sizeof(state)) != sizeof(state) || state.version != STATE_VERSION || state.hourlyPos >= HOURLY_BUCKETS || state.dailyPos >= DAILY_BUCKETS)
+    {
+        LOG_INFO(ENERGY, "No valid checkpoint found, starting from zero");
+        return;
+    }
+
+    portENTER_CRITICAL(&m_lock);
+    m_totals = state.totals;
+    memcpy(m_hourly, state.hourly, sizeof(m_hourly));
+    memcpy(m_daily, state.daily, sizeof(m_daily));
+    m_hourlyPos = state.hourlyPos;
+    m_dailyPos = state.dailyPos;
+    portEXIT_CRITICAL(&m_lock);
+    m_chargeAtCheckpointUAs = m_totals.chargeInUAs + m_totals.chargeOutUAs;
+    LOG_INFO(ENERGY, "Restored checkpoint: in %d mAh / %d Wh, out %d mAh / %d Wh",
+             m_totals.chargeInMAh(), m_totals.energyInWh(), m_totals.chargeOutMAh(), m_totals.energyOutWh());
+}
+
+void EnergyCounter::addSample(uint16_t voltage, int16_t current, uint32_t sampleMs)
+{
+    // 0.1A -> mA, and 0.01V * 0.1A happens to be exactly 1 mW
+    const int32_t currentMA = (int32_t)current * 100;
+    const int32_t powerMW = (int32_t)voltage * current;
+
+    rollBuckets();
+
+    if (m_hasLastSample)
+    {
+        const uint32_t dtMs = sampleMs - m_lastSampleMs;
+        if (dtMs > MAX_INTEGRATION_GAP_MS)
+        {
+            LOG_WARN(ENERGY, "Gap of %u ms between samples, not integrating", dtMs);
+        }
+        else if (dtMs > 0)
+        {
+            integrate(currentMA, powerMW, dtMs, sampleMs);
+        }
+    }
+
+    m_hasLastSample = true;
+    m_lastCurrentMA = currentMA;
+    m_lastPowerMW = powerMW;
+    m_lastSampleMs = sampleMs;
+
+    maybeCheckpoint(sampleMs);
+}
+
+void EnergyCounter::integrate(int32_t currentMA, int32_t powerMW, uint32_t dtMs, uint32_t sampleMs)
+{
+    EnergyTotals delta;
+    integrateSegment(m_lastCurrentMA, currentMA, dtMs, delta.chargeInUAs, delta.chargeOutUAs);
+    integrateSegment(m_lastPowerMW, powerMW, dtMs, delta.energyInUWs, delta.energyOutUWs);
+
+    portENTER_CRITICAL(&m_lock);
+    m_totals.add(delta);
+    if (m_bucketsCurrent)
+    {
+        m_hourly[m_hourlyPos].totals.add(delta);
+        m_daily[m_dailyPos].totals.add(delta);
+    }
+    portEXIT_CRITICAL(&m_lock);
+    if (!m_bucketsCurrent)
+    {
+        addPending(delta, Clock::fromMillis(sampleMs));
+    }
+
+    m_dirty = true;
+}
+
+void EnergyCounter::addPending(const EnergyTotals &delta, uint64_t nowMs)
+{
+    if (!m_hasPending)
+    {
+        m_hasPending = true;
+        m_pendingSinceMs = nowMs;
+        m_pendingHours = 1;
+        m_pending[0] = EnergyTotals();
+    }
+    const uint32_t hour = (uint32_t)((nowMs - m_pendingSinceMs) / PENDING_SLOT_MS);
+    // Slots of hours that passed without samples, or that go back further than the
+    // daily buckets, start from zero
+    while (m_pendingHours <= hour)
+    {
+        m_pending[m_pendingHours % PENDING_SLOTS] = EnergyTotals();
+        m_pendingHours++;
+    }
+    m_pending[hour % PENDING_SLOTS].add(delta);
+}
+
+// Trapezoidal integration of a linear segment v0 -> v1 over dtMs. If the sign changes
+// within the segment it is split at the zero crossing, so charge and discharge are
+// accounted separately. The negative part is returned as a positive magnitude.
+void EnergyCounter::integrateSegment(int32_t v0, int32_t v1, uint32_t dtMs, int64_t &positive, int64_t &negative)
+{
+    if ((v0 >= 0) == (v1 >= 0))
+    {
+        const int64_t area = ((int64_t)v0 + v1) * dtMs / 2;
+        if (area >= 0)
+            positive += area;
+        else
+            negative -= area;
+        return;
+    }
+
+    const int64_t abs0 = v0 < 0 ? -(int64_t)v0 : v0;
+    const int64_t abs1 = v1 < 0 ? -(int64_t)v1 : v1;
+    const int64_t dt0 = dtMs * abs0 / (abs0 + abs1);
+    const int64_t area0 = abs0 * dt0 / 2;
+    const int64_t area1 = abs1 * ((int64_t)dtMs - dt0) / 2;
+    // Same grouping as above: a segment starting at exactly 0 belongs to the sign of v1
+    if (v0 >= 0)
+    {
+        positive += area0;
+        negative += area1;
+    }
+    else
+    {
+        negative += area0;
+        positive += area1;
+    }
+}
+
+void EnergyCounter::toKeys(uint64_t epochMs, uint32_t &hourKey, uint32_t &dayKey)
+{
+    const time_t time = (time_t)(epochMs / 1000);
+    struct tm timeinfo;
+    localtime_r(&time, &timeinfo);
+    dayKey = (timeinfo.tm_year + 1900) * 10000 + (timeinfo.tm_mon + 1) * 100 + timeinfo.tm_mday;
+    hourKey = dayKey * 100 + timeinfo.tm_hour;
+}
+
+uint32_t EnergyCounter::msToNextHour(uint64_t epochMs)
+{
+    const time_t time = (time_t)(epochMs / 1000);
+    struct tm timeinfo;
+    localtime_r(&time, &timeinfo);
+    return (uint32_t)(3600 - timeinfo.tm_min * 60 - timeinfo.tm_sec) * 1000 - (uint32_t)(epochMs % 1000);
+}
+
+void EnergyCounter::rollBuckets()
+{
+    const uint64_t nowEpochMs = Clock::epochMs();
+    if (nowEpochMs == 0)
+    {
+        // Counted into m_pending until the time is known
+        m_bucketsCurrent = false;
+        return;
+    }
+    if (m_hasPending)
+    {
+        bookPending();
+    }
+
+    uint32_t hourKey;
+    uint32_t dayKey;
+    toKeys(nowEpochMs, hourKey, dayKey);
+    portENTER_CRITICAL(&m_lock);
+    if (m_hourly[m_hourlyPos].key != hourKey)
+    {
+        openBucket(m_hourly, m_hourlyPos, hourKey);
+    }
+    if (m_daily[m_dailyPos].key != dayKey)
+    {
+        openBucket(m_daily, m_dailyPos, dayKey);
+    }
+    portEXIT_CRITICAL(&m_lock);
+    m_bucketsCurrent = true;
+}
+
+// The energy counted before the first sync goes to the hours and days it was counted in,
+// now that the monotonic clock maps to them. Slots are hours of the monotonic clock, not
+// of local time, so a slot that spans the turn of an hour is split in proportion to the
+// time on either side.
+void EnergyCounter::bookPending()
+{
+    m_hasPending = false;
+    const uint64_t nowMs = Clock::nowMs();
+    const uint32_t oldest = m_pendingHours > (uint32_t)PENDING_SLOTS ? m_pendingHours - PENDING_SLOTS : 0;
+    uint32_t firstHourKey = 0;
+    for (uint32_t hour = oldest; hour < m_pendingHours; ++hour)
+    {
+        const EnergyTotals &slot = m_pending[hour % PENDING_SLOTS];
+        const uint64_t startMs = m_pendingSinceMs + (uint64_t)hour * PENDING_SLOT_MS;
+        const uint64_t startEpochMs = Clock::toEpochMs(startMs);
+        if (slot.isEmpty() || startEpochMs == 0 || nowMs <= startMs)
+        {
+            continue;
+        }
+        const int64_t span = (int64_t)std::min<uint64_t>(PENDING_SLOT_MS, nowMs - startMs);
+        const int64_t before = std::min<int64_t>(span, msToNextHour(startEpochMs));
+        EnergyTotals head;
+        head.chargeInUAs = slot.chargeInUAs * before / span;
+        head.chargeOutUAs = slot.chargeOutUAs * before / span;
+        head.energyInUWs = slot.energyInUWs * before / span;
+        head.energyOutUWs = slot.energyOutUWs * before / span;
+        EnergyTotals tail;
+        tail.chargeInUAs = slot.chargeInUAs - head.chargeInUAs;
+        tail.chargeOutUAs = slot.chargeOutUAs - head.chargeOutUAs;
+        tail.energyInUWs = slot.energyInUWs - head.energyInUWs;
+        tail.energyOutUWs = slot.energyOutUWs - head.energyOutUWs;
+        uint32_t hourKey;
+        uint32_t dayKey;
+        toKeys(startEpochMs, hourKey, dayKey);
+        if (firstHourKey == 0)
+        {
+            firstHourKey = hourKey;
+        }
+        book(head, hourKey, dayKey);
+        if (!tail.isEmpty())
+        {
+            toKeys(startEpochMs + before, hourKey, dayKey);
+            book(tail, hourKey, dayKey);
+        }
+    }
+    m_bucketRolled = true;
+    LOG_INFO(ENERGY, "Energy counted before the time sync booked from %u on", firstHourKey);
+}
+
+void EnergyCounter::book(const EnergyTotals &totals, uint32_t hourKey, uint32_t dayKey)
+{
+    portENTER_CRITICAL(&m_lock);
+    totalsFor(m_hourly, m_hourlyPos, hourKey).add(totals);
+    totalsFor(m_daily, m_dailyPos, dayKey).add(totals);
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void EnergyCounter::getSnapshot(Snapshot &out) const
+{
+    portENTER_CRITICAL(&m_lock);
+    out.totals = m_totals;
+    for (int i = 0; i < HOURLY_BUCKETS; ++i)
+    {
+        out.hourly[i] = getHourly(i);
+    }
+    for (int i = 0; i < DAILY_BUCKETS; ++i)
+    {
+        out.daily[i] = getDaily(i);
+    }
+    portEXIT_CRITICAL(&m_lock);
+}
+
+template <int SIZE>
+void EnergyCounter::openBucket(EnergyBucket (&buckets)[SIZE], uint8_t &pos, uint32_t key)
+{
+    pos = (pos + 1) % SIZE;
+    buckets[pos] = EnergyBucket();
+    buckets[pos].key = key;
+    m_bucketRolled = true;
+}
+
+// A later key than the current bucket's opens a new bucket, an earlier one goes to the
+// bucket that has it
+template <int SIZE>
+EnergyTotals &EnergyCounter::totalsFor(EnergyBucket (&buckets)[SIZE], uint8_t &pos, uint32_t key)
+{
+    if (key > buckets[pos].key)
+    {
+        openBucket(buckets, pos, key);
+        return buckets[pos].totals;
+    }
+    for (int i = 0; i < SIZE; ++i)
+    {
+        EnergyBucket &bucket = buckets[(pos + SIZE - i) % SIZE];
+        if (bucket.key == key)
+        {
+            return bucket.totals;
+        }
+    }
+    // Older than anything kept, or the clock was set back: nowhere better than the current one
+    return buckets[pos].totals;
+}
+
+void EnergyCounter::maybeCheckpoint(uint32_t nowMs)
+{
+    if (!m_dirty || nowMs - m_lastCheckpointMs < CHECKPOINT_INTERVAL_MS)
+    {
+        return;
+    }
+
+    const int64_t moved = m_totals.chargeInUAs + m_totals.chargeOutUAs - m_chargeAtCheckpointUAs;
+    if (moved < CHECKPOINT_MIN_DELTA_UAS && !m_bucketRolled)
+    {
+        return;
+    }
+
+    writeCheckpoint(nowMs);
+}
+
+void EnergyCounter::flush()
+{
+    if (m_dirty)
+    {
+        writeCheckpoint(millis());
+    }
+}
+
+void EnergyCounter::writeCheckpoint(uint32_t nowMs)
+{
+    if (!m_prefsOpen)
+    {
+        return;
+    }
+
+    PersistedState state;
+    state.version = STATE_VERSION;
+    state.totals = m_totals;
+    memcpy(state.hourly, m_hourly, sizeof(state.hourly));
+    memcpy(state.daily, m_daily, sizeof(state.daily));
+    state.hourlyPos = m_hourlyPos;
+    state.dailyPos = m_dailyPos;
+
+    if (m_prefs.putBytes(ENERGY_NVS_KEY, &state, sizeof(state)) != sizeof(state))
+    {
+        LOG_ERROR(ENERGY, "Writing checkpoint failed");
+        return;
+    }
+
+    m_dirty = false;
+    m_bucketRolled = false;
+    m_chargeAtCheckpointUAs = m_totals.chargeInUAs + m_totals.chargeOutUAs;
+    m_lastCheckpointMs = nowMs;
+    m_checkpointCount++;
+    LOG_DEBUG(ENERGY, "Checkpoint written (%u)", m_checkpointCount);
+}
@@ -0,0 +1,146 @@
+// EnergyCounter.h
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Charge and energy moved in/out of the battery. All values are kept as integers
+// in micro units (uAs = mA*ms, uWs = mW*ms) so integration does not lose the
+// small increments between 10 s polls.
+struct EnergyTotals
+{
+    int64_t chargeInUAs = 0;
+    int64_t chargeOutUAs = 0;
+    int64_t energyInUWs = 0;
+    int64_t energyOutUWs = 0;
+
+    int32_t chargeInMAh() const { return (int32_t)(chargeInUAs / 3600000LL); }
+    int32_t chargeOutMAh() const { return (int32_t)(chargeOutUAs / 3600000LL); }
+    int32_t energyInWh() const { return (int32_t)(energyInUWs / 3600000000LL); }
+    int32_t energyOutWh() const { return (int32_t)(energyOutUWs / 3600000000LL); }
+
+    void add(const EnergyTotals &other)
+    {
+        chargeInUAs += other.chargeInUAs;
+        chargeOutUAs += other.chargeOutUAs;
+        energyInUWs += other.energyInUWs;
+        energyOutUWs += other.energyOutUWs;
+    }
+
+    bool isEmpty() const { return chargeInUAs == 0 && chargeOutUAs == 0 && energyInUWs == 0 && energyOutUWs == 0; }
+};
+
+struct EnergyBucket
+{
+    uint32_t key = 0; // local time, YYYYMMDDHH for hourly and YYYYMMDD for daily buckets, 0 = time unknown
+    EnergyTotals totals;
+};
+
+// Integrated from the loop task. The web server reads a Snapshot from the AsyncTCP task;
+// every change of the totals and buckets holds a short critical section, so a snapshot
+// never has a torn 64 bit value or a half opened bucket.
+class EnergyCounter
+{
+public:
+    static constexpr int HOURLY_BUCKETS = 24;
+    static constexpr int DAILY_BUCKETS = 7;
+
+    // index 0 is the current bucket, higher indices go back in time
+    struct Snapshot
+    {
+        EnergyTotals totals;
+        EnergyBucket hourly[HOURLY_BUCKETS];
+        EnergyBucket daily[DAILY_BUCKETS];
+    };
+
+    // Polls are 10 s apart, anything much longer means we missed samples and
+    // interpolating across the gap would only invent energy
+    static constexpr uint32_t MAX_INTEGRATION_GAP_MS = 60000;
+    // NVS wear limiting: at most one write per interval, and only once enough
+    // has accumulated (or a bucket rolled over) to be worth persisting
+    static constexpr uint32_t CHECKPOINT_INTERVAL_MS = 15 * 60 * 1000;
+    static constexpr int64_t CHECKPOINT_MIN_DELTA_UAS = 100LL * 3600000LL; // 100 mAh
+    // Energy counted before the first time sync is kept per hour of the monotonic clock,
+    // as far back as the daily buckets go
+    static constexpr uint32_t PENDING_SLOT_MS = 60 * 60 * 1000;
+    static constexpr int PENDING_SLOTS = DAILY_BUCKETS * 24;
+
+    void init();
+    // voltage in 0.01V, current in 0.1A (positive = charging), as reported by the BMS
+    void addSample(uint16_t voltage, int16_t current, uint32_t sampleMs);
+    // Write pending changes regardless of the interval, e.g. before a planned restart
+    void flush();
+
+    // Any task
+    void getSnapshot(Snapshot &out) const;
+    // Loop task only. index 0 is the current bucket, higher indices go back in time
+    const EnergyTotals &getTotals() const { return m_totals; }
+    const EnergyBucket &getHourly(int index) const { return m_hourly[(m_hourlyPos + HOURLY_BUCKETS - index) % HOURLY_BUCKETS]; }
+    const EnergyBucket &getDaily(int index) const { return m_daily[(m_dailyPos + DAILY_BUCKETS - index) % DAILY_BUCKETS]; }
+    uint32_t getCheckpointCount() const { return m_checkpointCount; }
+
+private:
+    static constexpr uint32_t STATE_VERSION = 1;
+
+    struct PersistedState
+    {
+        uint32_t version;
+        EnergyTotals totals;
+        EnergyBucket hourly[HOURLY_BUCKETS];
+        EnergyBucket daily[DAILY_BUCKETS];
+        uint8_t hourlyPos;
+        uint8_t dailyPos;
+    };
+
+    Preferences m_prefs;
+    bool m_prefsOpen = false;
+
+    // Guards m_totals, m_hourly, m_daily and their positions. Nothing that may block runs
+    // under it, localtime_r() and logging included.
+    mutable portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+    EnergyTotals m_totals;
+    EnergyBucket m_hourly[HOURLY_BUCKETS];
+    EnergyBucket m_daily[DAILY_BUCKETS];
+    uint8_t m_hourlyPos = 0;
+    uint8_t m_dailyPos = 0;
+
+    bool m_hasLastSample = false;
+    int32_t m_lastCurrentMA = 0;
+    int32_t m_lastPowerMW = 0;
+    uint32_t m_lastSampleMs = 0;
+    bool m_bucketsCurrent = false; // rollBuckets() knew the time, the current buckets are this hour's and day's
+
+    // Until the time is known the buckets are left alone, they may be restored from NVS
+    // with the key of an hour long past. What is counted meanwhile waits here, hour n since
+    // m_pendingSinceMs in slot n % PENDING_SLOTS, and is booked to the hours and days it
+    // belongs to at the first sync. Not persisted: without a sync before the next restart
+    // only the totals keep it.
+    EnergyTotals m_pending[PENDING_SLOTS];
+    bool m_hasPending = false;
+    uint64_t m_pendingSinceMs = 0; // Clock::nowMs() of the first pending energy
+    uint32_t m_pendingHours = 0;   // hours since m_pendingSinceMs that were given a slot
+
+    bool m_dirty = false;
+    bool m_bucketRolled = false;
+    int64_t m_chargeAtCheckpointUAs = 0;
+    uint32_t m_lastCheckpointMs = 0;
+    uint32_t m_checkpointCount = 0;
+
+    void integrate(int32_t currentMA, int32_t powerMW, uint32_t dtMs, uint32_t sampleMs);
+    void addPending(const EnergyTotals &delta, uint64_t nowMs);
+    void rollBuckets();
+    void bookPending();
+    void book(const EnergyTotals &totals, uint32_t hourKey, uint32_t dayKey);
+
+    static void toKeys(uint64_t epochMs, uint32_t &hourKey, uint32_t &dayKey);
+    static uint32_t msToNextHour(uint64_t epochMs);
+    template <int SIZE>
+    void openBucket(EnergyBucket (&buckets)[SIZE], uint8_t &pos, uint32_t key);
+    template <int SIZE>
+    EnergyTotals &totalsFor(EnergyBucket (&buckets)[SIZE], uint8_t &pos, uint32_t key);
+    void maybeCheckpoint(uint32_t nowMs);
+    void writeCheckpoint(uint32_t nowMs);
+    void loadCheckpoint();
+
+    static void integrateSegment(int32_t v0, int32_t v1, uint32_t dtMs, int64_t &positive, int64_t &negative);
+};
@@ -0,0 +1,114 @@
+// FixedPoint.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Decimal fixed-point numbers for the data path. The C3 has no FPU, so every float
+// operation and every float printf is a soft-float library call; the BMS already
+// delivers scaled integers (0.01V, 0.1A, mV, 0.1°C), so we keep them that way and
+// only place the decimal point when formatting.
+struct Fixed
+{
+    int32_t raw;      // value * 10^decimals
+    uint8_t decimals;
+
+    constexpr Fixed(int32_t raw, uint8_t decimals) : raw(raw), decimals(decimals) {}
+
+    // Writes the decimal representation (e.g. "-12.34") and a terminating NUL,
+    // returns the number of characters written without the NUL
+    size_t format(char *buf, size_t size) const
+    {
+        char tmp[16];
+        size_t len = 0;
+        uint32_t magnitude = raw < 0 ? 0u - (uint32_t)raw : (uint32_t)raw;
+
+        // Digits are produced in reverse order
+        for (uint8_t i = 0; i < decimals; ++i)
+        {
+            tmp[len++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        }
+        if (decimals > 0)
+        {
+            tmp[len++] = '.';
+        }
+        do
+        {
+            tmp[len++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if (raw < 0)
+        {
+            tmp[len++] = '-';
+        }
+
+        if (size == 0)
+        {
+            return 0;
+        }
+        size_t out = len < size - 1 ? len : size - 1;
+        for (size_t i = 0; i < out; ++i)
+        {
+            buf[i] = tmp[len - 1 - i];
+        }
+        buf[out] = '\0';
+        return out;
+    }
+
+    // Same value with a different number of decimals, rounded half away from zero
+    constexpr Fixed rescale(uint8_t newDecimals) const
+    {
+        if (newDecimals >= decimals)
+        {
+            return Fixed(raw * pow10(newDecimals - decimals), newDecimals);
+        }
+        const int32_t div = pow10(decimals - newDecimals);
+        return Fixed(raw >= 0 ? (raw + div / 2) / div : (raw - div / 2) / div, newDecimals);
+    }
+
+    constexpr Fixed abs() const { return Fixed(raw < 0 ? -raw : raw, decimals); }
+
+    static constexpr int32_t pow10(uint8_t exponent)
+    {
+        int32_t result = 1;
+        while (exponent-- > 0)
+            result *= 10;
+        return result;
+    }
+};
+
+// Small stack buffer holding a formatted Fixed, for use in printf style calls:
+// LOG_INFO(BATTERY, "%sV", FixedText(Fixed(voltage, 2)).c_str());
+class FixedText
+{
+public:
+    explicit FixedText(Fixed value) { value.format(m_text, sizeof(m_text)); }
+    const char *c_str() const { return m_text; }
+
+private:
+    char m_text[16];
+};
+
+// Integer square root, used for standard deviations without touching the FPU emulation
+inline uint32_t isqrt64(uint64_t value)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value)
+        bit >>= 2;
+    while (bit != 0)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
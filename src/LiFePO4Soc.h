@@ -0,0 +1,82 @@
+// LiFePO4Soc.h
+#pragma once
+
+#include <stdint.h>
+
+// Voltage based state of charge for a single LiFePO4 cell, integer only (the C3 has no FPU).
+namespace LiFePO4Soc
+{
+    // Open circuit voltage in mV for each SOC percentage (0-100%), at 25°C
+    constexpr uint16_t OCV_TABLE_MV[101] = {
+        /* 0% */ 2500, /* 1% */ 2569, /* 2% */ 2638, /* 3% */ 2707, /* 4% */ 2776,
+        /* 5% */ 2800, /* 6% */ 2844, /* 7% */ 2889, /* 8% */ 2933, /* 9% */ 2978,
+        /* 10% */ 3017, /* 11% */ 3050, /* 12% */ 3083, /* 13% */ 3117, /* 14% */ 3150,
+        /* 15% */ 3159, /* 16% */ 3168, /* 17% */ 3178, /* 18% */ 3187, /* 19% */ 3196,
+        /* 20% */ 3205, /* 21% */ 3208, /* 22% */ 3210, /* 23% */ 3213, /* 24% */ 3215,
+        /* 25% */ 3218, /* 26% */ 3220, /* 27% */ 3223, /* 28% */ 3225, /* 29% */ 3228,
+        /* 30% */ 3230, /* 31% */ 3232, /* 32% */ 3234, /* 33% */ 3236, /* 34% */ 3238,
+        /* 35% */ 3240, /* 36% */ 3242, /* 37% */ 3244, /* 38% */ 3246, /* 39% */ 3248,
+        /* 40% */ 3250, /* 41% */ 3251, /* 42% */ 3252, /* 43% */ 3253, /* 44% */ 3254,
+        /* 45% */ 3255, /* 46% */ 3256, /* 47% */ 3257, /* 48% */ 3258, /* 49% */ 3259,
+        /* 50% */ 3260, /* 51% */ 3262, /* 52% */ 3264, /* 53% */ 3266, /* 54% */ 3268,
+        /* 55% */ 3270, /* 56% */ 3272, /* 57% */ 3274, /* 58% */ 3276, /* 59% */ 3278,
+        /* 60% */ 3280, /* 61% */ 3282, /* 62% */ 3284, /* 63% */ 3286, /* 64% */ 3288,
+        /* 65% */ 3290, /* 66% */ 3292, /* 67% */ 3294, /* 68% */ 3296, /* 69% */ 3298,
+        /* 70% */ 3300, /* 71% */ 3303, /* 72% */ 3306, /* 73% */ 3309, /* 74% */ 3312,
+        /* 75% */ 3315, /* 76% */ 3318, /* 77% */ 3321, /* 78% */ 3324, /* 79% */ 3327,
+        /* 80% */ 3330, /* 81% */ 3332, /* 82% */ 3334, /* 83% */ 3336, /* 84% */ 3338,
+        /* 85% */ 3340, /* 86% */ 3342, /* 87% */ 3344, /* 88% */ 3346, /* 89% */ 3348,
+        /* 90% */ 3350, /* 91% */ 3353, /* 92% */ 3357, /* 93% */ 3360, /* 94% */ 3363,
+        /* 95% */ 3367, /* 96% */ 3370, /* 97% */ 3373, /* 98% */ 3377, /* 99% */ 3380,
+        /* 100% */ 3650};
+
+    // OCV drops slightly when the cell is cold, roughly 0.3 mV per °C below 25°C
+    constexpr int32_t REFERENCE_TEMP_DECI_C = 250;
+    constexpr int32_t TEMP_COEFF_UV_PER_DECI_C = 30;
+
+    constexpr bool isStrictlyIncreasing()
+    {
+        for (int i = 1; i <= 100; ++i)
+        {
+            if (OCV_TABLE_MV[i] <= OCV_TABLE_MV[i - 1])
+                return false;
+        }
+        return true;
+    }
+    static_assert(isStrictlyIncreasing(), "OCV table must be strictly increasing for the binary search");
+
+    // Returns the SOC in 0.1% (0..1000) for the given cell voltage in mV and temperature in 0.1°C,
+    // linearly interpolated between the 1% table points
+    constexpr int16_t socPermille(uint16_t cellMillivolts, int16_t temperatureDeciC = REFERENCE_TEMP_DECI_C)
+    {
+        // Compensate in uV to keep the sub-mV part for the interpolation
+        const int32_t compensatedUv = (int32_t)cellMillivolts * 1000 + (REFERENCE_TEMP_DECI_C - temperatureDeciC) * TEMP_COEFF_UV_PER_DECI_C;
+
+        if (compensatedUv <= (int32_t)OCV_TABLE_MV[0] * 1000)
+            return 0;
+        if (compensatedUv >= (int32_t)OCV_TABLE_MV[100] * 1000)
+            return 1000;
+
+        // Find the first entry above the voltage
+        int lo = 0;
+        int hi = 100;
+        while (hi - lo > 1)
+        {
+            const int mid = (lo + hi) / 2;
+            if ((int32_t)OCV_TABLE_MV[mid] * 1000 <= compensatedUv)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        const int32_t spanUv = ((int32_t)OCV_TABLE_MV[hi] - OCV_TABLE_MV[lo]) * 1000;
+        const int32_t offsetUv = compensatedUv - (int32_t)OCV_TABLE_MV[lo] * 1000;
+        return (int16_t)(lo * 10 + offsetUv * 10 / spanUv);
+    }
+
+    static_assert(socPermille(2400) == 0, "below table");
+    static_assert(socPermille(3260) == 500, "exact table point");
+    static_assert(socPermille(3261) == 505, "interpolated");
+    static_assert(socPermille(3700) == 1000, "above table");
+    static_assert(socPermille(3260, 50) > socPermille(3260), "cold cells read higher SOC");
+}
@@ -5,8 +5,12 @@
 #include <vector>
 #include <string>
 #include <cstdarg>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
-//#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "LogRing.h"
+#include "BinaryLog.h"
+#include "CrashStore.h"
 
 enum class LogLevel {
     DEBUG = 0,
@@ -17,6 +21,19 @@ enum class LogLevel {
     NONE = 5
 };
 
+// Each module has its own runtime level, see LogClass::setModuleLevel and /loglevel
+enum class LogModule : uint8_t {
+    GENERAL = 0,
+    BLE,
+    TDT,
+    WIFI,
+    WEB,
+    TIME,
+    BATTERY,
+    ENERGY,
+    COUNT
+};
+
 #ifndef LOG_LEVEL_SERIAL
 #define LOG_LEVEL_SERIAL LogLevel::DEBUG
 #endif
@@ -25,124 +42,188 @@ enum class LogLevel {
 #define LOG_LEVEL_GUI LogLevel::INFO
 #endif
 
-struct LogEntry {
-    unsigned long timestamp;
-    LogLevel level;
-    std::string message;
-};
+// LOG_* calls below this level are compiled out, including the evaluation of their
+// arguments, e.g. -DLOG_LEVEL_FLOOR=LogLevel::INFO
+#ifndef LOG_LEVEL_FLOOR
+#define LOG_LEVEL_FLOOR LogLevel::DEBUG
+#endif
+
+// At most this many debug and info messages per module and second, the rest is counted
+// and reported with the next message that gets through
+#ifndef LOG_RATE_LIMIT
+#define LOG_RATE_LIMIT 20
+#endif
+
+// The same message of a module again within this time is counted instead of logged
+#ifndef LOG_DEDUP_INTERVAL_MS
+#define LOG_DEDUP_INTERVAL_MS 30000
+#endif
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 64
+#endif
+
+// Lines between the loggers and the serial drain task; when Serial cannot keep up the
+// oldest lines are overwritten and counted as dropped
+#ifndef LOG_SERIAL_RING_SIZE
+#define LOG_SERIAL_RING_SIZE 32
+#endif
+
+// Build with -DLOG_BINARY to record debug and info messages unformatted into a binary ring
+// (see BinaryLog.h and /logs.bin) instead of formatting them for Serial and /logs.
+// Warnings and above are always formatted.
+#ifndef LOG_BINARY_RING_SIZE
+#define LOG_BINARY_RING_SIZE 128
+#endif
+
+// LOG_INFO(WIFI, "Connected to %s", ssid) logs "[WIFI] Connected to ..." if the level passes
+// the compile time floor and the module's runtime level; otherwise the arguments are not
+// even evaluated.
+#define LOG_AT(level, module, ...)                                                          \
+    do {                                                                                    \
+        if ((level) >= LOG_LEVEL_FLOOR && Log.isEnabled(LogModule::module, (level))) {      \
+            Log.write(LogModule::module, (level), __VA_ARGS__);                             \
+        }                                                                                   \
+    } while (0)
+#define LOG_DEBUG(module, ...) LOG_AT(LogLevel::DEBUG, module, __VA_ARGS__)
+#define LOG_INFO(module, ...) LOG_AT(LogLevel::INFO, module, __VA_ARGS__)
+#define LOG_WARN(module, ...) LOG_AT(LogLevel::WARNING, module, __VA_ARGS__)
+#define LOG_ERROR(module, ...) LOG_AT(LogLevel::ERROR, module, __VA_ARGS__)
+#define LOG_CRITICAL(module, ...) LOG_AT(LogLevel::CRITICAL, module, __VA_ARGS__)
 
 class LogClass {
 public:
+    using Ring = LogRing<LogRecord, LOG_RING_SIZE>;
+    using SerialRing = LogRing<SerialLogRecord, LOG_SERIAL_RING_SIZE>;
+
     LogClass() {
-        /*logMutex = xSemaphoreCreateMutex();
-        if (logMutex == nullptr) {
-            Serial.println("Failed to create log mutex!");
-        }*/
+        for (auto& level : moduleLevels) {
+            level.store((uint8_t)LogLevel::DEBUG, std::memory_order_relaxed);
+        }
     }
 
-    ~LogClass() {
-        /*
-        if (logMutex != nullptr) {
-            vSemaphoreDelete(logMutex);
-        }*/
+    // Prefer the LOG_* macros, they skip the arguments of disabled messages
+    __attribute__((format(printf, 4, 5)))
+    void write(LogModule module, LogLevel level, const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+#ifdef LOG_BINARY
+        if (level <= LogLevel::INFO) {
+            logBinary(module, level, format, args);
+        } else {
+            log(module, level, format, args);
+        }
+#else
+        log(module, level, format, args);
+#endif
+        va_end(args);
     }
 
     void debug(const char* format, ...) {
         va_list args;
         va_start(args, format);
-        log(LogLevel::DEBUG, format, args);
+#ifdef LOG_BINARY
+        logBinary(LogModule::GENERAL, LogLevel::DEBUG, format, args);
+#else
+        log(LogModule::GENERAL, LogLevel::DEBUG, format, args);
+#endif
         va_end(args);
     }
 
     void info(const char* format, ...) {
         va_list args;
         va_start(args, format);
-        log(LogLevel::INFO, format, args);
+#ifdef LOG_BINARY
+        logBinary(LogModule::GENERAL, LogLevel::INFO, format, args);
+#else
+        log(LogModule::GENERAL, LogLevel::INFO, format, args);
+#endif
         va_end(args);
     }
 
     void warn(const char* format, ...) {
         va_list args;
         va_start(args, format);
-        log(LogLevel::WARNING, format, args);
+        log(LogModule::GENERAL, LogLevel::WARNING, format, args);
         va_end(args);
     }
 
     void error(const char* format, ...) {
         va_list args;
         va_start(args, format);
-        log(LogLevel::ERROR, format, args);
+        log(LogModule::GENERAL, LogLevel::ERROR, format, args);
         va_end(args);
     }
 
     void critical(const char* format, ...) {
         va_list args;
         va_start(args, format);
-        log(LogLevel::CRITICAL, format, args);
+        log(LogModule::GENERAL, LogLevel::CRITICAL, format, args);
         va_end(args);
     }
 
-    /*std::vector<LogEntry> getLogEntries() const {
-        std::vector<LogEntry> entriesCopy;
-        
-        if (logMutex != nullptr && xSemaphoreTake(logMutex, portMAX_DELAY) == pdTRUE) {
-            entriesCopy = logEntries;
-            xSemaphoreGive(logMutex);
+    // Logging never writes to Serial itself, it only queues the line for a low priority
+    // task, so a slow or absent USB CDC host cannot block a logger (e.g. the NimBLE host
+    // task). Lines logged before this is called are printed once the task runs.
+    void startSerialDrain() {
+        TaskHandle_t task = nullptr;
+        if (serialTask.load() == nullptr &&
+            xTaskCreate(serialDrainTask, "LogDrain", 3072, this, tskIDLE_PRIORITY + 1, &task) == pdPASS) {
+            serialTask.store(task);
         }
-        
-        return entriesCopy;
     }
 
-    void clearLogEntries() {
-        if (logMutex != nullptr && xSemaphoreTake(logMutex, portMAX_DELAY) == pdTRUE) {
-            logEntries.clear();
-            xSemaphoreGive(logMutex);
+    // Waits until the queued lines are printed, e.g. before a restart or sleep
+    void flushSerial(uint32_t timeoutMs) {
+        const TaskHandle_t task = serialTask.load();
+        const uint32_t start = millis();
+        while (task != nullptr && serialCursor.load() != serialRing.getEndSeq() && millis() - start < timeoutMs) {
+            xTaskNotifyGive(task);
+            delay(5);
         }
-    }*/
+    }
 
-private:
-    std::vector<LogEntry> logEntries;
-    //SemaphoreHandle_t logMutex;
+    // Lines that never made it to Serial
+    uint32_t getSerialDropped() const {
+        return serialDropped.load(std::memory_order_relaxed) + serialRing.getDropped();
+    }
 
-    void log(LogLevel level, const char* format, va_list args) {
-        if (level < LOG_LEVEL_SERIAL && level < LOG_LEVEL_GUI) {
-            return;
-        }
+    bool isEnabled(LogModule module, LogLevel level) const {
+        return (uint8_t)level >= moduleLevels[(int)module].load(std::memory_order_relaxed) &&
+               (level >= LOG_LEVEL_SERIAL || level >= LOG_LEVEL_GUI);
+    }
 
-        char buffer[256];
-        vsnprintf(buffer, sizeof(buffer), format, args);
-        
-        unsigned long currentTime = millis();
-        
-        if (level >= LOG_LEVEL_SERIAL) {
-            unsigned long seconds = currentTime / 1000;
-            unsigned long minutes = seconds / 60;
-            seconds %= 60;
-            unsigned long milliseconds = currentTime % 1000;
-            
-            Serial.printf("%lum %lu.%02lus %s: %s\n", minutes, seconds, milliseconds / 10, 
-                          levelToString(level), buffer);
-        }
-        
-        /*if (level >= LOG_LEVEL_GUI) {
-            if (logMutex != nullptr && xSemaphoreTake(logMutex, portMAX_DELAY) == pdTRUE) {
-                LogEntry entry;
-                entry.timestamp = currentTime;
-                entry.level = level;
-                entry.message = buffer;
-                logEntries.push_back(entry);
-                
-                constexpr size_t MAX_LOG_ENTRIES = 100;
-                if (logEntries.size() > MAX_LOG_ENTRIES) {
-                    logEntries.erase(logEntries.begin());
-                }
-                
-                xSemaphoreGive(logMutex);
-            }
-        }*/
+    // Takes effect immediately, from any task
+    void setModuleLevel(LogModule module, LogLevel level) {
+        moduleLevels[(int)module].store((uint8_t)level, std::memory_order_relaxed);
+    }
+
+    LogLevel getModuleLevel(LogModule module) const {
+        return (LogLevel)moduleLevels[(int)module].load(std::memory_order_relaxed);
+    }
+
+    // Messages dropped by the rate limit and repeats folded into a "repeated" note
+    uint32_t getSuppressed() const {
+        return suppressedTotal.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getRepeated() const {
+        return repeatedTotal.load(std::memory_order_relaxed);
+    }
+
+    // The most recent records at or above LOG_LEVEL_GUI, e.g. for the /logs endpoint
+    const Ring& getRing() const {
+        return ring;
+    }
+
+#ifdef LOG_BINARY
+    using BinaryRing = LogRing<BinaryLogRecord, LOG_BINARY_RING_SIZE>;
+    const BinaryRing& getBinaryRing() const {
+        return binaryRing;
     }
-    
-    const char* levelToString(LogLevel level) {
+#endif
+
+    static const char* levelToString(LogLevel level) {
         switch (level) {
             case LogLevel::DEBUG:    return "DEBUG";
             case LogLevel::INFO:     return "INFO";
@@ -152,11 +233,283 @@ private:
             default:       return "UNKNOWN";
         }
     }
+
+    static const char* moduleToString(LogModule module) {
+        switch (module) {
+            case LogModule::GENERAL: return "GENERAL";
+            case LogModule::BLE:     return "BLE";
+            case LogModule::TDT:     return "TDT";
+            case LogModule::WIFI:    return "WIFI";
+            case LogModule::WEB:     return "WEB";
+            case LogModule::TIME:    return "TIME";
+            case LogModule::BATTERY: return "BATTERY";
+            case LogModule::ENERGY:  return "ENERGY";
+            default:       return "UNKNOWN";
+        }
+    }
+
+    // Case insensitive, false for an unknown name
+    static bool parseLevel(const char* name, LogLevel& level) {
+        for (int i = (int)LogLevel::DEBUG; i <= (int)LogLevel::NONE; ++i) {
+            const char* candidate = i == (int)LogLevel::NONE ? "NONE" : levelToString((LogLevel)i);
+            if (strcasecmp(name, candidate) == 0) {
+                level = (LogLevel)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool parseModule(const char* name, LogModule& module) {
+        for (int i = 0; i < (int)LogModule::COUNT; ++i) {
+            if (strcasecmp(name, moduleToString((LogModule)i)) == 0) {
+                module = (LogModule)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Rate limit and repeat detection state of one module
+    struct Gate {
+        uint32_t windowStartMs = 0;
+        uint16_t windowCount = 0;
+        uint32_t suppressed = 0; // by the rate limit, not reported yet
+        uint32_t lastHash = 0;
+        uint32_t lastLoggedMs = 0;
+        uint8_t lastLevel = 0;
+        uint32_t repeats = 0;    // of the last message, not reported yet
+    };
+
+    Ring ring;
+    SerialRing serialRing;
+    std::atomic<TaskHandle_t> serialTask{nullptr};
+    std::atomic<uint32_t> serialCursor{0}; // next line to print
+    std::atomic<uint32_t> serialDropped{0};
+    std::atomic<uint8_t> moduleLevels[(int)LogModule::COUNT];
+    Gate gates[(int)LogModule::COUNT];
+    portMUX_TYPE gateLock = portMUX_INITIALIZER_UNLOCKED;
+    std::atomic<uint32_t> suppressedTotal{0};
+    std::atomic<uint32_t> repeatedTotal{0};
+
+    static void serialDrainTask(void* param);
+
+    static uint32_t hash(const void* data, size_t len, uint32_t value = 2166136261u) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < len; ++i) {
+            value = (value ^ bytes[i]) * 16777619u;
+        }
+        return value;
+    }
+
+    // Fixed one second windows; warnings and above are never rate limited. Reports the
+    // number of messages suppressed in the previous window when a new one starts.
+    bool passRateLimit(LogModule module, LogLevel level, uint32_t now) {
+        if (level > LogLevel::INFO) {
+            return true;
+        }
+        uint32_t suppressed = 0;
+        bool pass;
+        portENTER_CRITICAL(&gateLock);
+        Gate& gate = gates[(int)module];
+        if (now - gate.windowStartMs >= 1000) {
+            gate.windowStartMs = now;
+            gate.windowCount = 0;
+            suppressed = gate.suppressed;
+            gate.suppressed = 0;
+        }
+        pass = gate.windowCount < LOG_RATE_LIMIT;
+        if (pass) {
+            gate.windowCount++;
+        } else {
+            gate.suppressed++;
+        }
+        portEXIT_CRITICAL(&gateLock);
+
+        if (!pass) {
+            suppressedTotal.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (suppressed > 0) {
+            note(module, LogLevel::WARNING, now, "%u messages suppressed by the rate limit", suppressed);
+        }
+        return pass;
+    }
+
+    // True if the message with this hash is a repeat of the module's last one. Otherwise
+    // reports how often the previous message was repeated.
+    bool isRepeat(LogModule module, LogLevel level, uint32_t messageHash, uint32_t now) {
+        uint32_t repeats = 0;
+        LogLevel repeatLevel = level;
+        bool repeat;
+        portENTER_CRITICAL(&gateLock);
+        Gate& gate = gates[(int)module];
+        repeat = messageHash == gate.lastHash && now - gate.lastLoggedMs < LOG_DEDUP_INTERVAL_MS;
+        if (repeat) {
+            gate.repeats++;
+        } else {
+            repeats = gate.repeats;
+            repeatLevel = (LogLevel)gate.lastLevel;
+            gate.repeats = 0;
+            gate.lastHash = messageHash;
+            gate.lastLoggedMs = now;
+            gate.lastLevel = (uint8_t)level;
+        }
+        portEXIT_CRITICAL(&gateLock);
+
+        if (repeat) {
+            repeatedTotal.fetch_add(1, std::memory_order_relaxed);
+        } else if (repeats > 0) {
+            note(module, repeatLevel, now, "Last message repeated %u times", repeats);
+        }
+        return repeat;
+    }
+
+#ifdef LOG_BINARY
+    BinaryRing binaryRing;
+
+    // No formatting and no Serial output, just a copy of the arguments. The module goes
+    // into the upper half of the level byte.
+    void logBinary(LogModule module, LogLevel level, const char* format, va_list args) {
+        if (!isEnabled(module, level)) {
+            return;
+        }
+        const uint32_t currentTime = millis();
+        if (!passRateLimit(module, level, currentTime)) {
+            return;
+        }
+        uint8_t payload[BinaryLogRecord::PAYLOAD_SIZE];
+        const uint8_t payloadLength = BinaryLog::packArgs(format, args, payload, sizeof(payload));
+        const uint32_t formatAddress = (uint32_t)(uintptr_t)format;
+        if (isRepeat(module, level, hash(payload, payloadLength & ~BinaryLogRecord::FLAG_TRUNCATED, hash(&formatAddress, sizeof(formatAddress))), currentTime)) {
+            return;
+        }
+        binaryRing.push([&](BinaryLogRecord& record) {
+            record.format = formatAddress;
+            record.timestamp = currentTime;
+            record.level = (uint8_t)level | (uint8_t)((uint8_t)module << 4);
+            record.payloadLength = payloadLength;
+            memcpy(record.payload, payload, sizeof(payload));
+        });
+    }
+#endif
+
+    void log(LogModule module, LogLevel level, const char* format, va_list args) {
+        if (!isEnabled(module, level)) {
+            return;
+        }
+        const uint32_t currentTime = millis();
+        if (!passRateLimit(module, level, currentTime)) {
+            return;
+        }
+
+        char buffer[256];
+        const int prefixLength = module == LogModule::GENERAL ? 0 : snprintf(buffer, sizeof(buffer), "[%s] ", moduleToString(module));
+        vsnprintf(buffer + prefixLength, sizeof(buffer) - prefixLength, format, args);
+        if (isRepeat(module, level, hash(buffer, strlen(buffer)), currentTime)) {
+            return;
+        }
+        emit(level, buffer, currentTime);
+    }
+
+    // Notes about suppressed messages, these bypass the rate limit and repeat detection
+    __attribute__((format(printf, 5, 6)))
+    void note(LogModule module, LogLevel level, uint32_t currentTime, const char* format, ...) {
+        char buffer[96];
+        const int prefixLength = module == LogModule::GENERAL ? 0 : snprintf(buffer, sizeof(buffer), "[%s] ", moduleToString(module));
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer + prefixLength, sizeof(buffer) - prefixLength, format, args);
+        va_end(args);
+        emit(level, buffer, currentTime);
+    }
+
+    void emit(LogLevel level, const char* message, uint32_t currentTime) {
+        if (level >= LOG_LEVEL_SERIAL) {
+            serialRing.push([&](SerialLogRecord& record) {
+                record.timestamp = currentTime;
+                record.level = (uint8_t)level;
+                strncpy(record.message, message, SerialLogRecord::MESSAGE_SIZE - 1);
+                record.message[SerialLogRecord::MESSAGE_SIZE - 1] = '\0';
+            });
+            const TaskHandle_t task = serialTask.load(std::memory_order_relaxed);
+            if (task != nullptr) {
+                xTaskNotifyGive(task);
+            }
+        }
+
+        if (level >= LOG_LEVEL_GUI) {
+            ring.push([&](LogRecord& record) {
+                record.timestamp = currentTime;
+                record.level = (uint8_t)level;
+                strncpy(record.message, message, LogRecord::MESSAGE_SIZE - 1);
+                record.message[LogRecord::MESSAGE_SIZE - 1] = '\0';
+            });
+            CrashStore::addLog((uint8_t)level, currentTime, message);
+        }
+    }
 };
 
+inline LogClass& getLogInstance();
+
+// Prints everything that was queued since the last run. A line that is still being
+// written is retried on the next wakeup; if it is still not readable after 100 ms, its
+// writer was lapped by the whole ring and the line is counted as dropped.
+inline void LogClass::serialDrainTask(void* param) {
+    LogClass* self = static_cast<LogClass*>(param);
+    uint32_t stalledSeq = 0;
+    uint32_t stalledSinceMs = 0;
+    SerialLogRecord record;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(stalledSinceMs != 0 ? 20 : 1000));
+
+        uint32_t cursor = self->serialCursor.load(std::memory_order_relaxed);
+        uint32_t lost = 0;
+        while (cursor != self->serialRing.getEndSeq()) {
+            const uint32_t first = self->serialRing.getFirstSeq();
+            if ((int32_t)(first - cursor) > 0) {
+                lost += first - cursor;
+                cursor = first;
+                continue;
+            }
+            if (!self->serialRing.read(cursor, record)) {
+                if (cursor != stalledSeq || stalledSinceMs == 0) {
+                    stalledSeq = cursor;
+                    stalledSinceMs = millis() | 1;
+                    break;
+                }
+                if (millis() - stalledSinceMs < 100) {
+                    break;
+                }
+                stalledSinceMs = 0;
+                lost++;
+                cursor++;
+                continue;
+            }
+            stalledSinceMs = 0;
+            if (lost > 0) {
+                Serial.printf("%u log lines dropped\n", lost);
+                self->serialDropped.fetch_add(lost, std::memory_order_relaxed);
+                lost = 0;
+            }
+
+            const unsigned long seconds = record.timestamp / 1000;
+            Serial.printf("%lum %lu.%02lus %s: %s\n", seconds / 60, seconds % 60, (unsigned long)(record.timestamp % 1000) / 10,
+                          levelToString((LogLevel)record.level), record.message);
+            cursor++;
+            self->serialCursor.store(cursor, std::memory_order_relaxed);
+        }
+        if (lost > 0) {
+            Serial.printf("%u log lines dropped\n", lost);
+            self->serialDropped.fetch_add(lost, std::memory_order_relaxed);
+        }
+        self->serialCursor.store(cursor, std::memory_order_relaxed);
+    }
+}
+
 inline LogClass& getLogInstance() {
     static LogClass instance;
     return instance;
 }
 
-#define Log getLogInstance()
\ No newline at end of file
+#define Log getLogInstance()
@@ -0,0 +1,102 @@
+// LogRing.h
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+template <size_t SIZE>
+struct TextLogRecord
+{
+    static constexpr size_t MESSAGE_SIZE = SIZE;
+
+    uint32_t seq;
+    uint32_t timestamp; // millis()
+    uint8_t level;      // LogLevel
+    char message[MESSAGE_SIZE];
+};
+
+// What /logs shows
+using LogRecord = TextLogRecord<100>;
+// Serial lines waiting for the drain task, longer lines are cut
+using SerialLogRecord = TextLogRecord<160>;
+
+// Fixed size ring of the most recent log records, written from any task (loop, AsyncTCP,
+// WiFi, NimBLE host) without locks and without ever blocking: a writer claims a sequence
+// number with one atomic increment and then takes the slot seq % CAPACITY with one
+// compare-and-swap. Old records are simply overwritten.
+// Readers never consume anything, they copy a record by sequence number. Each slot carries
+// a stamp that is odd while a writer is busy with it, a reader only accepts the copy if
+// the stamp was the committed stamp of that sequence number before and after copying
+// (seqlock), otherwise the record is gone or not complete yet.
+// Record is any trivially copyable struct with a uint32_t seq member, push() hands the
+// slot's record to fill().
+template <typename Record, size_t CAPACITY>
+class LogRing
+{
+public:
+    template <typename Fill>
+    void push(Fill &&fill)
+    {
+        const uint32_t seq = m_head.fetch_add(1, std::memory_order_relaxed);
+        Slot &slot = m_slots[seq % CAPACITY];
+
+        // Take over the slot. If a writer that was lapped by the whole ring is still busy
+        // with it, or a newer record is in it already, this record is dropped; both writers
+        // in one slot would tear it in a way the readers could not detect.
+        uint32_t stamp = slot.stamp.load(std::memory_order_relaxed);
+        do
+        {
+            if ((stamp & 1) != 0 || (int32_t)(stamp - committedStamp(seq)) >= 0)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        } while (!slot.stamp.compare_exchange_weak(stamp, writingStamp(seq), std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_release);
+
+        fill(slot.record);
+        slot.record.seq = seq;
+
+        slot.stamp.store(committedStamp(seq), std::memory_order_release);
+    }
+
+    // Copies the record with the given sequence number, false if it was overwritten
+    // already, is still being written or does not exist yet
+    bool read(uint32_t seq, Record &out) const
+    {
+        const Slot &slot = m_slots[seq % CAPACITY];
+        if (slot.stamp.load(std::memory_order_acquire) != committedStamp(seq))
+        {
+            return false;
+        }
+        memcpy(&out, &slot.record, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.stamp.load(std::memory_order_relaxed) == committedStamp(seq);
+    }
+
+    // One past the newest claimed sequence number, the oldest one still available is
+    // at best getEndSeq() - CAPACITY
+    uint32_t getEndSeq() const { return m_head.load(std::memory_order_acquire); }
+    uint32_t getDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint32_t getFirstSeq() const
+    {
+        const uint32_t end = getEndSeq();
+        return end > CAPACITY ? end - CAPACITY : 0;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> stamp{0}; // 0 = never written
+        Record record;
+    };
+
+    // Sequence numbers wrap after 2^31 records, long after the slot has been reused anyway
+    static constexpr uint32_t writingStamp(uint32_t seq) { return (seq << 1) | 1; }
+    static constexpr uint32_t committedStamp(uint32_t seq) { return (seq << 1) + 2; }
+
+    Slot m_slots[CAPACITY];
+    std::atomic<uint32_t> m_head{0};
+    std::atomic<uint32_t> m_dropped{0};
+};
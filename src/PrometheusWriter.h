@@ -0,0 +1,69 @@
+// PrometheusWriter.h
+#pragma once
+
+#include "StreamingResponse.h"
+
+// Prometheus text exposition format (version 0.0.4) on top of a StreamingBody. Nothing
+// is allocated: names, help texts and label values are expected to be string literals
+// that need no escaping, and values are integers or Fixed, so no float formatting either.
+//
+//   metrics.family("bluefigate_battery_voltage_volts", "Pack voltage", "gauge");
+//   metrics.sample("bluefigate_battery_voltage_volts", Fixed(1328, 2));
+class PrometheusWriter
+{
+public:
+    explicit PrometheusWriter(StreamingBody &body) : m_body(body) {}
+
+    // HELP and TYPE lines, once per metric name before its samples
+    void family(const char *name, const char *help, const char *type)
+    {
+        m_body.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+
+    void sample(const char *name, Fixed value, const char *label = nullptr, const char *labelValue = nullptr)
+    {
+        m_body.print(name);
+        if (label != nullptr)
+        {
+            m_body.printf("{%s=\"%s\"}", label, labelValue);
+        }
+        m_body.print(" ");
+        m_body.print(value);
+        m_body.print("\n");
+    }
+
+    // Label values that are numbers, e.g. cell="1"
+    void sample(const char *name, Fixed value, const char *label, uint32_t labelValue)
+    {
+        char text[12];
+        snprintf(text, sizeof(text), "%u", labelValue);
+        sample(name, value, label, text);
+    }
+
+    // Counters may exceed INT32_MAX, so they are printed unsigned
+    void sample(const char *name, uint32_t value, const char *label = nullptr, const char *labelValue = nullptr)
+    {
+        m_body.print(name);
+        if (label != nullptr)
+        {
+            m_body.printf("{%s=\"%s\"}", label, labelValue);
+        }
+        m_body.printf(" %u\n", value);
+    }
+
+    // family() followed by a single unlabelled sample
+    void gauge(const char *name, const char *help, Fixed value)
+    {
+        family(name, help, "gauge");
+        sample(name, value);
+    }
+
+    void counter(const char *name, const char *help, uint32_t value)
+    {
+        family(name, help, "counter");
+        sample(name, value);
+    }
+
+private:
+    StreamingBody &m_body;
+};
@@ -0,0 +1,44 @@
+// ResponseCache.cpp
+#include "ResponseCache.h"
+
+ResponseCache::ResponseCache(const char *tag) : m_tag(tag)
+{
+    m_mutex = xSemaphoreCreateMutex();
+}
+
+ResponseCache::~ResponseCache()
+{
+    if (m_mutex != nullptr)
+    {
+        vSemaphoreDelete(m_mutex);
+    }
+}
+
+std::shared_ptr<const CachedBody> ResponseCache::get(uint32_t version, const Renderer &render)
+{
+    std::shared_ptr<const CachedBody> entry;
+    if (m_mutex == nullptr || xSemaphoreTake(m_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return entry;
+    }
+
+    if (m_entry && m_entry->version == version)
+    {
+        m_hitCount++;
+        entry = m_entry;
+    }
+    else
+    {
+        auto fresh = std::make_shared<CachedBody>();
+        fresh->version = version;
+        render(fresh->body);
+        // Weak, as responses may carry per-request bits (e.g. the current time) around the body
+        fresh->etag = "W/\"" + String(version) + "-" + m_tag + "\"";
+        m_renderCount++;
+        m_entry = fresh;
+        entry = fresh;
+    }
+
+    xSemaphoreGive(m_mutex);
+    return entry;
+}
@@ -0,0 +1,40 @@
+// ResponseCache.h
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+// A rendered representation of one battery sample. Immutable once published, so any
+// number of in-flight responses can stream from the same buffer.
+struct CachedBody
+{
+    uint32_t version;
+    std::string body;
+    String etag;
+};
+
+// Holds the latest rendering of one representation (JSON, HTML, ...) keyed on the
+// BatteryManager sample version. The first request after a new sample renders it,
+// every further request until the next sample shares that buffer.
+class ResponseCache
+{
+public:
+    using Renderer = std::function<void(std::string &out)>;
+
+    explicit ResponseCache(const char *tag);
+    ~ResponseCache();
+
+    std::shared_ptr<const CachedBody> get(uint32_t version, const Renderer &render);
+
+    uint32_t getRenderCount() const { return m_renderCount; }
+    uint32_t getHitCount() const { return m_hitCount; }
+
+private:
+    const char *m_tag;
+    SemaphoreHandle_t m_mutex;
+    std::shared_ptr<const CachedBody> m_entry;
+    uint32_t m_renderCount = 0;
+    uint32_t m_hitCount = 0;
+};
@@ -0,0 +1,73 @@
+// SampleHistory.cpp
+#include "SampleHistory.h"
+
+SampleHistory::SampleHistory()
+{
+    m_mutex = xSemaphoreCreateMutex();
+}
+
+SampleHistory::~SampleHistory()
+{
+    if (m_mutex != nullptr)
+    {
+        vSemaphoreDelete(m_mutex);
+    }
+}
+
+void SampleHistory::add(const TDTBMSData &bms, uint32_t sampleMs)
+{
+    HistorySample sample = {};
+    sample.sampleMs = sampleMs;
+    sample.voltage = bms.voltage;
+    sample.current = bms.current;
+    sample.batteryLevel = bms.batteryLevel;
+    sample.minCell = UINT16_MAX;
+    for (int i = 0; i < bms.cellCount && i < 4; ++i)
+    {
+        sample.minCell = std::min(sample.minCell, bms.cellVoltages[i]);
+        sample.maxCell = std::max(sample.maxCell, bms.cellVoltages[i]);
+    }
+    if (bms.cellCount == 0)
+    {
+        sample.minCell = 0;
+    }
+    sample.maxTemp = bms.tempSensorCount > 0 ? bms.temperatures[0] : 0;
+    for (int i = 1; i < bms.tempSensorCount && i < 4; ++i)
+    {
+        sample.maxTemp = std::max(sample.maxTemp, bms.temperatures[i]);
+    }
+
+    if (m_mutex == nullptr || xSemaphoreTake(m_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+    m_samples[m_endSeq % CAPACITY] = sample;
+    m_endSeq++;
+    xSemaphoreGive(m_mutex);
+}
+
+uint32_t SampleHistory::getFirstSeq() const
+{
+    const uint32_t end = m_endSeq;
+    return end > CAPACITY ? end - CAPACITY : 0;
+}
+
+uint32_t SampleHistory::getEndSeq() const
+{
+    return m_endSeq;
+}
+
+bool SampleHistory::get(uint32_t seq, HistorySample &out) const
+{
+    if (m_mutex == nullptr || xSemaphoreTake(m_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return false;
+    }
+    const bool valid = seq < m_endSeq && m_endSeq - seq <= CAPACITY;
+    if (valid)
+    {
+        out = m_samples[seq % CAPACITY];
+    }
+    xSemaphoreGive(m_mutex);
+    return valid;
+}
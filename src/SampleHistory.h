@@ -0,0 +1,42 @@
+// SampleHistory.h
+#pragma once
+
+#include <Arduino.h>
+#include "BLEManager.h"
+
+// Compact copy of one TDT sample for the history and export endpoints
+struct HistorySample
+{
+    uint32_t sampleMs;     // millis() when the sample was taken
+    uint16_t voltage;      // in 0.01V
+    int16_t current;       // in 0.1A
+    uint16_t minCell;      // in mV
+    uint16_t maxCell;      // in mV
+    int16_t maxTemp;       // in 0.1°C
+    uint8_t batteryLevel;  // in %
+    uint8_t reserved;
+};
+
+// Ring buffer of the most recent samples. Samples are addressed by a running sequence
+// number so readers streaming over several callbacks notice when the writer overtook them.
+class SampleHistory
+{
+public:
+    static constexpr uint32_t CAPACITY = 360; // one hour at the 10 s poll interval
+
+    SampleHistory();
+    ~SampleHistory();
+
+    void add(const TDTBMSData &bms, uint32_t sampleMs);
+
+    // Sequence numbers of the oldest and one past the newest sample still available
+    uint32_t getFirstSeq() const;
+    uint32_t getEndSeq() const;
+    // Copies the sample, false if it was already overwritten or does not exist yet
+    bool get(uint32_t seq, HistorySample &out) const;
+
+private:
+    HistorySample m_samples[CAPACITY];
+    uint32_t m_endSeq = 0;
+    SemaphoreHandle_t m_mutex;
+};
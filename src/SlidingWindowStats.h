@@ -0,0 +1,198 @@
+// SlidingWindowStats.h
+#pragma once
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+struct WindowStats
+{
+    uint32_t count = 0;
+    int32_t min = 0;
+    int32_t max = 0;
+    int64_t sum = 0;
+    int64_t sumSq = 0;
+
+    // Both in the unit of the samples with one decimal, integer math only
+    Fixed mean() const
+    {
+        if (count == 0)
+            return Fixed(0, 1);
+        const int64_t scaled = sum * 10;
+        const int64_t rounded = scaled >= 0 ? scaled + (int64_t)count / 2 : scaled - (int64_t)count / 2;
+        return Fixed((int32_t)(rounded / (int64_t)count), 1);
+    }
+    Fixed stddev() const
+    {
+        if (count < 2)
+            return Fixed(0, 1);
+        // count^2 * variance, exact in integers
+        const int64_t scaled = (int64_t)count * sumSq - sum * sum;
+        if (scaled <= 0)
+            return Fixed(0, 1);
+        return Fixed((int32_t)(isqrt64((uint64_t)scaled * 100) / count), 1);
+    }
+};
+
+// Rolling min/max/mean/stddev over a time window with O(1) amortized cost per sample
+// and fixed storage. The window is split into BUCKETS time slices; completed slices
+// are kept in running sums (added when the slice completes, subtracted when it falls
+// out of the window) and in two monotonic deques for min and max. The window
+// therefore slides in steps of windowMs / BUCKETS.
+// Samples are integers in their native BMS unit, so the sums are exact and eviction
+// never accumulates rounding error.
+// add() and get() hold a short critical section, so the loop task can add while the web
+// task reads and get() always returns the state after a whole add().
+template <int BUCKETS>
+class SlidingWindow
+{
+public:
+    explicit SlidingWindow(uint32_t windowMs) : m_bucketMs(windowMs / BUCKETS) {}
+
+    void add(int32_t value, uint32_t nowMs)
+    {
+        portENTER_CRITICAL(&m_lock);
+        advance(nowMs);
+
+        Bucket &bucket = m_buckets[m_head];
+        if (bucket.count == 0)
+        {
+            bucket.min = value;
+            bucket.max = value;
+        }
+        else
+        {
+            bucket.min = std::min(bucket.min, value);
+            bucket.max = std::max(bucket.max, value);
+        }
+        bucket.count++;
+        bucket.sum += value;
+        bucket.sumSq += (int64_t)value * value;
+        portEXIT_CRITICAL(&m_lock);
+    }
+
+    // Stats as of the last added sample
+    WindowStats get() const
+    {
+        portENTER_CRITICAL(&m_lock);
+        WindowStats result = m_window;
+        const Bucket &current = m_buckets[m_head];
+        if (m_window.count > 0)
+        {
+            result.min = m_buckets[m_minDeque[m_minFront % BUCKETS] % BUCKETS].min;
+            result.max = m_buckets[m_maxDeque[m_maxFront % BUCKETS] % BUCKETS].max;
+        }
+        if (current.count > 0)
+        {
+            result.min = result.count ? std::min(result.min, current.min) : current.min;
+            result.max = result.count ? std::max(result.max, current.max) : current.max;
+            result.count += current.count;
+            result.sum += current.sum;
+            result.sumSq += current.sumSq;
+        }
+        portEXIT_CRITICAL(&m_lock);
+        return result;
+    }
+
+private:
+    struct Bucket
+    {
+        int32_t min = 0;
+        int32_t max = 0;
+        uint16_t count = 0;
+        int32_t sum = 0;
+        int64_t sumSq = 0;
+    };
+
+    const uint32_t m_bucketMs;
+    mutable portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+    Bucket m_buckets[BUCKETS];
+    uint32_t m_seq = 0; // sequence number of the current (head) bucket
+    int m_head = 0;
+    uint32_t m_headStartMs = 0;
+    bool m_started = false;
+
+    // Running aggregate over the completed buckets inside the window
+    WindowStats m_window;
+
+    // Monotonic deques of bucket sequence numbers, ring buffers indexed by front/back counters
+    uint32_t m_minDeque[BUCKETS];
+    uint32_t m_maxDeque[BUCKETS];
+    uint32_t m_minFront = 0, m_minBack = 0;
+    uint32_t m_maxFront = 0, m_maxBack = 0;
+
+    void advance(uint32_t nowMs)
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            m_headStartMs = nowMs;
+            return;
+        }
+
+        uint32_t elapsed = nowMs - m_headStartMs;
+        if (elapsed >= m_bucketMs * BUCKETS)
+        {
+            // Whole window expired, start over instead of rotating through every slice
+            reset(nowMs);
+            return;
+        }
+
+        while (elapsed >= m_bucketMs)
+        {
+            completeHead();
+            m_head = (m_head + 1) % BUCKETS;
+            m_seq++;
+            evictHead();
+            m_headStartMs += m_bucketMs;
+            elapsed -= m_bucketMs;
+        }
+    }
+
+    void completeHead()
+    {
+        const Bucket &bucket = m_buckets[m_head];
+        if (bucket.count == 0)
+            return;
+
+        m_window.count += bucket.count;
+        m_window.sum += bucket.sum;
+        m_window.sumSq += bucket.sumSq;
+
+        while (m_minBack != m_minFront && m_buckets[m_minDeque[(m_minBack - 1) % BUCKETS] % BUCKETS].min >= bucket.min)
+            m_minBack--;
+        m_minDeque[m_minBack++ % BUCKETS] = m_seq;
+
+        while (m_maxBack != m_maxFront && m_buckets[m_maxDeque[(m_maxBack - 1) % BUCKETS] % BUCKETS].max <= bucket.max)
+            m_maxBack--;
+        m_maxDeque[m_maxBack++ % BUCKETS] = m_seq;
+    }
+
+    // The new head slot still holds the oldest completed bucket, drop it from the window
+    void evictHead()
+    {
+        Bucket &bucket = m_buckets[m_head];
+        if (bucket.count > 0)
+        {
+            m_window.count -= bucket.count;
+            m_window.sum -= bucket.sum;
+            m_window.sumSq -= bucket.sumSq;
+
+            const uint32_t evictedSeq = m_seq - BUCKETS;
+            if (m_minBack != m_minFront && m_minDeque[m_minFront % BUCKETS] == evictedSeq)
+                m_minFront++;
+            if (m_maxBack != m_maxFront && m_maxDeque[m_maxFront % BUCKETS] == evictedSeq)
+                m_maxFront++;
+        }
+        bucket = Bucket();
+    }
+
+    void reset(uint32_t nowMs)
+    {
+        for (Bucket &bucket : m_buckets)
+            bucket = Bucket();
+        m_window = WindowStats();
+        m_minFront = m_minBack = m_maxFront = m_maxBack = 0;
+        m_head = m_seq % BUCKETS;
+        m_headStartMs = nowMs;
+    }
+};
@@ -0,0 +1,163 @@
+// StreamingResponse.cpp
+#include "StreamingResponse.h"
+#include <cstdarg>
+#include "Log.h"
+
+StreamingBody::StreamingBody(Step step, StreamMetric *metric)
+    : m_step(step), m_metric(metric), m_startFreeHeap(ESP.getFreeHeap())
+{
+}
+
+StreamingBody::~StreamingBody()
+{
+    if (m_metric)
+    {
+        m_metric->responses++;
+        m_metric->bytes = m_bytes;
+        m_metric->lastHeapDrop = m_maxHeapDrop;
+        m_metric->maxHeapDrop = std::max(m_metric->maxHeapDrop, m_maxHeapDrop);
+        LOG_DEBUG(WEB, "Streamed %u bytes of %s, free heap dropped by up to %u bytes", (unsigned)m_bytes, m_metric->name, (unsigned)m_maxHeapDrop);
+    }
+}
+
+void StreamingBody::print(const char *text)
+{
+    print(text, strlen(text));
+}
+
+void StreamingBody::print(const char *text, size_t len)
+{
+    const size_t space = SCRATCH_SIZE - m_scratchLen;
+    if (len > space)
+    {
+        len = space;
+        m_overflow = true;
+    }
+    memcpy(m_scratch + m_scratchLen, text, len);
+    m_scratchLen += len;
+}
+
+void StreamingBody::print(Fixed value)
+{
+    char text[16];
+    print(text, value.format(text, sizeof(text)));
+}
+
+void StreamingBody::print(int32_t value)
+{
+    print(Fixed(value, 0));
+}
+
+void StreamingBody::printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const size_t space = SCRATCH_SIZE - m_scratchLen;
+    const int len = vsnprintf(m_scratch + m_scratchLen, space, format, args);
+    va_end(args);
+    if (len < 0)
+    {
+        return;
+    }
+    if ((size_t)len >= space)
+    {
+        // vsnprintf always terminates, so the last byte of the scratch buffer is lost
+        m_scratchLen = SCRATCH_SIZE - 1;
+        m_overflow = true;
+        return;
+    }
+    m_scratchLen += len;
+}
+
+void StreamingBody::printJson(const char *text)
+{
+    print("\"", 1);
+    const char *start = text;
+    for (const char *p = text; *p != '\0'; ++p)
+    {
+        const unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        print(start, p - start);
+        start = p + 1;
+        switch (c)
+        {
+        case '"':
+            print("\\\"", 2);
+            break;
+        case '\\':
+            print("\\\\", 2);
+            break;
+        case '\n':
+            print("\\n", 2);
+            break;
+        case '\r':
+            print("\\r", 2);
+            break;
+        case '\t':
+            print("\\t", 2);
+            break;
+        default:
+            printf("\\u%04x", c);
+            break;
+        }
+    }
+    print(start, strlen(start));
+    print("\"", 1);
+}
+
+void StreamingBody::printStatic(const char *data, size_t len)
+{
+    m_pending = data;
+    m_pendingLen = len;
+}
+
+size_t StreamingBody::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (m_pendingLen == 0)
+        {
+            if (m_done)
+            {
+                break;
+            }
+
+            // Produce the next step; steps may legitimately produce nothing
+            m_scratchLen = 0;
+            m_overflow = false;
+            m_pending = nullptr;
+            if (!m_step(m_nextStep++, *this))
+            {
+                m_done = true;
+            }
+            if (m_overflow)
+            {
+                LOG_WARN(WEB, "Streaming step %u exceeded the scratch buffer and was truncated", (unsigned)(m_nextStep - 1));
+            }
+            if (m_pending == nullptr)
+            {
+                m_pending = m_scratch;
+                m_pendingLen = m_scratchLen;
+            }
+            continue;
+        }
+
+        const size_t len = std::min(maxLen - written, m_pendingLen);
+        memcpy(buffer + written, m_pending, len);
+        m_pending += len;
+        m_pendingLen -= len;
+        written += len;
+    }
+
+    m_bytes += written;
+    const uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < m_startFreeHeap)
+    {
+        m_maxHeapDrop = std::max(m_maxHeapDrop, m_startFreeHeap - freeHeap);
+    }
+    return written;
+}
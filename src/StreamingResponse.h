@@ -0,0 +1,67 @@
+// StreamingResponse.h
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "FixedPoint.h"
+
+// Per endpoint memory accounting for streamed responses
+struct StreamMetric
+{
+    const char *name;
+    uint32_t responses = 0;
+    uint32_t bytes = 0;          // body bytes of the last response
+    // How far the free heap fell below its value at the start of the response while it was
+    // streaming. The heap is global, so this includes whatever other tasks (BLE, WiFi, other
+    // requests) allocated meanwhile; it is an upper bound of what the response took.
+    uint32_t lastHeapDrop = 0;
+    uint32_t maxHeapDrop = 0;
+
+    explicit StreamMetric(const char *name) : name(name) {}
+};
+
+// Produces a response body piece by piece for AsyncWebServer's chunked responses, so
+// the peak memory of a request is one small scratch buffer instead of the whole body.
+// The body is described by a step function that is called with increasing step numbers;
+// each step either prints (at most SCRATCH_SIZE bytes) into the scratch buffer or hands
+// out a static block (e.g. PROGMEM markup) that is copied out without buffering.
+class StreamingBody
+{
+public:
+    static constexpr size_t SCRATCH_SIZE = 384;
+    // Return false once there are no more steps
+    using Step = std::function<bool(size_t step, StreamingBody &body)>;
+
+    StreamingBody(Step step, StreamMetric *metric = nullptr);
+    ~StreamingBody();
+
+    // For use inside a step
+    void print(const char *text);
+    void print(const char *text, size_t len);
+    void print(Fixed value);
+    void print(int32_t value);
+    void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    // text as a quoted JSON string
+    void printJson(const char *text);
+    void printStatic(const char *data, size_t len);
+
+    // AwsResponseFiller, returns 0 when the body is complete
+    size_t fill(uint8_t *buffer, size_t maxLen);
+
+private:
+    Step m_step;
+    StreamMetric *m_metric;
+    size_t m_nextStep = 0;
+    bool m_done = false;
+
+    char m_scratch[SCRATCH_SIZE];
+    size_t m_scratchLen = 0;
+    bool m_overflow = false;
+
+    const char *m_pending = nullptr; // unsent part of the current step
+    size_t m_pendingLen = 0;
+
+    uint32_t m_startFreeHeap;
+    uint32_t m_maxHeapDrop = 0;
+    uint32_t m_bytes = 0;
+};
@@ -0,0 +1,166 @@
+// SyslogSink.cpp
+#include "SyslogSink.h"
+#include <WiFi.h>
+#include <time.h>
+#include "Clock.h"
+#include "OtherFunctions.h"
+
+namespace
+{
+    constexpr int FACILITY_LOCAL0 = 16;
+
+    // RFC 5424 severities
+    int toSeverity(uint8_t level)
+    {
+        switch ((LogLevel)level)
+        {
+        case LogLevel::DEBUG:
+            return 7;
+        case LogLevel::INFO:
+            return 6;
+        case LogLevel::WARNING:
+            return 4;
+        case LogLevel::ERROR:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+}
+
+void SyslogSink::begin(const char *host, uint16_t port)
+{
+    m_host = host;
+    m_port = port;
+    m_enabled = m_host.length() > 0;
+    if (!m_enabled)
+    {
+        return;
+    }
+    m_hostname = getUniqueHostname();
+    // Start with what is still in the ring, so the collector sees the boot
+    m_cursor = Log.getRing().getFirstSeq();
+    m_lastFlushMs = millis();
+    LOG_INFO(WIFI, "Sending logs to syslog at %s:%u", m_host.c_str(), m_port);
+}
+
+void SyslogSink::loop()
+{
+    const uint32_t nowMs = millis();
+    if (!m_enabled || nowMs - m_lastFlushMs < FLUSH_INTERVAL_MS)
+    {
+        return;
+    }
+    m_tokens = std::min(BURST, m_tokens + (nowMs - m_lastFlushMs) * SYSLOG_MAX_RATE / 1000);
+    m_lastFlushMs = nowMs;
+
+    const LogClass::Ring &ring = Log.getRing();
+    const uint32_t first = ring.getFirstSeq();
+    if ((int32_t)(first - m_cursor) > 0)
+    {
+        m_unreportedLost += first - m_cursor;
+        m_cursor = first;
+    }
+    if (!WiFi.isConnected() || !resolve(nowMs))
+    {
+        return;
+    }
+
+    const uint64_t nowEpochMs = Clock::epochMs();
+
+    char message[MESSAGE_SIZE];
+    if (m_unreportedLost > 0 && m_tokens > 0)
+    {
+        LogRecord note;
+        note.seq = m_cursor - 1; // the last record lost
+        note.timestamp = nowMs;
+        note.level = (uint8_t)LogLevel::WARNING;
+        snprintf(note.message, sizeof(note.message), "%u log records lost while offline or rate limited", m_unreportedLost);
+        if (send(message, format(note, m_hostname.c_str(), nowEpochMs, nowMs, message, sizeof(message))))
+        {
+            m_lost += m_unreportedLost;
+            m_unreportedLost = 0;
+            m_tokens--;
+        }
+    }
+
+    const uint32_t end = ring.getEndSeq();
+    while (m_cursor != end && m_tokens > 0)
+    {
+        LogRecord record;
+        if (!ring.read(m_cursor, record))
+        {
+            // Still being written, try again next time. If it still cannot be read then, its
+            // writer gave the slot up and the record never existed.
+            if (m_cursor != m_stalledSeq)
+            {
+                m_stalledSeq = m_cursor;
+                break;
+            }
+            m_cursor++;
+            continue;
+        }
+        if (!send(message, format(record, m_hostname.c_str(), nowEpochMs, nowMs, message, sizeof(message))))
+        {
+            break;
+        }
+        m_cursor++;
+        m_tokens--;
+        m_sent++;
+    }
+}
+
+size_t SyslogSink::format(const LogRecord &record, const char *hostname, uint64_t nowEpochMs, uint32_t nowMs,
+                          char *out, size_t size)
+{
+    char timestamp[32] = "-";
+    if (nowEpochMs != 0)
+    {
+        const uint64_t epochMs = nowEpochMs - (nowMs - record.timestamp);
+        const time_t seconds = (time_t)(epochMs / 1000);
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        const size_t len = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+        snprintf(timestamp + len, sizeof(timestamp) - len, ".%03uZ", (unsigned)(epochMs % 1000));
+    }
+
+    // <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID [meta ...] MSG, sysUpTime in 1/100 s
+    const int len = snprintf(out, size, "<%d>1 %s %s bluefigate - - [meta sequenceId=\"%u\" sysUpTime=\"%u\"] %s",
+                             FACILITY_LOCAL0 * 8 + toSeverity(record.level), timestamp, hostname,
+                             record.seq % 2147483647u + 1, record.timestamp / 10, record.message);
+    if (len < 0)
+    {
+        return 0;
+    }
+    return std::min((size_t)len, size - 1);
+}
+
+bool SyslogSink::resolve(uint32_t nowMs)
+{
+    if (m_resolved)
+    {
+        return true;
+    }
+    if (m_lastResolveMs != 0 && nowMs - m_lastResolveMs < RESOLVE_INTERVAL_MS)
+    {
+        return false;
+    }
+    m_lastResolveMs = nowMs;
+    m_resolved = m_address.fromString(m_host.c_str()) || WiFi.hostByName(m_host.c_str(), m_address) == 1;
+    if (!m_resolved)
+    {
+        LOG_WARN(WIFI, "Could not resolve syslog host %s", m_host.c_str());
+    }
+    return m_resolved;
+}
+
+bool SyslogSink::send(const char *message, size_t len)
+{
+    if (len == 0)
+    {
+        return false;
+    }
+    return m_udp.beginPacket(m_address, m_port) == 1 &&
+           m_udp.write((const uint8_t *)message, len) == len &&
+           m_udp.endPacket() == 1;
+}
@@ -0,0 +1,67 @@
+// SyslogSink.h
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "config.h"
+#include "Log.h"
+
+// Log collector, e.g. in config.local.h or as build flag. Empty disables the sink.
+#ifndef SYSLOG_HOST
+#define SYSLOG_HOST ""
+#endif
+
+#ifndef SYSLOG_PORT
+#define SYSLOG_PORT 514
+#endif
+
+// Datagrams per second on average, twice as many in a burst
+#ifndef SYSLOG_MAX_RATE
+#define SYSLOG_MAX_RATE 10
+#endif
+
+// Sends the records of the in-memory log ring (INFO and above) to a syslog collector as
+// RFC 5424 messages over UDP, one message per datagram as RFC 5426 requires. loop() catches
+// up with the ring once per FLUSH_INTERVAL_MS and sends what it found in one batch, so a
+// logger never waits for the network. While WiFi is down nothing is sent and the records
+// stay in the ring; whatever was overwritten in the meantime, or held back by the rate
+// limit for too long, is reported to the collector as lost.
+class SyslogSink
+{
+public:
+    void begin(const char *host = SYSLOG_HOST, uint16_t port = SYSLOG_PORT);
+    void loop();
+
+    uint32_t getSent() const { return m_sent; }
+    uint32_t getLost() const { return m_lost; }
+
+    // One RFC 5424 message, nowEpochMs = 0 while the time is not synced (NILVALUE timestamp)
+    static size_t format(const LogRecord &record, const char *hostname, uint64_t nowEpochMs, uint32_t nowMs,
+                         char *out, size_t size);
+
+private:
+    static constexpr uint32_t FLUSH_INTERVAL_MS = 1000;
+    static constexpr uint32_t RESOLVE_INTERVAL_MS = 30000;
+    static constexpr uint32_t BURST = 2 * SYSLOG_MAX_RATE;
+    static constexpr size_t MESSAGE_SIZE = 256;
+
+    WiFiUDP m_udp;
+    String m_host;
+    String m_hostname;
+    IPAddress m_address;
+    uint16_t m_port = 0;
+    bool m_enabled = false;
+    bool m_resolved = false;
+    uint32_t m_lastResolveMs = 0;
+
+    uint32_t m_cursor = 0; // next ring record to send
+    uint32_t m_stalledSeq = UINT32_MAX;
+    uint32_t m_lastFlushMs = 0;
+    uint32_t m_tokens = BURST;
+    uint32_t m_sent = 0;
+    uint32_t m_lost = 0;
+    uint32_t m_unreportedLost = 0;
+
+    bool resolve(uint32_t nowMs);
+    bool send(const char *message, size_t len);
+};
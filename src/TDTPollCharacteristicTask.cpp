@@ -1,5 +1,7 @@
 #include "TDTPollCharacteristicTask.h"
 #include "Log.h"
+#include "Clock.h"
+#include "FixedPoint.h"
 
 // TDTPollCharacteristicTask implementation
 TDTPollCharacteristicTask::TDTPollCharacteristicTask(int priority, uint32_t timeout,
@@ -15,6 +17,8 @@ TDTPollCharacteristicTask::TDTPollCharacteristicTask(int priority, uint32_t time
     dataFinal.clear();
     currentCmdIndex = 0;
     nextPollTime = 0;
+    scheduledPollTime = 0;
+    pollDueTime = 0;
 }
 
 TDTPollCharacteristicTask::~TDTPollCharacteristicTask()
@@ -39,15 +43,17 @@ void TDTPollCharacteristicTask::execute()
     dataFinal.clear();
     currentCmdIndex = 0;
     nextPollTime = 0;
+    scheduledPollTime = 0;
+    pollDueTime = 0;
 
     if (deviceAddress.isNull())
     {
-        Log.error("TDTPollCharacteristicTask: No device address provided");
+        LOG_ERROR(TDT, "No device address provided");
         setErrorResult("No device address provided");
     }
     else
     {
-        Log.info("TDTPollCharacteristicTask: Using known device address %s", deviceAddress.toString().c_str());
+        LOG_INFO(TDT, "Using known device address %s", deviceAddress.toString().c_str());
         connectToDeviceAsync();
     }
 }
@@ -61,11 +67,11 @@ void TDTPollCharacteristicTask::connectToDeviceAsync()
     connecting = true;
     if (!pBLEClient->connect(deviceAddress, true, true))
     { 
-        Log.error("TDTPollCharacteristicTask: Failed to start connection to device %s", deviceAddress.toString().c_str());
+        LOG_ERROR(TDT, "Failed to start connection to device %s", deviceAddress.toString().c_str());
         connecting = false;
         setErrorResult("Failed to start connection to device");
     } else {
-        Log.debug("TDTPollCharacteristicTask: Connection attempt started for device %s", deviceAddress.toString().c_str());
+        LOG_DEBUG(TDT, "Connection attempt started for device %s", deviceAddress.toString().c_str());
     }
 }
 
@@ -75,7 +81,7 @@ void TDTPollCharacteristicTask::initializeBMS()
     NimBLERemoteService* pService = pBLEClient->getService("fff0");
     if (pService == nullptr)
     {
-        Log.error("TDTPollCharacteristicTask: Service %s not found", serviceUuid.toString().c_str());
+        LOG_ERROR(TDT, "Service %s not found", serviceUuid.toString().c_str());
         setErrorResult("Service not found");
         return;
     }
@@ -84,7 +90,7 @@ void TDTPollCharacteristicTask::initializeBMS()
     pWriteChar = pService->getCharacteristic("fff2");
     if (pWriteChar == nullptr)
     {
-        Log.error("TDTPollCharacteristicTask: Write characteristic %s not found", "fff2");
+        LOG_ERROR(TDT, "Write characteristic %s not found", "fff2");
         setErrorResult("Write characteristic not found");
         return;
     }
@@ -92,7 +98,7 @@ void TDTPollCharacteristicTask::initializeBMS()
     pReadChar = pService->getCharacteristic("fff1");
     if (pReadChar == nullptr)
     {
-        Log.error("TDTPollCharacteristicTask: Read characteristic %s not found", "fff1");
+        LOG_ERROR(TDT, "Read characteristic %s not found", "fff1");
         setErrorResult("Read characteristic not found");
         return;
     }
@@ -100,7 +106,7 @@ void TDTPollCharacteristicTask::initializeBMS()
     pConfigChar = pService->getCharacteristic("fffa");
     if (pConfigChar == nullptr)
     {
-        Log.error("TDTPollCharacteristicTask: Config characteristic %s not found", "fffa");
+        LOG_ERROR(TDT, "Config characteristic %s not found", "fffa");
         setErrorResult("Config characteristic not found");
         return;
     }
@@ -109,7 +115,7 @@ void TDTPollCharacteristicTask::initializeBMS()
     const char* initData = "HiLink";
     if (!pConfigChar->writeValue((uint8_t*)initData, strlen(initData), false))
     {
-        Log.error("TDTPollCharacteristicTask: Failed to write HiLink initialization");
+        LOG_ERROR(TDT, "Failed to write HiLink initialization");
         setErrorResult("Failed to initialize BMS connection");
         return;
     }
@@ -118,10 +124,10 @@ void TDTPollCharacteristicTask::initializeBMS()
     std::string configValue = pConfigChar->readValue();
     if (configValue.length() > 0 && (uint8_t)configValue[0] != 0x01)
     {
-        Log.warn("TDTPollCharacteristicTask: BMS initialization returned: 0x%02X", (uint8_t)configValue[0]);
+        LOG_WARN(TDT, "BMS initialization returned: 0x%02X", (uint8_t)configValue[0]);
     }
     
-    Log.debug("TDTPollCharacteristicTask: BMS initialized successfully");
+    LOG_DEBUG(TDT, "BMS initialized successfully");
 
     // Register for notifications on the read characteristic
     if (pReadChar->canNotify())
@@ -130,14 +136,14 @@ void TDTPollCharacteristicTask::initializeBMS()
             this->onNotify(pChar, pData, length, isNotify);
         }))
         {
-            Log.error("TDTPollCharacteristicTask: Failed to subscribe to notifications");
+            LOG_ERROR(TDT, "Failed to subscribe to notifications");
             setErrorResult("Failed to subscribe to notifications");
             return;
         }
     }
     else
     {
-        Log.error("TDTPollCharacteristicTask: Read characteristic does not support notifications");
+        LOG_ERROR(TDT, "Read characteristic does not support notifications");
         setErrorResult("Read characteristic does not support notifications");
         return;
     }
@@ -164,19 +170,19 @@ void TDTPollCharacteristicTask::sendCommands()
             
             if (!pWriteChar->writeValue(frame.data(), frame.size(), false))
             {
-                Log.error("TDTPollCharacteristicTask: Failed to write command 0x%02X", cmd);
+                LOG_ERROR(TDT, "Failed to write command 0x%02X", cmd);
                 success = false;
                 break;
             }
             
-            //Log.debug("TDTPollCharacteristicTask: Sent command 0x%02X with header 0x%02X", cmd, cmdHead);
+            //LOG_DEBUG(TDT, "Sent command 0x%02X with header 0x%02X", cmd, cmdHead);
             delay(100);
         }
         
         if (success)
         {
             commandsSent = true;
-            //Log.debug("TDTPollCharacteristicTask: All commands sent successfully");
+            //LOG_DEBUG(TDT, "All commands sent successfully");
             return;
         }
     }
@@ -232,14 +238,14 @@ uint16_t TDTPollCharacteristicTask::calculateModbusCRC(const std::vector<uint8_t
 
 void TDTPollCharacteristicTask::onConnect(NimBLEClient* pClient)
 {
-    Log.info("TDTPollCharacteristicTask: Connected to device %s", deviceAddress.toString().c_str());
+    LOG_INFO(TDT, "Connected to device %s", deviceAddress.toString().c_str());
     connected = true;
     connecting = false;
 }
 
 void TDTPollCharacteristicTask::onDisconnect(NimBLEClient* pClient, int reason)
 {
-    Log.info("TDTPollCharacteristicTask: Disconnected from device, reason: %d", reason);
+    LOG_INFO(TDT, "Disconnected from device, reason: %d", reason);
     
     if ((connecting || (connected && !commandsSent)) && !pendingResult.has_value()) {
         setErrorResult("Disconnected before operation completed");
@@ -267,7 +273,8 @@ bool TDTPollCharacteristicTask::process()
         else
         {
             setStartTime(0); // disable timeout
-            nextPollTime = millis() + POLL_INTERVAL;
+            scheduledPollTime = getNextPollTime(scheduledPollTime);
+            nextPollTime = scheduledPollTime;
             bResult = false;
         }
         
@@ -276,12 +283,13 @@ bool TDTPollCharacteristicTask::process()
         return bResult;
     }
 
-    if (isSticky() && nextPollTime > 0 && millis() > nextPollTime)
+    if (isSticky() && nextPollTime > 0 && Clock::nowMs() >= nextPollTime)
     {
+        pollDueTime = nextPollTime == scheduledPollTime ? scheduledPollTime : 0;
         nextPollTime = 0;
         setStartTime(millis()); // restart the timeout timer
         commandsSent = false;
-        Log.debug("TDTPollCharacteristicTask: Repolling");
+        LOG_DEBUG(TDT, "Repolling");
     }
     
     if (connected && !initialized)
@@ -299,7 +307,7 @@ bool TDTPollCharacteristicTask::process()
 
 void TDTPollCharacteristicTask::onConnectFail(NimBLEClient* pClient, int reason)
 {
-    Log.warn("TDTPollCharacteristicTask: Connection to device %s failed, reason: %d", 
+    LOG_WARN(TDT, "Connection to device %s failed, reason: %d", 
              deviceAddress.toString().c_str(), reason);
     connecting = false;
     std::string errorMsg = "Connection failed, reason: " + std::to_string(reason);
@@ -326,13 +334,49 @@ void TDTPollCharacteristicTask::restart()
     execute();
 }
 
+uint64_t TDTPollCharacteristicTask::getNextPollTime(uint64_t lastSlot) const
+{
+    const uint64_t now = Clock::nowMs();
+    const uint64_t epochMs = Clock::toEpochMs(now);
+    uint64_t next;
+    if (epochMs != 0)
+    {
+        next = now + POLL_INTERVAL - epochMs % POLL_INTERVAL;
+    }
+    else if (lastSlot != 0)
+    {
+        // Fixed rate on the monotonic clock, independent of how long the polls take
+        next = lastSlot;
+    }
+    else
+    {
+        next = now + POLL_INTERVAL;
+    }
+    // Slots missed by a slow poll are skipped, not made up for
+    while (next < now + MIN_POLL_GAP)
+    {
+        next += POLL_INTERVAL;
+    }
+    return next;
+}
+
+void TDTPollCharacteristicTask::requestRefresh()
+{
+    // Only while waiting for the next interval, a poll in flight delivers a fresh sample anyway
+    if (isSticky() && nextPollTime > 0)
+    {
+        nextPollTime = Clock::nowMs();
+        LOG_DEBUG(TDT, "Refresh requested");
+    }
+}
+
 
 void TDTPollCharacteristicTask::onNotify(NimBLERemoteCharacteristic* pRemoteCharacteristic, 
                                         uint8_t* pData, size_t length, bool isNotify)
 {
     if (pRemoteCharacteristic->getUUID().equals(NimBLEUUID("fff1")))
     {
-        //Log.debug("TDTPollCharacteristicTask: Received notification, length: %d", length);
+        //LOG_DEBUG(TDT, "Received notification, length: %d", length);
         processIncomingData(pData, length);
     }
 }
@@ -345,13 +389,13 @@ void TDTPollCharacteristicTask::processIncomingData(uint8_t* pData, size_t lengt
         // New frame starting, calculate expected length
         expectedLength = TDT_INFO_LEN + (pData[6] << 8) + pData[7];
         dataBuffer.clear();
-        //Log.debug("TDTPollCharacteristicTask: New frame detected, expected length: %d", expectedLength);
+        //LOG_DEBUG(TDT, "New frame detected, expected length: %d", expectedLength);
     }
     
     // Append data to buffer
     dataBuffer.insert(dataBuffer.end(), pData, pData + length);
     
-    //Log.debug("TDTPollCharacteristicTask: Buffer size: %d, expected: %d", dataBuffer.size(), expectedLength);
+    //LOG_DEBUG(TDT, "Buffer size: %d, expected: %d", dataBuffer.size(), expectedLength);
     
     // Check if we have enough data
     if (dataBuffer.size() < std::max(TDT_INFO_LEN, expectedLength))
@@ -369,7 +413,7 @@ void TDTPollCharacteristicTask::processIncomingData(uint8_t* pData, size_t lengt
     uint8_t cmdId = dataBuffer[5];
     dataFinal[cmdId] = dataBuffer;
     
-    //Log.debug("TDTPollCharacteristicTask: Stored frame for command 0x%02X", cmdId);
+    //LOG_DEBUG(TDT, "Stored frame for command 0x%02X", cmdId);
     
     // Check if we have received all expected responses
     if (dataFinal.size() >= 2) // We expect responses for 0x8C and 0x8D
@@ -384,21 +428,21 @@ bool TDTPollCharacteristicTask::validateTDTFrame()
     // Check frame end
     if (dataBuffer.back() != TDT_TAIL)
     {
-        Log.debug("TDTPollCharacteristicTask: Invalid frame end: 0x%02X", dataBuffer.back());
+        LOG_DEBUG(TDT, "Invalid frame end: 0x%02X", dataBuffer.back());
         return false;
     }
     
     // Check frame version
     if (dataBuffer[1] != TDT_RSP_VER)
     {
-        Log.debug("TDTPollCharacteristicTask: Unknown frame version: 0x%02X", dataBuffer[1]);
+        LOG_DEBUG(TDT, "Unknown frame version: 0x%02X", dataBuffer[1]);
         return false;
     }
     
     // Check error code
     if (dataBuffer[4] != 0)
     {
-        Log.debug("TDTPollCharacteristicTask: BMS reported error code: 0x%02X", dataBuffer[4]);
+        LOG_DEBUG(TDT, "BMS reported error code: 0x%02X", dataBuffer[4]);
         return false;
     }
     
@@ -409,11 +453,11 @@ bool TDTPollCharacteristicTask::validateTDTFrame()
     
     if (calculatedCRC != receivedCRC)
     {
-        Log.debug("TDTPollCharacteristicTask: Invalid checksum 0x%04X != 0x%04X", receivedCRC, calculatedCRC);
+        LOG_DEBUG(TDT, "Invalid checksum 0x%04X != 0x%04X", receivedCRC, calculatedCRC);
         return false;
     }
     
-    //Log.debug("TDTPollCharacteristicTask: Frame validation successful");
+    //LOG_DEBUG(TDT, "Frame validation successful");
     return true;
 }
 
@@ -422,6 +466,8 @@ void TDTPollCharacteristicTask::createSuccessResult()
     TaskResult result;
     result.status = TaskStatus::SUCCESS;
     result.deviceAddress = deviceAddress;
+    result.durationMs = millis() - getStartTime();
+    result.scheduledMs = pollDueTime;
     
     TDTBMSData bmsData = parseTDTData();
     
@@ -431,7 +477,7 @@ void TDTPollCharacteristicTask::createSuccessResult()
     
     result.errorMessage = formatBMSDataAsString(bmsData);
     
-    //Log.info("TDTPollCharacteristicTask: Successfully parsed TDT BMS data: %s", result.errorMessage.c_str());
+    //LOG_INFO(TDT, "Successfully parsed TDT BMS data: %s", result.errorMessage.c_str());
     pendingResult = result;
 }
 
@@ -452,7 +498,7 @@ TDTBMSData TDTPollCharacteristicTask::parseTDTData()
     // Ensure we have the main data packet from the BMS
     if (dataFinal.find(0x8C) == dataFinal.end())
     {
-        Log.error("TDTPollCharacteristicTask: Missing 0x8C response data");
+        LOG_ERROR(TDT, "Missing 0x8C response data");
         return bmsData;
     }
     
@@ -486,8 +532,8 @@ TDTBMSData TDTPollCharacteristicTask::parseTDTData()
         if (mainData.size() >= tempStart + (i + 1) * 2)
         {
             uint16_t tempRaw = (mainData[tempStart + i * 2] << 8) | mainData[tempStart + i * 2 + 1];
-            // Correctly convert from 0.1 Kelvin to Celsius
-            bmsData.temperatures[i] = (static_cast<float>(tempRaw) - 2731.0f); // in °C * 10
+            // Convert from 0.1 Kelvin to 0.1 Celsius
+            bmsData.temperatures[i] = static_cast<int16_t>(tempRaw - 2731); // in °C * 10
         }
     }
     
@@ -497,7 +543,8 @@ TDTBMSData TDTPollCharacteristicTask::parseTDTData()
     if (mainData.size() >= dataStart + 2)
     {
         uint16_t currentRaw = (mainData[dataStart + 0] << 8) | mainData[dataStart + 1];
-        bmsData.current = (currentRaw & 0x3FFF) * ((currentRaw >> 15) ? -1.0f : 1.0f); // in A * 10
+        const int16_t magnitude = currentRaw & 0x3FFF;
+        bmsData.current = (currentRaw >> 15) ? -magnitude : magnitude; // in A * 10
     }
     
     // Voltage (relative offset 2)
@@ -509,7 +556,7 @@ TDTBMSData TDTPollCharacteristicTask::parseTDTData()
     // Cycle charge (relative offset 4)
     if (mainData.size() >= dataStart + 6)
     {
-        bmsData.cycleCharge = ((mainData[dataStart + 4] << 8) | mainData[dataStart + 5]) / 10.0f;
+        bmsData.cycleCharge = ((mainData[dataStart + 4] << 8) | mainData[dataStart + 5]) / 10;
     }
     
     // Cycles (relative offset 8)
@@ -540,20 +587,17 @@ TDTBMSData TDTPollCharacteristicTask::parseTDTData()
 
 std::string TDTPollCharacteristicTask::formatBMSDataAsString(const TDTBMSData& data)
 {
-    std::string result = "TDT BMS Data: ";
-    result += "Voltage=" + std::to_string(data.voltage / 100.0f) + "V, ";
-    result += "Current=" + std::to_string(data.current / 10.0f) + "A, ";
-    result += "SOC=" + std::to_string(data.batteryLevel) + "%, ";
-    result += "Cycles=" + std::to_string(data.cycles) + ", ";
-    result += "Cells=" + std::to_string(data.cellCount) + ", ";
-    result += "TempSensors=" + std::to_string(data.tempSensorCount);
-    
-    if (data.problemCode != 0)
+    char buffer[160];
+    int len = snprintf(buffer, sizeof(buffer), "TDT BMS Data: Voltage=%sV, Current=%sA, SOC=%u%%, Cycles=%u, Cells=%u, TempSensors=%u",
+                       FixedText(Fixed(data.voltage, 2)).c_str(), FixedText(Fixed(data.current, 1)).c_str(),
+                       data.batteryLevel, data.cycles, data.cellCount, data.tempSensorCount);
+
+    if (data.problemCode != 0 && len > 0 && len < (int)sizeof(buffer))
     {
-        result += ", Problem=0x" + std::to_string(data.problemCode);
+        snprintf(buffer + len, sizeof(buffer) - len, ", Problem=0x%04X", data.problemCode);
     }
-    
-    return result;
+
+    return std::string(buffer);
 }
 
 void TDTPollCharacteristicTask::setErrorResult(const std::string& errorMessage)
@@ -15,7 +15,12 @@ public:
     static constexpr int MAX_CELLS = 32;
     static constexpr int MAX_TEMP_SENSORS = 8;
 
+    // Polls are due on multiples of the interval in wall clock time, :00, :10, :20 s and
+    // so on, so samples of several batteries and gateways line up. Until the time is synced
+    // only the rate is fixed.
     static constexpr int POLL_INTERVAL = 10000;
+    // A poll closer than this to the previous one skips to the next slot
+    static constexpr int MIN_POLL_GAP = POLL_INTERVAL / 2;
 
     TDTPollCharacteristicTask(int priority, uint32_t timeout,
                              std::function<void(const TaskResult &)> callback,
@@ -28,6 +33,7 @@ public:
     bool process() override;
     void stop() override;
     void restart() override;
+    void requestRefresh() override;
 
     // NimBLEClientCallbacks
     void onConnect(NimBLEClient* pClient) override;
@@ -42,7 +48,9 @@ private:
     bool commandsSent;
     bool connecting;
 
-    uint32_t nextPollTime;
+    uint64_t nextPollTime;      // Clock::nowMs(), 0 = no poll scheduled
+    uint64_t scheduledPollTime; // slot on the poll schedule, nextPollTime unless a refresh moved it
+    uint64_t pollDueTime;       // slot of the poll in flight, 0 if it is not on the schedule
     
     NimBLEClient* pBLEClient;
     NimBLERemoteCharacteristic* pReadChar;
@@ -56,6 +64,7 @@ private:
     std::map<uint8_t, std::vector<uint8_t>> dataFinal;
     int currentCmdIndex;
     
+    uint64_t getNextPollTime(uint64_t lastSlot) const;
     void connectToDeviceAsync();
     void initializeBMS();
     void sendCommands();
@@ -1,16 +1,31 @@
 #include <WiFi.h>
 #include <time.h>
+#include <esp_sntp.h>
 #include "TimeSync.h"
 #include "Log.h"
+#include "Clock.h"
+
+namespace
+{
+    // Called by SNTP in the lwIP task whenever it set the system time, including the
+    // periodic resyncs that TimeSync does not wait for
+    void onNtpTime(struct timeval *)
+    {
+        Clock::updateWallClock();
+        LOG_INFO(TIME, "NTP time set, clock was off by %ld ms, drift %ld ppb",
+                 (long)(Clock::getLastStepUs() / 1000), (long)Clock::getDriftPpb());
+    }
+}
 
 void TimeSync::startSync()
 {
-    Log.debug("Starting NTP sync...");
+    LOG_DEBUG(TIME, "Starting NTP sync...");
     configTime(0, 0, "pool.ntp.org", "de.pool.ntp.org");
+    sntp_set_time_sync_notification_cb(onNtpTime);
     setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
     tzset();
 
-    syncStartTime = millis();
+    syncStartTime = Clock::nowMs();
     syncInProgress = true;
 }
 
@@ -22,26 +37,31 @@ bool TimeSync::checkIfSynced()
 
 void TimeSync::onSyncSuccess()
 {
-    Log.debug("Time sync successful!");
+    LOG_DEBUG(TIME, "Time sync successful!");
     timeIsSynced = true;
     syncInProgress = false;
-    lastSyncTime = millis();
+    lastSyncTime = Clock::nowMs();
 
     struct tm timeinfo;
     if (getLocalTime(&timeinfo))
     {
-        Log.debug("Current time: %s", asctime(&timeinfo));
+        LOG_DEBUG(TIME, "Current time: %s", asctime(&timeinfo));
     }
 }
 
 void TimeSync::onSyncFailed()
 {
-    Log.debug("Time sync failed, will retry in %d seconds", RETRY_INTERVAL / 1000);
+    LOG_DEBUG(TIME, "Time sync failed, will retry in %d seconds", RETRY_INTERVAL / 1000);
     syncInProgress = false;
 }
 
 void TimeSync::begin()
 {
+    // The system time survives a software reset, so it can be used before the first sync
+    if (checkIfSynced())
+    {
+        Clock::updateWallClock(false);
+    }
     if (WiFi.status() == WL_CONNECTED && !timeIsSynced)
     {
         startSync();
@@ -61,14 +81,14 @@ void TimeSync::loop()
         {
             onSyncSuccess();
         }
-        else if (millis() - syncStartTime > SYNC_TIMEOUT)
+        else if (Clock::nowMs() - syncStartTime > SYNC_TIMEOUT)
         {
             onSyncFailed();
         }
     }
     else
     {
-        unsigned long timeSinceLastSync = millis() - lastSyncTime;
+        const uint64_t timeSinceLastSync = Clock::nowMs() - lastSyncTime;
 
         if (!timeIsSynced)
         {
@@ -79,8 +99,8 @@ void TimeSync::loop()
         }
         else if (timeSinceLastSync > SYNC_INTERVAL)
         {
-            Log.debug("24h passed, re-syncing time");
-            lastSyncTime = millis();
+            LOG_DEBUG(TIME, "24h passed, re-syncing time");
+            lastSyncTime = Clock::nowMs();
             startSync();
             syncInProgress = false;
         }
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <stdint.h>
+
 class TimeSync {
 private:
-    unsigned long syncStartTime = 0;
-    unsigned long lastSyncTime = 0;
+    uint64_t syncStartTime = 0; // Clock::nowMs()
+    uint64_t lastSyncTime = 0;
     bool syncInProgress = false;
     bool timeIsSynced = false;
     
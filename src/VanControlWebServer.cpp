@@ -6,11 +6,21 @@
 #include <ArduinoJson.h>
 #include "BatteryManager.h"
 #include "Log.h"
-#include "TimeSync.h"
+#include "Clock.h"
+#include "BootPhases.h"
+#include "FixedPoint.h"
+#include "SampleHistory.h"
+#include "PrometheusWriter.h"
+#include "CborWriter.h"
+#include "CrashStore.h"
+#include "OtherFunctions.h"
+#include <array>
+#include "TDTPollCharacteristicTask.h"
+#include "generated/WebAssets.h"
 
 
 VanControlWebServer::VanControlWebServer(BatteryManager *batteryManager, int port)
-    : server(std::make_unique<AsyncWebServer>(port)), isRunning(false)
+    : server(std::make_unique<AsyncWebServer>(port)), liveSocket(std::make_unique<AsyncWebSocket>("/live")), isRunning(false)
 {
     this->batteryManager = batteryManager;
 }
@@ -18,20 +28,12 @@ VanControlWebServer::VanControlWebServer(BatteryManager *batteryManager, int por
 VanControlWebServer::~VanControlWebServer()
 {
     stop();
+    releaseLiveBuffers();
 }
 
 unsigned long VanControlWebServer::getCurrentTime() const
 {
-    if (TimeSync::checkIfSynced())
-    {
-        time_t now;
-        time(&now);
-        return now;
-    }
-    else
-    {
-        return 0;
-    }
+    return (unsigned long)(Clock::epochMs() / 1000);
 }
 
 bool VanControlWebServer::isDigitsOnly(const String &str) const
@@ -69,6 +71,117 @@ void VanControlWebServer::sendError(AsyncWebServerRequest *request, int code, co
     request->send(code, "text/plain", "Error: " + message + "\n");
 }
 
+// "now|dataTime|" in epoch seconds, "0|0|" as long as the time is not synced
+size_t VanControlWebServer::formatTimePrefix(char *buffer, size_t size) const
+{
+    const uint64_t nowMs = Clock::epochMs();
+    if (nowMs != 0)
+    {
+        const uint64_t dataTimeMs = batteryManager->getSampleEpochMs();
+        return snprintf(buffer, size, "%lu|%lu|", (unsigned long)(nowMs / 1000), (unsigned long)(dataTimeMs / 1000));
+    }
+    return snprintf(buffer, size, "0|0|");
+}
+
+bool VanControlWebServer::isNotModified(AsyncWebServerRequest *request, const CachedBody &entry) const
+{
+    AsyncWebHeader *header = request->getHeader("If-None-Match");
+    return header != nullptr && header->value() == entry.etag;
+}
+
+String VanControlWebServer::getCacheControl() const
+{
+    // Nothing new can show up before the next poll, so let clients reuse what they have until then
+    const uint32_t ageMs = millis() - batteryManager->getLastTdtUpdateMs();
+    const uint32_t pollMs = TDTPollCharacteristicTask::POLL_INTERVAL;
+    const uint32_t maxAge = ageMs < pollMs ? (pollMs - ageMs) / 1000 : 0;
+    return "private, max-age=" + String(maxAge);
+}
+
+void VanControlWebServer::sendCached(AsyncWebServerRequest *request, const char *contentType, std::shared_ptr<const CachedBody> entry, std::string prefix) const
+{
+    if (isNotModified(request, *entry))
+    {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", entry->etag);
+        response->addHeader("Cache-Control", getCacheControl());
+        request->send(response);
+        return;
+    }
+
+    // Stream straight from the shared buffer, the lambda keeps it alive until the response is done
+    const size_t total = prefix.size() + entry->body.size();
+    AsyncWebServerResponse *response = request->beginResponse(contentType, total,
+                                                              [entry, prefix, total](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                              {
+                                                                  size_t written = 0;
+                                                                  while (written < maxLen && index < total)
+                                                                  {
+                                                                      const std::string &part = index < prefix.size() ? prefix : entry->body;
+                                                                      const size_t offset = index < prefix.size() ? index : index - prefix.size();
+                                                                      const size_t len = std::min(maxLen - written, part.size() - offset);
+                                                                      memcpy(buffer + written, part.data() + offset, len);
+                                                                      written += len;
+                                                                      index += len;
+                                                                  }
+                                                                  return written;
+                                                              });
+    response->addHeader("ETag", entry->etag);
+    response->addHeader("Cache-Control", getCacheControl());
+    request->send(response);
+}
+
+
+// Chunked response fed by a StreamingBody, the body lives as long as the filler does
+AsyncWebServerResponse *VanControlWebServer::beginStreaming(AsyncWebServerRequest *request, const char *contentType, StreamingBody::Step step, StreamMetric *metric) const
+{
+    auto body = std::make_shared<StreamingBody>(step, metric);
+    return request->beginChunkedResponse(contentType, [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                         { return body->fill(buffer, maxLen); });
+}
+
+// Every route goes through admission control first, see AdmissionControl, and is
+// measured in endpointStats
+void VanControlWebServer::route(const char *uri, void (VanControlWebServer::*handler)(AsyncWebServerRequest *))
+{
+    const size_t index = endpointStats.size();
+    endpointStats.emplace_back(uri);
+    server->on(uri, HTTP_GET, [this, handler, index](AsyncWebServerRequest *request)
+               {
+                   if (!admit(request))
+                   {
+                       return;
+                   }
+                   const uint32_t startMs = millis();
+                   const uint32_t freeBefore = ESP.getFreeHeap();
+                   (this->*handler)(request);
+                   const uint32_t freeAfter = ESP.getFreeHeap();
+                   const uint32_t heldBytes = freeAfter < freeBefore ? freeBefore - freeAfter : 0;
+
+                   // Called when the request object goes away, after the response or on an aborted connection
+                   request->onDisconnect([this, index, startMs, heldBytes]()
+                                         {
+                                             admissionControl.release();
+                                             endpointStats[index].record(millis() - startMs, heldBytes); }); });
+}
+
+bool VanControlWebServer::admit(AsyncWebServerRequest *request)
+{
+    AsyncClient *client = request->client();
+    const Admission result = admissionControl.admit(client != nullptr ? (uint32_t)client->remoteIP() : 0);
+    if (result == Admission::ADMITTED)
+    {
+        // The caller releases the slot when the request is gone
+        return true;
+    }
+
+    const bool rateLimited = result == Admission::RATE_LIMITED;
+    AsyncWebServerResponse *response = request->beginResponse(rateLimited ? 429 : 503, "text/plain",
+                                                              rateLimited ? "Error: Too many requests\n" : "Error: Server busy\n");
+    response->addHeader("Retry-After", String(admissionControl.getRetryAfter(result)));
+    request->send(response);
+    return false;
+}
 
 bool VanControlWebServer::start()
 {
@@ -77,14 +190,57 @@ bool VanControlWebServer::start()
         return true;
     }
 
-    server->on("/", HTTP_GET, [this](AsyncWebServerRequest *request)
-               { handleBatteryHtml(request); });
+    route("/", &VanControlWebServer::handleDashboard);
+
+    route("/battery.json", &VanControlWebServer::handleBatteryJson);
+
+    route("/battery.cbor", &VanControlWebServer::handleBatteryCbor);
+
+    route("/energy.json", &VanControlWebServer::handleEnergyJson);
+
+    route("/stats.json", &VanControlWebServer::handleStatsJson);
+
+    route("/battery", &VanControlWebServer::handleBatteryHtml);
+
+    route("/history.json", &VanControlWebServer::handleHistoryJson);
+
+    route("/export.csv", &VanControlWebServer::handleExportCsv);
+
+    route("/metrics", &VanControlWebServer::handleMetrics);
+
+    route("/webstats.json", &VanControlWebServer::handleWebStats);
+
+    route("/logs", &VanControlWebServer::handleLogs);
 
-    server->on("/battery.json", HTTP_GET, [this](AsyncWebServerRequest *request)
-               { handleBatteryJson(request); });
+    route("/loglevel", &VanControlWebServer::handleLogLevel);
 
-    server->on("/battery", HTTP_GET, [this](AsyncWebServerRequest *request)
-               { handleBatteryHtml(request); });
+    route("/crash.json", &VanControlWebServer::handleCrashJson);
+
+#ifdef LOG_BINARY
+    route("/logs.bin", &VanControlWebServer::handleBinaryLogs);
+#endif
+
+    liveSocket->onEvent([this](AsyncWebSocket *socket, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+                        {
+                            if (type == WS_EVT_CONNECT)
+                            {
+                                LOG_DEBUG(WEB, "Live client %u connected", client->id());
+                                sendLatestSample(client);
+                                // Only AsyncTCP's task may send on its connections, so new samples go
+                                // out from its poll of each connection (about twice a second), not
+                                // from the loop task that stores them
+                                client->client()->onPoll([this, client](void *arg, AsyncClient *tcp)
+                                                         {
+                                                             publishPending();
+                                                             client->_onPoll();
+                                                         });
+                                if (socket->count() == 1 && batteryManager)
+                                {
+                                    // Nobody else is listening, so nothing older is left to publish
+                                    livePublishedVersion = batteryManager->getSampleVersion();
+                                }
+                            } });
+    server->addHandler(liveSocket.get());
 
     // Handle 404 errors
     server->onNotFound([](AsyncWebServerRequest *request)
@@ -118,60 +274,918 @@ void VanControlWebServer::handleBatteryJson(AsyncWebServerRequest *request)
         return;
     }
 
-    const TDTBMSData data = batteryManager->getTdtBms();
-    const uint32_t timestampMs = batteryManager->getLastTdtUpdateMs();
+    const uint32_t version = batteryManager->getSampleVersion();
+    if (request->hasParam("fresh"))
+    {
+        if (request->hasParam("wait") || request->hasParam("fields") || request->hasParam("since"))
+        {
+            sendError(request, 400, "Invalid fresh request");
+            return;
+        }
+        // Concurrent fresh requests all wait for the same next sample, BLEManager coalesces the triggers
+        batteryManager->requestFreshSample();
+        waitForSample(request, version, FRESH_TIMEOUT_MS, true);
+        return;
+    }
+    if (request->hasParam("wait"))
+    {
+        const String wait = request->getParam("wait")->value();
+        const String after = request->hasParam("after") ? request->getParam("after")->value() : String(version);
+        if (!isDigitsOnly(wait) || !isDigitsOnly(after) || request->hasParam("fields") || request->hasParam("since"))
+        {
+            sendError(request, 400, "Invalid wait request");
+            return;
+        }
+        const uint32_t afterVersion = strtoul(after.c_str(), nullptr, 10);
+        if (version <= afterVersion)
+        {
+            waitForSample(request, afterVersion, std::min((uint32_t)strtoul(wait.c_str(), nullptr, 10), MAX_WAIT_MS));
+            return;
+        }
+    }
 
-    if (timestampMs == 0)
+    if (version == 0)
     {
         sendError(request, 500, "No status available");
         return;
     }
 
+    // ?fields=soc,current,... limits the response to those fields, ?since=<version> to the
+    // fields that changed after that version. Both bypass the cache, they are small anyway.
+    // A since newer than the current sample comes from before a reboot, the version counter
+    // started over, so that client gets every field.
+    uint32_t mask = ALL_BATTERY_FIELDS;
+    if (request->hasParam("fields") && !parseFieldMask(request->getParam("fields")->value(), mask))
+    {
+        sendError(request, 400, "Unknown field");
+        return;
+    }
+    if (request->hasParam("since"))
+    {
+        const String since = request->getParam("since")->value();
+        if (!isDigitsOnly(since))
+        {
+            sendError(request, 400, "Invalid since version");
+            return;
+        }
+        const uint32_t sinceVersion = strtoul(since.c_str(), nullptr, 10);
+        for (int i = 0; i < (int)BatteryField::COUNT && sinceVersion <= version; ++i)
+        {
+            if (batteryManager->getFieldVersion((BatteryField)i) <= sinceVersion)
+            {
+                mask &= ~(1u << i);
+            }
+        }
+        if (mask == 0)
+        {
+            AsyncWebServerResponse *response = request->beginResponse(304);
+            response->addHeader("Cache-Control", getCacheControl());
+            request->send(response);
+            return;
+        }
+    }
+    if (mask != ALL_BATTERY_FIELDS)
+    {
+        char prefix[32];
+        const size_t prefixLen = formatTimePrefix(prefix, sizeof(prefix));
+        std::string body(prefix, prefixLen);
+        renderBatteryJson(body, mask);
+        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", body.c_str());
+        response->addHeader("Cache-Control", getCacheControl());
+        request->send(response);
+        return;
+    }
+
+    auto entry = jsonCache.get(version, [this](std::string &out)
+                               { renderBatteryJson(out); });
+    if (!entry)
+    {
+        sendError(request, 500, "Rendering failed");
+        return;
+    }
+
+    // The prefix carries the request time, so it stays outside the cached body
+    char prefix[32];
+    formatTimePrefix(prefix, sizeof(prefix));
+    sendCached(request, "text/plain", entry, prefix);
+}
+
+// JSON keys in BatteryField order, with the short names accepted by ?fields=
+static const struct
+{
+    const char *key;
+    const char *alias;
+} BATTERY_FIELD_NAMES[] = {
+    {"cellCount", nullptr},
+    {"tempSensorCount", nullptr},
+    {"voltage", nullptr},
+    {"current", nullptr},
+    {"batteryLevel", "soc"},
+    {"cycleCharge", nullptr},
+    {"cycles", nullptr},
+    {"problemCode", nullptr},
+    {"cellVoltages", "cells"},
+    {"temperatures", "temps"},
+    {"voltageSoc", nullptr},
+    {"atRest", nullptr},
+};
+static_assert(sizeof(BATTERY_FIELD_NAMES) / sizeof(BATTERY_FIELD_NAMES[0]) == (size_t)BatteryField::COUNT, "one name per field");
+
+bool VanControlWebServer::parseFieldMask(const String &fields, uint32_t &mask) const
+{
+    mask = 0;
+    int start = 0;
+    while (start <= (int)fields.length())
+    {
+        int end = fields.indexOf(',', start);
+        if (end < 0)
+        {
+            end = fields.length();
+        }
+        const String name = fields.substring(start, end);
+        int field = 0;
+        for (; field < (int)BatteryField::COUNT; ++field)
+        {
+            const char *alias = BATTERY_FIELD_NAMES[field].alias;
+            if (name == BATTERY_FIELD_NAMES[field].key || (alias != nullptr && name == alias))
+            {
+                break;
+            }
+        }
+        if (field == (int)BatteryField::COUNT)
+        {
+            return false;
+        }
+        mask |= 1u << field;
+        start = end + 1;
+    }
+    return mask != 0;
+}
+
+// Long poll: the response is started right away, but its filler keeps answering
+// RESPONSE_TRY_AGAIN until a newer sample exists or the wait is over. AsyncTCP retries on
+// its poll timer, so everything stays in the AsyncTCP task and no request pointer has to
+// be kept around. All waiters take the body from jsonCache, i.e. one serialisation per
+// sample no matter how many are parked. On timeout the current sample is returned, the
+// client sees that by its version not being newer than after.
+// For fresh requests the body starts with "fresh" and the measured "latencyMs" from the
+// request to the new sample; headers are already sent when that is known, which is also
+// why a wait before the first sample is turned away with 503 instead of possibly ending
+// in an empty 200.
+// While parked the request counts against the parked budget of admissionControl, not
+// against its in-flight cap.
+void VanControlWebServer::waitForSample(AsyncWebServerRequest *request, uint32_t afterVersion, uint32_t waitMs, bool fresh)
+{
+    if (batteryManager->getSampleVersion() == 0)
+    {
+        // A fresh request has triggered a poll already, otherwise the next one is due within POLL_INTERVAL
+        AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Error: No sample yet\n");
+        response->addHeader("Retry-After", fresh ? "1" : String(TDTPollCharacteristicTask::POLL_INTERVAL / 1000));
+        request->send(response);
+        return;
+    }
+    if (!admissionControl.park())
+    {
+        AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Error: Too many waiting requests\n");
+        response->addHeader("Retry-After", "1");
+        request->send(response);
+        return;
+    }
+
+    // Unparked when the response is done or the client went away and the filler is destroyed
+    struct Waiter
+    {
+        AdmissionControl &admission;
+        uint32_t afterVersion;
+        uint32_t startMs;
+        uint32_t waitMs;
+        bool fresh;
+        std::shared_ptr<const CachedBody> entry;
+        std::string prefix;
+        size_t bodyOffset = 0;
+
+        Waiter(AdmissionControl &admission, uint32_t afterVersion, uint32_t waitMs, bool fresh)
+            : admission(admission), afterVersion(afterVersion), startMs(millis()), waitMs(waitMs), fresh(fresh) {}
+        ~Waiter() { admission.unpark(); }
+    };
+    auto waiter = std::make_shared<Waiter>(admissionControl, afterVersion, waitMs, fresh);
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain", [this, waiter](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                     {
+                                                                         if (!waiter->entry)
+                                                                         {
+                                                                             const uint32_t version = batteryManager->getSampleVersion();
+                                                                             if (version <= waiter->afterVersion && millis() - waiter->startMs < waiter->waitMs)
+                                                                             {
+                                                                                 return RESPONSE_TRY_AGAIN;
+                                                                             }
+                                                                             waiter->entry = jsonCache.get(version, [this](std::string &out)
+                                                                                                           { renderBatteryJson(out); });
+                                                                             if (!waiter->entry)
+                                                                             {
+                                                                                 return 0;
+                                                                             }
+                                                                             char prefix[64];
+                                                                             size_t len = formatTimePrefix(prefix, sizeof(prefix));
+                                                                             if (waiter->fresh)
+                                                                             {
+                                                                                 // Replaces the opening brace of the cached body
+                                                                                 if (version > waiter->afterVersion)
+                                                                                     len += snprintf(prefix + len, sizeof(prefix) - len, "{\"fresh\":true,\"latencyMs\":%u,", millis() - waiter->startMs);
+                                                                                 else
+                                                                                     len += snprintf(prefix + len, sizeof(prefix) - len, "{\"fresh\":false,");
+                                                                                 waiter->bodyOffset = 1;
+                                                                             }
+                                                                             waiter->prefix.assign(prefix, len);
+                                                                         }
+
+                                                                         const std::string &prefix = waiter->prefix;
+                                                                         const size_t bodyOffset = waiter->bodyOffset;
+                                                                         const std::string &body = waiter->entry->body;
+                                                                         size_t written = 0;
+                                                                         while (written < maxLen && index < prefix.size() + body.size() - bodyOffset)
+                                                                         {
+                                                                             const std::string &part = index < prefix.size() ? prefix : body;
+                                                                             const size_t offset = index < prefix.size() ? index : index - prefix.size() + bodyOffset;
+                                                                             const size_t len = std::min(maxLen - written, part.size() - offset);
+                                                                             memcpy(buffer + written, part.data() + offset, len);
+                                                                             written += len;
+                                                                             index += len;
+                                                                         }
+                                                                         return written; });
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+
+void VanControlWebServer::renderBatteryJson(std::string &out, uint32_t mask) const
+{
+    const TDTBMSData data = batteryManager->getTdtBms();
     DynamicJsonDocument doc(1024);
+    auto selected = [mask](BatteryField field)
+    {
+        return (mask & (1u << (int)field)) != 0;
+    };
+    auto key = [](BatteryField field)
+    {
+        return BATTERY_FIELD_NAMES[(int)field].key;
+    };
 
-    doc["cellCount"] = data.cellCount;
-    doc["tempSensorCount"] = data.tempSensorCount;
-    doc["voltage"] = data.voltage;
-    doc["current"] = data.current;
-    doc["batteryLevel"] = data.batteryLevel;
-    doc["cycleCharge"] = data.cycleCharge;
-    doc["cycles"] = data.cycles;
-    doc["problemCode"] = data.problemCode;
+    // Lets clients ask for ?since=<version> next time
+    doc["version"] = batteryManager->getSampleVersion();
+    if (selected(BatteryField::CELL_COUNT))
+        doc[key(BatteryField::CELL_COUNT)] = data.cellCount;
+    if (selected(BatteryField::TEMP_SENSOR_COUNT))
+        doc[key(BatteryField::TEMP_SENSOR_COUNT)] = data.tempSensorCount;
+    if (selected(BatteryField::VOLTAGE))
+        doc[key(BatteryField::VOLTAGE)] = data.voltage;
+    if (selected(BatteryField::CURRENT))
+        doc[key(BatteryField::CURRENT)] = data.current;
+    if (selected(BatteryField::BATTERY_LEVEL))
+        doc[key(BatteryField::BATTERY_LEVEL)] = data.batteryLevel;
+    if (selected(BatteryField::CYCLE_CHARGE))
+        doc[key(BatteryField::CYCLE_CHARGE)] = data.cycleCharge;
+    if (selected(BatteryField::CYCLES))
+        doc[key(BatteryField::CYCLES)] = data.cycles;
+    if (selected(BatteryField::PROBLEM_CODE))
+        doc[key(BatteryField::PROBLEM_CODE)] = data.problemCode;
+    if (selected(BatteryField::VOLTAGE_SOC))
+        doc[key(BatteryField::VOLTAGE_SOC)] = batteryManager->getSOC();
+    if (selected(BatteryField::AT_REST))
+        doc[key(BatteryField::AT_REST)] = batteryManager->isAtRest();
 
     // Cell voltages array
-    JsonArray cellVoltages = doc.createNestedArray("cellVoltages");
-    for (int i = 0; i < data.cellCount && i < 4; ++i)
+    if (selected(BatteryField::CELL_VOLTAGES))
     {
-        cellVoltages.add(data.cellVoltages[i]);
+        JsonArray cellVoltages = doc.createNestedArray(key(BatteryField::CELL_VOLTAGES));
+        for (int i = 0; i < data.cellCount && i < 4; ++i)
+        {
+            cellVoltages.add(data.cellVoltages[i]);
+        }
     }
 
     // Temperatures array
-    JsonArray temperatures = doc.createNestedArray("temperatures");
-    for (int i = 0; i < data.tempSensorCount && i < 4; ++i)
+    if (selected(BatteryField::TEMPERATURES))
     {
-        temperatures.add(data.temperatures[i]);
+        JsonArray temperatures = doc.createNestedArray(key(BatteryField::TEMPERATURES));
+        for (int i = 0; i < data.tempSensorCount && i < 4; ++i)
+        {
+            temperatures.add(data.temperatures[i]);
+        }
     }
 
-    String jsonString;
-    serializeJson(doc, jsonString);
+    serializeJson(doc, out);
+}
+
+// Fixed schema, integer keys and raw BMS units, see README. Encoded on the stack, the
+// response only keeps the few encoded bytes.
+void VanControlWebServer::handleBatteryCbor(AsyncWebServerRequest *request)
+{
+    if (!batteryManager)
+    {
+        sendError(request, 500, "Battery manager not available");
+        return;
+    }
+
+    const uint32_t version = batteryManager->getSampleVersion();
+    if (version == 0)
+    {
+        sendError(request, 500, "No status available");
+        return;
+    }
+
+    const TDTBMSData data = batteryManager->getTdtBms();
+    const uint32_t ageMs = (uint32_t)(Clock::nowMs() - batteryManager->getLastSampleClockMs());
+    const uint64_t sampleTimeMs = batteryManager->getSampleEpochMs();
+
+    std::array<uint8_t, CBOR_BATTERY_MAX_SIZE> buffer;
+    CborWriter cbor(buffer.data(), buffer.size());
+    cbor.beginMap(14);
+    cbor.writeUInt(CBOR_KEY_SCHEMA);
+    cbor.writeUInt(CBOR_SCHEMA_VERSION);
+    cbor.writeUInt(CBOR_KEY_SAMPLE_TIME);
+    cbor.writeUInt(sampleTimeMs);
+    cbor.writeUInt(CBOR_KEY_SAMPLE_AGE);
+    cbor.writeUInt(ageMs);
+    cbor.writeUInt(CBOR_KEY_SAMPLE_VERSION);
+    cbor.writeUInt(version);
+    cbor.writeUInt(CBOR_KEY_VOLTAGE);
+    cbor.writeUInt(data.voltage);
+    cbor.writeUInt(CBOR_KEY_CURRENT);
+    cbor.writeInt(data.current);
+    cbor.writeUInt(CBOR_KEY_BATTERY_LEVEL);
+    cbor.writeUInt(data.batteryLevel);
+    cbor.writeUInt(CBOR_KEY_CYCLE_CHARGE);
+    cbor.writeUInt(data.cycleCharge);
+    cbor.writeUInt(CBOR_KEY_CYCLES);
+    cbor.writeUInt(data.cycles);
+    cbor.writeUInt(CBOR_KEY_PROBLEM_CODE);
+    cbor.writeUInt(data.problemCode);
+    cbor.writeUInt(CBOR_KEY_CELL_VOLTAGES);
+    const int cells = std::min((int)data.cellCount, 4);
+    cbor.beginArray(cells);
+    for (int i = 0; i < cells; ++i)
+    {
+        cbor.writeUInt(data.cellVoltages[i]);
+    }
+    cbor.writeUInt(CBOR_KEY_TEMPERATURES);
+    const int sensors = std::min((int)data.tempSensorCount, 4);
+    cbor.beginArray(sensors);
+    for (int i = 0; i < sensors; ++i)
+    {
+        cbor.writeInt(data.temperatures[i]);
+    }
+    cbor.writeUInt(CBOR_KEY_VOLTAGE_SOC);
+    cbor.writeInt(batteryManager->getSOC());
+    cbor.writeUInt(CBOR_KEY_AT_REST);
+    cbor.writeBool(batteryManager->isAtRest());
+
+    if (!cbor.ok())
+    {
+        sendError(request, 500, "Encoding failed");
+        return;
+    }
+
+    const size_t len = cbor.length();
+    AsyncWebServerResponse *response = request->beginResponse("application/cbor", len,
+                                                              [buffer, len](uint8_t *out, size_t maxLen, size_t index) -> size_t
+                                                              {
+                                                                  const size_t chunk = std::min(maxLen, len - index);
+                                                                  memcpy(out, buffer.data() + index, chunk);
+                                                                  return chunk;
+                                                              });
+    response->addHeader("Cache-Control", getCacheControl());
+    request->send(response);
+}
+
+// Runs in the AsyncTCP task, from the poll of any live client
+void VanControlWebServer::publishPending()
+{
+    if (!batteryManager || batteryManager->getSampleVersion() == livePublishedVersion)
+    {
+        return;
+    }
+    livePublishedVersion = batteryManager->getSampleVersion();
+    publishSample();
+}
+
+// Sends the latest sample to all live clients, in the AsyncTCP task. The message is
+// serialised once into a single buffer that all clients share. A client that has not
+// drained the previous sample yet skips this one instead of queueing up stale data.
+void VanControlWebServer::publishSample()
+{
+    releaseLiveBuffers();
+    liveSocket->cleanupClients();
+    if (liveSocket->count() == 0)
+    {
+        return;
+    }
+
+    const uint32_t version = batteryManager->getSampleVersion();
+    auto entry = jsonCache.get(version, [this](std::string &out)
+                               { renderBatteryJson(out); });
+    if (!entry)
+    {
+        return;
+    }
+
+    char prefix[32];
+    const size_t prefixLen = formatTimePrefix(prefix, sizeof(prefix));
+    const size_t len = prefixLen + entry->body.size();
+    AsyncWebSocketMessageBuffer *buffer = new AsyncWebSocketMessageBuffer(len);
+    if (buffer == nullptr || buffer->get() == nullptr)
+    {
+        delete buffer;
+        return;
+    }
+    memcpy(buffer->get(), prefix, prefixLen);
+    memcpy(buffer->get() + prefixLen, entry->body.data(), entry->body.size());
+
+    buffer->lock();
+    for (AsyncWebSocketClient *client : liveSocket->getClients())
+    {
+        if (client->status() != WS_CONNECTED)
+        {
+            continue;
+        }
+        AsyncClient *tcp = client->client();
+        if (client->queueIsFull() || tcp == nullptr || tcp->space() < len)
+        {
+            liveDroppedCount++;
+            continue;
+        }
+        client->text(buffer);
+        liveSentCount++;
+    }
+    buffer->unlock();
+    liveBuffers.push_back(buffer);
+}
+
+void VanControlWebServer::sendLatestSample(AsyncWebSocketClient *client)
+{
+    if (!batteryManager || batteryManager->getSampleVersion() == 0)
+    {
+        return;
+    }
+
+    auto entry = jsonCache.get(batteryManager->getSampleVersion(), [this](std::string &out)
+                               { renderBatteryJson(out); });
+    if (!entry)
+    {
+        return;
+    }
+
+    char prefix[32];
+    formatTimePrefix(prefix, sizeof(prefix));
+    std::string message = prefix + entry->body;
+    client->text(message.c_str(), message.size());
+}
+
+void VanControlWebServer::releaseLiveBuffers()
+{
+    for (auto it = liveBuffers.begin(); it != liveBuffers.end();)
+    {
+        if ((*it)->canDelete())
+        {
+            delete *it;
+            it = liveBuffers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
 
-    String prefixString;
-    if (TimeSync::checkIfSynced())
+void VanControlWebServer::handleDashboard(AsyncWebServerRequest *request)
+{
+    // Static shell, gzipped at build time and served straight from flash. The page
+    // pulls its data from /battery.json, /battery keeps the server rendered version.
+    AsyncWebHeader *header = request->getHeader("If-None-Match");
+    AsyncWebServerResponse *response;
+    if (header != nullptr && header->value() == DASHBOARD_HTML_ETAG)
     {
-        time_t now;
-        time(&now);
-        time_t dataTime = now - ((millis() - batteryManager->getLastTdtUpdateMs()) / 1000);
-        prefixString = String((unsigned long)now) + "|" + String((unsigned long)dataTime) + "|";
+        response = request->beginResponse(304);
     }
     else
     {
-        prefixString = "0|0|";
+        response = request->beginResponse_P(200, "text/html", DASHBOARD_HTML_GZ, DASHBOARD_HTML_GZ_LEN);
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", DASHBOARD_HTML_ETAG);
+    // The URL stays the same across OTA updates, so browsers must ask every time; with the
+    // ETag that costs a 304 as long as the firmware has not changed
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+void VanControlWebServer::handleEnergyJson(AsyncWebServerRequest *request)
+{
+    if (!batteryManager)
+    {
+        sendError(request, 500, "Battery manager not available");
+        return;
     }
 
-    request->send(200, "text/plain", prefixString + jsonString);
+    // Written by hand, one bucket per step: the ArduinoJson document for all 31 buckets
+    // needed a 4 KB pool plus the serialised copy. The loop task keeps integrating while
+    // this streams, so the steps print one snapshot taken now.
+    auto energy = std::make_shared<EnergyCounter::Snapshot>();
+    batteryManager->getEnergy().getSnapshot(*energy);
+    auto printTotals = [](StreamingBody &body, const EnergyTotals &totals)
+    {
+        // chargeIn/Out in mAh, energyIn/Out in Wh
+        body.printf("\"chargeIn\":%d,\"chargeOut\":%d,\"energyIn\":%d,\"energyOut\":%d",
+                    totals.chargeInMAh(), totals.chargeOutMAh(), totals.energyInWh(), totals.energyOutWh());
+    };
+
+    const size_t hourlyStart = 1;
+    const size_t dailyStart = hourlyStart + EnergyCounter::HOURLY_BUCKETS;
+    const size_t end = dailyStart + EnergyCounter::DAILY_BUCKETS;
+    request->send(beginStreaming(request, "application/json", [energy, printTotals, dailyStart, end](size_t step, StreamingBody &body)
+                                 {
+                                     if (step == 0)
+                                     {
+                                         body.print("{\"total\":{");
+                                         printTotals(body, energy->totals);
+                                         body.print("},\"hourly\":[");
+                                     }
+                                     else if (step < end)
+                                     {
+                                         const bool hourly = step < dailyStart;
+                                         const int index = hourly ? step - hourlyStart : step - dailyStart;
+                                         const EnergyBucket &bucket = hourly ? energy->hourly[index] : energy->daily[index];
+                                         if (step == dailyStart)
+                                             body.print("],\"daily\":[");
+                                         else if (index > 0)
+                                             body.print(",");
+                                         body.printf("{\"key\":%u,", bucket.key);
+                                         printTotals(body, bucket.totals);
+                                         body.print("}");
+                                     }
+                                     else
+                                     {
+                                         body.print("]}");
+                                     }
+                                     return step < end; },
+                                 &energyStream));
 }
 
-void VanControlWebServer::handleBatteryHtml(AsyncWebServerRequest *request)
+void VanControlWebServer::handleHistoryJson(AsyncWebServerRequest *request)
+{
+    if (!batteryManager)
+    {
+        sendError(request, 500, "Battery manager not available");
+        return;
+    }
+
+    // Column arrays would need two passes over the ring, so this is one row per sample:
+    // [ageMs, voltage, current, minCell, maxCell, maxTemp, batteryLevel] in raw BMS units
+    const SampleHistory *history = &batteryManager->getHistory();
+    const uint32_t nowMs = millis();
+    const uint32_t first = history->getFirstSeq();
+    const uint32_t end = history->getEndSeq();
+    request->send(beginStreaming(request, "application/json", [history, nowMs, first, end, separator = ""](size_t step, StreamingBody &body) mutable
+                                 {
+                                     const uint32_t seq = first + step;
+                                     if (step == 0)
+                                     {
+                                         body.print("{\"columns\":[\"ageMs\",\"voltage\",\"current\",\"minCell\",\"maxCell\",\"maxTemp\",\"batteryLevel\"],\"samples\":[");
+                                     }
+                                     if (seq >= end)
+                                     {
+                                         body.print("]}");
+                                         return false;
+                                     }
+                                     HistorySample sample;
+                                     if (history->get(seq, sample))
+                                     {
+                                         // Samples the writer overwrote meanwhile are skipped, so the first row written has no separator
+                                         body.printf("%s[%u,%u,%d,%u,%u,%d,%u]", separator, nowMs - sample.sampleMs, sample.voltage,
+                                                     sample.current, sample.minCell, sample.maxCell, sample.maxTemp, sample.batteryLevel);
+                                         separator = ",";
+                                     }
+                                     return true; },
+                                 &historyStream));
+}
+
+void VanControlWebServer::handleExportCsv(AsyncWebServerRequest *request)
+{
+    if (!batteryManager)
+    {
+        sendError(request, 500, "Battery manager not available");
+        return;
+    }
+
+    const SampleHistory *history = &batteryManager->getHistory();
+    const uint32_t first = history->getFirstSeq();
+    const uint32_t end = history->getEndSeq();
+    AsyncWebServerResponse *response = beginStreaming(request, "text/csv", [history, first, end](size_t step, StreamingBody &body)
+                                                      {
+                                                          if (step == 0)
+                                                          {
+                                                              body.print("time,voltage,current,minCell,maxCell,maxTemp,batteryLevel\r\n");
+                                                              return first < end;
+                                                          }
+                                                          const uint32_t seq = first + step - 1;
+                                                          HistorySample sample;
+                                                          if (history->get(seq, sample))
+                                                          {
+                                                              // Epoch seconds, 0 while the time is not synced
+                                                              const unsigned long time = (unsigned long)(Clock::toEpochMs(Clock::fromMillis(sample.sampleMs)) / 1000);
+                                                              body.printf("%lu,%s,%s,%s,%s,%s,%u\r\n", time, FixedText(Fixed(sample.voltage, 2)).c_str(),
+                                                                          FixedText(Fixed(sample.current, 1)).c_str(), FixedText(Fixed(sample.minCell, 3)).c_str(),
+                                                                          FixedText(Fixed(sample.maxCell, 3)).c_str(), FixedText(Fixed(sample.maxTemp, 1)).c_str(),
+                                                                          sample.batteryLevel);
+                                                          }
+                                                          return seq + 1 < end; },
+                                                      &exportStream);
+    response->addHeader("Content-Disposition", "attachment; filename=\"battery.csv\"");
+    request->send(response);
+}
+
+void VanControlWebServer::handleStatsJson(AsyncWebServerRequest *request)
+{
+    if (!batteryManager)
+    {
+        sendError(request, 500, "Battery manager not available");
+        return;
+    }
+
+    // One window per step instead of a 4 KB document and its serialised copy. Each window
+    // is read when its step runs, consistent in itself as SlidingWindow::get() is.
+    const BatteryStats *stats = &batteryManager->getStats();
+    constexpr size_t WINDOWS = (size_t)StatsWindow::COUNT;
+    constexpr size_t END = (size_t)StatsMetric::COUNT * WINDOWS;
+    request->send(beginStreaming(request, "application/json", [stats](size_t step, StreamingBody &body)
+                                 {
+                                     if (step == END)
+                                     {
+                                         body.print("}}");
+                                         return false;
+                                     }
+                                     const StatsMetric metric = (StatsMetric)(step / WINDOWS);
+                                     const StatsWindow window = (StatsWindow)(step % WINDOWS);
+                                     if (step % WINDOWS == 0)
+                                         body.printf("%s\"%s\":{", step == 0 ? "{" : "},", BatteryStats::getMetricName(metric));
+                                     else
+                                         body.print(",");
+                                     const WindowStats stat = stats->get(metric, window);
+                                     body.printf("\"%s\":{\"count\":%u", BatteryStats::getWindowName(window), (unsigned)stat.count);
+                                     if (stat.count > 0)
+                                     {
+                                         // Same raw units as min/max, with one decimal
+                                         body.printf(",\"min\":%d,\"max\":%d,\"mean\":", (int)stat.min, (int)stat.max);
+                                         body.print(stat.mean());
+                                         body.print(",\"stddev\":");
+                                         body.print(stat.stddev());
+                                     }
+                                     body.print("}");
+                                     return true; },
+                                 &statsStream));
+}
+
+// Recent log records from the in-memory ring as text, one "<seq> <ms> <LEVEL> <message>"
+// line each. ?after=<seq> continues after the last line a client has seen (X-Log-Next is
+// the value to pass next time), ?level=warning only returns records at or above the level.
+void VanControlWebServer::handleLogs(AsyncWebServerRequest *request)
+{
+    const LogClass::Ring &ring = Log.getRing();
+    const uint32_t end = ring.getEndSeq();
+    uint32_t first = ring.getFirstSeq();
+    if (request->hasParam("after"))
+    {
+        const String after = request->getParam("after")->value();
+        if (!isDigitsOnly(after))
+        {
+            sendError(request, 400, "Invalid after");
+            return;
+        }
+        first = std::max(first, (uint32_t)strtoul(after.c_str(), nullptr, 10) + 1);
+    }
+
+    LogLevel minLevel = LogLevel::DEBUG;
+    if (request->hasParam("level"))
+    {
+        if (!LogClass::parseLevel(request->getParam("level")->value().c_str(), minLevel))
+        {
+            sendError(request, 400, "Unknown level");
+            return;
+        }
+    }
+
+    // Only up to the records that existed when the request came in, so the stream ends
+    AsyncWebServerResponse *response = beginStreaming(request, "text/plain", [&ring, first, end, minLevel](size_t step, StreamingBody &body)
+                                                      {
+                                                          const uint32_t seq = first + step;
+                                                          if (seq >= end)
+                                                          {
+                                                              return false;
+                                                          }
+                                                          LogRecord record;
+                                                          if (ring.read(seq, record) && record.level >= (uint8_t)minLevel)
+                                                          {
+                                                              body.printf("%u %u %s %s\n", record.seq, record.timestamp,
+                                                                          LogClass::levelToString((LogLevel)record.level), record.message);
+                                                          }
+                                                          return true; },
+                                                      &logsStream);
+    if (end > 0)
+    {
+        response->addHeader("X-Log-Next", String(end - 1));
+    }
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+
+#ifdef LOG_BINARY
+// The binary log ring of a LOG_BINARY build for scripts/decode_binlog.py: a header followed
+// by the raw BinaryLogRecords, little endian as in memory. The decoder needs the ELF of the
+// running firmware to turn the format addresses back into text. ?after=<seq> as for /logs.
+void VanControlWebServer::handleBinaryLogs(AsyncWebServerRequest *request)
+{
+    struct Header
+    {
+        char magic[4];       // "BLG1"
+        uint32_t marker;     // address of BINARY_LOG_MARKER, identifies the build
+        uint16_t recordSize; // sizeof(BinaryLogRecord)
+        uint16_t reserved;
+        uint32_t dropped;
+        uint32_t uptimeMs;
+    };
+
+    const LogClass::BinaryRing &ring = Log.getBinaryRing();
+    const uint32_t end = ring.getEndSeq();
+    uint32_t first = ring.getFirstSeq();
+    if (request->hasParam("after"))
+    {
+        const String after = request->getParam("after")->value();
+        if (!isDigitsOnly(after))
+        {
+            sendError(request, 400, "Invalid after");
+            return;
+        }
+        first = std::max(first, (uint32_t)strtoul(after.c_str(), nullptr, 10) + 1);
+    }
+
+    const Header header = {{'B', 'L', 'G', '1'}, (uint32_t)(uintptr_t)BINARY_LOG_MARKER, sizeof(BinaryLogRecord), 0,
+                           ring.getDropped(), (uint32_t)millis()};
+    AsyncWebServerResponse *response = beginStreaming(request, "application/octet-stream", [&ring, first, end, header](size_t step, StreamingBody &body)
+                                                      {
+                                                          if (step == 0)
+                                                          {
+                                                              body.print((const char *)&header, sizeof(header));
+                                                              return first < end;
+                                                          }
+                                                          const uint32_t seq = first + step - 1;
+                                                          BinaryLogRecord record;
+                                                          if (ring.read(seq, record))
+                                                          {
+                                                              body.print((const char *)&record, sizeof(record));
+                                                          }
+                                                          return seq + 1 < end; },
+                                                      &binaryLogsStream);
+    if (end > 0)
+    {
+        response->addHeader("X-Log-Next", String(end - 1));
+    }
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+#endif
+
+// Runtime log level per module. ?module=ble&level=warning changes one module (module=all
+// changes every module) until the next reboot, the response shows the levels in effect.
+void VanControlWebServer::handleLogLevel(AsyncWebServerRequest *request)
+{
+    if (request->hasParam("module") || request->hasParam("level"))
+    {
+        if (!request->hasParam("module") || !request->hasParam("level"))
+        {
+            sendError(request, 400, "Both module and level are required");
+            return;
+        }
+        LogLevel level;
+        if (!LogClass::parseLevel(request->getParam("level")->value().c_str(), level))
+        {
+            sendError(request, 400, "Unknown level");
+            return;
+        }
+        const String name = request->getParam("module")->value();
+        LogModule module;
+        if (name.equalsIgnoreCase("all"))
+        {
+            for (int m = 0; m < (int)LogModule::COUNT; ++m)
+            {
+                Log.setModuleLevel((LogModule)m, level);
+            }
+        }
+        else if (LogClass::parseModule(name.c_str(), module))
+        {
+            Log.setModuleLevel(module, level);
+        }
+        else
+        {
+            sendError(request, 400, "Unknown module");
+            return;
+        }
+        LOG_WARN(WEB, "Log level of %s set to %s", name.c_str(), LogClass::levelToString(level));
+    }
+
+    DynamicJsonDocument doc(512);
+    doc["floor"] = LogClass::levelToString(LOG_LEVEL_FLOOR);
+    JsonObject modules = doc.createNestedObject("modules");
+    for (int m = 0; m < (int)LogModule::COUNT; ++m)
+    {
+        const LogLevel level = Log.getModuleLevel((LogModule)m);
+        modules[LogClass::moduleToString((LogModule)m)] = level == LogLevel::NONE ? "NONE" : LogClass::levelToString(level);
+    }
+    doc["suppressed"] = Log.getSuppressed();
+    doc["repeated"] = Log.getRepeated();
+
+    String jsonString;
+    serializeJson(doc, jsonString);
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", jsonString);
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+
+// What the previous boot left in the crash store: why it ended, its last log records and
+// battery samples (raw BMS units, times in millis() of that boot)
+void VanControlWebServer::handleCrashJson(AsyncWebServerRequest *request)
+{
+    // Streamed one entry per step: this is wanted most after a crash, when the heap may be
+    // too fragmented for the whole document. The recovered entries only change in recover()
+    // at boot, so they can be read while streaming.
+    const size_t logCount = CrashStore::getRecoveredLogs().size();
+    const size_t sampleCount = CrashStore::getRecoveredSamples().size();
+    request->send(beginStreaming(request, "application/json", [logCount, sampleCount](size_t step, StreamingBody &body)
+                                 {
+                                     if (step == 0)
+                                     {
+                                         body.printf("{\"resetReason\":\"%s\",\"bootCount\":%u,\"note\":",
+                                                     getResetReasonString(CrashStore::getResetReason()), (unsigned)CrashStore::getBootCount());
+                                         body.printJson(CrashStore::getRecoveredNote());
+                                         body.printf(",\"damaged\":%u,\"logs\":[", (unsigned)CrashStore::getRejected());
+                                         return true;
+                                     }
+                                     const size_t index = step - 1;
+                                     if (index < logCount)
+                                     {
+                                         const CrashStore::LogEntry &entry = CrashStore::getRecoveredLogs()[index];
+                                         body.printf("%s{\"ms\":%u,\"level\":\"%s\",\"message\":", index > 0 ? "," : "",
+                                                     (unsigned)entry.timestamp, LogClass::levelToString((LogLevel)entry.level));
+                                         body.printJson(entry.message);
+                                         body.print("}");
+                                         return true;
+                                     }
+                                     if (index == logCount)
+                                     {
+                                         body.print("],\"samples\":[");
+                                     }
+                                     if (index < logCount + sampleCount)
+                                     {
+                                         const CrashStore::SampleEntry &entry = CrashStore::getRecoveredSamples()[index - logCount];
+                                         body.printf("%s{\"ms\":%u,\"time\":%u,\"voltage\":%u,\"current\":%d,\"batteryLevel\":%u,"
+                                                     "\"minCellVoltage\":%u,\"maxCellVoltage\":%u,\"maxTemperature\":%d,\"problemCode\":%u}",
+                                                     index > logCount ? "," : "", (unsigned)entry.timestamp, (unsigned)entry.epoch, entry.voltage,
+                                                     entry.current, entry.batteryLevel, entry.minCellVoltage, entry.maxCellVoltage,
+                                                     entry.maxTemperature, entry.problemCode);
+                                         return true;
+                                     }
+                                     body.print("]}");
+                                     return false; },
+                                 &crashStream));
+}
+
+// Per endpoint request statistics, see EndpointStats. scripts/web_loadtest.py reads them
+// to put device side numbers next to what the client measured.
+void VanControlWebServer::handleWebStats(AsyncWebServerRequest *request)
+{
+    request->send(beginStreaming(request, "application/json", [this](size_t step, StreamingBody &body)
+                                 {
+                                     if (step == 0)
+                                     {
+                                         body.printf("{\"uptimeMs\":%u,\"freeHeap\":%u,\"minFreeHeap\":%u,\"endpoints\":[",
+                                                     millis(), ESP.getFreeHeap(), ESP.getMinFreeHeap());
+                                     }
+                                     const size_t index = step;
+                                     if (index >= endpointStats.size())
+                                     {
+                                         body.print("]}");
+                                         return false;
+                                     }
+                                     // Latencies are bucket upper bounds in ms, heap is bytes held after the handler returned
+                                     const EndpointStats &stats = endpointStats[index];
+                                     body.printf("%s{\"uri\":\"%s\",\"requests\":%u,\"latencyP50\":%u,\"latencyP90\":%u,\"latencyP99\":%u,"
+                                                 "\"latencyMax\":%u,\"latencySum\":%u,\"heapAvg\":%u,\"heapMax\":%u}",
+                                                 index == 0 ? "" : ",", stats.uri, stats.requests, stats.latencyPercentileMs(50),
+                                                 stats.latencyPercentileMs(90), stats.latencyPercentileMs(99), stats.latencyMaxMs,
+                                                 stats.latencySumMs, stats.requests ? stats.heapSum / stats.requests : 0, stats.heapMax);
+                                     return true; },
+                                 &webStatsStream));
+}
+
+void VanControlWebServer::handleMetrics(AsyncWebServerRequest *request)
 {
     if (!batteryManager)
     {
@@ -179,18 +1193,270 @@ void VanControlWebServer::handleBatteryHtml(AsyncWebServerRequest *request)
         return;
     }
 
-    const String html = generateBatteryHtml();
-    request->send(200, "text/html", html);
+    const TDTBMSData data = batteryManager->getTdtBms();
+    const bool hasSample = batteryManager->getSampleVersion() > 0;
+    request->send(beginStreaming(request, "text/plain; version=0.0.4", [this, data, hasSample](size_t step, StreamingBody &body)
+                                 {
+                                     PrometheusWriter metrics(body);
+                                     // Battery values only once there is a sample, an absent series is better than a false zero
+                                     if (!hasSample && step < METRICS_GATEWAY_STEP)
+                                         return true;
+                                     return renderMetricsStep(step, data, metrics); },
+                                 &metricsStream));
 }
 
-String VanControlWebServer::generateBatteryHtml() const
+// One metric family per step, or its HELP/TYPE lines and its samples in separate steps, so
+// that even with the longest values no step comes near StreamingBody::SCRATCH_SIZE;
+// test_metrics_format checks the output
+bool VanControlWebServer::renderMetricsStep(size_t step, const TDTBMSData &data, PrometheusWriter &metrics) const
 {
+    switch (step)
+    {
+    case 0:
+        metrics.gauge("bluefigate_battery_voltage_volts", "Pack voltage.", Fixed(data.voltage, 2));
+        break;
+    case 1:
+        metrics.gauge("bluefigate_battery_current_amperes", "Pack current, positive while charging.", Fixed(data.current, 1));
+        break;
+    case 2:
+        metrics.gauge("bluefigate_battery_soc_percent", "State of charge reported by the BMS.", Fixed(data.batteryLevel, 0));
+        break;
+    case 3:
+        if (batteryManager->getSOC() >= 0)
+        {
+            metrics.gauge("bluefigate_battery_voltage_soc_percent", "State of charge from the rest voltage.", Fixed(batteryManager->getSOC(), 0));
+        }
+        break;
+    case 4:
+        metrics.family("bluefigate_battery_cell_voltage_volts", "Cell voltage.", "gauge");
+        break;
+    case 5:
+        for (int i = 0; i < data.cellCount && i < 4; ++i)
+        {
+            metrics.sample("bluefigate_battery_cell_voltage_volts", Fixed(data.cellVoltages[i], 3), "cell", i + 1);
+        }
+        break;
+    case 6:
+        metrics.family("bluefigate_battery_temperature_celsius", "Temperature sensor reading.", "gauge");
+        break;
+    case 7:
+        for (int i = 0; i < data.tempSensorCount && i < 4; ++i)
+        {
+            metrics.sample("bluefigate_battery_temperature_celsius", Fixed(data.temperatures[i], 1), "sensor", i + 1);
+        }
+        break;
+    case 8:
+        metrics.gauge("bluefigate_battery_cycles", "Charge cycles reported by the BMS.", Fixed(data.cycles, 0));
+        break;
+    case 9:
+        metrics.gauge("bluefigate_battery_cycle_charge_ampere_hours", "Cycle charge reported by the BMS.", Fixed(data.cycleCharge, 1));
+        break;
+    case 10:
+        metrics.gauge("bluefigate_battery_problem_code", "BMS problem code, 0 if none.", Fixed(data.problemCode, 0));
+        break;
+    case 11:
+        metrics.gauge("bluefigate_battery_sample_age_seconds", "Time since the last sample.", Fixed((millis() - batteryManager->getLastTdtUpdateMs()) / 1000, 0));
+        break;
+    case METRICS_GATEWAY_STEP:
+        metrics.counter("bluefigate_battery_samples_total", "Samples received from the BMS.", batteryManager->getSampleVersion());
+        break;
+    case METRICS_GATEWAY_STEP + 1:
+        metrics.gauge("bluefigate_uptime_seconds", "Time since boot.", Fixed(millis() / 1000, 0));
+        break;
+    case METRICS_GATEWAY_STEP + 2:
+        metrics.gauge("bluefigate_heap_free_bytes", "Free heap.", Fixed(ESP.getFreeHeap(), 0));
+        break;
+    case METRICS_GATEWAY_STEP + 3:
+        metrics.gauge("bluefigate_heap_min_free_bytes", "Lowest free heap since boot.", Fixed(ESP.getMinFreeHeap(), 0));
+        break;
+    case METRICS_GATEWAY_STEP + 4:
+        metrics.gauge("bluefigate_heap_max_alloc_bytes", "Largest free heap block.", Fixed(ESP.getMaxAllocHeap(), 0));
+        break;
+    case METRICS_GATEWAY_STEP + 5:
+        metrics.gauge("bluefigate_poll_duration_seconds", "Duration of the last successful BMS poll.", Fixed(batteryManager->getPollDurationMs(), 3));
+        break;
+    case METRICS_GATEWAY_STEP + 6:
+        metrics.counter("bluefigate_poll_failures_total", "Failed or timed out BMS polls.", batteryManager->getPollFailures());
+        break;
+    case METRICS_GATEWAY_STEP + 7:
+        metrics.counter("bluefigate_ble_reconnects_total", "BLE connections restarted after an error.", batteryManager->getBleReconnects());
+        break;
+    case METRICS_GATEWAY_STEP + 8:
+        if (WiFi.isConnected())
+        {
+            metrics.gauge("bluefigate_wifi_rssi_dbm", "WiFi signal strength.", Fixed(WiFi.RSSI(), 0));
+        }
+        break;
+    case METRICS_GATEWAY_STEP + 9:
+        metrics.family("bluefigate_web_cache_renders_total", "Response cache misses that rendered a new body.", "counter");
+        metrics.sample("bluefigate_web_cache_renders_total", jsonCache.getRenderCount(), "cache", "json");
+        break;
+    case METRICS_GATEWAY_STEP + 10:
+        metrics.family("bluefigate_web_cache_hits_total", "Responses served from the cache.", "counter");
+        metrics.sample("bluefigate_web_cache_hits_total", jsonCache.getHitCount(), "cache", "json");
+        break;
+    case METRICS_GATEWAY_STEP + 11:
+        metrics.family("bluefigate_live_messages_total", "Samples pushed to WebSocket clients.", "counter");
+        metrics.sample("bluefigate_live_messages_total", liveSentCount, "result", "sent");
+        metrics.sample("bluefigate_live_messages_total", liveDroppedCount, "result", "dropped");
+        break;
+    case METRICS_GATEWAY_STEP + 12:
+        metrics.gauge("bluefigate_web_parked_requests", "Requests waiting for the next sample.", Fixed(admissionControl.getParked(), 0));
+        break;
+    case METRICS_GATEWAY_STEP + 13:
+    case METRICS_GATEWAY_STEP + 14:
+    case METRICS_GATEWAY_STEP + 15:
+    case METRICS_GATEWAY_STEP + 16:
+    case METRICS_GATEWAY_STEP + 17:
+    case METRICS_GATEWAY_STEP + 18:
+    {
+        // Two families with a sample per endpoint, each in three steps: the HELP and TYPE
+        // lines, then half of the endpoints per step
+        const StreamMetric *streams[] = {&htmlStream, &energyStream, &historyStream, &exportStream, &metricsStream, &webStatsStream, &logsStream, &crashStream, &statsStream};
+        constexpr size_t STREAMS = sizeof(streams) / sizeof(streams[0]);
+        const size_t part = step - (METRICS_GATEWAY_STEP + 13);
+        const bool heapDrop = part >= 3;
+        const char *name = heapDrop ? "bluefigate_web_stream_heap_drop_bytes" : "bluefigate_web_stream_responses_total";
+        if (part % 3 == 0)
+        {
+            metrics.family(name, heapDrop ? "Largest drop of the global free heap while a response streamed, other tasks included." : "Streamed responses.", heapDrop ? "gauge" : "counter");
+            break;
+        }
+        const size_t from = part % 3 == 1 ? 0 : (STREAMS + 1) / 2;
+        const size_t to = part % 3 == 1 ? (STREAMS + 1) / 2 : STREAMS;
+        for (size_t i = from; i < to; ++i)
+        {
+            metrics.sample(name, heapDrop ? streams[i]->maxHeapDrop : streams[i]->responses, "endpoint", streams[i]->name);
+        }
+        break;
+    }
+    case METRICS_GATEWAY_STEP + 19:
+        metrics.gauge("bluefigate_web_in_flight_requests", "Admitted requests not finished yet.", Fixed(admissionControl.getInFlight(), 0));
+        break;
+    case METRICS_GATEWAY_STEP + 20:
+        metrics.family("bluefigate_web_admission_total", "Admission decisions by result.", "counter");
+        break;
+    case METRICS_GATEWAY_STEP + 21:
+        for (int i = 0; i < (int)Admission::COUNT; ++i)
+        {
+            metrics.sample("bluefigate_web_admission_total", admissionControl.getCount((Admission)i), "result", AdmissionControl::getName((Admission)i));
+        }
+        break;
+    case METRICS_GATEWAY_STEP + 22:
+        metrics.counter("bluefigate_log_records_total", "Log records written to the in-memory ring.", Log.getRing().getEndSeq());
+        break;
+    case METRICS_GATEWAY_STEP + 23:
+        metrics.counter("bluefigate_log_ring_dropped_total", "Log records dropped on a busy ring slot.", Log.getRing().getDropped());
+        break;
+    case METRICS_GATEWAY_STEP + 24:
+        metrics.counter("bluefigate_log_suppressed_total", "Log messages dropped by the per module rate limit.", Log.getSuppressed());
+        break;
+    case METRICS_GATEWAY_STEP + 25:
+        metrics.counter("bluefigate_log_repeated_total", "Repeated log messages folded into a repeat note.", Log.getRepeated());
+        break;
+    case METRICS_GATEWAY_STEP + 26:
+        metrics.counter("bluefigate_log_serial_dropped_total", "Log lines dropped because Serial could not keep up.", Log.getSerialDropped());
+        break;
+    case METRICS_GATEWAY_STEP + 27:
+        if (Clock::getSyncCount() > 0)
+        {
+            metrics.counter("bluefigate_clock_syncs_total", "NTP syncs of the wall clock.", Clock::getSyncCount());
+        }
+        break;
+    case METRICS_GATEWAY_STEP + 28:
+        if (Clock::getSyncCount() > 0)
+        {
+            metrics.gauge("bluefigate_clock_drift_ppm", "Measured drift of the clock against NTP time.", Fixed(Clock::getDriftPpb(), 3));
+        }
+        break;
+    case METRICS_GATEWAY_STEP + 29:
+        if (Clock::getSyncCount() > 0)
+        {
+            metrics.gauge("bluefigate_clock_last_step_seconds", "How far the clock was off at the last NTP sync.",
+                          Fixed((int32_t)std::max<int64_t>(INT32_MIN, std::min<int64_t>(INT32_MAX, Clock::getLastStepUs() / 1000)), 3));
+        }
+        break;
+    case METRICS_GATEWAY_STEP + 30:
+        metrics.counter("bluefigate_poll_scheduled_total", "Samples polled on a scheduled slot.", batteryManager->getScheduledPolls());
+        break;
+    case METRICS_GATEWAY_STEP + 31:
+        metrics.counter("bluefigate_poll_missed_slots_total", "Poll slots without a sample.", batteryManager->getMissedPollSlots());
+        break;
+    case METRICS_GATEWAY_STEP + 32:
+    {
+        // The family goes out even without samples, a sample may arrive before the next step
+        metrics.family("bluefigate_poll_lateness_seconds", "Time from the scheduled slot to the sample over the last hour.", "gauge");
+        const WindowStats lateness = batteryManager->getPollLateness();
+        if (lateness.count > 0)
+        {
+            // ms with one decimal are s with four
+            const Fixed mean = lateness.mean();
+            const Fixed stddev = lateness.stddev();
+            metrics.sample("bluefigate_poll_lateness_seconds", Fixed(mean.raw, mean.decimals + 3), "stat", "mean");
+            metrics.sample("bluefigate_poll_lateness_seconds", Fixed(stddev.raw, stddev.decimals + 3), "stat", "stddev");
+        }
+        break;
+    }
+    case METRICS_GATEWAY_STEP + 33:
+    {
+        const WindowStats lateness = batteryManager->getPollLateness();
+        if (lateness.count > 0)
+        {
+            metrics.sample("bluefigate_poll_lateness_seconds", Fixed(lateness.min, 3), "stat", "min");
+            metrics.sample("bluefigate_poll_lateness_seconds", Fixed(lateness.max, 3), "stat", "max");
+        }
+        break;
+    }
+    case METRICS_GATEWAY_STEP + 34:
+        metrics.family("bluefigate_boot_phase_seconds", "Time from boot until a startup phase was reached.", "gauge");
+        break;
+    case METRICS_GATEWAY_STEP + 35:
+        for (int i = 0; i < (int)BootPhase::COUNT; ++i)
+        {
+            const uint32_t ms = BootPhases::getMs((BootPhase)i);
+            if (ms != 0)
+            {
+                metrics.sample("bluefigate_boot_phase_seconds", Fixed(ms, 3), "phase", BootPhases::getName((BootPhase)i));
+            }
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void VanControlWebServer::handleBatteryHtml(AsyncWebServerRequest *request)
+{
+    if (!batteryManager)
+    {
+        sendError(request, 500, "Battery manager not available");
+        return;
+    }
+
+    const String etag = "W/\"" + String(batteryManager->getSampleVersion()) + "-html\"";
+    AsyncWebHeader *header = request->getHeader("If-None-Match");
+    if (header != nullptr && header->value() == etag)
+    {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", getCacheControl());
+        request->send(response);
+        return;
+    }
+
+    // Render from one consistent snapshot, whatever the loop task does in the meantime
     const TDTBMSData data = batteryManager->getTdtBms();
-    time_t now;
-    time(&now);
-    time_t timestamp = now - ((millis() - batteryManager->getLastTdtUpdateMs()) / 1000);
+    const time_t timestamp = (time_t)(batteryManager->getSampleEpochMs() / 1000);
+
+    AsyncWebServerResponse *response = beginStreaming(request, "text/html", [data, timestamp](size_t step, StreamingBody &body)
+                                                      { return renderBatteryHtmlStep(step, data, timestamp, body); }, &htmlStream);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", getCacheControl());
+    request->send(response);
+}
 
-    String html = R"(
+static const char BATTERY_HTML_HEAD[] PROGMEM = R"(
 <!DOCTYPE html>
 <html>
 <head>
@@ -292,104 +1558,109 @@ String VanControlWebServer::generateBatteryHtml() const
         <h1>🔋 Battery Monitor</h1>
 )";
 
-    // Problem code alert
-    if (data.problemCode != 0)
-    {
-        html += "<div class=\"problem-alert\">⚠️ <strong>Problem Code: " + String(data.problemCode) + "</strong></div>";
-    }
-
-    // Main statistics
-    html += "<div class=\"main-stats\">";
-
-    // Battery Level (SOC)
-    String socClass = "good";
-    if (data.batteryLevel < 20)
-        socClass = "critical";
-    else if (data.batteryLevel < 50)
-        socClass = "warning";
-
-    html += "<div class=\"stat-card " + socClass + "\">";
-    html += "<div class=\"stat-label\">State of Charge</div>";
-    html += "<div class=\"stat-value\">" + String(data.batteryLevel) + "%</div>";
-    html += "</div>";
-
-    // Voltage
-    float voltage = data.voltage / 100.0f;
-    String voltageClass = "good";
-    if (voltage < 12.0f)
-        voltageClass = "critical";
-    else if (voltage < 12.5f)
-        voltageClass = "warning";
-
-    html += "<div class=\"stat-card " + voltageClass + "\">";
-    html += "<div class=\"stat-label\">Voltage</div>";
-    html += "<div class=\"stat-value\">" + String(voltage, 2) + "V</div>";
-    html += "</div>";
-
-    // Current
-    float current = data.current / 10.0f;
-    String currentClass = current < 0 ? "warning" : "good";
-    String currentSymbol = current < 0 ? "⬇️" : "⬆️";
-
-    html += "<div class=\"stat-card " + currentClass + "\">";
-    html += "<div class=\"stat-label\">Current " + currentSymbol + "</div>";
-    html += "<div class=\"stat-value\">" + String(abs(current), 1) + "A</div>";
-    html += "</div>";
-
-    html += "</div>"; // End main-stats
-
-    // Details sections
-    html += "<div class=\"details\">";
-
-    // Cell Information
-    html += "<div class=\"detail-section\">";
-    html += "<h3>📱 Cell Information</h3>";
-    for (int i = 0; i < data.cellCount && i < 4; ++i)
-    {
-        float cellVoltage = data.cellVoltages[i] / 1000.0f;
-        html += "<div class=\"detail-row\">";
-        html += "<span>Cell " + String(i + 1) + ":</span>";
-        html += "<span>" + String(cellVoltage, 3) + "V</span>";
-        html += "</div>";
-    }
-    html += "</div>";
-
-    // Temperature Information
-    html += "<div class=\"detail-section\">";
-    html += "<h3>🌡️ Temperature Sensors</h3>";
-    for (int i = 0; i < data.tempSensorCount && i < 4; ++i)
-    {
-        float temp = data.temperatures[i] / 10.0f;
-        html += "<div class=\"detail-row\">";
-        html += "<span>Sensor " + String(i + 1) + ":</span>";
-        html += "<span>" + String(temp, 1) + "°C</span>";
-        html += "</div>";
-    }
-    html += "</div>";
-
-    html += "</div>"; // End details
-
-    // Additional info
-    html += "<div class=\"details\">";
-    html += "<div class=\"detail-section\">";
-    html += "<h3>📊 Battery Statistics</h3>";
-    html += "<div class=\"detail-row\"><span>Cycle Charge:</span><span>" + String(data.cycleCharge / 10.0f, 1) + " Ah</span></div>";
-    html += "<div class=\"detail-row\"><span>Cycles:</span><span>" + String(data.cycles) + "</span></div>";
-    html += "<div class=\"detail-row\"><span>Problem Code:</span><span>" + String(data.problemCode) + "</span></div>";
-    html += "</div>";
-    html += "</div>";
-
-    // Timestamp
-    html += "<div class=\"timestamp\">";
-    html += "Last Update: " + String(ctime(&timestamp));
-    html += "<br>Auto-refresh in 30 seconds";
-    html += "</div>";
-
-    html += R"(
+static const char BATTERY_HTML_FOOT[] PROGMEM = R"(
     </div>
 </body>
 </html>
 )";
 
-    return html;
+static const char *getLevelClass(bool critical, bool warning)
+{
+    return critical ? "critical" : (warning ? "warning" : "good");
+}
+
+// One step per section, each well below StreamingBody::SCRATCH_SIZE
+bool VanControlWebServer::renderBatteryHtmlStep(size_t step, const TDTBMSData &data, time_t timestamp, StreamingBody &body)
+{
+    enum
+    {
+        HEAD,
+        PROBLEM,
+        SOC,
+        VOLTAGE,
+        CURRENT,
+        CELLS_START,
+        CELL_ROWS,
+        TEMPS_START = CELL_ROWS + 4,
+        TEMP_ROWS,
+        STATISTICS = TEMP_ROWS + 4,
+        TIMESTAMP,
+        FOOT
+    };
+
+    if (step == HEAD)
+    {
+        body.printStatic(BATTERY_HTML_HEAD, sizeof(BATTERY_HTML_HEAD) - 1);
+    }
+    else if (step == PROBLEM)
+    {
+        // Problem code alert
+        if (data.problemCode != 0)
+        {
+            body.printf("<div class=\"problem-alert\">⚠️ <strong>Problem Code: %u</strong></div>", data.problemCode);
+        }
+        // Main statistics
+        body.print("<div class=\"main-stats\">");
+    }
+    else if (step == SOC)
+    {
+        body.printf("<div class=\"stat-card %s\"><div class=\"stat-label\">State of Charge</div><div class=\"stat-value\">%u%%</div></div>",
+                    getLevelClass(data.batteryLevel < 20, data.batteryLevel < 50), data.batteryLevel);
+    }
+    else if (step == VOLTAGE)
+    {
+        body.printf("<div class=\"stat-card %s\"><div class=\"stat-label\">Voltage</div><div class=\"stat-value\">%sV</div></div>",
+                    getLevelClass(data.voltage < 1200, data.voltage < 1250), FixedText(Fixed(data.voltage, 2)).c_str());
+    }
+    else if (step == CURRENT)
+    {
+        body.printf("<div class=\"stat-card %s\"><div class=\"stat-label\">Current %s</div><div class=\"stat-value\">%sA</div></div>",
+                    data.current < 0 ? "warning" : "good", data.current < 0 ? "⬇️" : "⬆️", FixedText(Fixed(data.current, 1).abs()).c_str());
+        body.print("</div>"); // End main-stats
+    }
+    else if (step == CELLS_START)
+    {
+        body.print("<div class=\"details\"><div class=\"detail-section\"><h3>📱 Cell Information</h3>");
+    }
+    else if (step >= CELL_ROWS && step < TEMPS_START)
+    {
+        const size_t i = step - CELL_ROWS;
+        if (i < data.cellCount)
+        {
+            body.printf("<div class=\"detail-row\"><span>Cell %u:</span><span>%sV</span></div>", (unsigned)i + 1, FixedText(Fixed(data.cellVoltages[i], 3)).c_str());
+        }
+    }
+    else if (step == TEMPS_START)
+    {
+        body.print("</div><div class=\"detail-section\"><h3>🌡️ Temperature Sensors</h3>");
+    }
+    else if (step >= TEMP_ROWS && step < STATISTICS)
+    {
+        const size_t i = step - TEMP_ROWS;
+        if (i < data.tempSensorCount)
+        {
+            body.printf("<div class=\"detail-row\"><span>Sensor %u:</span><span>%s°C</span></div>", (unsigned)i + 1, FixedText(Fixed(data.temperatures[i], 1)).c_str());
+        }
+    }
+    else if (step == STATISTICS)
+    {
+        body.print("</div></div>"); // End details
+        body.printf("<div class=\"details\"><div class=\"detail-section\"><h3>📊 Battery Statistics</h3>"
+                    "<div class=\"detail-row\"><span>Cycle Charge:</span><span>%s Ah</span></div>"
+                    "<div class=\"detail-row\"><span>Cycles:</span><span>%u</span></div>"
+                    "<div class=\"detail-row\"><span>Problem Code:</span><span>%u</span></div></div></div>",
+                    FixedText(Fixed(data.cycleCharge, 1)).c_str(), data.cycles, data.problemCode);
+    }
+    else if (step == TIMESTAMP)
+    {
+        char timeText[32];
+        ctime_r(&timestamp, timeText);
+        body.printf("<div class=\"timestamp\">Last Update: %s<br>Auto-refresh in 30 seconds</div>", timeText);
+    }
+    else if (step == FOOT)
+    {
+        body.printStatic(BATTERY_HTML_FOOT, sizeof(BATTERY_HTML_FOOT) - 1);
+    }
+
+    return step < FOOT;
 }
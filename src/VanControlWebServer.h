@@ -3,28 +3,120 @@
 #include <Arduino.h>
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
+#include "BLEManager.h"
+#include "BatteryManager.h"
+#include "ResponseCache.h"
+#include "AdmissionControl.h"
+#include "WebStats.h"
+#include "StreamingResponse.h"
 
 class AsyncWebServerRequest;
+class AsyncWebServerResponse;
 class AsyncWebServer;
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+class AsyncWebSocketMessageBuffer;
 class BatteryManager;
+class PrometheusWriter;
 
 class VanControlWebServer {
 private:
     std::unique_ptr<AsyncWebServer> server;
+    std::unique_ptr<AsyncWebSocket> liveSocket;
+    std::vector<AsyncWebSocketMessageBuffer*> liveBuffers; // sent, waiting for all clients to release them
+    uint32_t livePublishedVersion = 0; // sample version last sent to the live clients
+    uint32_t liveSentCount = 0;
+    uint32_t liveDroppedCount = 0;
+
+    static constexpr uint32_t MAX_WAIT_MS = 30000;
+    static constexpr uint32_t FRESH_TIMEOUT_MS = 15000; // connected polls take well below a second
     bool isRunning;
     BatteryManager* batteryManager;
+    ResponseCache jsonCache{"json"};
+    AdmissionControl admissionControl;
+    std::vector<EndpointStats> endpointStats; // one per route, filled in start()
+    StreamMetric htmlStream{"battery"};
+    StreamMetric energyStream{"energy"};
+    StreamMetric historyStream{"history"};
+    StreamMetric exportStream{"export"};
+    StreamMetric metricsStream{"metrics"};
+    StreamMetric webStatsStream{"webstats"};
+    StreamMetric logsStream{"logs"};
+    StreamMetric crashStream{"crash"};
+    StreamMetric statsStream{"stats"};
+#ifdef LOG_BINARY
+    StreamMetric binaryLogsStream{"logs.bin"};
+#endif
+
+    // /battery.cbor map keys, never renumber, only append
+    static constexpr uint8_t CBOR_SCHEMA_VERSION = 1;
+    static constexpr size_t CBOR_BATTERY_MAX_SIZE = 96; // worst case of the schema is 81 bytes
+    enum CborBatteryKey : uint8_t
+    {
+        CBOR_KEY_SCHEMA = 0,
+        CBOR_KEY_SAMPLE_TIME = 1,    // epoch ms of the sample, 0 while the time is not synced
+        CBOR_KEY_SAMPLE_AGE = 2,     // ms since the sample was taken
+        CBOR_KEY_SAMPLE_VERSION = 3,
+        CBOR_KEY_VOLTAGE = 4,        // 0.01V
+        CBOR_KEY_CURRENT = 5,        // 0.1A
+        CBOR_KEY_BATTERY_LEVEL = 6,  // %
+        CBOR_KEY_CYCLE_CHARGE = 7,   // 0.1Ah
+        CBOR_KEY_CYCLES = 8,
+        CBOR_KEY_PROBLEM_CODE = 9,
+        CBOR_KEY_CELL_VOLTAGES = 10, // array, mV
+        CBOR_KEY_TEMPERATURES = 11,  // array, 0.1°C
+        CBOR_KEY_VOLTAGE_SOC = 12,   // %, -1 if unknown
+        CBOR_KEY_AT_REST = 13,
+    };
+
+    // First /metrics step that does not depend on a battery sample
+    static constexpr size_t METRICS_GATEWAY_STEP = 12;
     
     // Helper functions
+    void route(const char* uri, void (VanControlWebServer::*handler)(AsyncWebServerRequest*));
+    bool admit(AsyncWebServerRequest* request);
     unsigned long getCurrentTime() const;
     bool isDigitsOnly(const String& str) const;
     bool isHexOnly(const String& str) const;
     void sendError(AsyncWebServerRequest* request, int code, const String& message) const;
+    size_t formatTimePrefix(char* buffer, size_t size) const;
+    bool isNotModified(AsyncWebServerRequest* request, const CachedBody& entry) const;
+    String getCacheControl() const;
+    void sendCached(AsyncWebServerRequest* request, const char* contentType, std::shared_ptr<const CachedBody> entry, std::string prefix = std::string()) const;
+    AsyncWebServerResponse* beginStreaming(AsyncWebServerRequest* request, const char* contentType, StreamingBody::Step step, StreamMetric* metric) const;
     
     // Request handlers
     void handleBatteryJson(AsyncWebServerRequest* request);
     void handleBatteryHtml(AsyncWebServerRequest* request);
+    void handleBatteryCbor(AsyncWebServerRequest* request);
+    void handleDashboard(AsyncWebServerRequest* request);
+    void handleEnergyJson(AsyncWebServerRequest* request);
+    void handleStatsJson(AsyncWebServerRequest* request);
+    void handleHistoryJson(AsyncWebServerRequest* request);
+    void handleExportCsv(AsyncWebServerRequest* request);
+    void handleMetrics(AsyncWebServerRequest* request);
+    void handleWebStats(AsyncWebServerRequest* request);
+    void handleLogs(AsyncWebServerRequest* request);
+    void handleLogLevel(AsyncWebServerRequest* request);
+    void handleCrashJson(AsyncWebServerRequest* request);
+#ifdef LOG_BINARY
+    void handleBinaryLogs(AsyncWebServerRequest* request);
+#endif
+
+    static constexpr uint32_t ALL_BATTERY_FIELDS = (1u << (int)BatteryField::COUNT) - 1;
+    bool parseFieldMask(const String& fields, uint32_t& mask) const;
+    void waitForSample(AsyncWebServerRequest* request, uint32_t afterVersion, uint32_t waitMs, bool fresh = false);
+    void renderBatteryJson(std::string& out, uint32_t mask = ALL_BATTERY_FIELDS) const;
+    bool renderMetricsStep(size_t step, const TDTBMSData& data, PrometheusWriter& metrics) const;
+    static bool renderBatteryHtmlStep(size_t step, const TDTBMSData& data, time_t timestamp, StreamingBody& body);
 
-    String generateBatteryHtml() const;
+    // Live push of new samples to WebSocket clients
+    void publishPending();
+    void publishSample();
+    void sendLatestSample(AsyncWebSocketClient* client);
+    void releaseLiveBuffers();
     
 public:
     explicit VanControlWebServer(BatteryManager* batteryManager, int port = 80);
@@ -38,4 +130,6 @@ public:
     void clearData();
     [[nodiscard]] size_t getDataCount() const;
     bool getData(int sensorId, unsigned long& timestamp, String& value) const;
+    uint32_t getLiveSentCount() const { return liveSentCount; }
+    uint32_t getLiveDroppedCount() const { return liveDroppedCount; }
 };
\ No newline at end of file
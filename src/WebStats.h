@@ -0,0 +1,60 @@
+// WebStats.h
+#pragma once
+
+#include <Arduino.h>
+
+// Request statistics of one web endpoint: a latency histogram (from admission until the
+// connection is gone, i.e. including sending the response) and the heap a request still
+// holds once its handler returned (the response object, its body, captured buffers).
+// Written and read only in the AsyncTCP task.
+struct EndpointStats
+{
+    // Upper bounds of the latency buckets in ms, the last bucket is everything above
+    static constexpr uint16_t LATENCY_BOUNDS_MS[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000};
+    static constexpr int LATENCY_BUCKETS = sizeof(LATENCY_BOUNDS_MS) / sizeof(LATENCY_BOUNDS_MS[0]) + 1;
+
+    const char *uri;
+    uint32_t requests = 0;
+    uint32_t latencyBuckets[LATENCY_BUCKETS] = {};
+    uint32_t latencySumMs = 0;
+    uint32_t latencyMaxMs = 0;
+    uint32_t heapSum = 0;
+    uint32_t heapMax = 0;
+
+    explicit EndpointStats(const char *uri) : uri(uri) {}
+
+    void record(uint32_t latencyMs, uint32_t heapBytes)
+    {
+        int bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && latencyMs > LATENCY_BOUNDS_MS[bucket])
+        {
+            bucket++;
+        }
+        latencyBuckets[bucket]++;
+        requests++;
+        latencySumMs += latencyMs;
+        latencyMaxMs = std::max(latencyMaxMs, latencyMs);
+        heapSum += heapBytes;
+        heapMax = std::max(heapMax, heapBytes);
+    }
+
+    // Upper bound of the bucket holding the given percentile, latencyMaxMs for the open bucket
+    uint32_t latencyPercentileMs(uint32_t percent) const
+    {
+        if (requests == 0)
+        {
+            return 0;
+        }
+        const uint32_t rank = (requests * percent + 99) / 100;
+        uint32_t seen = 0;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS - 1; ++bucket)
+        {
+            seen += latencyBuckets[bucket];
+            if (seen >= rank)
+            {
+                return LATENCY_BOUNDS_MS[bucket];
+            }
+        }
+        return latencyMaxMs;
+    }
+};
@@ -13,6 +13,9 @@
 #include "BatteryManager.h"
 #include "VanControlWebServer.h"
 #include "TimeSync.h"
+#include "CrashStore.h"
+#include "SyslogSink.h"
+#include "BootPhases.h"
 
 const char *NVS_NAMESPACE = "blufigate";
 
@@ -24,6 +27,7 @@ Ticker ledTimer;
 Adafruit_NeoPixel pixel(1, 8, NEO_GRB + NEO_KHZ800);
 VanControlWebServer webserver(&batteryManager);
 TimeSync timeSync;
+SyslogSink syslogSink;
 bool bCrashedBefore;
 bool bStartedUpSucceededNotification = false;
 bool bIndicateError = false;
@@ -47,6 +51,7 @@ void setup()
 {
     esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
     esp_reset_reason_t reason = esp_reset_reason();
+    CrashStore::recover(reason);
     switch (reason)
     {
         case ESP_RST_PANIC:      //!< Software reset due to exception/panic
@@ -79,6 +84,7 @@ void setup()
     Serial.begin(115200);
     delay(200); // Give serial monitor time to open
     Serial.setDebugOutput(true);
+    Log.startSerialDrain();
 
     Log.debug("****************** Setup()  cause: %i, Reset Reason: %s", (int)cause, strReason);
 
@@ -95,6 +101,7 @@ void setup()
     while (!wifiManager.requestWifi(&wifiManager, true))
     {
         Log.debug("Retrying Wifi in 30 seconds");
+        Log.flushSerial(500);
         esp_sleep_enable_timer_wakeup(30 * 1000000);
         esp_light_sleep_start();
     }
@@ -108,9 +115,12 @@ void setup()
                                     //LittleFS.end();
                                 }
                                 bIsOtaRunning = true;
+                                batteryManager.flush();
                                 Log.info("Start updating - %s", type.c_str()); })
         .onEnd([]()
-               { bIsOtaRunning = false; })
+               {
+                   bIsOtaRunning = false;
+                   CrashStore::setRestartNote("OTA update"); })
         .onProgress([](unsigned int progress, unsigned int total)
                     {
                         // Log.info("Progress: %u%%\r", (progress / (total / 100)));
@@ -133,7 +143,9 @@ void setup()
     batteryManager.init();
     batteryManager.doPolling();
     webserver.start();
+    BootPhases::mark(BootPhase::WEB_SERVER);
     timeSync.begin();
+    syslogSink.begin();
 }
 
 void loop()
@@ -168,6 +180,9 @@ void loop()
 
     if (batteryManager.getLastTdtUpdateMs() > 0 && millis() - batteryManager.getLastTdtUpdateMs() > 1000 * 600)
     {
+        batteryManager.flush();
+        CrashStore::setRestartNote("No battery data for 600 s");
+        Log.flushSerial(500);
         esp_restart();
     }
 
@@ -177,6 +192,7 @@ void loop()
     bleManager.process();
     yield();
     timeSync.loop();
+    syslogSink.loop();
 
     delay(20);
 }
\ No newline at end of file
@@ -18,6 +18,8 @@
 #include <WiFi.h>
 #include <Preferences.h>
 #include "Log.h"
+#include "Clock.h"
+#include "BootPhases.h"
 #include "OtherFunctions.h"
 
 /**
@@ -85,7 +87,7 @@ WIFIMANAGER::WIFIMANAGER(const char *ns)
     // AP on/off
     WiFi.onEvent([&](WiFiEvent_t event, WiFiEventInfo_t info)
                  {
-                     Log.debug("[WIFI] onEvent() AP mode started!");
+                     LOG_DEBUG(WIFI, "onEvent() AP mode started!");
                      softApRunning = true;
 #if ESP_ARDUINO_VERSION_MAJOR >= 2
                  },
@@ -96,7 +98,7 @@ WIFIMANAGER::WIFIMANAGER(const char *ns)
 #endif
     WiFi.onEvent([&](WiFiEvent_t event, WiFiEventInfo_t info)
                  {
-                     Log.debug("[WIFI] onEvent() AP mode stopped!");
+                     LOG_DEBUG(WIFI, "onEvent() AP mode stopped!");
                      softApRunning = false;
 #if ESP_ARDUINO_VERSION_MAJOR >= 2
                  },
@@ -108,7 +110,7 @@ WIFIMANAGER::WIFIMANAGER(const char *ns)
     // AP client join/leave
     WiFi.onEvent([&](WiFiEvent_t event, WiFiEventInfo_t info)
                  {
-                     Log.debug("[WIFI] onEvent() New client connected to softAP!");
+                     LOG_DEBUG(WIFI, "onEvent() New client connected to softAP!");
 #if ESP_ARDUINO_VERSION_MAJOR >= 2
                  },
                  ARDUINO_EVENT_WIFI_AP_STACONNECTED); // arduino-esp32 2.0.0 and later
@@ -118,13 +120,43 @@ WIFIMANAGER::WIFIMANAGER(const char *ns)
 #endif
     WiFi.onEvent([&](WiFiEvent_t event, WiFiEventInfo_t info)
                  {
-                     Log.debug("[WIFI] onEvent() Client disconnected from softAP!");
+                     LOG_DEBUG(WIFI, "onEvent() Client disconnected from softAP!");
 #if ESP_ARDUINO_VERSION_MAJOR >= 2
                  },
                  ARDUINO_EVENT_WIFI_AP_STADISCONNECTED); // arduino-esp32 2.0.0 and later
 #else
                  },
                  SYSTEM_EVENT_AP_STADISCONNECTED); // arduino-esp32 1.0.6
+#endif
+    // STA connection progress, to measure the time until the gateway is reachable
+    WiFi.onEvent([&](WiFiEvent_t event, WiFiEventInfo_t info)
+                 {
+                     BootPhases::mark(BootPhase::WIFI_CONNECTED);
+#if ESP_ARDUINO_VERSION_MAJOR >= 2
+                 },
+                 ARDUINO_EVENT_WIFI_STA_CONNECTED); // arduino-esp32 2.0.0 and later
+#else
+                 },
+                 SYSTEM_EVENT_STA_CONNECTED); // arduino-esp32 1.0.6
+#endif
+    WiFi.onEvent([&](WiFiEvent_t event, WiFiEventInfo_t info)
+                 {
+                     BootPhases::mark(BootPhase::WIFI_GOT_IP);
+                     // Taken in one step, a connect attempt started meanwhile in the loop task keeps its time
+                     const uint64_t startMillis = connectStartMillis.exchange(0);
+                     if (startMillis != 0) // not for reconnects of the WiFi driver itself
+                     {
+                         LOG_INFO(WIFI, "Got IP %s %u ms after starting to connect (%s)",
+                                  WiFi.localIP().toString().c_str(),
+                                  (uint32_t)(Clock::nowMs() - startMillis),
+                                  fastConnecting ? "cached AP" : "scan");
+                     }
+#if ESP_ARDUINO_VERSION_MAJOR >= 2
+                 },
+                 ARDUINO_EVENT_WIFI_STA_GOT_IP); // arduino-esp32 2.0.0 and later
+#else
+                 },
+                 SYSTEM_EVENT_STA_GOT_IP); // arduino-esp32 1.0.6
 #endif
 }
 
@@ -195,7 +227,7 @@ bool WIFIMANAGER::loadFromNVS()
             {
                 sprintf(tmpKey, "apPass%d", i);
                 String apPass = preferences.getString(tmpKey);
-                Log.debug("[WIFI] Load SSID '%s' to %d. slot.", apName.c_str(), i + 1);
+                LOG_DEBUG(WIFI, "Load SSID '%s' to %d. slot.", apName.c_str(), i + 1);
                 apList[i].apName = apName;
                 apList[i].apPass = apPass;
                 configuredSSIDs++;
@@ -204,7 +236,7 @@ bool WIFIMANAGER::loadFromNVS()
         preferences.end();
         return true;
     }
-    Log.debug("[WIFI] Unable to load data from NVS, giving up...");
+    LOG_DEBUG(WIFI, "Unable to load data from NVS, giving up...");
     return false;
 }
 
@@ -231,7 +263,7 @@ bool WIFIMANAGER::writeToNVS()
         preferences.end();
         return true;
     }
-    Log.debug("[WIFI] Unable to write data to NVS, giving up...");
+    LOG_DEBUG(WIFI, "Unable to write data to NVS, giving up...");
     return false;
 }
 
@@ -247,13 +279,13 @@ bool WIFIMANAGER::addWifi(String apName, String apPass, bool updateNVS)
 {
     if (apName.length() < 1 || apName.length() > 31)
     {
-        Log.error("[WIFI] No SSID given or ssid too long");
+        LOG_ERROR(WIFI, "No SSID given or ssid too long");
         return false;
     }
 
     if (apPass.length() > 63)
     {
-        Log.error("[WIFI] Passphrase too long");
+        LOG_ERROR(WIFI, "Passphrase too long");
         return false;
     }
 
@@ -261,7 +293,7 @@ bool WIFIMANAGER::addWifi(String apName, String apPass, bool updateNVS)
     {
         if (apList[i].apName == "")
         {
-            Log.debug("[WIFI] Found unused slot Nr. %d to store the new SSID '%s' credentials.", i, apName.c_str());
+            LOG_DEBUG(WIFI, "Found unused slot Nr. %d to store the new SSID '%s' credentials.", i, apName.c_str());
             apList[i].apName = apName;
             apList[i].apPass = apPass;
             configuredSSIDs++;
@@ -271,7 +303,7 @@ bool WIFIMANAGER::addWifi(String apName, String apPass, bool updateNVS)
                 return true;
         }
     }
-    Log.error("[WIFI] No slot available to store SSID credentials");
+    LOG_ERROR(WIFI, "No slot available to store SSID credentials");
     return false; // max entries reached
 }
 
@@ -336,8 +368,8 @@ uint8_t WIFIMANAGER::getApEntry()
         if (apList[i].apName.length())
             return i;
     }
-    Log.error("[WIFI][ERROR] We did not find a valid entry!");
-    Log.error("[WIFI][ERROR] Make sure to not call this function if configuredSSIDs != 1.");
+    LOG_ERROR(WIFI, "We did not find a valid entry!");
+    LOG_ERROR(WIFI, "Make sure to not call this function if configuredSSIDs != 1.");
     return 0;
 }
 
@@ -347,9 +379,9 @@ uint8_t WIFIMANAGER::getApEntry()
  */
 void WIFIMANAGER::loop()
 {
-    if (millis() - lastWifiCheckMillis < intervalWifiCheckMillis)
+    if (Clock::nowMs() - lastWifiCheckMillis < intervalWifiCheckMillis)
         return;
-    lastWifiCheckMillis = millis();
+    lastWifiCheckMillis = Clock::nowMs();
 
     if (WiFi.waitForConnectResult() == WL_CONNECTED)
     {
@@ -358,20 +390,20 @@ void WIFIMANAGER::loop()
         {
             if (WiFi.SSID() == apList[i].apName)
             {
-                Log.debug("[WIFI][STATUS] Connected to known SSID: '%s' with IP %s.",
+                LOG_DEBUG(WIFI, "Connected to known SSID: '%s' with IP %s.",
                           WiFi.SSID().c_str(),
                           WiFi.localIP().toString().c_str());
                 return;
             }
         }
         // looks like we are connected to something else, strange!?
-        Log.warn("[WIFI] We are connected to an unknown SSID ignoring. Connected to: %s", WiFi.SSID().c_str());
+        LOG_WARN(WIFI, "We are connected to an unknown SSID ignoring. Connected to: %s", WiFi.SSID().c_str());
     }
     else
     {
         if (softApRunning)
         {
-            Log.debug("[WIFI] Not trying to connect to a known SSID. SoftAP has %d clients connected!", WiFi.softAPgetStationNum());
+            LOG_DEBUG(WIFI, "Not trying to connect to a known SSID. SoftAP has %d clients connected!", WiFi.softAPgetStationNum());
         }
         else
         {
@@ -381,7 +413,7 @@ void WIFIMANAGER::loop()
                 if (createFallbackAP)
                     runSoftAP();
                 else
-                    Log.debug("[WIFI] Auto creation of SoftAP is disabled, no starting AP!");
+                    LOG_DEBUG(WIFI, "Auto creation of SoftAP is disabled, no starting AP!");
             }
         }
     }
@@ -390,11 +422,11 @@ void WIFIMANAGER::loop()
     {
         if (WiFi.softAPgetStationNum() > 0)
         {
-            Log.debug("[WIFI] SoftAP has %d clients connected!", WiFi.softAPgetStationNum());
+            LOG_DEBUG(WIFI, "SoftAP has %d clients connected!", WiFi.softAPgetStationNum());
             startApTimeMillis = millis(); // reset timeout as someone is connected
             return;
         }
-        Log.info("[WIFI] Running in AP mode but timeout reached. Closing AP!");
+        LOG_INFO(WIFI, "Running in AP mode but timeout reached. Closing AP!");
         stopSoftAP();
         delay(100);
     }
@@ -410,7 +442,7 @@ bool WIFIMANAGER::tryConnect(bool bNoSoftAP)
 {
     if (!configAvailable())
     {
-        Log.info("[WIFI] No SSIDs configured in NVS, unable to connect.");
+        LOG_INFO(WIFI, "No SSIDs configured in NVS, unable to connect.");
         if (createFallbackAP && !bNoSoftAP)
             runSoftAP();
         return false;
@@ -418,12 +450,19 @@ bool WIFIMANAGER::tryConnect(bool bNoSoftAP)
 
     if (softApRunning)
     {
-        Log.debug("[WIFI] Not trying to connect. SoftAP has %d clients connected!", WiFi.softAPgetStationNum());
+        LOG_DEBUG(WIFI, "Not trying to connect. SoftAP has %d clients connected!", WiFi.softAPgetStationNum());
         return false;
     }
 
-    int choosenAp = INT_MIN;
-    if (configuredSSIDs == 1)
+    loadLastConnection();
+    int choosenAp = getLastConnectionEntry();
+    fastConnecting = choosenAp != INT_MIN;
+    if (fastConnecting)
+    {
+        // Connect straight to the AP of the last connection, this skips the scan of all channels
+        LOG_DEBUG(WIFI, "Using cached AP on channel %d for SSID %s", lastConnection.channel, lastConnection.ssid.c_str());
+    }
+    else if (configuredSSIDs == 1)
     {
         // only one configured SSID, skip scanning and try to connect to this specific one.
         choosenAp = getApEntry();
@@ -434,11 +473,10 @@ bool WIFIMANAGER::tryConnect(bool bNoSoftAP)
         int8_t scanResult = WiFi.scanNetworks(false, true);
         if (scanResult <= 0)
         {
-            Log.debug("[WIFI] Unable to find WIFI networks in range to this device!");
+            LOG_DEBUG(WIFI, "Unable to find WIFI networks in range to this device!");
             return false;
         }
-        Serial.print(F("[WIFI] Found networks: "));
-        Serial.println(scanResult);
+        LOG_DEBUG(WIFI, "Found networks: %d", scanResult);
         int choosenRssi = INT_MIN; // we want to select the strongest signal with the highest priority if we have multiple SSIDs available
         for (int8_t x = 0; x < scanResult; ++x)
         {
@@ -468,16 +506,21 @@ bool WIFIMANAGER::tryConnect(bool bNoSoftAP)
 
     if (choosenAp == INT_MIN)
     {
-        Log.debug("[WIFI] Unable to find an SSID to connect to!");
+        LOG_DEBUG(WIFI, "Unable to find an SSID to connect to!");
         return false;
     }
     else
     {
-        Log.debug("[WIFI] Trying to connect to SSID %s with password %s.",
+        LOG_DEBUG(WIFI, "Trying to connect to SSID %s with password %s.",
                   apList[choosenAp].apName.c_str(),
                   (apList[choosenAp].apPass.length() > 0 ? "'***'" : "''"));
         WiFi.setHostname(getUniqueHostname().c_str());
-        WiFi.begin(apList[choosenAp].apName.c_str(), apList[choosenAp].apPass.c_str());
+        BootPhases::mark(BootPhase::WIFI_START);
+        connectStartMillis = Clock::nowMs();
+        if (fastConnecting)
+            WiFi.begin(apList[choosenAp].apName.c_str(), apList[choosenAp].apPass.c_str(), lastConnection.channel, lastConnection.bssid);
+        else
+            WiFi.begin(apList[choosenAp].apName.c_str(), apList[choosenAp].apPass.c_str());
         #if defined(CONFIG_IDF_TARGET_ESP32C3) && defined(ANTENNA_BROKEN)
             WiFi.setTxPower(WIFI_POWER_8_5dBm);
         #endif
@@ -493,42 +536,113 @@ bool WIFIMANAGER::tryConnect(bool bNoSoftAP)
         switch (status)
         {
         case WL_IDLE_STATUS:
-            Log.debug("[WIFI] Connecting failed (0): Idle");
+            LOG_DEBUG(WIFI, "Connecting failed (0): Idle");
             break;
         case WL_NO_SSID_AVAIL:
-            Log.debug("[WIFI] Connection failed (1): The AP can't be found.");
+            LOG_DEBUG(WIFI, "Connection failed (1): The AP can't be found.");
             break;
         case WL_SCAN_COMPLETED:
-            Log.debug("[WIFI] Connecting failed (2): Scan completed");
+            LOG_DEBUG(WIFI, "Connecting failed (2): Scan completed");
             break;
         case WL_CONNECTED: // 3
-            Log.debug("[WIFI] Connection successful.");
-            Log.debug("[WIFI] SSID   : %s", WiFi.SSID().c_str());
-            Log.debug("[WIFI] IP     : %s", WiFi.localIP().toString().c_str());
+            LOG_DEBUG(WIFI, "Connection successful.");
+            LOG_DEBUG(WIFI, "SSID   : %s", WiFi.SSID().c_str());
+            LOG_DEBUG(WIFI, "IP     : %s", WiFi.localIP().toString().c_str());
 
+            storeLastConnection();
             stopSoftAP();
             return true;
             break;
         case WL_CONNECT_FAILED:
-            Log.debug("[WIFI] Connecting failed (4): Unknown reason");
+            LOG_DEBUG(WIFI, "Connecting failed (4): Unknown reason");
             break;
         case WL_CONNECTION_LOST:
-            Log.debug("[WIFI] Connecting failed (5): Connection lost");
+            LOG_DEBUG(WIFI, "Connecting failed (5): Connection lost");
             break;
         case WL_DISCONNECTED:
-            Log.debug("[WIFI] Connecting failed (6): Disconnected");
+            LOG_DEBUG(WIFI, "Connecting failed (6): Disconnected");
             break;
         case WL_NO_SHIELD:
-            Log.debug("[WIFI] Connecting failed (255): No Wifi shield found");
+            LOG_DEBUG(WIFI, "Connecting failed (255): No Wifi shield found");
             break;
         default:
-            Log.debug("[WIFI] Connecting Failed (Status: %d).", status);
+            LOG_DEBUG(WIFI, "Connecting Failed (Status: %d).", status);
             break;
         }
+        if (fastConnecting)
+        {
+            // The AP may be gone or on another channel now, forget it and look for one the usual way
+            LOG_INFO(WIFI, "Connecting to the cached AP failed, falling back to a scan");
+            lastConnection.channel = 0;
+            WiFi.disconnect();
+            return tryConnect(bNoSoftAP);
+        }
     }
     return false;
 }
 
+/**
+ * @brief Find the configured SSID of the last successful connection
+ * @return id of the apList entry, or INT_MIN if nothing is cached or the SSID is no longer configured
+ */
+int WIFIMANAGER::getLastConnectionEntry()
+{
+    if (lastConnection.channel <= 0)
+        return INT_MIN;
+    for (uint8_t i = 0; i < WIFIMANAGER_MAX_APS; i++)
+    {
+        if (apList[i].apName.length() > 0 && apList[i].apName == lastConnection.ssid)
+            return i;
+    }
+    return INT_MIN;
+}
+
+/**
+ * @brief Load BSSID and channel of the last successful connection from the NVS, once
+ */
+void WIFIMANAGER::loadLastConnection()
+{
+    if (lastConnectionLoaded)
+        return;
+    lastConnectionLoaded = true;
+    if (!preferences.begin(NVS, true))
+        return;
+    if (preferences.getBytesLength("lastBssid") == sizeof(lastConnection.bssid))
+    {
+        preferences.getBytes("lastBssid", lastConnection.bssid, sizeof(lastConnection.bssid));
+        lastConnection.ssid = preferences.getString("lastSsid", "");
+        lastConnection.channel = preferences.getInt("lastChannel", 0);
+    }
+    preferences.end();
+}
+
+/**
+ * @brief Write SSID, BSSID and channel of the current connection to the NVS
+ * @details Only writes if something changed, so a reconnect to the same AP costs no flash wear
+ */
+void WIFIMANAGER::storeLastConnection()
+{
+    const uint8_t *bssid = WiFi.BSSID();
+    const int32_t channel = WiFi.channel();
+    const String ssid = WiFi.SSID();
+    if (bssid == nullptr || channel <= 0)
+        return;
+    if (lastConnection.channel == channel && lastConnection.ssid == ssid && memcmp(lastConnection.bssid, bssid, sizeof(lastConnection.bssid)) == 0)
+        return;
+
+    lastConnection.ssid = ssid;
+    memcpy(lastConnection.bssid, bssid, sizeof(lastConnection.bssid));
+    lastConnection.channel = channel;
+    if (preferences.begin(NVS, false))
+    {
+        preferences.putString("lastSsid", ssid);
+        preferences.putBytes("lastBssid", lastConnection.bssid, sizeof(lastConnection.bssid));
+        preferences.putInt("lastChannel", channel);
+        preferences.end();
+    }
+    LOG_DEBUG(WIFI, "Cached AP %s on channel %d", WiFi.BSSIDstr().c_str(), channel);
+}
+
 /**
  * @brief Start a SoftAP for direct client access
  * @param apName name of the AP to create (default is ESP_XXXXXXXX)
@@ -552,20 +666,20 @@ bool WIFIMANAGER::runSoftAP(String apName)
             apName = "ESP_" + String((uint32_t)ESP.getEfuseMac());
         }
     }
-    Log.debug("[WIFI] Starting configuration portal on AP SSID %s", apName.c_str());
+    LOG_DEBUG(WIFI, "Starting configuration portal on AP SSID %s", apName.c_str());
     if (!softAPPassword.isEmpty())
-        Log.debug("Using SoftAP Password: %s", softAPPassword.c_str());
+        LOG_DEBUG(WIFI, "Using SoftAP Password: %s", softAPPassword.c_str());
     WiFi.mode(WIFI_AP);
     bool state = WiFi.softAP(apName.c_str(), softAPPassword.isEmpty() ? NULL : softAPPassword.c_str());
     if (state)
     {
         IPAddress IP = WiFi.softAPIP();
-        Log.info("[WIFI] AP created. My IP is: %s", IP.toString().c_str());
+        LOG_INFO(WIFI, "AP created. My IP is: %s", IP.toString().c_str());
         return true;
     }
     else
     {
-        Log.warn("[WIFI] Unable to create soft AP!");
+        LOG_WARN(WIFI, "Unable to create soft AP!");
         return false;
     }
 }
@@ -616,7 +730,7 @@ bool WIFIMANAGER::requestWifi(void *user, bool bNoSoftAP)
         if (existingUser == user)
         {
             // User already has a request, log warning
-            Log.error("WiFi already requested by this user");
+            LOG_ERROR(WIFI, "WiFi already requested by this user");
             return false;
         }
     }
@@ -660,7 +774,7 @@ void WIFIMANAGER::finishedWifi(void *user)
 
     if (!userFound)
     {
-        Log.error("WiFi release requested by user who didn't request it");
+        LOG_ERROR(WIFI, "WiFi release requested by user who didn't request it");
         return;
     }
 
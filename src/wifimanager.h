@@ -21,6 +21,7 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <atomic>
 #if WIFIM_WEBSERVER == true
     #if ASYNC_WEBSERVER == true
     #include <ESPAsyncWebServer.h>
@@ -52,6 +53,17 @@ class WIFIMANAGER {
 
     uint8_t configuredSSIDs = 0;        // Number of stored SSIDs in the NVS
 
+    struct lastConnection_t {
+      String ssid;                      // SSID of the last successful connection
+      uint8_t bssid[6] = {0};           // AP it was connected to
+      int32_t channel = 0;              // Channel of the AP, 0 if nothing is cached
+    };
+    lastConnection_t lastConnection;    // Cached in the NVS to connect without a scan after a restart
+    bool lastConnectionLoaded = false;  // Cache was read from the NVS
+    // Both also read by the got-IP handler in the WiFi event task
+    std::atomic<bool> fastConnecting{false};        // Current connect attempt goes to the cached AP
+    std::atomic<uint64_t> connectStartMillis{0};    // Time the current connect attempt started, 0 = none
+
     bool softApRunning = false;         // Due to lack of functions, we have to remember if the AP is already running...
     bool createFallbackAP = true;       // Create an AP for configuration if no other connection is available
     String softAPPassword = "";         // Password for SoftAP for additional protection, can be empty for open
@@ -76,6 +88,15 @@ class WIFIMANAGER {
     bool startBackgroundTask(bool bNoSoftAP);
     // Try each known SSID and connect until none is left or one is connected.
     bool tryConnect(bool bNoSoftAP);
+
+    // Get id of the entry of the last successful connection, INT_MIN if none is cached
+    int getLastConnectionEntry();
+
+    // Read the last successful connection from the NVS
+    void loadLastConnection();
+
+    // Remember the current connection in the NVS, written only if it changed
+    void storeLastConnection();
     
     // Disconnect/Stop SoftAP Mode
     void stopSoftAP();
@@ -0,0 +1,68 @@
+// Arduino.h
+#pragma once
+
+// The parts of the Arduino core for the ESP32 that the firmware uses, for host builds.
+// Time is simulated: millis() only moves when a test says so, see HostStubs.h.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include "WString.h"
+#include "HostStubs.h"
+
+#define PROGMEM
+
+using std::abs;
+using std::max;
+using std::min;
+
+// 32 bit like on the ESP32, so they wrap after 49.7 days there and here
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud) {}
+    void flush() { fflush(stdout); }
+    size_t print(const char *text) { return fputs(text, stdout) < 0 ? 0 : strlen(text); }
+    size_t print(const String &text) { return print(text.c_str()); }
+    size_t println(const char *text = "") { return print(text) + print("\n"); }
+    size_t println(const String &text) { return println(text.c_str()); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format);
+        const int len = vprintf(format, args);
+        va_end(args);
+        return len < 0 ? 0 : len;
+    }
+};
+
+extern HardwareSerial Serial;
+
+// Heap figures come from host::setHeap()
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    void restart() { esp_restart(); }
+};
+
+extern EspClass ESP;
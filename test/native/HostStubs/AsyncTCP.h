@@ -0,0 +1,47 @@
+// AsyncTCP.h
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "IPAddress.h"
+
+class AsyncClient;
+
+typedef std::function<void(void *arg, AsyncClient *client)> AcConnectHandler;
+
+// One client connection. On the host nothing is sent anywhere; space() is whatever the test
+// says is free in the send buffer, and poll() plays AsyncTCP's poll timer.
+class AsyncClient
+{
+public:
+    static constexpr size_t DEFAULT_SPACE = 5744; // TCP_SND_BUF of the ESP32 lwIP
+
+    explicit AsyncClient(IPAddress remoteIP = IPAddress(192, 168, 1, 10)) : m_remoteIP(remoteIP) {}
+
+    IPAddress remoteIP() const { return m_remoteIP; }
+    size_t space() const { return m_space; }
+    bool canSend() const { return m_space > 0; }
+    void onPoll(AcConnectHandler handler, void *arg = nullptr)
+    {
+        m_pollHandler = handler;
+        m_pollArg = arg;
+    }
+
+    // Host side
+    void setSpace(size_t space) { m_space = space; }
+    // Runs the poll handler in the AsyncTCP task, AsyncTCP does that about twice a second
+    void poll()
+    {
+        host::AsyncTcpScope scope;
+        if (m_pollHandler)
+        {
+            m_pollHandler(m_pollArg, this);
+        }
+    }
+
+private:
+    IPAddress m_remoteIP;
+    size_t m_space = DEFAULT_SPACE;
+    AcConnectHandler m_pollHandler;
+    void *m_pollArg = nullptr;
+};
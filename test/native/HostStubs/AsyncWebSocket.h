@@ -0,0 +1,129 @@
+// AsyncWebSocket.h
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AsyncTCP.h"
+
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+
+enum AwsEventType
+{
+    WS_EVT_CONNECT,
+    WS_EVT_DISCONNECT,
+    WS_EVT_PONG,
+    WS_EVT_ERROR,
+    WS_EVT_DATA
+};
+
+enum AwsClientStatus
+{
+    WS_DISCONNECTED,
+    WS_CONNECTED,
+    WS_DISCONNECTING
+};
+
+#define DEFAULT_MAX_WS_CLIENTS 8
+#define WS_MAX_QUEUED_MESSAGES 32
+
+typedef std::function<void(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg,
+                           uint8_t *data, size_t len)>
+    AwsEventHandler;
+
+// One message buffer shared by several clients; it may be deleted once no client holds it
+// and it is not locked
+class AsyncWebSocketMessageBuffer
+{
+public:
+    explicit AsyncWebSocketMessageBuffer(size_t size) : m_data(size) {}
+
+    uint8_t *get() { return m_data.data(); }
+    size_t length() const { return m_data.size(); }
+    void lock() { m_locked = true; }
+    void unlock() { m_locked = false; }
+    bool canDelete() const { return !m_locked && m_count == 0; }
+
+    // Host side, held by a queued message
+    void hold() { m_count++; }
+    void release() { m_count--; }
+
+private:
+    std::vector<uint8_t> m_data;
+    bool m_locked = false;
+    int m_count = 0;
+};
+
+// Messages go into the client's queue and out to the client on its next poll, as far as
+// space() of its connection allows
+class AsyncWebSocketClient
+{
+public:
+    AsyncWebSocketClient(AsyncWebSocket *server, uint32_t id, IPAddress remoteIP);
+    ~AsyncWebSocketClient();
+
+    uint32_t id() const { return m_id; }
+    AwsClientStatus status() const { return m_status; }
+    AsyncClient *client() { return &m_client; }
+    bool queueIsFull() const { return m_queue.size() >= WS_MAX_QUEUED_MESSAGES || m_status != WS_CONNECTED; }
+    void text(const char *message, size_t len);
+    void text(AsyncWebSocketMessageBuffer *buffer);
+    void close();
+
+    // System callback of the poll timer, sends what is queued
+    void _onPoll();
+
+    // Host side
+    // Text messages that went out to the client, oldest first
+    const std::vector<std::string> &getReceived() const { return m_received; }
+    void clearReceived() { m_received.clear(); }
+    size_t getQueued() const { return m_queue.size(); }
+    // Messages queued from outside the AsyncTCP task
+    uint32_t getCrossTaskCalls() const { return m_crossTaskCalls; }
+
+private:
+    struct Message
+    {
+        std::string text;
+        AsyncWebSocketMessageBuffer *buffer = nullptr;
+    };
+
+    AsyncWebSocket *m_server;
+    uint32_t m_id;
+    AsyncClient m_client;
+    AwsClientStatus m_status = WS_CONNECTED;
+    std::vector<Message> m_queue;
+    std::vector<std::string> m_received;
+    uint32_t m_crossTaskCalls = 0;
+};
+
+class AsyncWebSocket : public AsyncWebHandler
+{
+public:
+    explicit AsyncWebSocket(const String &url) : m_url(url) {}
+    ~AsyncWebSocket();
+
+    const String &url() const { return m_url; }
+    void onEvent(AwsEventHandler handler) { m_handler = handler; }
+    size_t count() const;
+    const std::vector<AsyncWebSocketClient *> &getClients() const { return m_clients; }
+    // Closes the oldest clients beyond maxClients, they stay in the list until disconnect()
+    void cleanupClients(uint16_t maxClients = DEFAULT_MAX_WS_CLIENTS);
+
+    // Host side
+    // A client opens the socket: WS_EVT_CONNECT runs in the AsyncTCP task
+    AsyncWebSocketClient *connect(IPAddress remoteIP = IPAddress(192, 168, 1, 20));
+    // The client goes away: WS_EVT_DISCONNECT, then the client is deleted
+    void disconnect(AsyncWebSocketClient *client);
+    // One round of AsyncTCP's poll timer over all connections
+    void pollAll();
+
+private:
+    String m_url;
+    AwsEventHandler m_handler;
+    std::vector<AsyncWebSocketClient *> m_clients;
+    uint32_t m_nextId = 1;
+};
@@ -0,0 +1,199 @@
+// ESPAsyncWebServer.h
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AsyncTCP.h"
+
+// The ESPAsyncWebServer API the firmware uses, with a host side to drive it: a test builds
+// an AsyncWebServerRequest, hands it to the server that was started, and pulls the body
+// out of the response the way AsyncTCP does, chunk by chunk. Handlers and fillers run in
+// a host::AsyncTcpScope. See HostWeb.h for the one call version.
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+
+typedef uint8_t WebRequestMethodComposite;
+enum WebRequestMethod : uint8_t
+{
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+};
+
+// A filler returning this has nothing yet and is asked again later
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void()> ArDisconnectHandler;
+
+class AsyncWebHeader
+{
+public:
+    AsyncWebHeader(const String &name, const String &value) : m_name(name), m_value(value) {}
+    const String &name() const { return m_name; }
+    const String &value() const { return m_value; }
+
+private:
+    String m_name;
+    String m_value;
+};
+
+class AsyncWebParameter
+{
+public:
+    AsyncWebParameter(const String &name, const String &value) : m_name(name), m_value(value) {}
+    const String &name() const { return m_name; }
+    const String &value() const { return m_value; }
+
+private:
+    String m_name;
+    String m_value;
+};
+
+class AsyncWebServerResponse
+{
+public:
+    void addHeader(const String &name, const String &value) { m_headers.emplace_back(name, value); }
+
+    // Host side
+    int code() const { return m_code; }
+    const String &contentType() const { return m_contentType; }
+    bool isChunked() const { return m_chunked; }
+    // Value of the header, nullptr if the response does not have it
+    const char *header(const char *name) const;
+    const std::vector<AsyncWebHeader> &headers() const { return m_headers; }
+
+private:
+    friend class AsyncWebServerRequest;
+
+    int m_code = 200;
+    String m_contentType;
+    std::vector<AsyncWebHeader> m_headers;
+    std::string m_content;        // for responses that have their body up front
+    AwsResponseFiller m_filler;   // for the others
+    size_t m_contentLength = 0;   // of a filler response that is not chunked
+    bool m_chunked = false;
+};
+
+class AsyncWebServerRequest
+{
+public:
+    // Host side: a GET of url, e.g. "/battery.json?fields=soc", from a client at clientIp.
+    // Deleting it is the connection going away, which runs the onDisconnect handler.
+    explicit AsyncWebServerRequest(const char *url, IPAddress clientIp = IPAddress(192, 168, 1, 10));
+    ~AsyncWebServerRequest();
+
+    AsyncClient *client() { return &m_client; }
+    const String &url() const { return m_url; }
+    WebRequestMethodComposite method() const { return HTTP_GET; }
+
+    bool hasParam(const String &name, bool post = false, bool file = false) const;
+    AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const;
+    size_t params() const { return m_params.size(); }
+    bool hasHeader(const String &name) const { return getHeader(name) != nullptr; }
+    AsyncWebHeader *getHeader(const String &name) const;
+
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &contentType = String(), const String &content = String());
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+    AsyncWebServerResponse *beginResponse(const String &contentType, size_t len, AwsResponseFiller callback);
+    AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len);
+    AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback);
+    void onDisconnect(ArDisconnectHandler handler) { m_onDisconnect = handler; }
+
+    // Host side
+    void addHeader(const char *name, const char *value) { m_headers.emplace_back(std::make_unique<AsyncWebHeader>(name, value)); }
+    // The response the handler sent, nullptr if it did not send one
+    const AsyncWebServerResponse *response() const { return m_response.get(); }
+    // Hands up to maxLen bytes of the body to the client, as AsyncTCP does whenever the
+    // connection has room. True once the body is complete, false if there is more to come
+    // or the filler answered RESPONSE_TRY_AGAIN (see wasTryAgain()).
+    bool transfer(size_t maxLen = 1436);
+    bool isComplete() const { return m_complete; }
+    bool wasTryAgain() const { return m_tryAgain; }
+    const std::string &body() const { return m_body; }
+    // Filler calls that returned data, i.e. the number of TCP segments of the body
+    size_t getChunkCount() const { return m_chunks; }
+
+private:
+    AsyncClient m_client;
+    String m_url;
+    std::vector<std::unique_ptr<AsyncWebParameter>> m_params;
+    std::vector<std::unique_ptr<AsyncWebHeader>> m_headers;
+    std::vector<std::unique_ptr<AsyncWebServerResponse>> m_begun; // owned until the request goes
+    std::unique_ptr<AsyncWebServerResponse> m_response;
+    ArDisconnectHandler m_onDisconnect;
+    std::string m_body;
+    bool m_complete = false;
+    bool m_tryAgain = false;
+    size_t m_chunks = 0;
+
+    AsyncWebServerResponse *begin(int code, const String &contentType);
+};
+
+class AsyncWebHandler
+{
+public:
+    virtual ~AsyncWebHandler() = default;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+public:
+    AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction handler)
+        : m_uri(uri), m_method(method), m_handler(handler) {}
+
+    // Host side
+    bool canHandle(const AsyncWebServerRequest &request) const;
+    void handle(AsyncWebServerRequest *request) const { m_handler(request); }
+
+private:
+    String m_uri;
+    WebRequestMethodComposite m_method;
+    ArRequestHandlerFunction m_handler;
+};
+
+class AsyncWebServer
+{
+public:
+    explicit AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+
+    void begin();
+    void end();
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+    void onNotFound(ArRequestHandlerFunction handler) { m_notFound = handler; }
+
+    // Host side
+    // The server that was begun last and is still listening, nullptr if none
+    static AsyncWebServer *running();
+    uint16_t port() const { return m_port; }
+    // Runs the handler for the request's path in the AsyncTCP task, the not found handler
+    // if there is none
+    void handle(AsyncWebServerRequest *request);
+    // The WebSocket handler added for url, nullptr if none
+    AsyncWebSocket *getWebSocket(const char *url) const;
+
+private:
+    uint16_t m_port;
+    bool m_listening = false;
+    std::vector<std::unique_ptr<AsyncCallbackWebHandler>> m_handlers;
+    std::vector<AsyncWebHandler *> m_addedHandlers;
+    ArRequestHandlerFunction m_notFound;
+};
+
+#include "AsyncWebSocket.h"
@@ -0,0 +1,137 @@
+// FakeBLEManager.cpp
+// BLEManager and the static parts of TDTPollCharacteristicTask without a BLE stack. Queued
+// tasks are not run; a poll waits for HostBLE.h to complete it.
+#include "HostBLE.h"
+#include "TDTPollCharacteristicTask.h"
+#include <map>
+
+namespace
+{
+    std::map<const BLEManager *, std::function<void(const TaskResult &)>> s_pendingPolls;
+
+    bool complete(BLEManager &bleManager, const TaskResult &result)
+    {
+        const auto it = s_pendingPolls.find(&bleManager);
+        if (it == s_pendingPolls.end())
+        {
+            return false;
+        }
+        // BatteryManager queues the next poll from the callback
+        const std::function<void(const TaskResult &)> callback = it->second;
+        s_pendingPolls.erase(it);
+        callback(result);
+        return true;
+    }
+}
+
+BLETask::BLETask(TaskType type, int priority, uint32_t timeout, const NimBLEUUID &serviceUuid, const NimBLEAddress &deviceAddress,
+                 std::function<void(const TaskResult &)> callback, bool bSticky)
+    : type(type), priority(priority), timeout(timeout), startTime(0), bSticky(bSticky), deviceAddress(deviceAddress), serviceUuid(serviceUuid), callback(callback)
+{
+}
+
+void BLETask::complete(const TaskResult &result)
+{
+    if (callback)
+    {
+        callback(result);
+    }
+}
+
+const char *BLETask::getResultLabel(const TaskStatus &status)
+{
+    switch (status)
+    {
+    case TaskStatus::SUCCESS:
+        return "SUCCESS";
+    case TaskStatus::ERROR:
+        return "ERROR";
+    case TaskStatus::TIMEOUT:
+        return "TIMEOUT";
+    case TaskStatus::CANCELLED:
+        return "CANCELLED";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+TDTBMSData TDTPollCharacteristicTask::getBMSDataFromResultTaskResult(const TaskResult result)
+{
+    TDTBMSData bmsData;
+    if (result.status == TaskStatus::SUCCESS && result.dataLength == sizeof(TDTBMSData))
+    {
+        memcpy(&bmsData, result.data.get(), result.dataLength);
+    }
+    return bmsData;
+}
+
+BLEManager::BLEManager() : busy(false), initialized(false) {}
+
+void BLEManager::queueTask(std::shared_ptr<BLETask> task)
+{
+}
+
+void BLEManager::queueTDTPollCharacteristicTask(int priority, uint32_t timeout,
+                                                std::function<void(const TaskResult &)> callback,
+                                                const NimBLEAddress &deviceAddress, bool bSticky)
+{
+    s_pendingPolls[this] = callback;
+}
+
+void BLEManager::close()
+{
+    s_pendingPolls.erase(this);
+}
+
+void BLEManager::process()
+{
+}
+
+void BLEManager::init(bool bIsReset)
+{
+    initialized = true;
+}
+
+bool BLEManager::isBusy() const
+{
+    return s_pendingPolls.count(this) > 0;
+}
+
+std::string BLEManager::uuidToShortKey(const NimBLEUUID &uuid)
+{
+    return uuid.toString().substr(0, 15);
+}
+
+NimBLEAddress BLEManager::getKnownDevice(const NimBLEUUID &serviceUuid)
+{
+    const auto it = m_knownDeviceMap.find(serviceUuid);
+    return it != m_knownDeviceMap.end() ? it->second : NimBLEAddress();
+}
+
+namespace host
+{
+    bool hasPendingPoll(BLEManager &bleManager)
+    {
+        return s_pendingPolls.count(&bleManager) > 0;
+    }
+
+    bool deliverBmsSample(BLEManager &bleManager, const TDTBMSData &data, uint64_t scheduledMs, uint32_t durationMs)
+    {
+        TaskResult result;
+        result.status = TaskStatus::SUCCESS;
+        result.data = std::shared_ptr<uint8_t[]>(new uint8_t[sizeof(TDTBMSData)]);
+        memcpy(result.data.get(), &data, sizeof(TDTBMSData));
+        result.dataLength = sizeof(TDTBMSData);
+        result.durationMs = durationMs;
+        result.scheduledMs = scheduledMs;
+        return complete(bleManager, result);
+    }
+
+    bool failBmsPoll(BLEManager &bleManager, TaskStatus status)
+    {
+        TaskResult result;
+        result.status = status;
+        result.errorMessage = "host";
+        return complete(bleManager, result);
+    }
+}
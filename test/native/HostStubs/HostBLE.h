@@ -0,0 +1,19 @@
+// HostBLE.h
+#pragma once
+
+#include "BLEManager.h"
+
+// The BMS side of the fake BLEManager in FakeBLEManager.cpp: the poll task queued last on
+// a BLEManager stays pending, these complete it like TDTPollCharacteristicTask would.
+namespace host
+{
+    // True if a poll task was queued on bleManager and not completed yet
+    bool hasPendingPoll(BLEManager &bleManager);
+
+    // Completes the pending poll with a sample, false if there is none. scheduledMs is the
+    // slot the poll was due on (0 = not on the schedule), durationMs how long it took.
+    bool deliverBmsSample(BLEManager &bleManager, const TDTBMSData &data, uint64_t scheduledMs = 0, uint32_t durationMs = 1500);
+
+    // Completes the pending poll without a sample
+    bool failBmsPoll(BLEManager &bleManager, TaskStatus status = TaskStatus::TIMEOUT);
+}
@@ -0,0 +1,366 @@
+// HostStubs.cpp
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+namespace
+{
+    std::atomic<int64_t> s_uptimeUs{0};
+
+    std::mutex s_wallLock;
+    int64_t s_wallEpochUs = 0;  // at s_wallUptimeUs
+    int64_t s_wallUptimeUs = 0;
+    int32_t s_wallDriftPpb = 0;
+
+    std::atomic<uint32_t> s_freeHeap{200 * 1024};
+    std::atomic<uint32_t> s_minFreeHeap{200 * 1024};
+    std::atomic<uint32_t> s_largestBlock{100 * 1024};
+    std::atomic<bool> s_wifiConnected{true};
+
+    thread_local bool s_inAsyncTcp = false;
+
+    std::mutex s_prefsLock;
+    std::map<std::string, std::vector<uint8_t>> s_prefs; // "namespace/key"
+}
+
+extern "C" int64_t host_wall_clock_us()
+{
+    std::lock_guard<std::mutex> lock(s_wallLock);
+    if (s_wallEpochUs == 0)
+    {
+        // Not set yet, the ESP32 starts counting from the epoch at boot
+        return s_uptimeUs;
+    }
+    const int64_t elapsedUs = s_uptimeUs - s_wallUptimeUs;
+    return s_wallEpochUs + elapsedUs + elapsedUs / 1000 * s_wallDriftPpb / 1000000;
+}
+
+namespace host
+{
+    int64_t uptimeUs()
+    {
+        return s_uptimeUs;
+    }
+
+    void setUptimeUs(int64_t us)
+    {
+        s_uptimeUs = us;
+    }
+
+    void advanceMs(uint64_t ms)
+    {
+        s_uptimeUs += (int64_t)ms * 1000;
+    }
+
+    void setWallClock(int64_t epochUs, int32_t driftPpb)
+    {
+        std::lock_guard<std::mutex> lock(s_wallLock);
+        s_wallEpochUs = epochUs;
+        s_wallUptimeUs = s_uptimeUs;
+        s_wallDriftPpb = driftPpb;
+    }
+
+    void setHeap(uint32_t freeHeap, uint32_t largestBlock)
+    {
+        s_freeHeap = freeHeap;
+        s_largestBlock = largestBlock;
+        s_minFreeHeap = std::min(s_minFreeHeap.load(), freeHeap);
+    }
+
+    void setWiFiConnected(bool connected)
+    {
+        s_wifiConnected = connected;
+    }
+
+    bool isWiFiConnected()
+    {
+        return s_wifiConnected;
+    }
+
+    void clearPreferences()
+    {
+        std::lock_guard<std::mutex> lock(s_prefsLock);
+        s_prefs.clear();
+    }
+
+    bool inAsyncTcpTask()
+    {
+        return s_inAsyncTcp;
+    }
+
+    AsyncTcpScope::AsyncTcpScope() : m_previous(s_inAsyncTcp)
+    {
+        s_inAsyncTcp = true;
+    }
+
+    AsyncTcpScope::~AsyncTcpScope()
+    {
+        s_inAsyncTcp = m_previous;
+    }
+}
+
+int64_t esp_timer_get_time()
+{
+    return s_uptimeUs;
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(s_uptimeUs / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)s_uptimeUs;
+}
+
+void delay(uint32_t ms)
+{
+    host::advanceMs(ms);
+}
+
+void yield()
+{
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host::advanceMs(ticks);
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    return s_freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    return s_minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap()
+{
+    return s_largestBlock;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+    return ESP_RST_POWERON;
+}
+
+void esp_restart()
+{
+    fprintf(stderr, "esp_restart() called\n");
+    abort();
+}
+
+int esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    const uint8_t address[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+    memcpy(mac, address, sizeof(address));
+    return 0;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    m_namespace = name;
+    m_readOnly = readOnly;
+    m_open = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    m_open = false;
+}
+
+std::string Preferences::path(const char *key) const
+{
+    return m_namespace + "/" + key;
+}
+
+bool Preferences::clear()
+{
+    if (!m_open || m_readOnly)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(s_prefsLock);
+    const std::string prefix = m_namespace + "/";
+    for (auto it = s_prefs.begin(); it != s_prefs.end();)
+    {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? s_prefs.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!m_open || m_readOnly)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(s_prefsLock);
+    return s_prefs.erase(path(key)) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    std::lock_guard<std::mutex> lock(s_prefsLock);
+    return m_open && s_prefs.count(path(key)) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+    if (!m_open || m_readOnly)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(s_prefsLock);
+    s_prefs[path(key)].assign((const uint8_t *)value, (const uint8_t *)value + len);
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    std::lock_guard<std::mutex> lock(s_prefsLock);
+    const auto it = s_prefs.find(path(key));
+    return m_open && it != s_prefs.end() ? it->second.size() : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+    std::lock_guard<std::mutex> lock(s_prefsLock);
+    const auto it = s_prefs.find(path(key));
+    if (!m_open || it == s_prefs.end() || it->second.size() > maxLen)
+    {
+        return 0;
+    }
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::putInt(const char *key, int32_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char *key, int32_t defaultValue)
+{
+    int32_t value;
+    return getBytesLength(key) == sizeof(value) && getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putULong64(const char *key, uint64_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint64_t Preferences::getULong64(const char *key, uint64_t defaultValue)
+{
+    uint64_t value;
+    return getBytesLength(key) == sizeof(value) && getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+bool IPAddress::fromString(const char *text)
+{
+    struct in_addr address;
+    if (inet_pton(AF_INET, text, &address) != 1)
+    {
+        return false;
+    }
+    memcpy(m_bytes, &address.s_addr, sizeof(m_bytes));
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", m_bytes[0], m_bytes[1], m_bytes[2], m_bytes[3]);
+    return String(text);
+}
+
+int WiFiClass::hostByName(const char *name, IPAddress &address)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(name, nullptr, &hints, &result) != 0 || result == nullptr)
+    {
+        return 0;
+    }
+    address = IPAddress((uint32_t)((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(result);
+    return 1;
+}
+
+int WiFiUDP::beginPacket(IPAddress address, uint16_t port)
+{
+    if (m_socket < 0)
+    {
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket < 0)
+        {
+            return 0;
+        }
+    }
+    m_address = address;
+    m_port = port;
+    m_packet.clear();
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *data, size_t len)
+{
+    m_packet.append((const char *)data, len);
+    return len;
+}
+
+int WiFiUDP::endPacket()
+{
+    struct sockaddr_in target = {};
+    target.sin_family = AF_INET;
+    target.sin_port = htons(m_port);
+    target.sin_addr.s_addr = (uint32_t)m_address;
+    const ssize_t sent = sendto(m_socket, m_packet.data(), m_packet.size(), 0, (const struct sockaddr *)&target, sizeof(target));
+    return sent == (ssize_t)m_packet.size() ? 1 : 0;
+}
+
+void WiFiUDP::stop()
+{
+    if (m_socket >= 0)
+    {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
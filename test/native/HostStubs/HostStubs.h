@@ -0,0 +1,39 @@
+// HostStubs.h
+#pragma once
+
+#include <stdint.h>
+
+// Knobs of the simulated ESP32 for tests. Everything starts out as on a fresh boot: uptime
+// 0, wall clock not set, plenty of heap, WiFi connected.
+namespace host
+{
+    // Monotonic time since boot, what esp_timer_get_time() and millis() return
+    int64_t uptimeUs();
+    void setUptimeUs(int64_t us);
+    void advanceMs(uint64_t ms);
+
+    // What gettimeofday() returns from now on: epochUs, running driftPpb faster than the
+    // monotonic clock (positive = the crystal is slow). epochUs = 0 is the unset clock of
+    // a fresh boot.
+    void setWallClock(int64_t epochUs, int32_t driftPpb = 0);
+
+    void setHeap(uint32_t freeHeap, uint32_t largestBlock);
+    void setWiFiConnected(bool connected);
+    bool isWiFiConnected();
+
+    // Forgets everything written to Preferences, like an erased NVS partition
+    void clearPreferences();
+
+    // The AsyncTCP task: the web server stubs run request handlers, response fillers and
+    // WebSocket polls inside such a scope, so tests can check what runs where
+    bool inAsyncTcpTask();
+    class AsyncTcpScope
+    {
+    public:
+        AsyncTcpScope();
+        ~AsyncTcpScope();
+
+    private:
+        bool m_previous;
+    };
+}
@@ -0,0 +1,17 @@
+// HostTime.c
+// gettimeofday() of the simulated wall clock, see host::setWallClock(). In C and without
+// the C library's declaration, so this definition takes the place of the library's for
+// the firmware code linked into the test.
+#include <stdint.h>
+#include <sys/select.h>
+
+int64_t host_wall_clock_us(void);
+
+int gettimeofday(struct timeval *tv, void *tz)
+{
+    (void)tz;
+    const int64_t us = host_wall_clock_us();
+    tv->tv_sec = (time_t)(us / 1000000);
+    tv->tv_usec = (suseconds_t)(us % 1000000);
+    return 0;
+}
@@ -0,0 +1,524 @@
+// HostWeb.cpp
+#include "HostWeb.h"
+#include <ESPAsyncWebServer.h>
+
+namespace
+{
+    AsyncWebServer *s_running = nullptr;
+
+    // AsyncTCP's poll timer
+    constexpr uint32_t POLL_INTERVAL_MS = 500;
+    // hostGet() gives up on a filler that keeps answering RESPONSE_TRY_AGAIN for longer
+    constexpr uint32_t MAX_WAIT_MS = 10 * 60 * 1000;
+
+    String urlDecode(const std::string &text)
+    {
+        std::string decoded;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] == '+')
+            {
+                decoded += ' ';
+            }
+            else if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) && isxdigit((unsigned char)text[i + 2]))
+            {
+                decoded += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            }
+            else
+            {
+                decoded += text[i];
+            }
+        }
+        return String(decoded);
+    }
+
+    const char *findHeader(const std::vector<AsyncWebHeader> &headers, const char *name)
+    {
+        for (const AsyncWebHeader &header : headers)
+        {
+            if (header.name().equalsIgnoreCase(name))
+            {
+                return header.value().c_str();
+            }
+        }
+        return nullptr;
+    }
+}
+
+const char *AsyncWebServerResponse::header(const char *name) const
+{
+    return findHeader(m_headers, name);
+}
+
+const char *HostResponse::header(const char *name) const
+{
+    for (const auto &header : headers)
+    {
+        if (header.first.equalsIgnoreCase(name))
+        {
+            return header.second.c_str();
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(const char *url, IPAddress clientIp) : m_client(clientIp)
+{
+    const std::string text(url);
+    const size_t query = text.find('?');
+    m_url = urlDecode(text.substr(0, query));
+    if (query == std::string::npos)
+    {
+        return;
+    }
+
+    size_t start = query + 1;
+    while (start <= text.size())
+    {
+        size_t end = text.find('&', start);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        const std::string pair = text.substr(start, end - start);
+        if (!pair.empty())
+        {
+            const size_t equals = pair.find('=');
+            const std::string name = pair.substr(0, equals);
+            const std::string value = equals == std::string::npos ? std::string() : pair.substr(equals + 1);
+            m_params.emplace_back(std::make_unique<AsyncWebParameter>(urlDecode(name), urlDecode(value)));
+        }
+        start = end + 1;
+    }
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+    if (m_onDisconnect)
+    {
+        host::AsyncTcpScope scope;
+        m_onDisconnect();
+    }
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const
+{
+    return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file) const
+{
+    if (post || file)
+    {
+        return nullptr;
+    }
+    for (const auto &param : m_params)
+    {
+        if (param->name() == name)
+        {
+            return param.get();
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name) const
+{
+    for (const auto &header : m_headers)
+    {
+        if (header->name().equalsIgnoreCase(name.c_str()))
+        {
+            return header.get();
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::begin(int code, const String &contentType)
+{
+    m_begun.emplace_back(std::make_unique<AsyncWebServerResponse>());
+    AsyncWebServerResponse *response = m_begun.back().get();
+    response->m_code = code;
+    response->m_contentType = contentType;
+    return response;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content)
+{
+    AsyncWebServerResponse *response = begin(code, contentType);
+    response->m_content.assign(content.c_str(), content.length());
+    return response;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(const String &contentType, size_t len, AwsResponseFiller callback)
+{
+    AsyncWebServerResponse *response = begin(200, contentType);
+    response->m_filler = callback;
+    response->m_contentLength = len;
+    return response;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t len)
+{
+    AsyncWebServerResponse *response = begin(code, contentType);
+    response->m_content.assign((const char *)content, len);
+    return response;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType, AwsResponseFiller callback)
+{
+    AsyncWebServerResponse *response = begin(200, contentType);
+    response->m_filler = callback;
+    response->m_chunked = true;
+    return response;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    if (m_response)
+    {
+        // The library ignores a second response too
+        return;
+    }
+    for (auto it = m_begun.begin(); it != m_begun.end(); ++it)
+    {
+        if (it->get() == response)
+        {
+            m_response = std::move(*it);
+            m_begun.erase(it);
+            return;
+        }
+    }
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+    send(beginResponse(code, contentType, content));
+}
+
+bool AsyncWebServerRequest::transfer(size_t maxLen)
+{
+    m_tryAgain = false;
+    if (m_complete)
+    {
+        return true;
+    }
+    if (!m_response)
+    {
+        // Nothing sent, the connection just closes
+        m_complete = true;
+        return true;
+    }
+
+    AsyncWebServerResponse &response = *m_response;
+    if (!response.m_filler)
+    {
+        const size_t len = std::min(maxLen, response.m_content.size() - m_body.size());
+        m_body.append(response.m_content, m_body.size(), len);
+        m_chunks += len > 0 ? 1 : 0;
+        m_complete = m_body.size() == response.m_content.size();
+        return m_complete;
+    }
+
+    if (!response.m_chunked)
+    {
+        maxLen = std::min(maxLen, response.m_contentLength - m_body.size());
+        if (maxLen == 0)
+        {
+            m_complete = true;
+            return true;
+        }
+    }
+
+    std::vector<uint8_t> buffer(maxLen);
+    size_t len;
+    {
+        host::AsyncTcpScope scope;
+        len = response.m_filler(buffer.data(), maxLen, m_body.size());
+    }
+    if (len == RESPONSE_TRY_AGAIN)
+    {
+        m_tryAgain = true;
+        return false;
+    }
+    if (len > maxLen)
+    {
+        fprintf(stderr, "filler of %s returned %zu bytes for a %zu byte buffer\n", m_url.c_str(), len, maxLen);
+        abort();
+    }
+    if (len == 0)
+    {
+        // The end of a chunked body; a filler that stops short of its content length
+        // makes the library close the connection, the client sees a short body
+        m_complete = true;
+        return true;
+    }
+    m_body.append((const char *)buffer.data(), len);
+    m_chunks++;
+    m_complete = !response.m_chunked && m_body.size() == response.m_contentLength;
+    return m_complete;
+}
+
+bool AsyncCallbackWebHandler::canHandle(const AsyncWebServerRequest &request) const
+{
+    if ((m_method & request.method()) == 0)
+    {
+        return false;
+    }
+    const String &url = request.url();
+    return url == m_uri || url.startsWith(m_uri + "/");
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t port) : m_port(port)
+{
+}
+
+AsyncWebServer::~AsyncWebServer()
+{
+    end();
+}
+
+void AsyncWebServer::begin()
+{
+    m_listening = true;
+    s_running = this;
+}
+
+void AsyncWebServer::end()
+{
+    m_listening = false;
+    if (s_running == this)
+    {
+        s_running = nullptr;
+    }
+}
+
+AsyncWebServer *AsyncWebServer::running()
+{
+    return s_running;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest)
+{
+    m_handlers.emplace_back(std::make_unique<AsyncCallbackWebHandler>(uri, method, onRequest));
+    return *m_handlers.back();
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler)
+{
+    m_addedHandlers.push_back(handler);
+    return *handler;
+}
+
+void AsyncWebServer::handle(AsyncWebServerRequest *request)
+{
+    host::AsyncTcpScope scope;
+    for (const auto &handler : m_handlers)
+    {
+        if (handler->canHandle(*request))
+        {
+            handler->handle(request);
+            return;
+        }
+    }
+    if (m_notFound)
+    {
+        m_notFound(request);
+        return;
+    }
+    request->send(404);
+}
+
+AsyncWebSocket *AsyncWebServer::getWebSocket(const char *url) const
+{
+    for (AsyncWebHandler *handler : m_addedHandlers)
+    {
+        AsyncWebSocket *socket = dynamic_cast<AsyncWebSocket *>(handler);
+        if (socket != nullptr && socket->url() == url)
+        {
+            return socket;
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebSocket *server, uint32_t id, IPAddress remoteIP)
+    : m_server(server), m_id(id), m_client(remoteIP)
+{
+    // Like the library, the poll timer drives the client's queue
+    m_client.onPoll([](void *arg, AsyncClient *)
+                    { ((AsyncWebSocketClient *)arg)->_onPoll(); },
+                    this);
+}
+
+AsyncWebSocketClient::~AsyncWebSocketClient()
+{
+    for (Message &message : m_queue)
+    {
+        if (message.buffer != nullptr)
+        {
+            message.buffer->release();
+        }
+    }
+}
+
+void AsyncWebSocketClient::text(const char *message, size_t len)
+{
+    if (!host::inAsyncTcpTask())
+    {
+        m_crossTaskCalls++;
+    }
+    if (queueIsFull())
+    {
+        return;
+    }
+    m_queue.push_back({std::string(message, len), nullptr});
+    _onPoll();
+}
+
+void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer *buffer)
+{
+    if (!host::inAsyncTcpTask())
+    {
+        m_crossTaskCalls++;
+    }
+    if (buffer == nullptr || queueIsFull())
+    {
+        return;
+    }
+    buffer->hold();
+    m_queue.push_back({std::string(), buffer});
+    _onPoll();
+}
+
+void AsyncWebSocketClient::close()
+{
+    m_status = WS_DISCONNECTED;
+}
+
+void AsyncWebSocketClient::_onPoll()
+{
+    // Whatever fits into the send buffer goes out, in order
+    size_t space = m_client.space();
+    size_t sent = 0;
+    for (; sent < m_queue.size() && m_status == WS_CONNECTED; ++sent)
+    {
+        Message &message = m_queue[sent];
+        const std::string text = message.buffer != nullptr ? std::string((const char *)message.buffer->get(), message.buffer->length()) : message.text;
+        if (text.size() > space)
+        {
+            break;
+        }
+        space -= text.size();
+        m_received.push_back(text);
+        if (message.buffer != nullptr)
+        {
+            message.buffer->release();
+        }
+    }
+    m_queue.erase(m_queue.begin(), m_queue.begin() + sent);
+}
+
+AsyncWebSocket::~AsyncWebSocket()
+{
+    for (AsyncWebSocketClient *client : m_clients)
+    {
+        delete client;
+    }
+}
+
+size_t AsyncWebSocket::count() const
+{
+    return std::count_if(m_clients.begin(), m_clients.end(), [](AsyncWebSocketClient *client)
+                         { return client->status() == WS_CONNECTED; });
+}
+
+void AsyncWebSocket::cleanupClients(uint16_t maxClients)
+{
+    // Like the library this only closes the oldest, the client goes away with its connection
+    for (AsyncWebSocketClient *client : m_clients)
+    {
+        if (count() <= maxClients)
+        {
+            break;
+        }
+        client->close();
+    }
+}
+
+AsyncWebSocketClient *AsyncWebSocket::connect(IPAddress remoteIP)
+{
+    AsyncWebSocketClient *client = new AsyncWebSocketClient(this, m_nextId++, remoteIP);
+    m_clients.push_back(client);
+    if (m_handler)
+    {
+        host::AsyncTcpScope scope;
+        m_handler(this, client, WS_EVT_CONNECT, nullptr, nullptr, 0);
+    }
+    return client;
+}
+
+void AsyncWebSocket::disconnect(AsyncWebSocketClient *client)
+{
+    client->close();
+    if (m_handler)
+    {
+        host::AsyncTcpScope scope;
+        m_handler(this, client, WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+    }
+    m_clients.erase(std::remove(m_clients.begin(), m_clients.end(), client), m_clients.end());
+    delete client;
+}
+
+void AsyncWebSocket::pollAll()
+{
+    for (AsyncWebSocketClient *client : std::vector<AsyncWebSocketClient *>(m_clients))
+    {
+        client->client()->poll();
+    }
+}
+
+HostResponse hostGet(const char *url, std::initializer_list<std::pair<const char *, const char *>> headers,
+                     IPAddress clientIp, size_t segmentSize)
+{
+    HostResponse result;
+    AsyncWebServer *server = AsyncWebServer::running();
+    if (server == nullptr)
+    {
+        return result;
+    }
+
+    auto request = std::make_unique<AsyncWebServerRequest>(url, clientIp);
+    for (const auto &header : headers)
+    {
+        request->addHeader(header.first, header.second);
+    }
+    server->handle(request.get());
+
+    while (!request->transfer(segmentSize))
+    {
+        if (request->wasTryAgain())
+        {
+            if (result.waitMs >= MAX_WAIT_MS)
+            {
+                break;
+            }
+            host::advanceMs(POLL_INTERVAL_MS);
+            result.waitMs += POLL_INTERVAL_MS;
+        }
+    }
+
+    if (const AsyncWebServerResponse *response = request->response())
+    {
+        result.code = response->code();
+        result.contentType = response->contentType();
+        for (const AsyncWebHeader &header : response->headers())
+        {
+            result.headers.emplace_back(header.name(), header.value());
+        }
+    }
+    result.body = request->body();
+    result.chunks = request->getChunkCount();
+    return result;
+}
@@ -0,0 +1,28 @@
+// HostWeb.h
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+#include <ESPAsyncWebServer.h>
+
+// What a client got back for one request
+struct HostResponse
+{
+    int code = 0; // 0 = the handler sent nothing
+    String contentType;
+    std::vector<std::pair<String, String>> headers;
+    std::string body;
+    size_t chunks = 0;   // TCP segments the body took
+    uint32_t waitMs = 0; // simulated time the filler kept answering RESPONSE_TRY_AGAIN
+
+    // nullptr if the response does not have the header
+    const char *header(const char *name) const;
+};
+
+// One GET against AsyncWebServer::running() the way a browser does it: the request is
+// dispatched, the body drained in segments of segmentSize, and the connection closed. While
+// the filler answers RESPONSE_TRY_AGAIN the simulated time moves on in AsyncTCP poll steps.
+HostResponse hostGet(const char *url, std::initializer_list<std::pair<const char *, const char *>> headers = {},
+                     IPAddress clientIp = IPAddress(192, 168, 1, 10), size_t segmentSize = 1436);
@@ -0,0 +1,30 @@
+// IPAddress.h
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "WString.h"
+
+// IPv4 address, in memory in network order like on the ESP32
+class IPAddress
+{
+public:
+    IPAddress() = default;
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : m_bytes{a, b, c, d} {}
+    IPAddress(uint32_t address) { memcpy(m_bytes, &address, sizeof(m_bytes)); }
+
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, m_bytes, sizeof(address));
+        return address;
+    }
+    uint8_t operator[](int index) const { return m_bytes[index]; }
+    bool operator==(const IPAddress &other) const { return memcmp(m_bytes, other.m_bytes, sizeof(m_bytes)) == 0; }
+
+    bool fromString(const char *text);
+    String toString() const;
+
+private:
+    uint8_t m_bytes[4] = {};
+};
@@ -0,0 +1,60 @@
+// NimBLEDevice.h
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Only the value types and declarations BLEManager.h and TDTPollCharacteristicTask.h need;
+// there is no BLE stack on the host, FakeBLEManager.cpp stands in for BLEManager.
+#define BLE_ADDR_PUBLIC 0
+#define BLE_ADDR_RANDOM 1
+
+class NimBLEAddress
+{
+public:
+    NimBLEAddress() = default;
+    NimBLEAddress(const std::string &address, uint8_t type) : m_address(address), m_type(type) {}
+    NimBLEAddress(uint64_t address, uint8_t type) : m_address(std::to_string(address)), m_type(type) {}
+
+    bool isNull() const { return m_address.empty(); }
+    std::string toString() const { return m_address; }
+    uint8_t getType() const { return m_type; }
+    bool operator==(const NimBLEAddress &other) const { return m_address == other.m_address; }
+    bool operator!=(const NimBLEAddress &other) const { return !(*this == other); }
+
+private:
+    std::string m_address;
+    uint8_t m_type = BLE_ADDR_PUBLIC;
+};
+
+class NimBLEUUID
+{
+public:
+    NimBLEUUID() = default;
+    NimBLEUUID(const std::string &uuid) : m_uuid(uuid) {}
+    NimBLEUUID(const char *uuid) : m_uuid(uuid) {}
+
+    std::string toString() const { return m_uuid; }
+    bool equals(const NimBLEUUID &other) const { return m_uuid == other.m_uuid; }
+    bool operator==(const NimBLEUUID &other) const { return equals(other); }
+
+private:
+    std::string m_uuid;
+};
+
+class NimBLEClient;
+class NimBLERemoteService;
+class NimBLERemoteCharacteristic;
+
+class NimBLEClientCallbacks
+{
+public:
+    virtual ~NimBLEClientCallbacks() = default;
+    virtual void onConnect(NimBLEClient *client) {}
+    virtual void onDisconnect(NimBLEClient *client, int reason) {}
+    virtual void onConnectFail(NimBLEClient *client, int reason) {}
+};
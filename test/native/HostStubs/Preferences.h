@@ -0,0 +1,34 @@
+// Preferences.h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// NVS in memory. Values outlive the Preferences object like they outlive a reboot on the
+// ESP32, until host::clearPreferences().
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end();
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putBytes(const char *key, const void *value, size_t len);
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+
+    size_t putInt(const char *key, int32_t value);
+    int32_t getInt(const char *key, int32_t defaultValue = 0);
+    size_t putULong64(const char *key, uint64_t value);
+    uint64_t getULong64(const char *key, uint64_t defaultValue = 0);
+
+private:
+    std::string m_namespace;
+    bool m_open = false;
+    bool m_readOnly = false;
+
+    std::string path(const char *key) const;
+};
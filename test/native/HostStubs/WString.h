@@ -0,0 +1,152 @@
+// WString.h
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <string>
+
+// Arduino's String on top of std::string, with the members the firmware and ArduinoJson use
+class String
+{
+public:
+    String(const char *text = "") : m_value(text != nullptr ? text : "") {}
+    String(const char *text, size_t len) : m_value(text, len) {}
+    String(const std::string &text) : m_value(text) {}
+    explicit String(char c) : m_value(1, c) {}
+    explicit String(int value, unsigned char base = 10) : m_value(format((long long)value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : m_value(format((unsigned long long)value, base)) {}
+    explicit String(long value, unsigned char base = 10) : m_value(format((long long)value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : m_value(format((unsigned long long)value, base)) {}
+    explicit String(long long value, unsigned char base = 10) : m_value(format(value, base)) {}
+    explicit String(unsigned long long value, unsigned char base = 10) : m_value(format(value, base)) {}
+
+    const char *c_str() const { return m_value.c_str(); }
+    unsigned int length() const { return m_value.size(); }
+    bool isEmpty() const { return m_value.empty(); }
+    bool reserve(unsigned int size)
+    {
+        m_value.reserve(size);
+        return true;
+    }
+    char charAt(unsigned int index) const { return index < m_value.size() ? m_value[index] : '\0'; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    int indexOf(char c, unsigned int from = 0) const { return find(m_value.find(c, from)); }
+    int indexOf(const String &text, unsigned int from = 0) const { return find(m_value.find(text.m_value, from)); }
+    String substring(unsigned int begin) const { return substring(begin, m_value.size()); }
+    String substring(unsigned int begin, unsigned int end) const
+    {
+        if (begin > end)
+            std::swap(begin, end);
+        if (begin >= m_value.size())
+            return String();
+        return String(m_value.substr(begin, std::min<size_t>(end, m_value.size()) - begin));
+    }
+    bool startsWith(const String &prefix) const { return m_value.compare(0, prefix.m_value.size(), prefix.m_value) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return m_value.size() >= suffix.m_value.size() &&
+               m_value.compare(m_value.size() - suffix.m_value.size(), suffix.m_value.size(), suffix.m_value) == 0;
+    }
+    long toInt() const { return strtol(m_value.c_str(), nullptr, 10); }
+
+    bool equals(const String &other) const { return m_value == other.m_value; }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+    bool operator==(const String &other) const { return m_value == other.m_value; }
+    bool operator==(const char *other) const { return m_value == (other != nullptr ? other : ""); }
+    bool operator!=(const String &other) const { return !(*this == other); }
+    bool operator!=(const char *other) const { return !(*this == other); }
+
+    bool concat(const String &text)
+    {
+        m_value += text.m_value;
+        return true;
+    }
+    bool concat(const char *text)
+    {
+        m_value += text != nullptr ? text : "";
+        return true;
+    }
+    bool concat(const char *text, unsigned int len)
+    {
+        m_value.append(text, len);
+        return true;
+    }
+    bool concat(char c)
+    {
+        m_value += c;
+        return true;
+    }
+    String &operator+=(const String &text) { return concat(text), *this; }
+    String &operator+=(const char *text) { return concat(text), *this; }
+    String &operator+=(char c) { return concat(c), *this; }
+
+private:
+    std::string m_value;
+
+    static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+    static std::string format(unsigned long long value, unsigned char base)
+    {
+        char digits[66];
+        size_t len = 0;
+        do
+        {
+            const unsigned digit = value % base;
+            digits[len++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            value /= base;
+        } while (value > 0);
+        std::reverse(digits, digits + len);
+        return std::string(digits, len);
+    }
+
+    static std::string format(long long value, unsigned char base)
+    {
+        if (value >= 0)
+            return format((unsigned long long)value, base);
+        return "-" + format(0ULL - (unsigned long long)value, base);
+    }
+};
+
+// What String + ... yields in the Arduino core, ArduinoJson knows it by name
+class StringSumHelper : public String
+{
+public:
+    using String::String;
+    StringSumHelper(const String &text) : String(text) {}
+};
+
+inline StringSumHelper operator+(const String &a, const String &b)
+{
+    StringSumHelper sum(a);
+    sum += b;
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &a, const char *b)
+{
+    StringSumHelper sum(a);
+    sum += b;
+    return sum;
+}
+
+inline StringSumHelper operator+(const char *a, const String &b)
+{
+    StringSumHelper sum(a);
+    sum += b;
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &a, char b)
+{
+    StringSumHelper sum(a);
+    sum += b;
+    return sum;
+}
+
+inline bool operator==(const char *a, const String &b)
+{
+    return b == a;
+}
@@ -0,0 +1,17 @@
+// WiFi.h
+#pragma once
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+// Connected unless a test says otherwise, see host::setWiFiConnected()
+class WiFiClass
+{
+public:
+    bool isConnected() { return host::isWiFiConnected(); }
+    int8_t RSSI() { return -60; }
+    // Resolves with the host's resolver, 1 on success
+    int hostByName(const char *name, IPAddress &address);
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,23 @@
+// WiFiUdp.h
+#pragma once
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+// Sends real datagrams through a host UDP socket, so tests can listen on localhost
+class WiFiUDP
+{
+public:
+    ~WiFiUDP() { stop(); }
+
+    int beginPacket(IPAddress address, uint16_t port);
+    size_t write(const uint8_t *data, size_t len);
+    int endPacket();
+    void stop();
+
+private:
+    int m_socket = -1;
+    IPAddress m_address;
+    uint16_t m_port = 0;
+    std::string m_packet;
+};
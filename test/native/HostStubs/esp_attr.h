@@ -0,0 +1,14 @@
+// esp_attr.h
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+// RTC memory that survives a reset. On ELF hosts it is a section of its own, so a test can
+// find the bytes of a simulated previous boot between __start_rtc_noinit and
+// __stop_rtc_noinit and damage them.
+#ifdef __ELF__
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_noinit")))
+#else
+#define RTC_NOINIT_ATTR
+#endif
@@ -0,0 +1,8 @@
+// esp_rom_crc.h
+#pragma once
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected) like the ROM function: pass the previous result as crc to
+// continue over more data, 0 to start
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,7 @@
+// esp_timer.h
+#pragma once
+
+#include <stdint.h>
+
+// Simulated time since boot in µs, see host::setUptimeUs()
+int64_t esp_timer_get_time();
@@ -0,0 +1,34 @@
+// task.h
+#pragma once
+
+#include "FreeRTOS.h"
+
+// There is no scheduler on the host: tasks are never created, so whatever a firmware task
+// would do in the background a test has to call itself
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                              UBaseType_t priority, TaskHandle_t *created)
+{
+    return pdFAIL;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                                          UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+    return pdFAIL;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    return 0;
+}
+
+// Advances the simulated time
+void vTaskDelay(TickType_t ticks);
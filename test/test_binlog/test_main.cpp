@@ -0,0 +1,299 @@
+// test_main.cpp
+// BinaryLog::packArgs against a decoder that walks the format the way
+// scripts/decode_binlog.py does: every message must come back as printf would print it.
+#include <unity.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "BinaryLog.h"
+#include "LogRing.h"
+
+struct Packed
+{
+    uint8_t length;
+    uint8_t payload[BinaryLogRecord::PAYLOAD_SIZE];
+};
+
+static Packed pack(const char *format, ...)
+{
+    Packed packed;
+    memset(packed.payload, 0xAA, sizeof(packed.payload));
+    va_list args;
+    va_start(args, format);
+    packed.length = BinaryLog::packArgs(format, args, packed.payload, sizeof(packed.payload));
+    va_end(args);
+    return packed;
+}
+
+static std::string printed(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return buf;
+}
+
+// format_record of decode_binlog.py: flags, width and precision, length, conversion; the
+// length modifier only picks 4 or 8 bytes, a missing argument ends with " [truncated]"
+static std::string decode(const char *format, const uint8_t *payload, size_t length)
+{
+    std::string out;
+    size_t pos = 0;
+    auto take = [&](void *value, size_t bytes) -> bool
+    {
+        if (pos + bytes > length)
+            return false;
+        memcpy(value, payload + pos, bytes);
+        pos += bytes;
+        return true;
+    };
+
+    for (const char *p = format; *p != '\0'; ++p)
+    {
+        if (*p != '%')
+        {
+            out += *p;
+            continue;
+        }
+        ++p;
+        std::string spec = "%";
+        bool complete = true;
+        while (*p != '\0' && strchr("-+ #0123456789.*", *p) != nullptr)
+        {
+            if (*p == '*')
+            {
+                int32_t value;
+                if (!(complete = take(&value, sizeof(value))))
+                    break;
+                spec += std::to_string(value);
+            }
+            else
+            {
+                spec += *p;
+            }
+            ++p;
+        }
+        if (!complete)
+            return out + " [truncated]";
+        int longs = 0;
+        while (*p != '\0' && strchr("hlzjt", *p) != nullptr)
+        {
+            longs += *p == 'l' ? 1 : 0;
+            ++p;
+        }
+
+        char text[128];
+        const char conv = *p;
+        if (conv == '%')
+        {
+            out += '%';
+            continue;
+        }
+        if (conv != '\0' && strchr("diuxXoc", conv) != nullptr)
+        {
+            if (longs >= 2)
+            {
+                uint64_t value;
+                if (!take(&value, sizeof(value)))
+                    return out + " [truncated]";
+                snprintf(text, sizeof(text), (spec + "ll" + conv).c_str(), (unsigned long long)value);
+            }
+            else
+            {
+                uint32_t value;
+                if (!take(&value, sizeof(value)))
+                    return out + " [truncated]";
+                snprintf(text, sizeof(text), (spec + conv).c_str(), value);
+            }
+        }
+        else if (conv != '\0' && strchr("fFeEgG", conv) != nullptr)
+        {
+            double value;
+            if (!take(&value, sizeof(value)))
+                return out + " [truncated]";
+            snprintf(text, sizeof(text), (spec + conv).c_str(), value);
+        }
+        else if (conv == 's')
+        {
+            const void *end = memchr(payload + pos, '\0', length - pos);
+            if (pos >= length || end == nullptr)
+                return out + " [truncated]";
+            snprintf(text, sizeof(text), (spec + 's').c_str(), (const char *)payload + pos);
+            pos = (const uint8_t *)end - payload + 1;
+        }
+        else
+        {
+            return out + " [truncated]";
+        }
+        out += text;
+    }
+    return out;
+}
+
+static std::string decode(const char *format, const Packed &packed)
+{
+    return decode(format, packed.payload, packed.length & ~BinaryLogRecord::FLAG_TRUNCATED);
+}
+
+// Packs, decodes and prints the same call, the decoded and printed text must match
+#define ROUND_TRIP(format, ...)                                                    \
+    do                                                                             \
+    {                                                                              \
+        const Packed packed = pack(format, __VA_ARGS__);                           \
+        TEST_ASSERT_EQUAL_UINT8(0, packed.length & BinaryLogRecord::FLAG_TRUNCATED); \
+        const std::string expected = printed(format, __VA_ARGS__);                 \
+        const std::string actual = decode(format, packed);                         \
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), actual.c_str());                \
+    } while (0)
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_integers(void)
+{
+    ROUND_TRIP("Cell %d: %u mV", 3, 3312u);
+    ROUND_TRIP("current %d dA", -52);
+    ROUND_TRIP("%i %x %X %o", -1, 0xBEEFu, 0xCAFEu, 0755u);
+    ROUND_TRIP("%08x|%-6d|%+d|% d", 0x1234u, 42, 7, 7);
+    ROUND_TRIP("%c%c%c", 'B', 'M', 'S');
+    ROUND_TRIP("%d %d", INT32_MIN, INT32_MAX);
+    ROUND_TRIP("%u", UINT32_MAX);
+    // 32 bit values through the l modifier the firmware uses for uint32_t
+    ROUND_TRIP("heap %lu free, %ld", 123456ul, -7l);
+    // Each read with its own type, whatever its width on this host
+    ROUND_TRIP("%hu %hhx %d", (unsigned short)65535, (unsigned char)0xAB, -9);
+    ROUND_TRIP("%zu bytes, %td apart, %jd", sizeof(Packed), (std::ptrdiff_t)-3, (std::intmax_t)42);
+    ROUND_TRIP("%d %lu %u %ld %x", -1, 0xFFFFFFFFul, 7u, -2l, 0x10u);
+}
+
+void test_long_long(void)
+{
+    ROUND_TRIP("uptime %llu us", 0x0123456789ABCDEFull);
+    ROUND_TRIP("%lld", (long long)INT64_MIN);
+    ROUND_TRIP("%llx %d", 0xFFFFFFFF00000001ull, 5);
+}
+
+void test_floats(void)
+{
+    ROUND_TRIP("%.2f V", 13.25);
+    ROUND_TRIP("%e %g", -1.5e-7, 0.1);
+    ROUND_TRIP("%8.3f|%-8.1E", 3.14159, 2.5e10);
+    ROUND_TRIP("%G", 1e100);
+}
+
+void test_strings(void)
+{
+    ROUND_TRIP("connected to %s", "TDT-BMS");
+    ROUND_TRIP("[%s] [%s]", "", "x");
+    ROUND_TRIP("%-8s|%5s|%.2s", "ab", "cd", "efgh");
+    const char *none = nullptr;
+    const Packed packed = pack("%s", none);
+    const std::string actual = decode("%s", packed);
+    TEST_ASSERT_EQUAL_STRING("(null)", actual.c_str());
+}
+
+void test_star_width_and_precision(void)
+{
+    ROUND_TRIP("%*d|%-*d", 6, 42, 4, 7);
+    ROUND_TRIP("%.*f", 3, 2.0 / 3.0);
+    ROUND_TRIP("%*.*f", 10, 2, -1.005);
+    ROUND_TRIP("%.*s", 3, "truncate");
+}
+
+void test_percent_and_no_arguments(void)
+{
+    const Packed packed = pack("100%% charged");
+    TEST_ASSERT_EQUAL_UINT8(0, packed.length);
+    const std::string actual = decode("100%% charged", packed);
+    TEST_ASSERT_EQUAL_STRING("100% charged", actual.c_str());
+    ROUND_TRIP("SOC %d%%", 87);
+}
+
+void test_mixed(void)
+{
+    ROUND_TRIP("%s %d %.1f %c", "pack", -3, 12.5, 'V');
+    ROUND_TRIP("%llu %s %u", 1ull << 40, "ok", 9u);
+}
+
+// Arguments that do not fit set the flag and the decoder says so after what it has
+void test_truncation(void)
+{
+    // Three doubles take 24 bytes, two fit
+    const Packed floats = pack("%.1f %.1f %.1f end", 1.0, 2.0, 3.0);
+    TEST_ASSERT_TRUE(floats.length & BinaryLogRecord::FLAG_TRUNCATED);
+    TEST_ASSERT_EQUAL_UINT8(16, floats.length & ~BinaryLogRecord::FLAG_TRUNCATED);
+    const std::string decodedFloats = decode("%.1f %.1f %.1f end", floats);
+    TEST_ASSERT_EQUAL_STRING("1.0 2.0  [truncated]", decodedFloats.c_str());
+
+    // A long string keeps as much as fits, terminated, and nothing after it is packed
+    const char *longName = "a-very-long-device-name-that-does-not-fit";
+    const Packed text = pack("%d %s %d", 1, longName, 2);
+    TEST_ASSERT_TRUE(text.length & BinaryLogRecord::FLAG_TRUNCATED);
+    TEST_ASSERT_EQUAL_UINT8(BinaryLogRecord::PAYLOAD_SIZE, text.length & ~BinaryLogRecord::FLAG_TRUNCATED);
+    TEST_ASSERT_EQUAL_UINT8(0, text.payload[BinaryLogRecord::PAYLOAD_SIZE - 1]);
+    const std::string decodedText = decode("%d %s %d", text);
+    const std::string expectedText = "1 " + std::string(longName, BinaryLogRecord::PAYLOAD_SIZE - 4 - 1) + "  [truncated]";
+    TEST_ASSERT_EQUAL_STRING(expectedText.c_str(), decodedText.c_str());
+
+    // Exactly full is not truncated
+    const Packed full = pack("%llu %u %u %u %s", 1ull, 2u, 3u, 4u, "x");
+    TEST_ASSERT_EQUAL_UINT8(BinaryLogRecord::PAYLOAD_SIZE, full.length);
+    const std::string decodedFull = decode("%llu %u %u %u %s", full);
+    TEST_ASSERT_EQUAL_STRING("1 2 3 4 x", decodedFull.c_str());
+
+    // A conversion packArgs does not know stops it, whatever follows is lost
+    const Packed unknown = pack("%d %n %d", 1, nullptr, 2);
+    TEST_ASSERT_TRUE(unknown.length & BinaryLogRecord::FLAG_TRUNCATED);
+    TEST_ASSERT_EQUAL_UINT8(4, unknown.length & ~BinaryLogRecord::FLAG_TRUNCATED);
+}
+
+// Records go through the ring the logger writes and /logs.bin reads, still decoding
+void test_through_ring(void)
+{
+    static LogRing<BinaryLogRecord, 8> ring;
+    static const char *const FORMAT = "cell %u %s %.3f";
+    for (uint32_t i = 0; i < 20; ++i)
+    {
+        ring.push([i](BinaryLogRecord &record)
+                  {
+                      const Packed packed = pack(FORMAT, i, i % 2 ? "odd" : "even", i / 8.0);
+                      record.format = (uint32_t)i;
+                      record.timestamp = 1000 + i;
+                      record.level = 1;
+                      record.payloadLength = packed.length;
+                      memcpy(record.payload, packed.payload, sizeof(record.payload)); });
+    }
+    for (uint32_t seq = ring.getFirstSeq(); seq < ring.getEndSeq(); ++seq)
+    {
+        BinaryLogRecord record;
+        TEST_ASSERT_TRUE(ring.read(seq, record));
+        TEST_ASSERT_EQUAL_UINT32(seq, record.format);
+        const std::string expected = printed(FORMAT, seq, seq % 2 ? "odd" : "even", seq / 8.0);
+        const std::string actual = decode(FORMAT, record.payload, record.payloadLength & ~BinaryLogRecord::FLAG_TRUNCATED);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), actual.c_str());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_integers);
+    RUN_TEST(test_long_long);
+    RUN_TEST(test_floats);
+    RUN_TEST(test_strings);
+    RUN_TEST(test_star_width_and_precision);
+    RUN_TEST(test_percent_and_no_arguments);
+    RUN_TEST(test_mixed);
+    RUN_TEST(test_truncation);
+    RUN_TEST(test_through_ring);
+    return UNITY_END();
+}
@@ -0,0 +1,275 @@
+// test_main.cpp
+// ResponseCache on its own and behind the web server, and a load test of /battery.json
+// with the cache hit on every request against one that misses on every request.
+#include <unity.h>
+#include <HostBLE.h>
+#include <HostWeb.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+#include "BatteryManager.h"
+#include "ResponseCache.h"
+#include "TDTPollCharacteristicTask.h"
+#include "VanControlWebServer.h"
+
+// Heap allocations of the whole process, for the heap use per request of the load test
+static std::atomic<uint64_t> s_allocations{0};
+static std::atomic<uint64_t> s_allocatedBytes{0};
+
+// Every form of new and delete, all on malloc and free, so no pair is mismatched
+static void *allocate(size_t size)
+{
+    s_allocations++;
+    s_allocatedBytes += size;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static std::unique_ptr<BLEManager> bleManager;
+static std::unique_ptr<BatteryManager> batteryManager;
+static std::unique_ptr<VanControlWebServer> webServer;
+
+static void deliverSample(int16_t current = -52)
+{
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        data.cellVoltages[i] = 3312 + i;
+    }
+    data.temperatures[0] = 215;
+    data.temperatures[1] = 198;
+    data.voltage = 1325;
+    data.current = current;
+    data.batteryLevel = 87;
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, data));
+}
+
+void setUp(void)
+{
+    host::advanceMs(60 * 1000);
+    host::setHeap(200 * 1024, 100 * 1024);
+    host::clearPreferences();
+    bleManager = std::make_unique<BLEManager>();
+    batteryManager = std::make_unique<BatteryManager>(*bleManager);
+    batteryManager->init();
+    webServer = std::make_unique<VanControlWebServer>(batteryManager.get());
+    webServer->start();
+}
+
+void tearDown(void)
+{
+    webServer.reset();
+    batteryManager.reset();
+    bleManager.reset();
+}
+
+void test_renders_once_per_version(void)
+{
+    ResponseCache cache("json");
+    int renders = 0;
+    auto render = [&renders](std::string &out)
+    {
+        renders++;
+        out = "body " + std::to_string(renders);
+    };
+
+    const auto first = cache.get(1, render);
+    const auto again = cache.get(1, render);
+    TEST_ASSERT_EQUAL(1, renders);
+    TEST_ASSERT_TRUE(first == again);
+    TEST_ASSERT_EQUAL_STRING("body 1", first->body.c_str());
+    TEST_ASSERT_EQUAL_STRING("W/\"1-json\"", first->etag.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, cache.getRenderCount());
+    TEST_ASSERT_EQUAL_UINT32(1, cache.getHitCount());
+
+    const auto next = cache.get(2, render);
+    TEST_ASSERT_EQUAL(2, renders);
+    TEST_ASSERT_EQUAL_STRING("body 2", next->body.c_str());
+    TEST_ASSERT_EQUAL_STRING("W/\"2-json\"", next->etag.c_str());
+    // A response still streaming the old body keeps it
+    TEST_ASSERT_EQUAL_STRING("body 1", first->body.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, first->version);
+}
+
+void test_tag_tells_representations_apart(void)
+{
+    ResponseCache json("json");
+    ResponseCache html("html");
+    auto render = [](std::string &out)
+    { out = "x"; };
+    const String jsonEtag = json.get(7, render)->etag;
+    const String htmlEtag = html.get(7, render)->etag;
+    TEST_ASSERT_TRUE(jsonEtag != htmlEtag);
+}
+
+// Web tasks asking at the same time still render a version once
+void test_concurrent_get(void)
+{
+    ResponseCache cache("json");
+    std::atomic<int> renders{0};
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 for (uint32_t version = 1; version <= 2000; ++version)
+                                 {
+                                     const auto entry = cache.get(version / 100, [&renders, version](std::string &out)
+                                                                  {
+                                                                      renders++;
+                                                                      out = std::to_string(version / 100);
+                                                                  });
+                                     if (entry->body != std::to_string(entry->version))
+                                     {
+                                         mismatches++;
+                                     }
+                                 } });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    TEST_ASSERT_EQUAL(0, mismatches.load());
+    TEST_ASSERT_EQUAL_UINT32(renders.load(), cache.getRenderCount());
+    TEST_ASSERT_EQUAL_UINT32(4 * 2000 - renders.load(), cache.getHitCount());
+}
+
+// Clients may keep a response until the next poll is due
+void test_cache_control_follows_poll(void)
+{
+    deliverSample();
+    const uint32_t pollS = TDTPollCharacteristicTask::POLL_INTERVAL / 1000;
+    const std::string fresh = hostGet("/battery.json").header("Cache-Control");
+    const std::string expectedFresh = "private, max-age=" + std::to_string(pollS);
+    TEST_ASSERT_EQUAL_STRING(expectedFresh.c_str(), fresh.c_str());
+
+    host::advanceMs(4000);
+    const std::string older = hostGet("/battery.json").header("Cache-Control");
+    const std::string expectedOlder = "private, max-age=" + std::to_string(pollS - 4);
+    TEST_ASSERT_EQUAL_STRING(expectedOlder.c_str(), older.c_str());
+
+    // An overdue poll leaves nothing to reuse
+    host::advanceMs(TDTPollCharacteristicTask::POLL_INTERVAL);
+    const std::string overdue = hostGet("/battery.json").header("Cache-Control");
+    TEST_ASSERT_EQUAL_STRING("private, max-age=0", overdue.c_str());
+}
+
+void test_html_revalidation(void)
+{
+    deliverSample();
+    const HostResponse first = hostGet("/battery");
+    TEST_ASSERT_EQUAL(200, first.code);
+    TEST_ASSERT_NOT_NULL(first.header("ETag"));
+    const std::string etag = first.header("ETag");
+
+    const HostResponse unchanged = hostGet("/battery", {{"If-None-Match", etag.c_str()}});
+    TEST_ASSERT_EQUAL(304, unchanged.code);
+    TEST_ASSERT_EQUAL(0, unchanged.body.size());
+
+    deliverSample(-60);
+    TEST_ASSERT_EQUAL(200, hostGet("/battery", {{"If-None-Match", etag.c_str()}}).code);
+}
+
+struct LoadResult
+{
+    double requestsPerSecond;
+    double allocationsPerRequest;
+    double bytesPerRequest;
+};
+
+// REQUESTS GETs of /battery.json from 8 clients, only the requests themselves are measured.
+// With newSamples every request finds a new sample, so the cache never hits.
+static LoadResult runLoad(bool newSamples)
+{
+    constexpr int REQUESTS = 500;
+    double seconds = 0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    deliverSample();
+    for (int i = 0; i < REQUESTS; ++i)
+    {
+        host::advanceMs(50);
+        if (newSamples)
+        {
+            deliverSample((int16_t)(i % 100));
+        }
+        const uint64_t allocationsBefore = s_allocations;
+        const uint64_t bytesBefore = s_allocatedBytes;
+        const auto start = std::chrono::steady_clock::now();
+        const HostResponse response = hostGet("/battery.json", {}, IPAddress(192, 168, 4, 10 + i % 8));
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocations += s_allocations - allocationsBefore;
+        bytes += s_allocatedBytes - bytesBefore;
+        TEST_ASSERT_EQUAL(200, response.code);
+    }
+    return {REQUESTS / seconds, (double)allocations / REQUESTS, (double)bytes / REQUESTS};
+}
+
+void test_load_with_and_without_cache(void)
+{
+    const LoadResult cached = runLoad(false);
+    tearDown();
+    setUp();
+    const LoadResult uncached = runLoad(true);
+
+    char report[256];
+    snprintf(report, sizeof(report), "/battery.json: cache hits %.0f req/s, %.1f allocations and %.0f bytes per request; "
+                                     "every request rendered %.0f req/s, %.1f allocations and %.0f bytes per request",
+             cached.requestsPerSecond, cached.allocationsPerRequest, cached.bytesPerRequest,
+             uncached.requestsPerSecond, uncached.allocationsPerRequest, uncached.bytesPerRequest);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE(cached.bytesPerRequest < uncached.bytesPerRequest);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_renders_once_per_version);
+    RUN_TEST(test_tag_tells_representations_apart);
+    RUN_TEST(test_concurrent_get);
+    RUN_TEST(test_cache_control_follows_poll);
+    RUN_TEST(test_html_revalidation);
+    RUN_TEST(test_load_with_and_without_cache);
+    return UNITY_END();
+}
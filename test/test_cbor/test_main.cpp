@@ -0,0 +1,381 @@
+// test_main.cpp
+// CborWriter against the encoding examples of RFC 8949 Appendix A and a small decoder, and
+// /battery.cbor against /battery.json in size and encoding cost.
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <HostBLE.h>
+#include <HostWeb.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "BatteryManager.h"
+#include "CborWriter.h"
+#include "VanControlWebServer.h"
+
+static std::unique_ptr<BLEManager> bleManager;
+static std::unique_ptr<BatteryManager> batteryManager;
+static std::unique_ptr<VanControlWebServer> webServer;
+
+static TDTBMSData makeSample()
+{
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 2;
+    data.cellVoltages[0] = 3312;
+    data.cellVoltages[1] = 3313;
+    data.cellVoltages[2] = 3311;
+    data.cellVoltages[3] = 3314;
+    data.temperatures[0] = 215;
+    data.temperatures[1] = 198;
+    data.voltage = 1325;
+    data.current = -52;
+    data.cycleCharge = 2500;
+    data.batteryLevel = 87;
+    data.cycles = 42;
+    return data;
+}
+
+// Encodes with a writer function and compares with the expected bytes
+template <typename Write>
+static void assertEncodes(std::vector<uint8_t> expected, Write write)
+{
+    uint8_t buffer[16];
+    CborWriter cbor(buffer, sizeof(buffer));
+    write(cbor);
+    TEST_ASSERT_TRUE(cbor.ok());
+    TEST_ASSERT_EQUAL_size_t(expected.size(), cbor.length());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.data(), buffer, expected.size());
+}
+
+// Decodes the head of the item at pos: major type and argument
+static bool readHead(const uint8_t *data, size_t len, size_t &pos, uint8_t &major, uint64_t &value)
+{
+    if (pos >= len)
+        return false;
+    major = data[pos] >> 5;
+    const uint8_t info = data[pos++] & 0x1f;
+    if (info < 24)
+    {
+        value = info;
+        return true;
+    }
+    if (info > 27)
+        return false;
+    const int bytes = 1 << (info - 24);
+    if (pos + bytes > len)
+        return false;
+    value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value = value << 8 | data[pos++];
+    }
+    return true;
+}
+
+void setUp(void)
+{
+    host::advanceMs(60 * 1000);
+    host::setHeap(200 * 1024, 100 * 1024);
+    host::clearPreferences();
+    bleManager = std::make_unique<BLEManager>();
+    batteryManager = std::make_unique<BatteryManager>(*bleManager);
+    batteryManager->init();
+    webServer = std::make_unique<VanControlWebServer>(batteryManager.get());
+    webServer->start();
+}
+
+void tearDown(void)
+{
+    webServer.reset();
+    batteryManager.reset();
+    bleManager.reset();
+}
+
+void test_unsigned(void)
+{
+    const struct
+    {
+        uint64_t value;
+        std::vector<uint8_t> bytes;
+    } cases[] = {
+        {0, {0x00}},
+        {1, {0x01}},
+        {10, {0x0a}},
+        {23, {0x17}},
+        {24, {0x18, 0x18}},
+        {25, {0x18, 0x19}},
+        {100, {0x18, 0x64}},
+        {255, {0x18, 0xff}},
+        {256, {0x19, 0x01, 0x00}},
+        {1000, {0x19, 0x03, 0xe8}},
+        {65535, {0x19, 0xff, 0xff}},
+        {65536, {0x1a, 0x00, 0x01, 0x00, 0x00}},
+        {1000000, {0x1a, 0x00, 0x0f, 0x42, 0x40}},
+        {1000000000000ULL, {0x1b, 0x00, 0x00, 0x00, 0xe8, 0xd4, 0xa5, 0x10, 0x00}},
+        {UINT64_MAX, {0x1b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}},
+    };
+    for (const auto &c : cases)
+    {
+        assertEncodes(c.bytes, [&c](CborWriter &cbor)
+                      { cbor.writeUInt(c.value); });
+    }
+}
+
+void test_signed(void)
+{
+    const struct
+    {
+        int64_t value;
+        std::vector<uint8_t> bytes;
+    } cases[] = {
+        {0, {0x00}},
+        {100, {0x18, 0x64}},
+        {-1, {0x20}},
+        {-10, {0x29}},
+        {-24, {0x37}},
+        {-25, {0x38, 0x18}},
+        {-100, {0x38, 0x63}},
+        {-1000, {0x39, 0x03, 0xe7}},
+        {INT64_MIN, {0x3b, 0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}},
+    };
+    for (const auto &c : cases)
+    {
+        assertEncodes(c.bytes, [&c](CborWriter &cbor)
+                      { cbor.writeInt(c.value); });
+    }
+}
+
+void test_simple_and_containers(void)
+{
+    assertEncodes({0xf4}, [](CborWriter &cbor)
+                  { cbor.writeBool(false); });
+    assertEncodes({0xf5}, [](CborWriter &cbor)
+                  { cbor.writeBool(true); });
+    assertEncodes({0x80}, [](CborWriter &cbor)
+                  { cbor.beginArray(0); });
+    assertEncodes({0x83, 0x01, 0x02, 0x03}, [](CborWriter &cbor)
+                  {
+                      cbor.beginArray(3);
+                      cbor.writeUInt(1);
+                      cbor.writeUInt(2);
+                      cbor.writeUInt(3); });
+    assertEncodes({0xa0}, [](CborWriter &cbor)
+                  { cbor.beginMap(0); });
+    assertEncodes({0xa2, 0x01, 0x02, 0x03, 0x04}, [](CborWriter &cbor)
+                  {
+                      cbor.beginMap(2);
+                      cbor.writeUInt(1);
+                      cbor.writeUInt(2);
+                      cbor.writeUInt(3);
+                      cbor.writeUInt(4); });
+    assertEncodes({0x98, 0x19}, [](CborWriter &cbor)
+                  { cbor.beginArray(25); });
+}
+
+void test_overflow(void)
+{
+    uint8_t buffer[8];
+    memset(buffer, 0xaa, sizeof(buffer));
+    CborWriter cbor(buffer, 4);
+    cbor.writeUInt(1000);
+    TEST_ASSERT_TRUE(cbor.ok());
+    cbor.writeUInt(1000);
+    TEST_ASSERT_FALSE(cbor.ok());
+    TEST_ASSERT_EQUAL_size_t(4, cbor.length());
+    TEST_ASSERT_EQUAL_HEX8(0xaa, buffer[4]);
+    // Stays failed
+    cbor.writeBool(true);
+    TEST_ASSERT_FALSE(cbor.ok());
+
+    CborWriter empty(buffer, 0);
+    empty.writeUInt(0);
+    TEST_ASSERT_FALSE(empty.ok());
+    TEST_ASSERT_EQUAL_size_t(0, empty.length());
+}
+
+// Random integers of every size decode to themselves
+void test_round_trip(void)
+{
+    std::mt19937_64 random(35);
+    std::vector<int64_t> values;
+    for (int i = 0; i < 1000; ++i)
+    {
+        values.push_back((int64_t)(random() >> (random() % 64)) * (random() % 2 ? 1 : -1));
+    }
+    values.push_back(INT64_MIN);
+    values.push_back(INT64_MAX);
+
+    std::vector<uint8_t> buffer(values.size() * 9 + 3);
+    CborWriter cbor(buffer.data(), buffer.size());
+    cbor.beginArray(values.size());
+    for (int64_t value : values)
+    {
+        cbor.writeInt(value);
+    }
+    TEST_ASSERT_TRUE(cbor.ok());
+
+    size_t pos = 0;
+    uint8_t major;
+    uint64_t argument;
+    TEST_ASSERT_TRUE(readHead(buffer.data(), cbor.length(), pos, major, argument));
+    TEST_ASSERT_EQUAL_UINT8(4, major);
+    TEST_ASSERT_EQUAL_UINT64(values.size(), argument);
+    for (int64_t value : values)
+    {
+        TEST_ASSERT_TRUE(readHead(buffer.data(), cbor.length(), pos, major, argument));
+        const int64_t decoded = major == 0 ? (int64_t)argument : -1 - (int64_t)argument;
+        TEST_ASSERT_TRUE(major == 0 || major == 1);
+        TEST_ASSERT_EQUAL_INT64(value, decoded);
+    }
+    TEST_ASSERT_EQUAL_size_t(cbor.length(), pos);
+}
+
+// The whole response is one well formed map, with every key once
+void test_battery_cbor_is_well_formed(void)
+{
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, makeSample()));
+    const HostResponse response = hostGet("/battery.cbor");
+    TEST_ASSERT_EQUAL(200, response.code);
+    const uint8_t *data = (const uint8_t *)response.body.data();
+    const size_t len = response.body.size();
+
+    size_t pos = 0;
+    uint8_t major;
+    uint64_t pairs;
+    TEST_ASSERT_TRUE(readHead(data, len, pos, major, pairs));
+    TEST_ASSERT_EQUAL_UINT8(5, major);
+    uint32_t keys = 0;
+    for (uint64_t i = 0; i < pairs; ++i)
+    {
+        uint64_t key;
+        TEST_ASSERT_TRUE(readHead(data, len, pos, major, key));
+        TEST_ASSERT_EQUAL_UINT8(0, major);
+        TEST_ASSERT_TRUE(key < 32 && (keys & (1u << key)) == 0);
+        keys |= 1u << key;
+
+        uint64_t value;
+        if (data[pos] == 0xf4 || data[pos] == 0xf5)
+        {
+            pos++;
+            continue;
+        }
+        TEST_ASSERT_TRUE(readHead(data, len, pos, major, value));
+        if (major == 4)
+        {
+            for (uint64_t j = 0; j < value; ++j)
+            {
+                uint64_t item;
+                TEST_ASSERT_TRUE(readHead(data, len, pos, major, item));
+                TEST_ASSERT_TRUE(major == 0 || major == 1);
+            }
+        }
+        else
+        {
+            TEST_ASSERT_TRUE(major == 0 || major == 1);
+        }
+    }
+    TEST_ASSERT_EQUAL_size_t(len, pos);
+}
+
+// Wire size of the real responses, and the cost of encoding the same fields both ways.
+// Host CPU time; the JSON side uses whatever ArduinoJson the test is built against.
+void test_cbor_vs_json(void)
+{
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, makeSample()));
+    const size_t cborBytes = hostGet("/battery.cbor").body.size();
+    const size_t jsonBytes = hostGet("/battery.json").body.size();
+    TEST_ASSERT_TRUE(cborBytes < jsonBytes);
+
+    const TDTBMSData data = makeSample();
+    constexpr int ROUNDS = 20000;
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        uint8_t buffer[96];
+        CborWriter cbor(buffer, sizeof(buffer));
+        cbor.beginMap(12);
+        cbor.writeUInt(3);
+        cbor.writeUInt(round);
+        cbor.writeUInt(4);
+        cbor.writeUInt(data.voltage);
+        cbor.writeUInt(5);
+        cbor.writeInt(data.current);
+        cbor.writeUInt(6);
+        cbor.writeUInt(data.batteryLevel);
+        cbor.writeUInt(7);
+        cbor.writeUInt(data.cycleCharge);
+        cbor.writeUInt(8);
+        cbor.writeUInt(data.cycles);
+        cbor.writeUInt(9);
+        cbor.writeUInt(data.problemCode);
+        cbor.writeUInt(10);
+        cbor.beginArray(4);
+        for (int i = 0; i < 4; ++i)
+        {
+            cbor.writeUInt(data.cellVoltages[i]);
+        }
+        cbor.writeUInt(11);
+        cbor.beginArray(2);
+        for (int i = 0; i < 2; ++i)
+        {
+            cbor.writeInt(data.temperatures[i]);
+        }
+        cbor.writeUInt(12);
+        cbor.writeInt(-1);
+        cbor.writeUInt(13);
+        cbor.writeBool(false);
+        sink += cbor.length();
+    }
+    const double cborNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        DynamicJsonDocument doc(1024);
+        doc["version"] = round;
+        doc["voltage"] = data.voltage;
+        doc["current"] = data.current;
+        doc["batteryLevel"] = data.batteryLevel;
+        doc["cycleCharge"] = data.cycleCharge;
+        doc["cycles"] = data.cycles;
+        doc["problemCode"] = data.problemCode;
+        JsonArray cells = doc.createNestedArray("cellVoltages");
+        for (int i = 0; i < 4; ++i)
+        {
+            cells.add(data.cellVoltages[i]);
+        }
+        JsonArray temperatures = doc.createNestedArray("temperatures");
+        for (int i = 0; i < 2; ++i)
+        {
+            temperatures.add(data.temperatures[i]);
+        }
+        doc["voltageSoc"] = -1;
+        doc["atRest"] = false;
+        std::string out;
+        serializeJson(doc, out);
+        sink += out.size();
+    }
+    const double jsonNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+
+    char report[160];
+    snprintf(report, sizeof(report), "battery sample: CBOR %zu bytes in %.0f ns, JSON %zu bytes in %.0f ns", cborBytes, cborNs, jsonBytes, jsonNs);
+    TEST_MESSAGE(report);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_unsigned);
+    RUN_TEST(test_signed);
+    RUN_TEST(test_simple_and_containers);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_battery_cbor_is_well_formed);
+    RUN_TEST(test_cbor_vs_json);
+    return UNITY_END();
+}
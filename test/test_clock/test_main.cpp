@@ -0,0 +1,245 @@
+// test_main.cpp
+// Clock in accelerated time: the 64 bit monotonic clock and fromMillis() across the
+// 49.7 day millis() wrap, the wall clock offset with millisecond precision, before and
+// after the wrap, and the drift estimate between syncs.
+#include <unity.h>
+#include <HostBLE.h>
+#include <HostWeb.h>
+#include <sys/time.h>
+#include <memory>
+#include <string>
+#include "BatteryManager.h"
+#include "Clock.h"
+#include "VanControlWebServer.h"
+
+static constexpr uint64_t WRAP_MS = 1ull << 32;
+static constexpr uint64_t HOUR_MS = 60 * 60 * 1000;
+// 2023-11-14 22:13:20.567 UTC
+static constexpr int64_t EPOCH_US = 1700000000567000ll;
+
+// Syncs to epochUs. The unsynced step first starts a new drift measurement, so syncs of
+// earlier tests do not show up as drift here.
+static void syncTo(int64_t epochUs)
+{
+    host::setWallClock(epochUs);
+    Clock::updateWallClock(false);
+    Clock::updateWallClock();
+}
+
+// Moves the uptime to ms, time only runs forward
+static void uptimeTo(uint64_t ms)
+{
+    TEST_ASSERT_TRUE(ms * 1000 >= (uint64_t)host::uptimeUs());
+    host::setUptimeUs((int64_t)ms * 1000);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Runs first, on the fresh boot of the test process
+void test_not_set_before_sync(void)
+{
+    host::advanceMs(5000);
+    TEST_ASSERT_FALSE(Clock::isWallClockSet());
+    TEST_ASSERT_EQUAL_UINT64(0, Clock::epochMs());
+    TEST_ASSERT_EQUAL_UINT64(0, Clock::toEpochMs(1000));
+    TEST_ASSERT_EQUAL_UINT32(0, Clock::getSyncCount());
+}
+
+void test_now(void)
+{
+    const uint64_t before = Clock::nowMs();
+    host::advanceMs(1234);
+    TEST_ASSERT_EQUAL_UINT64(before + 1234, Clock::nowMs());
+    TEST_ASSERT_EQUAL_UINT64(Clock::nowMs() * 1000, Clock::nowUs());
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)Clock::nowMs(), millis());
+}
+
+void test_from_millis(void)
+{
+    const uint64_t now = Clock::nowMs();
+    TEST_ASSERT_EQUAL_UINT64(now, Clock::fromMillis(millis()));
+    TEST_ASSERT_EQUAL_UINT64(now - 4000, Clock::fromMillis(millis() - 4000));
+}
+
+void test_offset_ms_precision(void)
+{
+    const uint64_t syncedAt = Clock::nowMs();
+    syncTo(EPOCH_US);
+    TEST_ASSERT_TRUE(Clock::isWallClockSet());
+    TEST_ASSERT_EQUAL_UINT64(EPOCH_US / 1000, Clock::epochMs());
+
+    host::advanceMs(1234);
+    TEST_ASSERT_EQUAL_UINT64(EPOCH_US / 1000 + 1234, Clock::epochMs());
+    // Timestamps taken before the sync get their time from the same offset
+    TEST_ASSERT_EQUAL_UINT64(EPOCH_US / 1000 - 3000, Clock::toEpochMs(syncedAt - 3000));
+    TEST_ASSERT_EQUAL_INT32(0, Clock::getDriftPpb());
+}
+
+// A resync moves old and new timestamps alike and reports the step
+void test_resync_step(void)
+{
+    const uint64_t earlier = Clock::nowMs() - 1000;
+    const uint64_t earlierEpochMs = Clock::toEpochMs(earlier);
+    const uint32_t syncs = Clock::getSyncCount();
+    host::advanceMs(60 * 1000);
+
+    host::setWallClock((int64_t)Clock::epochMs() * 1000 + 2500 * 1000);
+    Clock::updateWallClock();
+    TEST_ASSERT_EQUAL_UINT32(syncs + 1, Clock::getSyncCount());
+    TEST_ASSERT_EQUAL_INT64(2500 * 1000, Clock::getLastStepUs());
+    TEST_ASSERT_EQUAL_UINT64(earlierEpochMs + 2500, Clock::toEpochMs(earlier));
+    // Too soon after the first sync to tell drift from the step
+    TEST_ASSERT_EQUAL_INT32(0, Clock::getDriftPpb());
+
+    // A time kept from before a reset is used but is not an NTP sync
+    Clock::updateWallClock(false);
+    TEST_ASSERT_EQUAL_UINT32(syncs + 1, Clock::getSyncCount());
+}
+
+// nowMs() keeps counting where millis() starts over
+void test_wrap(void)
+{
+    uptimeTo(WRAP_MS - 2000);
+    const uint32_t beforeWrap = millis();
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX - 1999, beforeWrap);
+
+    host::advanceMs(3000);
+    TEST_ASSERT_EQUAL_UINT32(1000, millis());
+    TEST_ASSERT_EQUAL_UINT64(WRAP_MS + 1000, Clock::nowMs());
+    // A millis() stamp from before the wrap lands before it
+    TEST_ASSERT_EQUAL_UINT64(WRAP_MS - 2000, Clock::fromMillis(beforeWrap));
+    TEST_ASSERT_EQUAL_UINT32(3000, millis() - beforeWrap);
+    TEST_ASSERT_EQUAL_UINT64(3000, Clock::nowMs() - Clock::fromMillis(beforeWrap));
+}
+
+// Accelerated time over three wraps: the clock never goes back, the epoch mapping keeps
+// its offset and a millis() stamp of a day ago always maps back to the same time
+void test_accelerated_wraps(void)
+{
+    syncTo(EPOCH_US + (int64_t)Clock::nowMs() * 1000);
+    const int64_t offsetMs = (int64_t)Clock::epochMs() - (int64_t)Clock::nowMs();
+    const uint64_t end = Clock::nowMs() + 3 * WRAP_MS;
+    constexpr uint64_t STEP_MS = 37 * 60 * 1000 + 13; // not a divisor of the wrap
+    constexpr uint64_t DAY_MS = 24ull * 60 * 60 * 1000;
+    uint64_t previous = Clock::nowMs();
+    uint32_t wraps = 0;
+    while (Clock::nowMs() < end)
+    {
+        const uint32_t millisBefore = millis();
+        host::advanceMs(STEP_MS);
+        wraps += millis() < millisBefore ? 1 : 0;
+
+        const uint64_t now = Clock::nowMs();
+        TEST_ASSERT_EQUAL_UINT64(previous + STEP_MS, now);
+        previous = now;
+        TEST_ASSERT_EQUAL_INT64(offsetMs, (int64_t)Clock::epochMs() - (int64_t)now);
+        TEST_ASSERT_EQUAL_UINT64(now - DAY_MS, Clock::fromMillis(millis() - (uint32_t)DAY_MS));
+        TEST_ASSERT_EQUAL_UINT64(now + offsetMs - DAY_MS, Clock::toEpochMs(Clock::fromMillis(millis() - (uint32_t)DAY_MS)));
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, wraps);
+}
+
+// A sample taken before the wrap and before the first sync is exported with the right
+// time once the clock is synced after the wrap
+void test_export_across_wrap(void)
+{
+    std::unique_ptr<BLEManager> bleManager = std::make_unique<BLEManager>();
+    std::unique_ptr<BatteryManager> batteryManager = std::make_unique<BatteryManager>(*bleManager);
+    batteryManager->init();
+    std::unique_ptr<VanControlWebServer> webServer = std::make_unique<VanControlWebServer>(batteryManager.get());
+    webServer->start();
+
+    uptimeTo((Clock::nowMs() / WRAP_MS + 1) * WRAP_MS - 5000);
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 1;
+    for (int i = 0; i < 4; ++i)
+    {
+        data.cellVoltages[i] = 3300;
+    }
+    data.voltage = 1320;
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, data));
+    const uint64_t sampledAt = Clock::nowMs();
+
+    host::advanceMs(65 * 1000);
+    TEST_ASSERT_TRUE(millis() < 65 * 1000);
+    syncTo(EPOCH_US);
+    const HostResponse csv = hostGet("/export.csv");
+    TEST_ASSERT_EQUAL(200, csv.code);
+    const uint64_t expectedSeconds = (EPOCH_US / 1000 - (Clock::nowMs() - sampledAt)) / 1000;
+    const std::string expectedRow = "\r\n" + std::to_string(expectedSeconds) + ",13.20,";
+    TEST_ASSERT_TRUE_MESSAGE(csv.body.find(expectedRow) != std::string::npos, csv.body.c_str());
+}
+
+// What the simulated system time says, the NTP time of the tests below
+static uint64_t systemTimeMs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// A crystal 40 ppm slow: the drift is learned from two syncs 12 h apart, after that the
+// time stays right until the next daily sync
+void test_drift_correction(void)
+{
+    constexpr int32_t DRIFT_PPB = 40000;
+    host::setWallClock(EPOCH_US, DRIFT_PPB);
+    Clock::updateWallClock(false);
+    Clock::updateWallClock();
+    host::advanceMs(12 * HOUR_MS);
+    // Without a drift estimate the mapping is 40 ppm of 12 h behind
+    TEST_ASSERT_UINT64_WITHIN(1, systemTimeMs() - 1728, Clock::epochMs());
+    Clock::updateWallClock();
+    TEST_ASSERT_INT32_WITHIN(10, DRIFT_PPB, Clock::getDriftPpb());
+    TEST_ASSERT_INT64_WITHIN(1000, 1728 * 1000, Clock::getLastStepUs());
+
+    const uint64_t sampleMs = Clock::nowMs() + HOUR_MS;
+    const uint64_t sampleSystemMs = systemTimeMs() + HOUR_MS + HOUR_MS * DRIFT_PPB / 1000000000;
+    host::advanceMs(24 * HOUR_MS);
+    TEST_ASSERT_UINT64_WITHIN(1, systemTimeMs(), Clock::epochMs());
+    TEST_ASSERT_UINT64_WITHIN(1, sampleSystemMs, Clock::toEpochMs(sampleMs));
+    Clock::updateWallClock();
+    TEST_ASSERT_INT64_WITHIN(1000, 0, Clock::getLastStepUs());
+    TEST_ASSERT_INT32_WITHIN(10, DRIFT_PPB, Clock::getDriftPpb());
+}
+
+// Syncs closer together than MIN_DRIFT_INTERVAL_MS keep the estimate, and a step far
+// beyond any crystal is a new time rather than drift
+void test_drift_interval_and_jump(void)
+{
+    const int32_t drift = Clock::getDriftPpb();
+    host::advanceMs(Clock::MIN_DRIFT_INTERVAL_MS / 2);
+    host::setWallClock((int64_t)systemTimeMs() * 1000 + 50 * 1000);
+    Clock::updateWallClock();
+    TEST_ASSERT_EQUAL_INT32(drift, Clock::getDriftPpb());
+
+    host::advanceMs(Clock::MIN_DRIFT_INTERVAL_MS);
+    host::setWallClock((int64_t)(systemTimeMs() + HOUR_MS) * 1000);
+    Clock::updateWallClock();
+    TEST_ASSERT_EQUAL_INT32(0, Clock::getDriftPpb());
+    TEST_ASSERT_UINT64_WITHIN(1, systemTimeMs(), Clock::epochMs());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_not_set_before_sync);
+    RUN_TEST(test_now);
+    RUN_TEST(test_from_millis);
+    RUN_TEST(test_offset_ms_precision);
+    RUN_TEST(test_resync_step);
+    RUN_TEST(test_wrap);
+    RUN_TEST(test_accelerated_wraps);
+    RUN_TEST(test_export_across_wrap);
+    RUN_TEST(test_drift_correction);
+    RUN_TEST(test_drift_interval_and_jump);
+    return UNITY_END();
+}
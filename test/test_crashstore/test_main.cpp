@@ -0,0 +1,211 @@
+// test_main.cpp
+// CrashStore across simulated resets: what comes back after a reset, what a power cycle or
+// a damaged header throws away, and damaged entries dropped while the others are kept.
+#include <unity.h>
+#include <cstring>
+#include <string>
+#include "BLEManager.h"
+#include "CrashStore.h"
+
+// The RTC memory of the previous boot, see esp_attr.h of the host stubs
+extern "C" uint8_t __start_rtc_noinit[];
+extern "C" uint8_t __stop_rtc_noinit[];
+
+// Flips a bit of the first byte after text in RTC memory
+static void damageAfter(const char *text)
+{
+    const size_t len = strlen(text);
+    for (uint8_t *p = __start_rtc_noinit; p + len < __stop_rtc_noinit; ++p)
+    {
+        if (memcmp(p, text, len) == 0)
+        {
+            p[len] ^= 0x01;
+            return;
+        }
+    }
+    TEST_FAIL_MESSAGE("text not found in RTC memory");
+}
+
+static TDTBMSData sample(uint16_t voltage)
+{
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        data.cellVoltages[i] = 3300 + i * 5;
+    }
+    data.temperatures[0] = 215;
+    data.temperatures[1] = 198;
+    data.voltage = voltage;
+    data.current = -52;
+    data.batteryLevel = 87;
+    return data;
+}
+
+void setUp(void)
+{
+    // Every test starts from a cold boot
+    CrashStore::recover(ESP_RST_POWERON);
+}
+
+void tearDown(void)
+{
+}
+
+void test_power_on_starts_empty(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(1, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL(ESP_RST_POWERON, CrashStore::getResetReason());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredLogs().size());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredSamples().size());
+    TEST_ASSERT_EQUAL_STRING("", CrashStore::getRecoveredNote());
+    TEST_ASSERT_EQUAL_UINT32(0, CrashStore::getRejected());
+
+    // A reset without anything written brings nothing back either
+    CrashStore::recover(ESP_RST_SW);
+    TEST_ASSERT_EQUAL_UINT32(2, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredLogs().size());
+    TEST_ASSERT_EQUAL_UINT32(0, CrashStore::getRejected());
+}
+
+void test_recovers_after_panic(void)
+{
+    CrashStore::addLog(2, 1000, "first");
+    CrashStore::addLog(3, 2000, "second");
+    CrashStore::addSample(sample(1325), 1500);
+    CrashStore::addSample(sample(1320), 2500);
+    CrashStore::setRestartNote("No battery data for 600 s");
+
+    CrashStore::recover(ESP_RST_PANIC);
+    TEST_ASSERT_EQUAL(ESP_RST_PANIC, CrashStore::getResetReason());
+    TEST_ASSERT_EQUAL_UINT32(2, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL_STRING("No battery data for 600 s", CrashStore::getRecoveredNote());
+    TEST_ASSERT_EQUAL_UINT32(0, CrashStore::getRejected());
+
+    const auto &logs = CrashStore::getRecoveredLogs();
+    TEST_ASSERT_EQUAL(2, logs.size());
+    TEST_ASSERT_EQUAL_STRING("first", logs[0].message);
+    TEST_ASSERT_EQUAL_UINT32(1000, logs[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT8(2, logs[0].level);
+    TEST_ASSERT_EQUAL_STRING("second", logs[1].message);
+
+    const auto &samples = CrashStore::getRecoveredSamples();
+    TEST_ASSERT_EQUAL(2, samples.size());
+    TEST_ASSERT_EQUAL_UINT16(1325, samples[0].voltage);
+    TEST_ASSERT_EQUAL_UINT32(1500, samples[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT16(3300, samples[0].minCellVoltage);
+    TEST_ASSERT_EQUAL_UINT16(3315, samples[0].maxCellVoltage);
+    TEST_ASSERT_EQUAL_INT16(215, samples[0].maxTemperature);
+    TEST_ASSERT_EQUAL_INT16(-52, samples[0].current);
+    TEST_ASSERT_EQUAL_UINT8(87, samples[0].batteryLevel);
+    TEST_ASSERT_EQUAL_UINT16(1320, samples[1].voltage);
+
+    // The store was cleared for this boot: the next reset only brings back the warning
+    // recover() logged about what it found
+    CrashStore::recover(ESP_RST_SW);
+    TEST_ASSERT_EQUAL_UINT32(3, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL(1, CrashStore::getRecoveredLogs().size());
+    TEST_ASSERT_TRUE(strstr(CrashStore::getRecoveredLogs()[0].message, "Recovered 2 log records") != nullptr);
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredSamples().size());
+    TEST_ASSERT_EQUAL_STRING("", CrashStore::getRecoveredNote());
+}
+
+// Only the newest entries are kept, oldest first
+void test_keeps_newest_in_order(void)
+{
+    const uint32_t total = CrashStore::LOG_ENTRIES * 2 + 5;
+    for (uint32_t i = 0; i < total; ++i)
+    {
+        const std::string message = "log " + std::to_string(i);
+        CrashStore::addLog(2, i, message.c_str());
+    }
+    for (uint16_t i = 0; i < CrashStore::SAMPLE_ENTRIES + 3; ++i)
+    {
+        CrashStore::addSample(sample(1300 + i), i);
+    }
+
+    CrashStore::recover(ESP_RST_TASK_WDT);
+    const auto &logs = CrashStore::getRecoveredLogs();
+    TEST_ASSERT_EQUAL(CrashStore::LOG_ENTRIES, logs.size());
+    for (size_t i = 0; i < logs.size(); ++i)
+    {
+        const std::string expected = "log " + std::to_string(total - CrashStore::LOG_ENTRIES + i);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), logs[i].message);
+    }
+    const auto &samples = CrashStore::getRecoveredSamples();
+    TEST_ASSERT_EQUAL(CrashStore::SAMPLE_ENTRIES, samples.size());
+    TEST_ASSERT_EQUAL_UINT16(1303, samples[0].voltage);
+    TEST_ASSERT_EQUAL_UINT16(1306, samples[CrashStore::SAMPLE_ENTRIES - 1].voltage);
+}
+
+void test_long_message_is_cut(void)
+{
+    const std::string message(CrashStore::LOG_MESSAGE_SIZE * 2, 'm');
+    CrashStore::addLog(2, 0, message.c_str());
+    CrashStore::recover(ESP_RST_SW);
+    TEST_ASSERT_EQUAL(1, CrashStore::getRecoveredLogs().size());
+    TEST_ASSERT_EQUAL(CrashStore::LOG_MESSAGE_SIZE - 1, strlen(CrashStore::getRecoveredLogs()[0].message));
+}
+
+// A half written entry is dropped and counted, the others still come back
+void test_damaged_entries_dropped(void)
+{
+    CrashStore::addLog(2, 1, "kept before");
+    CrashStore::addLog(2, 2, "torn by the crash");
+    CrashStore::addLog(2, 3, "kept after");
+    CrashStore::addSample(sample(1325), 4);
+    damageAfter("torn by the");
+
+    CrashStore::recover(ESP_RST_PANIC);
+    TEST_ASSERT_EQUAL_UINT32(1, CrashStore::getRejected());
+    const auto &logs = CrashStore::getRecoveredLogs();
+    TEST_ASSERT_EQUAL(2, logs.size());
+    TEST_ASSERT_EQUAL_STRING("kept before", logs[0].message);
+    TEST_ASSERT_EQUAL_STRING("kept after", logs[1].message);
+    TEST_ASSERT_EQUAL(1, CrashStore::getRecoveredSamples().size());
+}
+
+// A damaged header, or a power cycle, throws away everything
+void test_damaged_header_drops_all(void)
+{
+    CrashStore::addLog(2, 1, "lost");
+    CrashStore::setRestartNote("OTA update");
+    damageAfter("OTA upd");
+    CrashStore::recover(ESP_RST_SW);
+    TEST_ASSERT_EQUAL_UINT32(1, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredLogs().size());
+    TEST_ASSERT_EQUAL_STRING("", CrashStore::getRecoveredNote());
+
+    CrashStore::addLog(2, 1, "lost too");
+    CrashStore::recover(ESP_RST_POWERON);
+    TEST_ASSERT_EQUAL_UINT32(1, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredLogs().size());
+}
+
+// Noise in RTC memory after a power cycle: every entry fails its CRC, none is taken
+void test_noise_rejected(void)
+{
+    for (uint8_t *p = __start_rtc_noinit; p < __stop_rtc_noinit; ++p)
+    {
+        *p = (uint8_t)((p - __start_rtc_noinit) * 37 + 11);
+    }
+    CrashStore::recover(ESP_RST_BROWNOUT);
+    TEST_ASSERT_EQUAL_UINT32(1, CrashStore::getBootCount());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredLogs().size());
+    TEST_ASSERT_EQUAL(0, CrashStore::getRecoveredSamples().size());
+    TEST_ASSERT_EQUAL_UINT32(0, CrashStore::getRejected());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_power_on_starts_empty);
+    RUN_TEST(test_recovers_after_panic);
+    RUN_TEST(test_keeps_newest_in_order);
+    RUN_TEST(test_long_message_is_cut);
+    RUN_TEST(test_damaged_entries_dropped);
+    RUN_TEST(test_damaged_header_drops_all);
+    RUN_TEST(test_noise_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,278 @@
+// test_main.cpp
+// Charge and energy integration of EnergyCounter, in particular across sign changes, the
+// hourly and daily buckets of a restart before the time is synced, and snapshots read
+// while samples are added.
+#include <unity.h>
+#include <HostStubs.h>
+#include <atomic>
+#include <memory>
+#include <stdlib.h>
+#include <thread>
+#include <time.h>
+#include "Clock.h"
+#include "EnergyCounter.h"
+
+static constexpr uint16_t VOLTAGE = 1300; // 13.00 V
+static constexpr uint32_t STEP_MS = 10000;
+
+// The NVS record of EnergyCounter (version 1), to restore the buckets of an earlier boot
+struct Checkpoint
+{
+    uint32_t version;
+    EnergyTotals totals;
+    EnergyBucket hourly[EnergyCounter::HOURLY_BUCKETS];
+    EnergyBucket daily[EnergyCounter::DAILY_BUCKETS];
+    uint8_t hourlyPos;
+    uint8_t dailyPos;
+};
+
+// uAs for a current ramp in 0.1A over ms, trapezoid area of mA * ms
+static int64_t rampUAs(int32_t fromDeciAmps, int32_t toDeciAmps, uint32_t ms)
+{
+    return ((int64_t)fromDeciAmps * 100 + (int64_t)toDeciAmps * 100) * ms / 2;
+}
+
+// Two samples STEP_MS apart; the counter lives on the heap, it is several KB
+static std::unique_ptr<EnergyCounter> integrate(int16_t from, int16_t to, uint32_t dtMs = STEP_MS)
+{
+    auto counter = std::make_unique<EnergyCounter>();
+    const uint32_t startMs = millis();
+    counter->addSample(VOLTAGE, from, startMs);
+    counter->addSample(VOLTAGE, to, startMs + dtMs);
+    return counter;
+}
+
+void setUp(void)
+{
+    host::clearPreferences();
+    host::advanceMs(60 * 1000);
+}
+
+void tearDown(void)
+{
+}
+
+void test_charging(void)
+{
+    const auto counter = integrate(20, 40);
+    TEST_ASSERT_EQUAL_INT64(rampUAs(20, 40, STEP_MS), counter->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(0, counter->getTotals().chargeOutUAs);
+    // 13 V * 3 A average for 10 s
+    TEST_ASSERT_EQUAL_INT64(13LL * 3000 * STEP_MS, counter->getTotals().energyInUWs);
+}
+
+void test_discharging(void)
+{
+    const auto counter = integrate(-20, -40);
+    TEST_ASSERT_EQUAL_INT64(0, counter->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(rampUAs(20, 40, STEP_MS), counter->getTotals().chargeOutUAs);
+    TEST_ASSERT_EQUAL_INT64(13LL * 3000 * STEP_MS, counter->getTotals().energyOutUWs);
+}
+
+void test_zero_crossing(void)
+{
+    // +3 A to -1 A crosses zero after 3/4 of the interval
+    const auto counter = integrate(30, -10, 8000);
+    TEST_ASSERT_EQUAL_INT64(3000LL * 6000 / 2, counter->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(1000LL * 2000 / 2, counter->getTotals().chargeOutUAs);
+    TEST_ASSERT_EQUAL_INT64(13LL * 3000 * 6000 / 2, counter->getTotals().energyInUWs);
+    TEST_ASSERT_EQUAL_INT64(13LL * 1000 * 2000 / 2, counter->getTotals().energyOutUWs);
+
+    const auto back = integrate(-10, 30, 8000);
+    TEST_ASSERT_EQUAL_INT64(1000LL * 2000 / 2, back->getTotals().chargeOutUAs);
+    TEST_ASSERT_EQUAL_INT64(3000LL * 6000 / 2, back->getTotals().chargeInUAs);
+}
+
+void test_starting_at_zero(void)
+{
+    // All of the area has the sign of the end point
+    const auto down = integrate(0, -20);
+    TEST_ASSERT_EQUAL_INT64(0, down->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(rampUAs(0, 20, STEP_MS), down->getTotals().chargeOutUAs);
+    TEST_ASSERT_EQUAL_INT64(0, down->getTotals().energyInUWs);
+    TEST_ASSERT_EQUAL_INT64(13LL * 1000 * STEP_MS, down->getTotals().energyOutUWs);
+
+    const auto up = integrate(0, 20);
+    TEST_ASSERT_EQUAL_INT64(rampUAs(0, 20, STEP_MS), up->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(0, up->getTotals().chargeOutUAs);
+}
+
+void test_ending_at_zero(void)
+{
+    const auto down = integrate(-20, 0);
+    TEST_ASSERT_EQUAL_INT64(0, down->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(rampUAs(20, 0, STEP_MS), down->getTotals().chargeOutUAs);
+
+    const auto up = integrate(20, 0);
+    TEST_ASSERT_EQUAL_INT64(rampUAs(20, 0, STEP_MS), up->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(0, up->getTotals().chargeOutUAs);
+}
+
+void test_idle(void)
+{
+    const auto counter = integrate(0, 0);
+    TEST_ASSERT_EQUAL_INT64(0, counter->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(0, counter->getTotals().chargeOutUAs);
+}
+
+void test_gap_is_not_integrated(void)
+{
+    const auto counter = integrate(20, 20, EnergyCounter::MAX_INTEGRATION_GAP_MS + 1);
+    TEST_ASSERT_EQUAL_INT64(0, counter->getTotals().chargeInUAs);
+}
+
+// A restart before the time is synced, with buckets restored from NVS: what is counted
+// meanwhile stays out of the restored buckets and goes to its own hours at the first sync.
+// Runs before any other test syncs the clock.
+void test_restart_before_sync(void)
+{
+    constexpr int64_t RESTORED_UAS = 5 * 3600000LL; // 5 mAh
+    Checkpoint checkpoint = {};
+    checkpoint.version = 1;
+    checkpoint.totals.chargeInUAs = RESTORED_UAS;
+    checkpoint.hourlyPos = 5;
+    checkpoint.hourly[5].key = 2023111408;
+    checkpoint.hourly[5].totals.chargeInUAs = RESTORED_UAS;
+    checkpoint.dailyPos = 2;
+    checkpoint.daily[2].key = 20231114;
+    checkpoint.daily[2].totals.chargeInUAs = RESTORED_UAS;
+    Preferences prefs;
+    prefs.begin("energy");
+    prefs.putBytes("state", &checkpoint, sizeof(checkpoint));
+
+    auto counter = std::make_unique<EnergyCounter>();
+    counter->init();
+    TEST_ASSERT_FALSE(Clock::isWallClockSet());
+
+    // 1 A for two and a half hours
+    constexpr int64_t SAMPLE_UAS = 1000LL * STEP_MS;
+    constexpr int INTERVALS = 900;
+    const uint64_t startMs = Clock::nowMs();
+    for (int i = 0; i <= INTERVALS; ++i)
+    {
+        if (i > 0)
+        {
+            host::advanceMs(STEP_MS);
+        }
+        counter->addSample(VOLTAGE, 10, millis());
+    }
+    TEST_ASSERT_EQUAL_INT64(RESTORED_UAS + INTERVALS * SAMPLE_UAS, counter->getTotals().chargeInUAs);
+    TEST_ASSERT_EQUAL_UINT32(2023111408, counter->getHourly(0).key);
+    TEST_ASSERT_EQUAL_INT64(RESTORED_UAS, counter->getHourly(0).totals.chargeInUAs);
+    TEST_ASSERT_EQUAL_UINT32(20231114, counter->getDaily(0).key);
+    TEST_ASSERT_EQUAL_INT64(RESTORED_UAS, counter->getDaily(0).totals.chargeInUAs);
+
+    // The sync says the first sample was taken at 2023-11-15 09:30:00 UTC
+    constexpr int64_t START_EPOCH_MS = 1700040600000LL;
+    host::setWallClock((START_EPOCH_MS + (int64_t)(Clock::nowMs() - startMs)) * 1000);
+    Clock::updateWallClock();
+    host::advanceMs(STEP_MS);
+    counter->addSample(VOLTAGE, 10, millis());
+
+    // Every hour gets what was counted in it, to within the one sample at the turn of an hour
+    const struct
+    {
+        uint32_t key;
+        int64_t chargeInUAs;
+    } hours[] = {
+        {2023111512, 1 * SAMPLE_UAS},
+        {2023111511, 360 * SAMPLE_UAS},
+        {2023111510, 360 * SAMPLE_UAS},
+        {2023111509, 180 * SAMPLE_UAS},
+        {2023111408, RESTORED_UAS},
+    };
+    int64_t booked = 0;
+    for (int i = 0; i < 5; ++i)
+    {
+        TEST_ASSERT_EQUAL_UINT32(hours[i].key, counter->getHourly(i).key);
+        TEST_ASSERT_INT64_WITHIN(SAMPLE_UAS, hours[i].chargeInUAs, counter->getHourly(i).totals.chargeInUAs);
+        booked += counter->getHourly(i).totals.chargeInUAs;
+    }
+    TEST_ASSERT_EQUAL_INT64(counter->getTotals().chargeInUAs, booked);
+
+    TEST_ASSERT_EQUAL_UINT32(20231115, counter->getDaily(0).key);
+    TEST_ASSERT_EQUAL_INT64((INTERVALS + 1) * SAMPLE_UAS, counter->getDaily(0).totals.chargeInUAs);
+    TEST_ASSERT_EQUAL_UINT32(20231114, counter->getDaily(1).key);
+    TEST_ASSERT_EQUAL_INT64(RESTORED_UAS, counter->getDaily(1).totals.chargeInUAs);
+}
+
+void test_buckets_follow_totals(void)
+{
+    const auto counter = integrate(30, -10, 8000);
+    const EnergyTotals &hour = counter->getHourly(0).totals;
+    const EnergyTotals &day = counter->getDaily(0).totals;
+    TEST_ASSERT_EQUAL_INT64(counter->getTotals().chargeInUAs, hour.chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(counter->getTotals().chargeOutUAs, hour.chargeOutUAs);
+    TEST_ASSERT_EQUAL_INT64(counter->getTotals().chargeInUAs, day.chargeInUAs);
+    TEST_ASSERT_EQUAL_INT64(counter->getTotals().chargeOutUAs, day.chargeOutUAs);
+}
+
+// A reader takes snapshots while the loop adds samples across many hour turns: the
+// buckets of every snapshot add up to its totals, none is caught half way
+void test_snapshot_while_adding(void)
+{
+    TEST_ASSERT_TRUE(Clock::isWallClockSet());
+    auto counter = std::make_unique<EnergyCounter>();
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> snapshots{0};
+    uint32_t torn = 0;
+    std::thread reader([&]()
+                       {
+                           auto snapshot = std::make_unique<EnergyCounter::Snapshot>();
+                           while (!done)
+                           {
+                               counter->getSnapshot(*snapshot);
+                               int64_t booked = 0;
+                               for (const EnergyBucket &bucket : snapshot->hourly)
+                               {
+                                   booked += bucket.totals.chargeInUAs;
+                               }
+                               torn += booked != snapshot->totals.chargeInUAs ? 1 : 0;
+                               snapshots++;
+                           } });
+
+    while (snapshots == 0)
+    {
+        std::this_thread::yield();
+    }
+    // 20 hours in 10 s steps, fewer than the hourly buckets kept
+    for (int i = 0; i < 20 * 360; ++i)
+    {
+        counter->addSample(VOLTAGE, 10 + i % 7, millis());
+        host::advanceMs(STEP_MS);
+    }
+    done = true;
+    reader.join();
+    TEST_ASSERT_TRUE(snapshots > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+
+    auto snapshot = std::make_unique<EnergyCounter::Snapshot>();
+    counter->getSnapshot(*snapshot);
+    int64_t booked = 0;
+    for (int i = 0; i < EnergyCounter::HOURLY_BUCKETS; ++i)
+    {
+        TEST_ASSERT_EQUAL_UINT32(counter->getHourly(i).key, snapshot->hourly[i].key);
+        booked += snapshot->hourly[i].totals.chargeInUAs;
+    }
+    TEST_ASSERT_EQUAL_INT64(counter->getTotals().chargeInUAs, booked);
+    TEST_ASSERT_EQUAL_UINT32(counter->getDaily(0).key, snapshot->daily[0].key);
+}
+
+int main(int argc, char **argv)
+{
+    // Bucket keys are local time
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    UNITY_BEGIN();
+    RUN_TEST(test_charging);
+    RUN_TEST(test_discharging);
+    RUN_TEST(test_zero_crossing);
+    RUN_TEST(test_starting_at_zero);
+    RUN_TEST(test_ending_at_zero);
+    RUN_TEST(test_idle);
+    RUN_TEST(test_gap_is_not_integrated);
+    RUN_TEST(test_restart_before_sync);
+    RUN_TEST(test_buckets_follow_totals);
+    RUN_TEST(test_snapshot_while_adding);
+    return UNITY_END();
+}
@@ -0,0 +1,169 @@
+// test_main.cpp
+// Fixed formatting and rescaling, isqrt64, and the formatter's cost against float printf.
+#include <unity.h>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include "FixedPoint.h"
+
+static std::string text(Fixed value)
+{
+    return FixedText(value).c_str();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_format(void)
+{
+    const struct
+    {
+        Fixed value;
+        const char *expected;
+    } cases[] = {
+        {Fixed(0, 0), "0"},
+        {Fixed(0, 2), "0.00"},
+        {Fixed(1325, 2), "13.25"},
+        {Fixed(-52, 1), "-5.2"},
+        {Fixed(5, 3), "0.005"},
+        {Fixed(-5, 3), "-0.005"},
+        {Fixed(100, 2), "1.00"},
+        {Fixed(42, 0), "42"},
+        {Fixed(INT32_MAX, 0), "2147483647"},
+        {Fixed(INT32_MIN, 0), "-2147483648"},
+        {Fixed(INT32_MIN, 3), "-2147483.648"},
+    };
+    for (const auto &c : cases)
+    {
+        const std::string actual = text(c.value);
+        TEST_ASSERT_EQUAL_STRING(c.expected, actual.c_str());
+    }
+}
+
+void test_format_returns_length(void)
+{
+    char buf[16];
+    TEST_ASSERT_EQUAL_size_t(6, Fixed(-1234, 3).format(buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("-1.234", buf);
+}
+
+void test_format_truncates(void)
+{
+    char buf[8];
+    memset(buf, 'x', sizeof(buf));
+    TEST_ASSERT_EQUAL_size_t(4, Fixed(-1234, 3).format(buf, 5));
+    TEST_ASSERT_EQUAL_STRING("-1.2", buf);
+    TEST_ASSERT_EQUAL_CHAR('x', buf[5]);
+
+    buf[0] = 'x';
+    TEST_ASSERT_EQUAL_size_t(0, Fixed(7, 0).format(buf, 0));
+    TEST_ASSERT_EQUAL_CHAR('x', buf[0]);
+    TEST_ASSERT_EQUAL_size_t(0, Fixed(7, 0).format(buf, 1));
+    TEST_ASSERT_EQUAL_CHAR('\0', buf[0]);
+}
+
+// Same text as printf("%.*f") of the value as a double
+void test_format_against_printf(void)
+{
+    std::mt19937 random(29);
+    for (int i = 0; i < 100000; ++i)
+    {
+        const int32_t raw = (int32_t)(random() % 2000001) - 1000000;
+        const uint8_t decimals = random() % 4;
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%.*f", decimals, raw / (double)Fixed::pow10(decimals));
+        const std::string actual = text(Fixed(raw, decimals));
+        TEST_ASSERT_EQUAL_STRING(expected, actual.c_str());
+    }
+}
+
+void test_rescale(void)
+{
+    TEST_ASSERT_EQUAL_INT32(132500, Fixed(1325, 2).rescale(4).raw);
+    TEST_ASSERT_EQUAL_INT32(4, Fixed(1325, 2).rescale(4).decimals);
+    TEST_ASSERT_EQUAL_INT32(133, Fixed(1325, 3).rescale(2).raw);
+    TEST_ASSERT_EQUAL_INT32(132, Fixed(1324, 3).rescale(2).raw);
+    // Half away from zero on both sides
+    TEST_ASSERT_EQUAL_INT32(-133, Fixed(-1325, 3).rescale(2).raw);
+    TEST_ASSERT_EQUAL_INT32(-132, Fixed(-1324, 3).rescale(2).raw);
+    TEST_ASSERT_EQUAL_INT32(1, Fixed(5, 1).rescale(0).raw);
+    TEST_ASSERT_EQUAL_INT32(-1, Fixed(-5, 1).rescale(0).raw);
+    TEST_ASSERT_EQUAL_INT32(0, Fixed(-4, 1).rescale(0).raw);
+    TEST_ASSERT_EQUAL_INT32(7, Fixed(7, 2).rescale(2).raw);
+}
+
+void test_abs(void)
+{
+    TEST_ASSERT_EQUAL_INT32(52, Fixed(-52, 1).abs().raw);
+    TEST_ASSERT_EQUAL_INT32(1, Fixed(-52, 1).abs().decimals);
+    TEST_ASSERT_EQUAL_INT32(52, Fixed(52, 1).abs().raw);
+}
+
+void test_isqrt64(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(0, isqrt64(0));
+    TEST_ASSERT_EQUAL_UINT32(1, isqrt64(1));
+    TEST_ASSERT_EQUAL_UINT32(1, isqrt64(3));
+    TEST_ASSERT_EQUAL_UINT32(2, isqrt64(4));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, isqrt64(UINT64_MAX));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX - 1, isqrt64((uint64_t)UINT32_MAX * UINT32_MAX - 1));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, isqrt64((uint64_t)UINT32_MAX * UINT32_MAX));
+
+    // floor(sqrt(value)) for random values of every magnitude
+    std::mt19937_64 random(29);
+    for (int i = 0; i < 100000; ++i)
+    {
+        const uint64_t value = random() >> (random() % 64);
+        const uint64_t root = isqrt64(value);
+        TEST_ASSERT_TRUE(root * root <= value);
+        TEST_ASSERT_TRUE(root == UINT32_MAX || (root + 1) * (root + 1) > value);
+    }
+}
+
+// Host CPU time. The host has an FPU, on the C3 every float operation of the printf path
+// is a soft-float call as well, so the gap there is wider
+void test_benchmark(void)
+{
+    constexpr int VALUES = 200000;
+    char buf[32];
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < VALUES; ++i)
+    {
+        sink += Fixed(i - VALUES / 2, 2).format(buf, sizeof(buf));
+    }
+    const double fixedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / VALUES;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < VALUES; ++i)
+    {
+        const float volts = (i - VALUES / 2) / 100.0f;
+        sink += snprintf(buf, sizeof(buf), "%.2f", volts);
+    }
+    const double floatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / VALUES;
+
+    char report[120];
+    snprintf(report, sizeof(report), "format 0.01 units: Fixed %.1f ns, float printf %.1f ns", fixedNs, floatNs);
+    TEST_MESSAGE(report);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_format);
+    RUN_TEST(test_format_returns_length);
+    RUN_TEST(test_format_truncates);
+    RUN_TEST(test_format_against_printf);
+    RUN_TEST(test_rescale);
+    RUN_TEST(test_abs);
+    RUN_TEST(test_isqrt64);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
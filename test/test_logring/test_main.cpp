@@ -0,0 +1,213 @@
+// test_main.cpp
+// LogRing with one writer, with a writer lapped by the whole ring, and with several
+// writer threads and a reader hammering it at once.
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "LogRing.h"
+
+// Every byte of the payload follows from writer and count, so a torn copy shows
+struct TestRecord
+{
+    uint32_t seq;
+    uint32_t writer;
+    uint32_t count;
+    uint8_t payload[244];
+};
+
+static constexpr size_t CAPACITY = 64;
+using TestRing = LogRing<TestRecord, CAPACITY>;
+
+static void fillRecord(TestRecord &record, uint32_t writer, uint32_t count)
+{
+    record.writer = writer;
+    record.count = count;
+    for (size_t i = 0; i < sizeof(record.payload); ++i)
+    {
+        record.payload[i] = (uint8_t)(writer * 31 + count * 7 + i);
+    }
+}
+
+static bool isIntact(const TestRecord &record)
+{
+    for (size_t i = 0; i < sizeof(record.payload); ++i)
+    {
+        if (record.payload[i] != (uint8_t)(record.writer * 31 + record.count * 7 + i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_empty(void)
+{
+    static TestRing ring;
+    TestRecord record;
+    TEST_ASSERT_EQUAL_UINT32(0, ring.getEndSeq());
+    TEST_ASSERT_EQUAL_UINT32(0, ring.getFirstSeq());
+    TEST_ASSERT_FALSE(ring.read(0, record));
+}
+
+void test_push_and_read(void)
+{
+    static TestRing ring;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        ring.push([i](TestRecord &record)
+                  { fillRecord(record, 1, i); });
+    }
+    TEST_ASSERT_EQUAL_UINT32(10, ring.getEndSeq());
+    TEST_ASSERT_EQUAL_UINT32(0, ring.getFirstSeq());
+    for (uint32_t seq = 0; seq < 10; ++seq)
+    {
+        TestRecord record;
+        TEST_ASSERT_TRUE(ring.read(seq, record));
+        TEST_ASSERT_EQUAL_UINT32(seq, record.seq);
+        TEST_ASSERT_EQUAL_UINT32(seq, record.count);
+        TEST_ASSERT_TRUE(isIntact(record));
+    }
+    TestRecord record;
+    TEST_ASSERT_FALSE(ring.read(10, record));
+}
+
+void test_overwrite(void)
+{
+    static TestRing ring;
+    const uint32_t total = CAPACITY * 3 + 5;
+    for (uint32_t i = 0; i < total; ++i)
+    {
+        ring.push([i](TestRecord &record)
+                  { fillRecord(record, 1, i); });
+    }
+    TEST_ASSERT_EQUAL_UINT32(total - CAPACITY, ring.getFirstSeq());
+    TestRecord record;
+    TEST_ASSERT_FALSE(ring.read(ring.getFirstSeq() - 1, record));
+    TEST_ASSERT_FALSE(ring.read(0, record));
+    for (uint32_t seq = ring.getFirstSeq(); seq < total; ++seq)
+    {
+        TEST_ASSERT_TRUE(ring.read(seq, record));
+        TEST_ASSERT_EQUAL_UINT32(seq, record.count);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, ring.getDropped());
+}
+
+// A writer that is still busy with its slot when the ring comes round again keeps the
+// slot, the lapping record is dropped rather than written over it
+void test_lapped_writer(void)
+{
+    static TestRing ring;
+    ring.push([](TestRecord &record)
+              {
+                  // Seq 0 is being written, now the others go once round the ring
+                  for (uint32_t i = 1; i <= CAPACITY; ++i)
+                  {
+                      ring.push([i](TestRecord &inner)
+                                { fillRecord(inner, 2, i); });
+                  }
+                  fillRecord(record, 1, 0); });
+    TEST_ASSERT_EQUAL_UINT32(1, ring.getDropped());
+    TestRecord record;
+    TEST_ASSERT_TRUE(ring.read(0, record));
+    TEST_ASSERT_EQUAL_UINT32(1, record.writer);
+    TEST_ASSERT_FALSE(ring.read(CAPACITY, record));
+    TEST_ASSERT_TRUE(ring.read(CAPACITY - 1, record));
+    TEST_ASSERT_EQUAL_UINT32(2, record.writer);
+}
+
+// Several writers and a reader at once: the reader only ever gets whole records with the
+// sequence number it asked for, each writer's records keep their order, and every record
+// is either readable afterwards, overwritten or counted as dropped
+void test_concurrent_writers(void)
+{
+    static TestRing ring;
+    constexpr uint32_t WRITERS = 4;
+    constexpr uint32_t PER_WRITER = 200000;
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> reads{0};
+    std::atomic<uint32_t> torn{0};
+
+    std::thread reader([&]()
+                       {
+                           while (!done)
+                           {
+                               const uint32_t end = ring.getEndSeq();
+                               for (uint32_t seq = end > CAPACITY ? end - CAPACITY : 0; seq < end; ++seq)
+                               {
+                                   TestRecord record;
+                                   if (ring.read(seq, record))
+                                   {
+                                       reads++;
+                                       if (record.seq != seq || !isIntact(record))
+                                       {
+                                           torn++;
+                                       }
+                                   }
+                               }
+                           } });
+    std::vector<std::thread> writers;
+    for (uint32_t writer = 0; writer < WRITERS; ++writer)
+    {
+        writers.emplace_back([writer]()
+                             {
+                                 for (uint32_t count = 0; count < PER_WRITER; ++count)
+                                 {
+                                     ring.push([writer, count](TestRecord &record)
+                                               { fillRecord(record, writer, count); });
+                                 } });
+    }
+    for (std::thread &thread : writers)
+    {
+        thread.join();
+    }
+    done = true;
+    reader.join();
+
+    TEST_ASSERT_EQUAL_UINT32(WRITERS * PER_WRITER, ring.getEndSeq());
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+    TEST_ASSERT_GREATER_THAN_UINT32(0, reads.load());
+
+    // What is left is the newest CAPACITY records less the dropped ones, in order per writer
+    uint32_t lastCount[WRITERS];
+    bool seen[WRITERS] = {false};
+    uint32_t readable = 0;
+    for (uint32_t seq = ring.getFirstSeq(); seq < ring.getEndSeq(); ++seq)
+    {
+        TestRecord record;
+        if (!ring.read(seq, record))
+        {
+            continue;
+        }
+        readable++;
+        TEST_ASSERT_TRUE(isIntact(record));
+        TEST_ASSERT_TRUE(record.writer < WRITERS);
+        TEST_ASSERT_TRUE(!seen[record.writer] || record.count > lastCount[record.writer]);
+        seen[record.writer] = true;
+        lastCount[record.writer] = record.count;
+    }
+    TEST_ASSERT_TRUE(readable + ring.getDropped() >= CAPACITY);
+
+    char report[120];
+    snprintf(report, sizeof(report), "%u records from %u writers, %u reads, %u dropped", WRITERS * PER_WRITER, WRITERS, reads.load(), ring.getDropped());
+    TEST_MESSAGE(report);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_push_and_read);
+    RUN_TEST(test_overwrite);
+    RUN_TEST(test_lapped_writer);
+    RUN_TEST(test_concurrent_writers);
+    return UNITY_END();
+}
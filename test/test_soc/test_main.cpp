@@ -0,0 +1,217 @@
+// test_main.cpp
+// The voltage based SOC: the OCV table lookup against a float reference, the temperature
+// correction, the rest detection of BatteryManager, and integer against float cost.
+#include <unity.h>
+#include <HostBLE.h>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include "BatteryManager.h"
+#include "LiFePO4Soc.h"
+
+using LiFePO4Soc::OCV_TABLE_MV;
+
+// The same lookup in float, the way it would be written without caring for the FPU
+static float socPercentFloat(float cellVolts, float temperatureC)
+{
+    const float compensatedMv = cellVolts * 1000.0f + (25.0f - temperatureC) * 0.3f;
+    if (compensatedMv <= OCV_TABLE_MV[0])
+        return 0.0f;
+    if (compensatedMv >= OCV_TABLE_MV[100])
+        return 100.0f;
+    int i = 1;
+    while (OCV_TABLE_MV[i] <= compensatedMv)
+        ++i;
+    return (i - 1) + (compensatedMv - OCV_TABLE_MV[i - 1]) / (float)(OCV_TABLE_MV[i] - OCV_TABLE_MV[i - 1]);
+}
+
+static std::unique_ptr<BLEManager> bleManager;
+static std::unique_ptr<BatteryManager> batteryManager;
+
+// A pack of four cells at cellMv each, all sensors at temperature
+static void deliverSample(int16_t current, uint16_t cellMv = 3260, int16_t temperature = 250)
+{
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        data.cellVoltages[i] = cellMv;
+    }
+    data.temperatures[0] = temperature;
+    data.temperatures[1] = temperature;
+    data.voltage = cellMv * 4 / 10;
+    data.current = current;
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, data));
+}
+
+void setUp(void)
+{
+    host::advanceMs(60 * 1000);
+    host::clearPreferences();
+    bleManager = std::make_unique<BLEManager>();
+    batteryManager = std::make_unique<BatteryManager>(*bleManager);
+    batteryManager->init();
+}
+
+void tearDown(void)
+{
+    batteryManager.reset();
+    bleManager.reset();
+}
+
+void test_table_ends(void)
+{
+    TEST_ASSERT_EQUAL_INT16(0, LiFePO4Soc::socPermille(0));
+    TEST_ASSERT_EQUAL_INT16(0, LiFePO4Soc::socPermille(OCV_TABLE_MV[0]));
+    TEST_ASSERT_EQUAL_INT16(1000, LiFePO4Soc::socPermille(OCV_TABLE_MV[100]));
+    TEST_ASSERT_EQUAL_INT16(1000, LiFePO4Soc::socPermille(UINT16_MAX));
+}
+
+void test_every_table_point(void)
+{
+    for (int percent = 1; percent < 100; ++percent)
+    {
+        TEST_ASSERT_EQUAL_INT16(percent * 10, LiFePO4Soc::socPermille(OCV_TABLE_MV[percent]));
+    }
+}
+
+void test_monotonic(void)
+{
+    int16_t previous = 0;
+    for (uint16_t mv = 2400; mv <= 3700; ++mv)
+    {
+        const int16_t soc = LiFePO4Soc::socPermille(mv);
+        TEST_ASSERT_TRUE(soc >= previous);
+        previous = soc;
+    }
+}
+
+// The integer path truncates to 0.1%, the float one does not
+void test_against_float(void)
+{
+    for (int16_t temperature = -200; temperature <= 450; temperature += 50)
+    {
+        for (uint16_t mv = 2400; mv <= 3700; ++mv)
+        {
+            const float expected = socPercentFloat(mv / 1000.0f, temperature / 10.0f) * 10.0f;
+            const int16_t actual = LiFePO4Soc::socPermille(mv, temperature);
+            TEST_ASSERT_TRUE_MESSAGE(actual <= expected + 0.01f && actual > expected - 1.01f, "off by more than the truncation");
+        }
+    }
+}
+
+void test_temperature_correction(void)
+{
+    // 20°C below the reference adds 6 mV: 3260 mV reads like 3266 mV, 53%
+    TEST_ASSERT_EQUAL_INT16(LiFePO4Soc::socPermille(3266), LiFePO4Soc::socPermille(3260, 50));
+    TEST_ASSERT_EQUAL_INT16(530, LiFePO4Soc::socPermille(3260, 50));
+    // 20°C above takes 6 mV off
+    TEST_ASSERT_EQUAL_INT16(LiFePO4Soc::socPermille(3254), LiFePO4Soc::socPermille(3260, 450));
+    // Sub-mV corrections still move the interpolation, 1°C is 0.3 mV
+    TEST_ASSERT_TRUE(LiFePO4Soc::socPermille(3260, 150) > LiFePO4Soc::socPermille(3260, 250));
+    TEST_ASSERT_EQUAL_INT16(LiFePO4Soc::socPermille(3260), LiFePO4Soc::socPermille(3260, LiFePO4Soc::REFERENCE_TEMP_DECI_C));
+}
+
+void test_unknown_until_rest(void)
+{
+    deliverSample(-52);
+    TEST_ASSERT_EQUAL(-1, batteryManager->getSOC());
+    TEST_ASSERT_FALSE(batteryManager->isAtRest());
+
+    // Idle, but not for long enough yet
+    deliverSample(BatteryManager::REST_CURRENT_THRESHOLD);
+    host::advanceMs(BatteryManager::REST_TIME_MS - 10 * 1000);
+    deliverSample(0);
+    TEST_ASSERT_EQUAL(-1, batteryManager->getSOC());
+    TEST_ASSERT_FALSE(batteryManager->isAtRest());
+
+    host::advanceMs(10 * 1000);
+    deliverSample(0);
+    TEST_ASSERT_TRUE(batteryManager->isAtRest());
+    TEST_ASSERT_EQUAL(50, batteryManager->getSOC());
+}
+
+void test_load_keeps_last_rest_soc(void)
+{
+    deliverSample(0);
+    host::advanceMs(BatteryManager::REST_TIME_MS);
+    deliverSample(0, 3300);
+    TEST_ASSERT_EQUAL(70, batteryManager->getSOC());
+
+    // Under load the OCV is off, the SOC stays at the last rest value and the timer restarts
+    deliverSample(BatteryManager::REST_CURRENT_THRESHOLD + 1, 3400);
+    TEST_ASSERT_FALSE(batteryManager->isAtRest());
+    TEST_ASSERT_EQUAL(70, batteryManager->getSOC());
+    deliverSample(0, 3400);
+    TEST_ASSERT_FALSE(batteryManager->isAtRest());
+    TEST_ASSERT_EQUAL(70, batteryManager->getSOC());
+}
+
+void test_coldest_sensor_counts(void)
+{
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        data.cellVoltages[i] = 3260;
+    }
+    data.temperatures[0] = 250;
+    data.temperatures[1] = 50;
+    for (int i = 0; i < 2; ++i)
+    {
+        batteryManager->doPolling();
+        TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, data));
+        host::advanceMs(BatteryManager::REST_TIME_MS);
+    }
+    TEST_ASSERT_EQUAL(53, batteryManager->getSOC());
+}
+
+// Host CPU time, so only the ratio means something: on the C3 the float path is soft-float
+// library calls and the gap is much wider than here
+void test_benchmark(void)
+{
+    constexpr int ROUNDS = 200;
+    volatile int64_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (uint16_t mv = 2400; mv <= 3700; ++mv)
+        {
+            sink += LiFePO4Soc::socPermille(mv, (int16_t)(round - 100));
+        }
+    }
+    const double intNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (ROUNDS * 1301);
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (uint16_t mv = 2400; mv <= 3700; ++mv)
+        {
+            sink += (int64_t)(socPercentFloat(mv / 1000.0f, (round - 100) / 10.0f) * 10.0f);
+        }
+    }
+    const double floatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (ROUNDS * 1301);
+
+    char report[120];
+    snprintf(report, sizeof(report), "SOC lookup: integer %.1f ns, float %.1f ns", intNs, floatNs);
+    TEST_MESSAGE(report);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_table_ends);
+    RUN_TEST(test_every_table_point);
+    RUN_TEST(test_monotonic);
+    RUN_TEST(test_against_float);
+    RUN_TEST(test_temperature_correction);
+    RUN_TEST(test_unknown_until_rest);
+    RUN_TEST(test_load_keeps_last_rest_soc);
+    RUN_TEST(test_coldest_sensor_counts);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
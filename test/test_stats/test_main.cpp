@@ -0,0 +1,293 @@
+// test_main.cpp
+// SlidingWindow against a brute force reference, its locking, and what it costs per sample.
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "SlidingWindowStats.h"
+
+static constexpr int BUCKETS = 12;
+static constexpr uint32_t WINDOW_MS = 60 * 1000;
+static constexpr uint32_t BUCKET_MS = WINDOW_MS / BUCKETS;
+
+struct Sample
+{
+    int32_t value;
+    uint32_t bucket; // time slice since the first sample
+};
+
+// What the window should hold: every sample of the current slice and the BUCKETS - 1 before it
+static WindowStats reference(const std::vector<Sample> &samples)
+{
+    WindowStats stats;
+    if (samples.empty())
+    {
+        return stats;
+    }
+    const uint32_t head = samples.back().bucket;
+    for (const Sample &sample : samples)
+    {
+        if (sample.bucket + BUCKETS <= head)
+        {
+            continue;
+        }
+        stats.min = stats.count ? std::min(stats.min, sample.value) : sample.value;
+        stats.max = stats.count ? std::max(stats.max, sample.value) : sample.value;
+        stats.count++;
+        stats.sum += sample.value;
+        stats.sumSq += (int64_t)sample.value * sample.value;
+    }
+    return stats;
+}
+
+static void assertSame(const WindowStats &expected, const WindowStats &actual)
+{
+    TEST_ASSERT_EQUAL_UINT32(expected.count, actual.count);
+    TEST_ASSERT_EQUAL_INT64(expected.sum, actual.sum);
+    TEST_ASSERT_EQUAL_INT64(expected.sumSq, actual.sumSq);
+    if (expected.count > 0)
+    {
+        TEST_ASSERT_EQUAL_INT32(expected.min, actual.min);
+        TEST_ASSERT_EQUAL_INT32(expected.max, actual.max);
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_empty(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    const WindowStats stats = window.get();
+    TEST_ASSERT_EQUAL_UINT32(0, stats.count);
+    TEST_ASSERT_EQUAL_INT32(0, stats.mean().raw);
+    TEST_ASSERT_EQUAL_INT32(0, stats.stddev().raw);
+}
+
+void test_mean_and_stddev(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    // 2, 4, 4, 4, 5, 5, 7, 9: mean 5, population stddev 2
+    const int32_t values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    uint32_t nowMs = 1000;
+    for (int32_t value : values)
+    {
+        window.add(value, nowMs);
+        nowMs += 1000;
+    }
+    const WindowStats stats = window.get();
+    TEST_ASSERT_EQUAL_UINT32(8, stats.count);
+    TEST_ASSERT_EQUAL_INT32(2, stats.min);
+    TEST_ASSERT_EQUAL_INT32(9, stats.max);
+    TEST_ASSERT_EQUAL_INT32(50, stats.mean().raw);
+    TEST_ASSERT_EQUAL_INT32(1, stats.mean().decimals);
+    TEST_ASSERT_EQUAL_INT32(20, stats.stddev().raw);
+}
+
+void test_negative_mean_rounds_away_from_zero(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    window.add(-1, 0);
+    window.add(-2, 10);
+    window.add(-2, 20);
+    // -5/3 = -1.67
+    TEST_ASSERT_EQUAL_INT32(-17, window.get().mean().raw);
+}
+
+void test_min_max_slide_out(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    window.add(100, 0);             // slice 0, the maximum
+    window.add(-100, BUCKET_MS);    // slice 1, the minimum
+    window.add(5, 5 * BUCKET_MS);
+    TEST_ASSERT_EQUAL_INT32(100, window.get().max);
+    TEST_ASSERT_EQUAL_INT32(-100, window.get().min);
+
+    // Slice 12 pushes slice 0 out, slice 13 slice 1
+    window.add(6, 12 * BUCKET_MS);
+    TEST_ASSERT_EQUAL_INT32(6, window.get().max);
+    TEST_ASSERT_EQUAL_INT32(-100, window.get().min);
+    window.add(7, 13 * BUCKET_MS);
+    TEST_ASSERT_EQUAL_INT32(7, window.get().max);
+    TEST_ASSERT_EQUAL_INT32(5, window.get().min);
+    TEST_ASSERT_EQUAL_UINT32(3, window.get().count);
+}
+
+void test_whole_window_expires(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    window.add(10, 0);
+    window.add(20, 1000);
+    window.add(30, 1000 + WINDOW_MS);
+    const WindowStats stats = window.get();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.count);
+    TEST_ASSERT_EQUAL_INT32(30, stats.min);
+    TEST_ASSERT_EQUAL_INT32(30, stats.max);
+}
+
+void test_millis_wrap(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    const uint32_t start = UINT32_MAX - 2 * BUCKET_MS;
+    window.add(1, start);
+    window.add(2, start + 4 * BUCKET_MS); // past the wrap
+    TEST_ASSERT_EQUAL_UINT32(2, window.get().count);
+    window.add(3, start + 12 * BUCKET_MS);
+    TEST_ASSERT_EQUAL_UINT32(2, window.get().count);
+    TEST_ASSERT_EQUAL_INT32(2, window.get().min);
+}
+
+void test_random_against_reference(void)
+{
+    std::mt19937 random(27);
+    for (int round = 0; round < 20; ++round)
+    {
+        SlidingWindow<BUCKETS> window(WINDOW_MS);
+        std::vector<Sample> samples;
+        // Slices start at the first sample, which may be anywhere, also just before the wrap
+        const uint32_t startMs = random();
+        uint32_t offsetMs = 0;
+        for (int i = 0; i < 2000; ++i)
+        {
+            const int32_t value = (int32_t)(random() % 20001) - 10000;
+            window.add(value, startMs + offsetMs);
+            samples.push_back({value, offsetMs / BUCKET_MS});
+            assertSame(reference(samples), window.get());
+            // Mostly the 10 s poll rate with jitter, sometimes a gap of a few slices
+            offsetMs += random() % 8 == 0 ? random() % (6 * BUCKET_MS) : 9000 + random() % 2000;
+        }
+    }
+}
+
+// A reader never sees half of an add(): the sums and min/max it gets belong together
+void test_concurrent_get(void)
+{
+    SlidingWindow<BUCKETS> window(WINDOW_MS);
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> reads{0};
+    std::atomic<uint32_t> inconsistent{0};
+    auto reader = [&]()
+    {
+        while (!done)
+        {
+            const WindowStats stats = window.get();
+            // Samples alternate between 7 and 9, starting with 7, so each count has one sum
+            const int64_t nines = stats.count / 2;
+            if (stats.count > 0 && (stats.sum != 7 * (int64_t)(stats.count - nines) + 9 * nines || stats.min != 7 || stats.max != (stats.count > 1 ? 9 : 7)))
+            {
+                inconsistent++;
+            }
+            reads++;
+        }
+    };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i)
+    {
+        readers.emplace_back(reader);
+    }
+    for (uint32_t i = 0; i < 1000000; ++i)
+    {
+        // A new window every 1000 samples, all in its first slice
+        window.add(i % 2 ? 9 : 7, (i / 1000) * WINDOW_MS);
+    }
+    done = true;
+    for (std::thread &thread : readers)
+    {
+        thread.join();
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(0, reads.load());
+    TEST_ASSERT_EQUAL_UINT32(0, inconsistent.load());
+}
+
+// ns per add() at the 10 s poll rate over many lengths of the window, best of a few runs
+// so a descheduled run does not count, host CPU time
+template <int WINDOW_BUCKETS>
+static double addCostNs(uint32_t windowMs)
+{
+    constexpr int SAMPLES = 100000;
+    double best = 0;
+    for (int run = 0; run < 5; ++run)
+    {
+        SlidingWindow<WINDOW_BUCKETS> window(windowMs);
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < SAMPLES; ++i)
+        {
+            window.add(i % 1000, (uint32_t)i * 10000);
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SAMPLES;
+        best = run == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+// The windows of BatteryStats hold 6 to 8640 samples, add() must cost the same for all of
+// them. For scale, recomputing the stats from the samples of the 1 h window.
+void test_benchmark(void)
+{
+    const double min1Ns = addCostNs<12>(60UL * 1000);
+    const double min15Ns = addCostNs<15>(15UL * 60 * 1000);
+    const double hour1Ns = addCostNs<12>(60UL * 60 * 1000);
+    const double hour24Ns = addCostNs<24>(24UL * 60 * 60 * 1000);
+
+    constexpr int SAMPLES = 20000;
+    constexpr size_t RAW_WINDOW = 360;
+    std::vector<int32_t> raw;
+    raw.reserve(RAW_WINDOW);
+    volatile int64_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        if (raw.size() == RAW_WINDOW)
+        {
+            raw.erase(raw.begin());
+        }
+        raw.push_back(i % 1000);
+        WindowStats stats;
+        stats.min = raw[0];
+        stats.max = raw[0];
+        for (int32_t value : raw)
+        {
+            stats.min = std::min(stats.min, value);
+            stats.max = std::max(stats.max, value);
+            stats.count++;
+            stats.sum += value;
+            stats.sumSq += (int64_t)value * value;
+        }
+        sink += stats.sum;
+    }
+    const double rawNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SAMPLES;
+
+    char report[200];
+    snprintf(report, sizeof(report), "add(): 1 min %.1f ns, 15 min %.1f ns, 1 h %.1f ns, 24 h %.1f ns; recompute over %zu samples %.0f ns",
+             min1Ns, min15Ns, hour1Ns, hour24Ns, RAW_WINDOW, rawNs);
+    TEST_MESSAGE(report);
+
+    // Flat: 1440 times the samples of the 1 min window may not cost more than a small
+    // factor, which leaves room for timing noise
+    constexpr double MAX_FACTOR = 3.0;
+    TEST_ASSERT_TRUE_MESSAGE(min15Ns <= MAX_FACTOR * min1Ns, report);
+    TEST_ASSERT_TRUE_MESSAGE(hour1Ns <= MAX_FACTOR * min1Ns, report);
+    TEST_ASSERT_TRUE_MESSAGE(hour24Ns <= MAX_FACTOR * min1Ns, report);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_mean_and_stddev);
+    RUN_TEST(test_negative_mean_rounds_away_from_zero);
+    RUN_TEST(test_min_max_slide_out);
+    RUN_TEST(test_whole_window_expires);
+    RUN_TEST(test_millis_wrap);
+    RUN_TEST(test_random_against_reference);
+    RUN_TEST(test_concurrent_get);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
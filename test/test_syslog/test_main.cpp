@@ -0,0 +1,296 @@
+// test_main.cpp
+// SyslogSink: the RFC 5424 framing of single messages, and what a collector listening on
+// localhost receives: one message per datagram, the rate limit, and the note about
+// records lost while WiFi was down.
+#include <unity.h>
+#include <HostStubs.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <regex>
+#include <string>
+#include <vector>
+#include "Clock.h"
+#include "SyslogSink.h"
+
+// RFC 5424 section 6 as far as the sink uses it: PRI, VERSION, TIMESTAMP (NILVALUE or UTC
+// with milliseconds), HOSTNAME, APP-NAME, NILVALUE PROCID and MSGID, one SD-ELEMENT, MSG
+static const std::regex RFC5424(R"re(<([0-9]{1,3})>1 (-|[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9]{2}:[0-9]{2}:[0-9]{2}\.[0-9]{3}Z) )re"
+                                R"re(([!-~]{1,255}) ([!-~]{1,48}) - - \[meta sequenceId="([0-9]+)" sysUpTime="([0-9]+)"\] (.*))re");
+
+static LogRecord record(uint32_t seq, uint32_t timestamp, LogLevel level, const char *message)
+{
+    LogRecord r;
+    r.seq = seq;
+    r.timestamp = timestamp;
+    r.level = (uint8_t)level;
+    strncpy(r.message, message, sizeof(r.message) - 1);
+    r.message[sizeof(r.message) - 1] = '\0';
+    return r;
+}
+
+static std::string format(const LogRecord &r, uint64_t nowEpochMs = 0, uint32_t nowMs = 0)
+{
+    char out[256];
+    const size_t len = SyslogSink::format(r, "van", nowEpochMs, nowMs, out, sizeof(out));
+    TEST_ASSERT_EQUAL_size_t(strlen(out), len);
+    return out;
+}
+
+// A collector on a free localhost port
+class Collector
+{
+public:
+    Collector()
+    {
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(m_socket, (struct sockaddr *)&address, sizeof(address));
+        socklen_t len = sizeof(address);
+        getsockname(m_socket, (struct sockaddr *)&address, &len);
+        m_port = ntohs(address.sin_port);
+        struct timeval timeout = {0, 200 * 1000};
+        setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    ~Collector() { close(m_socket); }
+
+    uint16_t getPort() const { return m_port; }
+
+    // Every datagram that arrives until none came for 200 ms
+    std::vector<std::string> receive()
+    {
+        std::vector<std::string> datagrams;
+        char buf[2048];
+        ssize_t len;
+        while ((len = recv(m_socket, buf, sizeof(buf), 0)) >= 0)
+        {
+            datagrams.emplace_back(buf, len);
+        }
+        return datagrams;
+    }
+
+private:
+    int m_socket;
+    uint16_t m_port;
+};
+
+// The datagrams with text in their message
+static std::vector<std::string> containing(const std::vector<std::string> &datagrams, const char *text)
+{
+    std::vector<std::string> found;
+    for (const std::string &datagram : datagrams)
+    {
+        if (datagram.find(text) != std::string::npos)
+        {
+            found.push_back(datagram);
+        }
+    }
+    return found;
+}
+
+void setUp(void)
+{
+    host::setWiFiConnected(true);
+    host::setWallClock(0);
+    host::advanceMs(60 * 1000);
+}
+
+void tearDown(void)
+{
+}
+
+void test_format_unsynced(void)
+{
+    const std::string message = format(record(41, 12345, LogLevel::INFO, "[BLE] Connected"), 0, 20000);
+    TEST_ASSERT_EQUAL_STRING("<134>1 - van bluefigate - - [meta sequenceId=\"42\" sysUpTime=\"1234\"] [BLE] Connected",
+                             message.c_str());
+}
+
+// The timestamp is when the record was written, not when it is sent
+void test_format_synced(void)
+{
+    const std::string message = format(record(0, 9000, LogLevel::WARNING, "late"), 1700000000123ull, 10000);
+    TEST_ASSERT_EQUAL_STRING("<132>1 2023-11-14T22:13:19.123Z van bluefigate - - [meta sequenceId=\"1\" sysUpTime=\"900\"] late",
+                             message.c_str());
+}
+
+void test_severities(void)
+{
+    const struct
+    {
+        LogLevel level;
+        int pri;
+    } cases[] = {
+        {LogLevel::DEBUG, 16 * 8 + 7},
+        {LogLevel::INFO, 16 * 8 + 6},
+        {LogLevel::WARNING, 16 * 8 + 4},
+        {LogLevel::ERROR, 16 * 8 + 3},
+        {LogLevel::CRITICAL, 16 * 8 + 2},
+    };
+    for (const auto &c : cases)
+    {
+        const std::string message = format(record(0, 0, c.level, "x"));
+        std::smatch match;
+        TEST_ASSERT_TRUE(std::regex_match(message, match, RFC5424));
+        TEST_ASSERT_EQUAL(c.pri, std::stoi(match[1]));
+    }
+}
+
+// sequenceId runs from 1 to 2147483647 and starts over
+void test_sequence_id_range(void)
+{
+    TEST_ASSERT_TRUE(format(record(2147483645u, 0, LogLevel::INFO, "x")).find("sequenceId=\"2147483646\"") != std::string::npos);
+    TEST_ASSERT_TRUE(format(record(2147483646u, 0, LogLevel::INFO, "x")).find("sequenceId=\"2147483647\"") != std::string::npos);
+    TEST_ASSERT_TRUE(format(record(2147483647u, 0, LogLevel::INFO, "x")).find("sequenceId=\"1\"") != std::string::npos);
+    TEST_ASSERT_TRUE(format(record(UINT32_MAX, 0, LogLevel::INFO, "x")).find("sequenceId=\"2\"") != std::string::npos);
+}
+
+void test_format_truncates(void)
+{
+    const LogRecord r = record(0, 0, LogLevel::INFO, "a message that does not fit");
+    char out[40];
+    memset(out, 'x', sizeof(out));
+    TEST_ASSERT_EQUAL_size_t(31, SyslogSink::format(r, "van", 0, 0, out, 32));
+    TEST_ASSERT_EQUAL_CHAR('\0', out[31]);
+    TEST_ASSERT_EQUAL_CHAR('x', out[32]);
+}
+
+// Each record arrives as one datagram, well formed, in order
+void test_collector_receives(void)
+{
+    Collector collector;
+    SyslogSink sink;
+    sink.begin("127.0.0.1", collector.getPort());
+    for (int i = 0; i < 5; ++i)
+    {
+        LOG_WARN(WIFI, "collector test %d", i);
+    }
+    // Nothing before the flush interval is up
+    sink.loop();
+    TEST_ASSERT_EQUAL(0, collector.receive().size());
+
+    host::advanceMs(1000);
+    sink.loop();
+    const std::vector<std::string> datagrams = collector.receive();
+    TEST_ASSERT_EQUAL(sink.getSent(), datagrams.size());
+    TEST_ASSERT_EQUAL(1, containing(datagrams, "Sending logs to syslog at 127.0.0.1").size());
+
+    const std::vector<std::string> ours = containing(datagrams, "collector test");
+    TEST_ASSERT_EQUAL(5, ours.size());
+    uint32_t previousId = 0;
+    for (size_t i = 0; i < ours.size(); ++i)
+    {
+        std::smatch match;
+        TEST_ASSERT_TRUE(std::regex_match(ours[i], match, RFC5424));
+        TEST_ASSERT_EQUAL(16 * 8 + 4, std::stoi(match[1]));
+        const std::string timestamp = match[2];
+        const std::string hostname = match[3];
+        TEST_ASSERT_EQUAL_STRING("-", timestamp.c_str());
+        TEST_ASSERT_EQUAL_STRING("bluefigate", hostname.c_str());
+        const uint32_t id = std::stoul(match[5]);
+        TEST_ASSERT_TRUE(i == 0 || id == previousId + 1);
+        previousId = id;
+        const std::string expected = "[WIFI] collector test " + std::to_string(i);
+        const std::string message = match[7];
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), message.c_str());
+    }
+}
+
+// Once the clock is synced messages carry their UTC time
+void test_collector_timestamps(void)
+{
+    Collector collector;
+    SyslogSink sink;
+    host::setWallClock(1700000000000000ll);
+    Clock::updateWallClock();
+    sink.begin("127.0.0.1", collector.getPort());
+    LOG_WARN(WIFI, "timestamp test");
+    host::advanceMs(1000);
+    sink.loop();
+    const std::vector<std::string> ours = containing(collector.receive(), "timestamp test");
+    TEST_ASSERT_EQUAL(1, ours.size());
+    std::smatch match;
+    TEST_ASSERT_TRUE(std::regex_match(ours[0], match, RFC5424));
+    const std::string timestamp = match[2];
+    TEST_ASSERT_EQUAL_STRING("2023-11-14T22:13:20.000Z", timestamp.c_str());
+}
+
+// Twice SYSLOG_MAX_RATE in a burst, the rest follows at SYSLOG_MAX_RATE per second
+void test_rate_limit(void)
+{
+    Collector collector;
+    SyslogSink sink;
+    sink.begin("127.0.0.1", collector.getPort());
+    host::advanceMs(1000);
+    sink.loop();
+    collector.receive();
+    const uint32_t sentBefore = sink.getSent();
+
+    for (int i = 0; i < 3 * SYSLOG_MAX_RATE; ++i)
+    {
+        LOG_WARN(WIFI, "burst %d", i);
+    }
+    host::advanceMs(1000);
+    sink.loop();
+    TEST_ASSERT_EQUAL(2 * SYSLOG_MAX_RATE, containing(collector.receive(), "burst").size());
+    host::advanceMs(1000);
+    sink.loop();
+    TEST_ASSERT_EQUAL(SYSLOG_MAX_RATE, containing(collector.receive(), "burst").size());
+    TEST_ASSERT_EQUAL_UINT32(sentBefore + 3 * SYSLOG_MAX_RATE, sink.getSent());
+    TEST_ASSERT_EQUAL_UINT32(0, sink.getLost());
+}
+
+// Nothing goes out without WiFi; what the ring overwrote meanwhile is reported first
+void test_lost_while_offline(void)
+{
+    Collector collector;
+    SyslogSink sink;
+    sink.begin("127.0.0.1", collector.getPort());
+    host::advanceMs(1000);
+    sink.loop();
+    collector.receive();
+
+    host::setWiFiConnected(false);
+    for (int i = 0; i < LOG_RING_SIZE + 10; ++i)
+    {
+        LOG_WARN(WIFI, "offline %d", i);
+    }
+    host::advanceMs(1000);
+    sink.loop();
+    TEST_ASSERT_EQUAL(0, collector.receive().size());
+
+    host::setWiFiConnected(true);
+    host::advanceMs(1000);
+    sink.loop();
+    const std::vector<std::string> datagrams = collector.receive();
+    TEST_ASSERT_TRUE(datagrams.size() > 0);
+    std::smatch match;
+    TEST_ASSERT_TRUE(std::regex_match(datagrams[0], match, RFC5424));
+    TEST_ASSERT_EQUAL(16 * 8 + 4, std::stoi(match[1]));
+    TEST_ASSERT_TRUE(sink.getLost() >= 10);
+    const std::string expected = std::to_string(sink.getLost()) + " log records lost while offline or rate limited";
+    const std::string message = match[7];
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), message.c_str());
+
+    // After the note come the oldest records still in the ring
+    TEST_ASSERT_TRUE(datagrams[1].find("offline") != std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_format_unsynced);
+    RUN_TEST(test_format_synced);
+    RUN_TEST(test_severities);
+    RUN_TEST(test_sequence_id_range);
+    RUN_TEST(test_format_truncates);
+    RUN_TEST(test_collector_receives);
+    RUN_TEST(test_collector_timestamps);
+    RUN_TEST(test_rate_limit);
+    RUN_TEST(test_lost_while_offline);
+    return UNITY_END();
+}
@@ -0,0 +1,667 @@
+// test_main.cpp
+// The web server's handlers against the mock AsyncWebServer of HostStubs, with samples
+// delivered through the fake BLEManager.
+#include <unity.h>
+#include <HostBLE.h>
+#include <HostWeb.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <vector>
+#include "BatteryManager.h"
+#include "BootPhases.h"
+#include "Clock.h"
+#include "CrashStore.h"
+#include "OtherFunctions.h"
+#include "VanControlWebServer.h"
+
+// Heap allocations of the whole process, for the allocations per request of the load report
+static std::atomic<uint64_t> s_allocations{0};
+
+// Every form of new and delete, all on malloc and free, so no pair is mismatched
+static void *allocate(size_t size)
+{
+    s_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static std::unique_ptr<BLEManager> bleManager;
+static std::unique_ptr<BatteryManager> batteryManager;
+static std::unique_ptr<VanControlWebServer> webServer;
+
+static TDTBMSData makeSample(uint16_t voltage = 1325, int16_t current = -52)
+{
+    TDTBMSData data;
+    data.cellCount = 4;
+    data.tempSensorCount = 2;
+    data.cellVoltages[0] = 3312;
+    data.cellVoltages[1] = 3313;
+    data.cellVoltages[2] = 3311;
+    data.cellVoltages[3] = 3314;
+    data.temperatures[0] = 215;
+    data.temperatures[1] = 198;
+    data.voltage = voltage;
+    data.current = current;
+    data.cycleCharge = 2500;
+    data.batteryLevel = 87;
+    data.cycles = 42;
+    data.problemCode = 0;
+    return data;
+}
+
+static void deliverSample(const TDTBMSData &data = makeSample())
+{
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, data));
+}
+
+static bool contains(const std::string &text, const char *part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+void setUp(void)
+{
+    host::advanceMs(60 * 1000); // refills every client's token bucket
+    host::setHeap(200 * 1024, 100 * 1024);
+    host::clearPreferences();
+    bleManager = std::make_unique<BLEManager>();
+    batteryManager = std::make_unique<BatteryManager>(*bleManager);
+    batteryManager->init();
+    webServer = std::make_unique<VanControlWebServer>(batteryManager.get());
+    webServer->start();
+}
+
+void tearDown(void)
+{
+    webServer.reset();
+    batteryManager.reset();
+    bleManager.reset();
+}
+
+void test_battery_json_without_sample(void)
+{
+    const HostResponse response = hostGet("/battery.json");
+    TEST_ASSERT_EQUAL(500, response.code);
+    TEST_ASSERT_EQUAL_STRING("Error: No status available\n", response.body.c_str());
+}
+
+void test_battery_json_fields(void)
+{
+    deliverSample();
+    const HostResponse response = hostGet("/battery.json");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("text/plain", response.contentType.c_str());
+    // Time prefix, the clock is not synced
+    TEST_ASSERT_EQUAL_STRING_LEN("0|0|{", response.body.c_str(), 5);
+    TEST_ASSERT_TRUE(contains(response.body, "\"version\":1"));
+    TEST_ASSERT_TRUE(contains(response.body, "\"voltage\":1325"));
+    TEST_ASSERT_TRUE(contains(response.body, "\"current\":-52"));
+    TEST_ASSERT_TRUE(contains(response.body, "\"batteryLevel\":87"));
+    TEST_ASSERT_TRUE(contains(response.body, "\"cellVoltages\":[3312,3313,3311,3314]"));
+    TEST_ASSERT_TRUE(contains(response.body, "\"temperatures\":[215,198]"));
+    TEST_ASSERT_NOT_NULL(response.header("ETag"));
+    TEST_ASSERT_NOT_NULL(response.header("Cache-Control"));
+}
+
+void test_battery_json_etag_revalidation(void)
+{
+    deliverSample();
+    const HostResponse first = hostGet("/battery.json");
+    TEST_ASSERT_NOT_NULL(first.header("ETag"));
+    const std::string etag = first.header("ETag");
+
+    const HostResponse unchanged = hostGet("/battery.json", {{"If-None-Match", etag.c_str()}});
+    TEST_ASSERT_EQUAL(304, unchanged.code);
+    TEST_ASSERT_EQUAL(0, unchanged.body.size());
+    TEST_ASSERT_EQUAL_STRING(etag.c_str(), unchanged.header("ETag"));
+
+    deliverSample(makeSample(1330));
+    const HostResponse changed = hostGet("/battery.json", {{"If-None-Match", etag.c_str()}});
+    TEST_ASSERT_EQUAL(200, changed.code);
+    TEST_ASSERT_TRUE(contains(changed.body, "\"voltage\":1330"));
+    TEST_ASSERT_TRUE(etag != changed.header("ETag"));
+}
+
+void test_battery_json_projection_and_delta(void)
+{
+    deliverSample();
+    const HostResponse projected = hostGet("/battery.json?fields=soc,current");
+    TEST_ASSERT_EQUAL(200, projected.code);
+    TEST_ASSERT_TRUE(contains(projected.body, "\"batteryLevel\":87"));
+    TEST_ASSERT_TRUE(contains(projected.body, "\"current\":-52"));
+    TEST_ASSERT_FALSE(contains(projected.body, "\"voltage\""));
+
+    TEST_ASSERT_EQUAL(400, hostGet("/battery.json?fields=bogus").code);
+
+    // Only the voltage changes in the second sample
+    deliverSample(makeSample(1330));
+    const HostResponse delta = hostGet("/battery.json?since=1");
+    TEST_ASSERT_EQUAL(200, delta.code);
+    TEST_ASSERT_TRUE(contains(delta.body, "\"voltage\":1330"));
+    TEST_ASSERT_FALSE(contains(delta.body, "\"current\""));
+    TEST_ASSERT_EQUAL(304, hostGet("/battery.json?since=2").code);
+
+    // A version from before a reboot is ahead of the counter, that client gets everything
+    const HostResponse ahead = hostGet("/battery.json?since=1000");
+    TEST_ASSERT_EQUAL(200, ahead.code);
+    TEST_ASSERT_TRUE(contains(ahead.body, "\"voltage\":1330"));
+    TEST_ASSERT_TRUE(contains(ahead.body, "\"current\":-52"));
+    TEST_ASSERT_TRUE(contains(ahead.body, "\"cellVoltages\""));
+}
+
+void test_battery_cbor(void)
+{
+    deliverSample();
+    const HostResponse response = hostGet("/battery.cbor");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("application/cbor", response.contentType.c_str());
+
+    const uint8_t expected[] = {
+        0xae,                   // map of 14
+        0x00, 0x01,             // schema 1
+        0x01, 0x00,             // sample time, clock not synced
+        0x02, 0x00,             // age 0 ms
+        0x03, 0x01,             // version 1
+        0x04, 0x19, 0x05, 0x2d, // voltage 1325
+        0x05, 0x38, 0x33,       // current -52
+        0x06, 0x18, 0x57,       // battery level 87
+        0x07, 0x19, 0x09, 0xc4, // cycle charge 2500
+        0x08, 0x18, 0x2a,       // cycles 42
+        0x09, 0x00,             // problem code 0
+        0x0a, 0x84, 0x19, 0x0c, 0xf0, 0x19, 0x0c, 0xf1, 0x19, 0x0c, 0xef, 0x19, 0x0c, 0xf2,
+        0x0b, 0x82, 0x18, 0xd7, 0x18, 0xc6,
+        0x0c, 0x20, // voltage SOC -1, not at rest
+        0x0d, 0xf4, // at rest false
+    };
+    TEST_ASSERT_EQUAL(sizeof(expected), response.body.size());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, (const uint8_t *)response.body.data(), sizeof(expected));
+}
+
+void test_metrics(void)
+{
+    deliverSample();
+    const HostResponse response = hostGet("/metrics");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("text/plain; version=0.0.4", response.contentType.c_str());
+    TEST_ASSERT_TRUE(contains(response.body, "# HELP bluefigate_battery_voltage_volts Pack voltage.\n"
+                                             "# TYPE bluefigate_battery_voltage_volts gauge\n"
+                                             "bluefigate_battery_voltage_volts 13.25\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_battery_current_amperes -5.2\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_battery_cell_voltage_volts{cell=\"4\"} 3.314\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_battery_samples_total 1\n"));
+    // The host heap does not move, so no response has lowered it
+    TEST_ASSERT_TRUE(contains(response.body, "# TYPE bluefigate_web_stream_heap_drop_bytes gauge\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_web_stream_heap_drop_bytes{endpoint=\"battery\"} 0\n"));
+}
+
+void test_metrics_without_sample(void)
+{
+    const HostResponse response = hostGet("/metrics");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_FALSE(contains(response.body, "bluefigate_battery_voltage_volts"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_battery_samples_total 0\n"));
+}
+
+// Every line of /metrics is valid exposition format: HELP and TYPE once per family, right
+// before its samples. With the longest values every series can have, so a step that does not
+// fit its scratch buffer shows up as a cut line.
+void test_metrics_format(void)
+{
+    TDTBMSData data = makeSample(65535, -32768);
+    data.tempSensorCount = 4;
+    for (int i = 0; i < 4; ++i)
+    {
+        data.temperatures[i] = -400;
+    }
+    data.cycleCharge = 65535;
+    data.cycles = 65535;
+    data.problemCode = 65535;
+    host::setWallClock(1700000000LL * 1000000);
+    Clock::updateWallClock();
+    for (int i = 0; i < (int)BootPhase::COUNT; ++i)
+    {
+        BootPhases::mark((BootPhase)i);
+    }
+    batteryManager->doPolling();
+    TEST_ASSERT_TRUE(host::deliverBmsSample(*bleManager, data, Clock::nowMs() - 1234));
+    for (uint32_t i = 0; i < AdmissionControl::BUCKET_CAPACITY + 1; ++i)
+    {
+        hostGet("/battery", {}, IPAddress(192, 168, 1, 60));
+    }
+    hostGet("/metrics", {}, IPAddress(192, 168, 1, 61));
+
+    const HostResponse response = hostGet("/metrics", {}, IPAddress(192, 168, 1, 62));
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_TRUE(!response.body.empty() && response.body.back() == '\n');
+
+    const std::regex help("# HELP ([a-z_]+) [^\n]+");
+    const std::regex type("# TYPE ([a-z_]+) (gauge|counter)");
+    const std::regex sample("([a-z_]+)(\\{[a-z_]+=\"[a-z_.0-9]+\"\\})? -?[0-9]+(\\.[0-9]+)?");
+    std::istringstream lines(response.body);
+    std::string line;
+    std::string helpName;
+    std::string family;
+    std::set<std::string> families;
+    int samples = 0;
+    while (std::getline(lines, line))
+    {
+        std::smatch match;
+        if (std::regex_match(line, match, help))
+        {
+            TEST_ASSERT_TRUE_MESSAGE(helpName.empty(), line.c_str());
+            helpName = match[1];
+        }
+        else if (std::regex_match(line, match, type))
+        {
+            TEST_ASSERT_TRUE_MESSAGE(match[1] == helpName, line.c_str());
+            TEST_ASSERT_TRUE_MESSAGE(families.insert(helpName).second, line.c_str());
+            family = helpName;
+            helpName.clear();
+        }
+        else
+        {
+            TEST_ASSERT_TRUE_MESSAGE(std::regex_match(line, match, sample), line.c_str());
+            TEST_ASSERT_TRUE_MESSAGE(helpName.empty() && match[1] == family, line.c_str());
+            samples++;
+        }
+    }
+    TEST_ASSERT_TRUE(helpName.empty());
+
+    // The steps that come closest to the scratch buffer are all there
+    const char *expected[] = {"bluefigate_battery_temperature_celsius", "bluefigate_battery_cycle_charge_ampere_hours", "bluefigate_heap_max_alloc_bytes",
+                              "bluefigate_ble_reconnects_total", "bluefigate_web_stream_heap_drop_bytes", "bluefigate_web_admission_total",
+                              "bluefigate_clock_last_step_seconds", "bluefigate_poll_lateness_seconds", "bluefigate_boot_phase_seconds"};
+    for (const char *name : expected)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(families.count(name) == 1, name);
+    }
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_battery_temperature_celsius{sensor=\"4\"} -40.0\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_web_stream_heap_drop_bytes{endpoint=\"logs\"} 0\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_web_admission_total{result=\"rate_limited\"} 1\n"));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_poll_lateness_seconds{stat=\"max\"} "));
+    TEST_ASSERT_TRUE(contains(response.body, "bluefigate_boot_phase_seconds{phase=\"first_sample\"} "));
+    TEST_ASSERT_TRUE(samples > 50);
+}
+
+void test_not_found(void)
+{
+    const HostResponse response = hostGet("/nothing.json");
+    TEST_ASSERT_EQUAL(404, response.code);
+}
+
+void test_dashboard(void)
+{
+    const HostResponse response = hostGet("/");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("gzip", response.header("Content-Encoding"));
+    TEST_ASSERT_TRUE(response.body.size() > 2 && (uint8_t)response.body[0] == 0x1f && (uint8_t)response.body[1] == 0x8b);
+    TEST_ASSERT_NOT_NULL(response.header("ETag"));
+    // Revalidated on every load, or a browser keeps the page of the previous firmware
+    TEST_ASSERT_EQUAL_STRING("no-cache", response.header("Cache-Control"));
+
+    const HostResponse revalidated = hostGet("/", {{"If-None-Match", response.header("ETag")}});
+    TEST_ASSERT_EQUAL(304, revalidated.code);
+    TEST_ASSERT_EQUAL(0, revalidated.body.size());
+    TEST_ASSERT_EQUAL_STRING("no-cache", revalidated.header("Cache-Control"));
+}
+
+// Streamed one window per step
+void test_stats_json(void)
+{
+    const HostResponse empty = hostGet("/stats.json");
+    TEST_ASSERT_EQUAL(200, empty.code);
+    TEST_ASSERT_EQUAL_STRING("application/json", empty.contentType.c_str());
+    TEST_ASSERT_EQUAL(0, empty.body.find("{\"voltage\":{\"1m\":{\"count\":0},\"15m\":{\"count\":0},\"1h\":{\"count\":0},\"24h\":{\"count\":0}},\"current\":{"));
+
+    deliverSample(makeSample(1320, -50));
+    host::advanceMs(10 * 1000);
+    deliverSample(makeSample(1330, -40));
+    const HostResponse response = hostGet("/stats.json", {}, IPAddress(192, 168, 1, 10), 64);
+    TEST_ASSERT_EQUAL(200, response.code);
+    const char *window = "{\"count\":2,\"min\":-50,\"max\":-40,\"mean\":-45.0,\"stddev\":5.0}";
+    const std::string current = std::string("\"current\":{\"1m\":") + window + ",\"15m\":" + window + ",\"1h\":" + window + ",\"24h\":" + window + "}";
+    TEST_ASSERT_TRUE(contains(response.body, current.c_str()));
+    const std::string last = "\"24h\":{\"count\":2,\"min\":198,\"max\":198,\"mean\":198.0,\"stddev\":0.0}}}";
+    TEST_ASSERT_EQUAL(response.body.size() - last.size(), response.body.rfind(last));
+}
+
+// Streamed one entry per step, strings escaped as ArduinoJson did
+void test_crash_json(void)
+{
+    CrashStore::recover(ESP_RST_POWERON);
+    CrashStore::addLog(3, 1000, "said \"stop\" \\ twice\n\x01");
+    CrashStore::addLog(4, 2000, "second");
+    CrashStore::addSample(makeSample(1320, -52), 1500);
+    CrashStore::setRestartNote("No \"data\"");
+    CrashStore::recover(ESP_RST_PANIC);
+
+    const HostResponse response = hostGet("/crash.json", {}, IPAddress(192, 168, 1, 10), 64);
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_EQUAL_STRING("application/json", response.contentType.c_str());
+    const std::string expected = std::string("{\"resetReason\":\"") + getResetReasonString(ESP_RST_PANIC) +
+                                 "\",\"bootCount\":2,\"note\":\"No \\\"data\\\"\",\"damaged\":0,\"logs\":["
+                                 "{\"ms\":1000,\"level\":\"ERROR\",\"message\":\"said \\\"stop\\\" \\\\ twice\\n\\u0001\"},"
+                                 "{\"ms\":2000,\"level\":\"CRITICAL\",\"message\":\"second\"}],\"samples\":["
+                                 "{\"ms\":1500,\"time\":" + std::to_string(CrashStore::getRecoveredSamples()[0].epoch) + ",\"voltage\":1320,\"current\":-52,\"batteryLevel\":87,"
+                                 "\"minCellVoltage\":3311,\"maxCellVoltage\":3314,\"maxTemperature\":215,\"problemCode\":0}]}";
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), response.body.c_str());
+
+    CrashStore::recover(ESP_RST_POWERON);
+    const HostResponse empty = hostGet("/crash.json");
+    TEST_ASSERT_TRUE(contains(empty.body, "\"damaged\":0,\"logs\":[],\"samples\":[]}"));
+}
+
+void test_admission_rate_limit(void)
+{
+    deliverSample();
+    const IPAddress client(192, 168, 1, 50);
+    for (uint32_t i = 0; i < AdmissionControl::BUCKET_CAPACITY; ++i)
+    {
+        TEST_ASSERT_EQUAL(200, hostGet("/battery.json", {}, client).code);
+    }
+    const HostResponse limited = hostGet("/battery.json", {}, client);
+    TEST_ASSERT_EQUAL(429, limited.code);
+    TEST_ASSERT_NOT_NULL(limited.header("Retry-After"));
+
+    // Other clients have their own bucket, and this one gets a token back in 250 ms
+    TEST_ASSERT_EQUAL(200, hostGet("/battery.json", {}, IPAddress(192, 168, 1, 51)).code);
+    host::advanceMs(1000 / AdmissionControl::REFILL_PER_SECOND);
+    TEST_ASSERT_EQUAL(200, hostGet("/battery.json", {}, client).code);
+}
+
+void test_admission_low_heap(void)
+{
+    deliverSample();
+    host::setHeap(AdmissionControl::MIN_FREE_HEAP - 1, 100 * 1024);
+    const HostResponse busy = hostGet("/battery.json");
+    TEST_ASSERT_EQUAL(503, busy.code);
+    TEST_ASSERT_NOT_NULL(busy.header("Retry-After"));
+
+    host::setHeap(200 * 1024, AdmissionControl::MIN_LARGEST_BLOCK - 1);
+    TEST_ASSERT_EQUAL(503, hostGet("/battery.json").code);
+}
+
+void test_admission_in_flight(void)
+{
+    deliverSample();
+    AsyncWebServer *server = AsyncWebServer::running();
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> open;
+    for (uint8_t i = 0; i < AdmissionControl::MAX_IN_FLIGHT; ++i)
+    {
+        open.emplace_back(std::make_unique<AsyncWebServerRequest>("/battery.json", IPAddress(192, 168, 2, 10 + i)));
+        server->handle(open.back().get());
+        TEST_ASSERT_EQUAL(200, open.back()->response()->code());
+    }
+    TEST_ASSERT_EQUAL(503, hostGet("/battery.json", {}, IPAddress(192, 168, 2, 100)).code);
+
+    // The slot is given back when the request object goes away
+    open.pop_back();
+    TEST_ASSERT_EQUAL(200, hostGet("/battery.json", {}, IPAddress(192, 168, 2, 100)).code);
+}
+
+void test_long_poll(void)
+{
+    deliverSample();
+    AsyncWebServerRequest request("/battery.json?wait=5000&after=1");
+    AsyncWebServer::running()->handle(&request);
+    TEST_ASSERT_EQUAL(200, request.response()->code());
+    TEST_ASSERT_TRUE(request.response()->isChunked());
+    TEST_ASSERT_FALSE(request.transfer());
+    TEST_ASSERT_TRUE(request.wasTryAgain());
+
+    host::advanceMs(1000);
+    TEST_ASSERT_FALSE(request.transfer());
+    TEST_ASSERT_TRUE(request.wasTryAgain());
+
+    deliverSample(makeSample(1330));
+    while (!request.transfer())
+    {
+        TEST_ASSERT_FALSE(request.wasTryAgain());
+    }
+    TEST_ASSERT_TRUE(contains(request.body(), "\"version\":2"));
+    TEST_ASSERT_TRUE(contains(request.body(), "\"voltage\":1330"));
+}
+
+void test_long_poll_timeout(void)
+{
+    deliverSample();
+    const HostResponse response = hostGet("/battery.json?wait=2000");
+    TEST_ASSERT_EQUAL(200, response.code);
+    TEST_ASSERT_INT_WITHIN(500, 2000, response.waitMs);
+    // The current sample, the client sees the timeout by the version
+    TEST_ASSERT_TRUE(contains(response.body, "\"version\":1"));
+
+    TEST_ASSERT_EQUAL(400, hostGet("/battery.json?wait=abc").code);
+}
+
+void test_long_poll_parked_limit(void)
+{
+    deliverSample();
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> parked;
+    for (uint8_t i = 0; i < AdmissionControl::MAX_PARKED; ++i)
+    {
+        parked.emplace_back(std::make_unique<AsyncWebServerRequest>("/battery.json?wait=30000", IPAddress(192, 168, 3, 10 + i)));
+        AsyncWebServer::running()->handle(parked.back().get());
+        TEST_ASSERT_EQUAL(200, parked.back()->response()->code());
+    }
+    const HostResponse rejected = hostGet("/battery.json?wait=30000", {}, IPAddress(192, 168, 3, 100));
+    TEST_ASSERT_EQUAL(503, rejected.code);
+    TEST_ASSERT_EQUAL_STRING("1", rejected.header("Retry-After"));
+
+    // Parked requests leave every in-flight slot to the others, the last one to /metrics
+    AsyncWebServer *server = AsyncWebServer::running();
+    std::vector<std::unique_ptr<AsyncWebServerRequest>> open;
+    for (uint8_t i = 0; i < AdmissionControl::MAX_IN_FLIGHT - 1; ++i)
+    {
+        open.emplace_back(std::make_unique<AsyncWebServerRequest>("/", IPAddress(192, 168, 4, 10 + i)));
+        server->handle(open.back().get());
+        TEST_ASSERT_EQUAL(200, open.back()->response()->code());
+    }
+    const HostResponse metrics = hostGet("/metrics", {}, IPAddress(192, 168, 4, 99));
+    TEST_ASSERT_EQUAL(200, metrics.code);
+    const std::string parkedGauge = "bluefigate_web_parked_requests " + std::to_string(AdmissionControl::MAX_PARKED) + "\n";
+    TEST_ASSERT_TRUE(contains(metrics.body, parkedGauge.c_str()));
+    open.emplace_back(std::make_unique<AsyncWebServerRequest>("/", IPAddress(192, 168, 4, 99)));
+    server->handle(open.back().get());
+    TEST_ASSERT_EQUAL(503, hostGet("/battery.json", {}, IPAddress(192, 168, 4, 100)).code);
+    open.clear();
+
+    parked.clear();
+    TEST_ASSERT_EQUAL(200, hostGet("/battery.json?wait=0", {}, IPAddress(192, 168, 3, 100)).code);
+}
+
+// Headers go out before the wait is over, a wait that could end without any sample is
+// turned away up front
+void test_long_poll_without_sample(void)
+{
+    const HostResponse wait = hostGet("/battery.json?wait=2000");
+    TEST_ASSERT_EQUAL(503, wait.code);
+    TEST_ASSERT_EQUAL_STRING("10", wait.header("Retry-After"));
+    TEST_ASSERT_EQUAL(0, wait.waitMs);
+
+    const HostResponse fresh = hostGet("/battery.json?fresh");
+    TEST_ASSERT_EQUAL(503, fresh.code);
+    TEST_ASSERT_EQUAL_STRING("1", fresh.header("Retry-After"));
+}
+
+// Throughput, latency, bytes and allocations per request over a mix of the endpoints a
+// dashboard and a Prometheus scraper hit. Latencies are host CPU time, not ESP32 time, so
+// the numbers are for comparing changes, the test only fails on errors.
+void test_live_connect_gets_latest(void)
+{
+    deliverSample();
+    AsyncWebSocket *socket = AsyncWebServer::running()->getWebSocket("/live");
+    TEST_ASSERT_NOT_NULL(socket);
+    AsyncWebSocketClient *client = socket->connect();
+    TEST_ASSERT_EQUAL(1, client->getReceived().size());
+    TEST_ASSERT_TRUE(contains(client->getReceived()[0], "\"voltage\":1325"));
+
+    // The sample it got on connect is not published to it again
+    socket->pollAll();
+    TEST_ASSERT_EQUAL(1, client->getReceived().size());
+    socket->disconnect(client);
+}
+
+// New samples are stored by the loop task but sent from AsyncTCP's poll
+void test_live_publish_from_poll(void)
+{
+    deliverSample();
+    AsyncWebSocket *socket = AsyncWebServer::running()->getWebSocket("/live");
+    AsyncWebSocketClient *first = socket->connect(IPAddress(192, 168, 1, 21));
+    AsyncWebSocketClient *second = socket->connect(IPAddress(192, 168, 1, 22));
+    first->clearReceived();
+    second->clearReceived();
+
+    deliverSample(makeSample(1330));
+    TEST_ASSERT_EQUAL(0, first->getReceived().size());
+    TEST_ASSERT_EQUAL(0, second->getReceived().size());
+
+    socket->pollAll();
+    TEST_ASSERT_EQUAL(1, first->getReceived().size());
+    TEST_ASSERT_EQUAL(1, second->getReceived().size());
+    TEST_ASSERT_TRUE(contains(first->getReceived()[0], "\"voltage\":1330"));
+    TEST_ASSERT_TRUE(first->getReceived()[0] == second->getReceived()[0]);
+    socket->pollAll();
+    TEST_ASSERT_EQUAL(1, first->getReceived().size());
+
+    TEST_ASSERT_EQUAL_UINT32(0, first->getCrossTaskCalls());
+    TEST_ASSERT_EQUAL_UINT32(0, second->getCrossTaskCalls());
+    socket->disconnect(first);
+    socket->disconnect(second);
+}
+
+// A client that has not drained the last sample skips the next one
+void test_live_slow_client(void)
+{
+    deliverSample();
+    AsyncWebSocket *socket = AsyncWebServer::running()->getWebSocket("/live");
+    AsyncWebSocketClient *slow = socket->connect(IPAddress(192, 168, 1, 23));
+    AsyncWebSocketClient *fast = socket->connect(IPAddress(192, 168, 1, 24));
+    slow->clearReceived();
+    fast->clearReceived();
+    slow->client()->setSpace(10);
+
+    deliverSample(makeSample(1330));
+    socket->pollAll();
+    TEST_ASSERT_EQUAL(0, slow->getReceived().size());
+    TEST_ASSERT_EQUAL(0, slow->getQueued());
+    TEST_ASSERT_EQUAL(1, fast->getReceived().size());
+
+    slow->client()->setSpace(AsyncClient::DEFAULT_SPACE);
+    deliverSample(makeSample(1335));
+    socket->pollAll();
+    TEST_ASSERT_EQUAL(1, slow->getReceived().size());
+    TEST_ASSERT_TRUE(contains(slow->getReceived()[0], "\"voltage\":1335"));
+    socket->disconnect(slow);
+    socket->disconnect(fast);
+}
+
+void test_load_report(void)
+{
+    deliverSample();
+    const char *urls[] = {"/battery.json", "/battery.json", "/battery.json", "/battery.cbor", "/metrics", "/energy.json", "/battery"};
+    constexpr size_t REQUESTS = 700;
+    constexpr int CLIENTS = 8;
+
+    std::vector<uint32_t> latenciesUs;
+    latenciesUs.reserve(REQUESTS);
+    uint64_t bytes = 0;
+    const uint64_t allocationsBefore = s_allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < REQUESTS; ++i)
+    {
+        // 20 requests per second over 8 clients stay within every client's refill rate
+        host::advanceMs(50);
+        const auto requestStart = std::chrono::steady_clock::now();
+        const HostResponse response = hostGet(urls[i % (sizeof(urls) / sizeof(urls[0]))], {}, IPAddress(192, 168, 4, 10 + i % CLIENTS));
+        latenciesUs.push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - requestStart).count());
+        TEST_ASSERT_EQUAL(200, response.code);
+        bytes += response.body.size();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t allocations = s_allocations - allocationsBefore;
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    auto percentile = [&latenciesUs](int p)
+    {
+        return latenciesUs[std::min(latenciesUs.size() - 1, latenciesUs.size() * p / 100)];
+    };
+    char report[256];
+    snprintf(report, sizeof(report), "%zu requests: %.0f req/s, latency p50 %u us p95 %u us p99 %u us, %.0f bytes and %.1f allocations per response",
+             REQUESTS, REQUESTS / seconds, percentile(50), percentile(95), percentile(99), (double)bytes / REQUESTS, (double)allocations / REQUESTS);
+    TEST_MESSAGE(report);
+
+    // One sample, so /battery.json rendered once and came from the cache after that
+    const HostResponse metrics = hostGet("/metrics", {}, IPAddress(192, 168, 4, 200));
+    TEST_ASSERT_TRUE(contains(metrics.body, "bluefigate_web_cache_renders_total{cache=\"json\"} 1\n"));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_battery_json_without_sample);
+    RUN_TEST(test_battery_json_fields);
+    RUN_TEST(test_battery_json_etag_revalidation);
+    RUN_TEST(test_battery_json_projection_and_delta);
+    RUN_TEST(test_battery_cbor);
+    RUN_TEST(test_metrics);
+    RUN_TEST(test_metrics_without_sample);
+    RUN_TEST(test_metrics_format);
+    RUN_TEST(test_not_found);
+    RUN_TEST(test_dashboard);
+    RUN_TEST(test_stats_json);
+    RUN_TEST(test_crash_json);
+    RUN_TEST(test_admission_rate_limit);
+    RUN_TEST(test_admission_low_heap);
+    RUN_TEST(test_admission_in_flight);
+    RUN_TEST(test_long_poll);
+    RUN_TEST(test_long_poll_timeout);
+    RUN_TEST(test_long_poll_parked_limit);
+    RUN_TEST(test_long_poll_without_sample);
+    RUN_TEST(test_live_connect_gets_latest);
+    RUN_TEST(test_live_publish_from_poll);
+    RUN_TEST(test_live_slow_client);
+    RUN_TEST(test_load_report);
+    return UNITY_END();
+}